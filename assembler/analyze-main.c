@@ -0,0 +1,587 @@
+/*
+ * Copyright © 2013 Intel Corporation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/*
+ * Static performance report for an EU kernel: where it stalls, how long
+ * each basic block takes and which path through the kernel is the longest,
+ * according to the rough cost model in eu_analysis.c. Also how many
+ * registers it really needs, and how to get there.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <getopt.h>
+
+#include "libgen4asm.h"
+#include "gen4bin.h"
+#include "brw_context.h"
+#include "eu_analysis.h"
+
+struct label {
+	const char *name;
+	unsigned offset;
+};
+
+static struct label *labels;
+static unsigned num_labels;
+
+static const struct option longopts[] = {
+	{"advanced", no_argument, 0, 'a'},
+	{"raw", no_argument, 0, 'r'},
+	{"gen", required_argument, 0, 'g'},
+	{"output", required_argument, 0, 'o'},
+	{"json", required_argument, 0, 'j'},
+	{"stalls", required_argument, 0, 'n'},
+	{"liveness", no_argument, 0, 'l'},
+	{"verbose", no_argument, 0, 'v'},
+	{ NULL, 0, NULL, 0 }
+};
+
+static void usage(void)
+{
+	fprintf(stderr, "usage: intel-gen4analyze [options] inputfile\n");
+	fprintf(stderr, "OPTIONS:\n");
+	fprintf(stderr, "\t-a, --advanced                       "
+		"Set advanced flag for assembly input\n");
+	fprintf(stderr, "\t-r, --raw                            "
+		"Raw binary input\n");
+	fprintf(stderr, "\t-g, --gen <4|5|6|7>                  "
+		"Specify GPU generation\n");
+	fprintf(stderr, "\t-o, --output {outputfile}            "
+		"Specify output file\n");
+	fprintf(stderr, "\t-j, --json {jsonfile}                "
+		"Also write the report as JSON\n");
+	fprintf(stderr, "\t-n, --stalls {count}                 "
+		"Number of stalls to list (10)\n");
+	fprintf(stderr, "\t-l, --liveness                       "
+		"Live registers and renumbering\n");
+	fprintf(stderr, "\t-v, --verbose                        "
+		"Annotated listing\n");
+	fprintf(stderr, "\n");
+	fprintf(stderr, "Containers are recognised as such, anything else "
+		"which is not\nraw is assembled first.\n");
+}
+
+static void add_label(const char *name, unsigned offset)
+{
+	labels = realloc(labels, (num_labels + 1) * sizeof(*labels));
+	if (labels == NULL) {
+		perror("realloc");
+		exit(1);
+	}
+	labels[num_labels].name = name;
+	labels[num_labels].offset = offset;
+	num_labels++;
+}
+
+/* the first label at the start of a block, or a made up name */
+static const char *block_name(const struct eu_kernel *kernel, unsigned b)
+{
+	static char buf[4][16];
+	static unsigned next;
+	unsigned offset = kernel->insns[kernel->blocks[b].first].offset;
+	unsigned n;
+
+	for (n = 0; n < num_labels; n++)
+		if (labels[n].offset == offset)
+			return labels[n].name;
+
+	next = (next + 1) % 4;
+	snprintf(buf[next], sizeof(buf[next]), "B%u", b);
+	return buf[next];
+}
+
+static const char *reg_name(int reg)
+{
+	static char buf[16];
+
+	if (reg < EU_NUM_GRF)
+		snprintf(buf, sizeof(buf), "g%d", reg);
+	else
+		snprintf(buf, sizeof(buf), "m%d", reg - EU_NUM_GRF);
+	return buf;
+}
+
+static const char *opcode_name(const struct eu_insn *e)
+{
+	return opcode_descs[e->insn.header.opcode].name ?: "???";
+}
+
+static const struct eu_kernel *sort_kernel;
+
+static int compare_stalls(const void *a, const void *b)
+{
+	const struct eu_insn *x = &sort_kernel->insns[*(const unsigned *)a];
+	const struct eu_insn *y = &sort_kernel->insns[*(const unsigned *)b];
+
+	if (x->stall != y->stall)
+		return x->stall < y->stall ? 1 : -1;
+	return x->offset < y->offset ? -1 : x->offset > y->offset;
+}
+
+/* instruction indices with a stall, the longest first */
+static unsigned *sort_stalls(const struct eu_kernel *kernel, unsigned *count)
+{
+	unsigned *order = calloc(kernel->num_insns + 1, sizeof(*order));
+	unsigned n, i;
+
+	if (order == NULL) {
+		perror("calloc");
+		exit(1);
+	}
+
+	for (n = i = 0; i < kernel->num_insns; i++)
+		if (kernel->insns[i].stall)
+			order[n++] = i;
+	sort_kernel = kernel;
+	qsort(order, n, sizeof(*order), compare_stalls);
+
+	*count = n;
+	return order;
+}
+
+/* one past the highest GRF in the set */
+static unsigned footprint(const struct eu_regset *set)
+{
+	unsigned r = EU_NUM_GRF;
+
+	while (r && !eu_regset_test(set, r - 1))
+		r--;
+	return r;
+}
+
+/* the GRFs in the set as runs, "g2-g5 g9" */
+static void print_grfs(FILE *output, const struct eu_regset *set)
+{
+	unsigned r, end;
+
+	for (r = 0; r < EU_NUM_GRF; r = end) {
+		if (!eu_regset_test(set, r)) {
+			end = r + 1;
+			continue;
+		}
+		for (end = r + 1; end < EU_NUM_GRF && eu_regset_test(set, end); end++)
+			;
+		if (end - r > 1)
+			fprintf(output, " g%u-g%u", r, end - 1);
+		else
+			fprintf(output, " g%u", r);
+	}
+	fprintf(output, "\n");
+}
+
+static void print_liveness(FILE *output, struct eu_kernel *kernel,
+			   const struct gen4asm_program *program,
+			   const char *filename)
+{
+	int map[EU_NUM_GRF];
+	unsigned used = footprint(&kernel->used), r, end, n;
+	int packed;
+
+	fprintf(output, "\nregisters: g0-g%d, %u block%s of 16\n",
+		(int)used - 1, (used + 15) / 16, used > 16 ? "s" : "");
+	if (kernel->num_blocks) {
+		fprintf(output, "live at the entry:");
+		print_grfs(output, &kernel->blocks[0].live_in);
+	}
+
+	/* only assembly input has declarations */
+	for (n = 0; program && n < program->num_registers; n++) {
+		const struct gen4asm_register *reg = &program->registers[n];
+
+		if (reg->uses)
+			continue;
+		fprintf(output, "%s:%d: %s declared but never used\n",
+			filename, reg->line, reg->name);
+	}
+
+	packed = eu_kernel_renumber(kernel, map);
+	if (packed < 0) {
+		fprintf(output, "no renumbering, indirect operands\n");
+		return;
+	}
+	if ((unsigned)packed >= used) {
+		fprintf(output, "already compact\n");
+		return;
+	}
+
+	fprintf(output, "renumbered, g0-g%d, %u block%s of 16:\n",
+		packed - 1, (packed + 15) / 16, packed > 16 ? "s" : "");
+	for (r = 0; r < EU_NUM_GRF; r = end) {
+		end = r + 1;
+		if (map[r] < 0 || map[r] == (int)r)
+			continue;
+		while (end < EU_NUM_GRF && map[end] == map[r] + (int)(end - r))
+			end++;
+		if (end - r > 1)
+			fprintf(output, "  g%u-g%u -> g%d-g%d\n",
+				r, end - 1, map[r], map[end - 1]);
+		else
+			fprintf(output, "  g%u -> g%d\n", r, map[r]);
+	}
+}
+
+static void print_listing(FILE *output, struct eu_kernel *kernel)
+{
+	unsigned b, i;
+
+	fprintf(output, "\n");
+	for (b = 0; b < kernel->num_blocks; b++) {
+		const struct eu_block *block = &kernel->blocks[b];
+
+		fprintf(output, "%s:\t\t/* %u cycles, %u stalled */\n",
+			block_name(kernel, b), block->cycles, block->stall);
+		for (i = block->first; i <= block->last; i++) {
+			struct eu_insn *e = &kernel->insns[i];
+
+			fprintf(output, "  0x%04x %5u %3u ", e->offset, e->start,
+				e->pressure);
+			if (e->stall)
+				fprintf(output, "+%-4u ", e->stall);
+			else
+				fprintf(output, "      ");
+			brw_disasm(output, &e->insn, kernel->gen / 10);
+		}
+	}
+}
+
+static void print_report(FILE *output, struct eu_kernel *kernel,
+			 unsigned max_stalls)
+{
+	unsigned *stalls, num_stalls, b, n;
+
+	fprintf(output, "%s kernel: %u instructions, %zu bytes, %u blocks\n",
+		kernel->info->name, kernel->num_insns, kernel->size,
+		kernel->num_blocks);
+	fprintf(output, "issue %u cycles, stalled %u cycles\n",
+		kernel->issue, kernel->stall);
+	if (kernel->num_insns)
+		fprintf(output, "GRFs up to g%d, at most %u live at 0x%04x\n",
+			(int)footprint(&kernel->used) - 1,
+			kernel->peak_pressure,
+			kernel->insns[kernel->peak_insn].offset);
+	if (kernel->num_indirect)
+		fprintf(output, "%u instructions with indirect operands, "
+			"their dependencies are not tracked\n",
+			kernel->num_indirect);
+
+	fprintf(output, "\n%-20s %8s %6s %7s %6s %6s %6s %8s\n",
+		"block", "offset", "insns", "cycles", "issue", "stall",
+		"drain", "critical");
+	for (b = 0; b < kernel->num_blocks; b++) {
+		const struct eu_block *block = &kernel->blocks[b];
+
+		fprintf(output, "%-20s   0x%04x %6u %7u %6u %6u %6u %8u\n",
+			block_name(kernel, b),
+			kernel->insns[block->first].offset,
+			block->last - block->first + 1,
+			block->cycles, block->issue, block->stall,
+			block->drain, block->critical_path);
+	}
+
+	if (kernel->path_len) {
+		fprintf(output, "\nlongest path, %u cycles:", kernel->path_cycles);
+		for (n = 0; n < kernel->path_len; n++)
+			fprintf(output, "%s %s", n ? " ->" : "",
+				block_name(kernel, kernel->path[n]));
+		fprintf(output, "\n");
+	}
+
+	stalls = sort_stalls(kernel, &num_stalls);
+	if (num_stalls && max_stalls)
+		fprintf(output, "\nstalls:\n");
+	for (n = 0; n < num_stalls && n < max_stalls; n++) {
+		const struct eu_insn *e = &kernel->insns[stalls[n]];
+		const struct eu_insn *p = &kernel->insns[e->stall_producer];
+
+		fprintf(output, "%6u cycles  0x%04x %-8s waits for %s from "
+			"0x%04x %s\n", e->stall, e->offset, opcode_name(e),
+			reg_name(e->stall_reg), p->offset, opcode_name(p));
+	}
+	free(stalls);
+}
+
+static void json_string(FILE *file, const char *s)
+{
+	fputc('"', file);
+	for (; *s; s++) {
+		if (*s == '"' || *s == '\\')
+			fprintf(file, "\\%c", *s);
+		else if ((unsigned char)*s < 0x20)
+			fprintf(file, "\\u%04x", *s);
+		else
+			fputc(*s, file);
+	}
+	fputc('"', file);
+}
+
+static void write_json(FILE *file, struct eu_kernel *kernel)
+{
+	unsigned *stalls, num_stalls, b, n;
+
+	fprintf(file, "{\n  \"gen\": %d,\n  \"instructions\": %u,\n"
+		"  \"bytes\": %zu,\n  \"issue\": %u,\n  \"stall\": %u,\n"
+		"  \"indirect\": %u,\n  \"path_cycles\": %u,\n",
+		kernel->gen, kernel->num_insns, kernel->size, kernel->issue,
+		kernel->stall, kernel->num_indirect, kernel->path_cycles);
+
+	fprintf(file, "  \"blocks\": [");
+	for (b = 0; b < kernel->num_blocks; b++) {
+		const struct eu_block *block = &kernel->blocks[b];
+
+		fprintf(file, "%s\n    { \"name\": ", b ? "," : "");
+		json_string(file, block_name(kernel, b));
+		fprintf(file, ", \"offset\": %u, \"instructions\": %u, "
+			"\"cycles\": %u, \"issue\": %u, \"stall\": %u, "
+			"\"drain\": %u, \"critical_path\": %u, "
+			"\"exits\": %s, \"successors\": [",
+			kernel->insns[block->first].offset,
+			block->last - block->first + 1,
+			block->cycles, block->issue, block->stall,
+			block->drain, block->critical_path,
+			block->exits ? "true" : "false");
+		for (n = 0; n < block->num_succ; n++)
+			fprintf(file, "%s%u", n ? ", " : "", block->succ[n]);
+		fprintf(file, "] }");
+	}
+	fprintf(file, "\n  ],\n");
+
+	fprintf(file, "  \"registers\": { \"used\": %u, \"peak_pressure\": %u, "
+		"\"peak_offset\": %u, \"live_in\": [",
+		footprint(&kernel->used), kernel->peak_pressure,
+		kernel->num_insns ? kernel->insns[kernel->peak_insn].offset : 0);
+	for (n = 0, b = 0; b < EU_NUM_GRF && kernel->num_blocks; b++)
+		if (eu_regset_test(&kernel->blocks[0].live_in, b))
+			fprintf(file, "%s%u", n++ ? ", " : "", b);
+	fprintf(file, "] },\n");
+
+	fprintf(file, "  \"path\": [");
+	for (n = 0; n < kernel->path_len; n++)
+		fprintf(file, "%s%u", n ? ", " : "", kernel->path[n]);
+	fprintf(file, "],\n");
+
+	stalls = sort_stalls(kernel, &num_stalls);
+	fprintf(file, "  \"stalls\": [");
+	for (n = 0; n < num_stalls; n++) {
+		const struct eu_insn *e = &kernel->insns[stalls[n]];
+
+		fprintf(file, "%s\n    { \"offset\": %u, \"cycles\": %u, "
+			"\"register\": \"%s\", \"producer\": %u }",
+			n ? "," : "", e->offset, e->stall,
+			reg_name(e->stall_reg),
+			kernel->insns[e->stall_producer].offset);
+	}
+	fprintf(file, "%s]\n}\n", num_stalls ? "\n  " : "");
+	free(stalls);
+}
+
+int main(int argc, char **argv)
+{
+	struct gen4asm_options options;
+	struct gen4asm_program *program = NULL;
+	struct gen4bin_image image;
+	struct eu_kernel kernel;
+	char *input_filename = "<stdin>";
+	char *output_file = NULL, *json_file = NULL;
+	FILE *input = stdin, *output = stdout;
+	long int gen_level = 40;
+	unsigned max_stalls = 10, n;
+	bool raw = false, verbose = false, liveness = false;
+	const void *code;
+	size_t size;
+	char *data;
+	int o;
+
+	gen4asm_options_init(&options);
+
+	while ((o = getopt_long(argc, argv, "arg:o:j:n:lv", longopts, NULL)) != -1) {
+		switch (o) {
+		case 'a':
+			options.advanced = true;
+			break;
+		case 'r':
+			raw = true;
+			break;
+
+		case 'g': {
+			char *dec_ptr, *end_ptr;
+			unsigned long decimal;
+
+			gen_level = strtol(optarg, &dec_ptr, 10) * 10;
+
+			if (*dec_ptr == '.') {
+				decimal = strtoul(++dec_ptr, &end_ptr, 10);
+				if (end_ptr != dec_ptr && *end_ptr == '\0') {
+					if (decimal > 10) {
+						fprintf(stderr, "Invalid Gen X decimal version\n");
+						exit(1);
+					}
+					gen_level += decimal;
+				}
+			}
+
+			if (gen_level < 40 || gen_level > 75) {
+				usage();
+				exit(1);
+			}
+
+			break;
+		}
+
+		case 'o':
+			if (strcmp(optarg, "-") != 0)
+				output_file = optarg;
+			break;
+		case 'j':
+			json_file = optarg;
+			break;
+		case 'n':
+			max_stalls = strtoul(optarg, NULL, 0);
+			break;
+		case 'l':
+			liveness = true;
+			break;
+		case 'v':
+			verbose = true;
+			break;
+		default:
+			usage();
+			exit(1);
+		}
+	}
+	argc -= optind;
+	argv += optind;
+	if (argc != 1) {
+		usage();
+		exit(1);
+	}
+
+	if (strcmp(argv[0], "-") != 0) {
+		input_filename = argv[0];
+		input = fopen(input_filename, "r");
+		if (input == NULL) {
+			perror("Couldn't open input file");
+			exit(1);
+		}
+	}
+
+	data = gen4bin_read_file(input, &size);
+	if (data == NULL) {
+		perror("Couldn't read input file");
+		exit(1);
+	}
+	if (input != stdin)
+		fclose(input);
+
+	if (gen4bin_is_container(data, size)) {
+		if (gen4bin_parse(data, size, &image)) {
+			fprintf(stderr, "Invalid container\n");
+			exit(1);
+		}
+		gen_level = image.header.gen;
+		code = image.code;
+		size = image.code_size;
+		for (n = 0; n < image.num_symbols; n++)
+			add_label(gen4bin_symbol_name(&image, &image.symbols[n]),
+				  image.symbols[n].offset);
+		gen4bin_fini(&image);
+	} else if (raw) {
+		code = data;
+	} else {
+		options.gen = gen_level;
+		options.filename = input_filename;
+		options.diagnostics = stderr;
+
+		program = gen4asm_assemble(data, size, &options);
+		if (program == NULL) {
+			fprintf(stderr, "Out of memory\n");
+			exit(1);
+		}
+		if (program->num_errors)
+			exit(1);
+
+		code = program->code;
+		size = program->size;
+		for (n = 0; n < program->num_labels; n++)
+			add_label(program->labels[n].name,
+				  program->labels[n].offset);
+	}
+
+	switch (eu_kernel_init(&kernel, gen_level, code, size)) {
+	case 0:
+		break;
+	case -EINVAL:
+		fprintf(stderr, "Truncated instruction at the end of the kernel\n");
+		exit(1);
+	default:
+		fprintf(stderr, "Out of memory\n");
+		exit(1);
+	}
+	eu_kernel_build_cfg(&kernel);
+	eu_kernel_schedule(&kernel);
+	if (eu_kernel_liveness(&kernel)) {
+		fprintf(stderr, "Out of memory\n");
+		exit(1);
+	}
+
+	if (output_file) {
+		output = fopen(output_file, "w");
+		if (output == NULL) {
+			perror("Couldn't open output file");
+			exit(1);
+		}
+	}
+
+	print_report(output, &kernel, max_stalls);
+	if (liveness)
+		print_liveness(output, &kernel, program, input_filename);
+	if (verbose)
+		print_listing(output, &kernel);
+
+	if (json_file) {
+		FILE *json = strcmp(json_file, "-") ? fopen(json_file, "w") : stdout;
+
+		if (json == NULL) {
+			perror("Couldn't open JSON file");
+			exit(1);
+		}
+		write_json(json, &kernel);
+		if (json != stdout)
+			fclose(json);
+	}
+
+	eu_kernel_fini(&kernel);
+	if (program)
+		gen4asm_program_free(program);
+	free(labels);
+	free(data);
+
+	fflush(output);
+	if (ferror(output)) {
+		perror("Could not flush output file");
+		return 1;
+	}
+	return 0;
+}
@@ -0,0 +1,186 @@
+/*
+ * Copyright © 2013 Intel Corporation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "arena.h"
+
+#define ARENA_ALIGN		16
+#define ARENA_MIN_CHUNK		(64 << 10)
+#define ARENA_MAX_CHUNK		(1 << 20)
+
+#define ALIGN(x, y) (((x) + (y) - 1) & ~((y) - 1))
+
+struct arena_chunk {
+	struct arena_chunk *next;
+	size_t size;
+} __attribute__((aligned(ARENA_ALIGN)));
+
+struct arena_string {
+	char *str;
+	size_t len;
+	unsigned hash;
+};
+
+void arena_init(struct gen4asm_arena *arena)
+{
+	memset(arena, 0, sizeof(*arena));
+	arena->chunk_size = ARENA_MIN_CHUNK;
+}
+
+/**
+ * arena_fini - release everything allocated from the arena
+ */
+void arena_fini(struct gen4asm_arena *arena)
+{
+	struct arena_chunk *chunk, *next;
+
+	for (chunk = arena->chunks; chunk; chunk = next) {
+		next = chunk->next;
+		free(chunk);
+	}
+	free(arena->strings);
+	arena_init(arena);
+}
+
+static struct arena_chunk *arena_new_chunk(struct gen4asm_arena *arena,
+					   size_t size)
+{
+	struct arena_chunk *chunk;
+
+	/* chunks come zeroed, and the arena never hands out space twice */
+	chunk = calloc(1, sizeof(*chunk) + size);
+	if (chunk == NULL)
+		return NULL;
+
+	chunk->size = size;
+	chunk->next = arena->chunks;
+	arena->chunks = chunk;
+	return chunk;
+}
+
+/**
+ * arena_alloc - allocate zeroed memory, aligned for any type
+ *
+ * Returns NULL if out of memory.
+ */
+void *arena_alloc(struct gen4asm_arena *arena, size_t size)
+{
+	struct arena_chunk *chunk;
+	void *ret;
+
+	size = ALIGN(size ?: 1, ARENA_ALIGN);
+	if (size > (size_t)(arena->end - arena->next)) {
+		/* big ones get a chunk of their own, the current one stays */
+		if (size > arena->chunk_size / 2) {
+			chunk = arena_new_chunk(arena, size);
+			return chunk ? chunk + 1 : NULL;
+		}
+
+		chunk = arena_new_chunk(arena, arena->chunk_size);
+		if (chunk == NULL)
+			return NULL;
+		arena->next = (char *)(chunk + 1);
+		arena->end = arena->next + arena->chunk_size;
+		if (arena->chunk_size < ARENA_MAX_CHUNK)
+			arena->chunk_size *= 2;
+	}
+
+	ret = arena->next;
+	arena->next += size;
+	return ret;
+}
+
+/* FNV-1a */
+static unsigned hash_string(const char *str, size_t len)
+{
+	unsigned ret = 2166136261u;
+
+	while (len--)
+		ret = (ret ^ (unsigned char)*str++) * 16777619u;
+	return ret;
+}
+
+static int arena_grow_strings(struct gen4asm_arena *arena)
+{
+	unsigned size = arena->strings_size ? 2 * arena->strings_size : 256;
+	struct arena_string *strings;
+	unsigned i, j;
+
+	strings = calloc(size, sizeof(*strings));
+	if (strings == NULL)
+		return -1;
+
+	for (i = 0; i < arena->strings_size; i++) {
+		if (arena->strings[i].str == NULL)
+			continue;
+		j = arena->strings[i].hash & (size - 1);
+		while (strings[j].str)
+			j = (j + 1) & (size - 1);
+		strings[j] = arena->strings[i];
+	}
+
+	free(arena->strings);
+	arena->strings = strings;
+	arena->strings_size = size;
+	return 0;
+}
+
+/**
+ * arena_intern - the one copy of the first @len characters of @str
+ *
+ * The copy is nul terminated and lives as long as the arena. It is shared
+ * by everyone interning the same string, so it must not be modified.
+ * Returns NULL if out of memory.
+ */
+char *arena_intern(struct gen4asm_arena *arena, const char *str, size_t len)
+{
+	unsigned hash = hash_string(str, len);
+	struct arena_string *s;
+	unsigned i;
+
+	if (2 * (arena->num_strings + 1) > arena->strings_size &&
+	    arena_grow_strings(arena))
+		return NULL;
+
+	for (i = hash & (arena->strings_size - 1);
+	     arena->strings[i].str;
+	     i = (i + 1) & (arena->strings_size - 1)) {
+		s = &arena->strings[i];
+		if (s->hash == hash && s->len == len &&
+		    memcmp(s->str, str, len) == 0)
+			return s->str;
+	}
+
+	s = &arena->strings[i];
+	s->str = arena_alloc(arena, len + 1);
+	if (s->str == NULL)
+		return NULL;
+	memcpy(s->str, str, len);
+	s->len = len;
+	s->hash = hash;
+	arena->num_strings++;
+	return s->str;
+}
@@ -0,0 +1,61 @@
+/*
+ * Copyright © 2013 Intel Corporation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef __ARENA_H__
+#define __ARENA_H__
+
+#include <stddef.h>
+
+/*
+ * A bump allocator for what the parser builds: the instruction list, the
+ * declared registers, the hash entries and the names, which all live
+ * until the program is assembled. Allocations are carved out of large
+ * chunks back to back and all released at once by arena_fini().
+ *
+ * Names are interned, so that every label or register name is stored
+ * once however often the source mentions it.
+ */
+
+struct arena_chunk;
+struct arena_string;
+
+struct gen4asm_arena {
+	struct arena_chunk *chunks;
+	char *next, *end;		/* free space in the current chunk */
+	size_t chunk_size;		/* of the next one */
+
+	/* the interned strings, open addressing */
+	struct arena_string *strings;
+	unsigned strings_size;		/* power of two */
+	unsigned num_strings;
+};
+
+void arena_init(struct gen4asm_arena *arena);
+void arena_fini(struct gen4asm_arena *arena);
+
+void *arena_alloc(struct gen4asm_arena *arena, size_t size);
+char *arena_intern(struct gen4asm_arena *arena, const char *str, size_t len);
+
+#define arena_new(arena, type) ((type *) arena_alloc(arena, sizeof(type)))
+
+#endif /* __ARENA_H__ */
@@ -392,7 +392,7 @@ static const char * const sampler_target_format[4] = {
 };
 
 
-static int column;
+static __thread int column;
 
 static int string (FILE *file, const char *string)
 {
@@ -323,10 +323,11 @@ static const uint32_t gen7_src_index_table[32] = {
    0b010110001000
 };
 
-static const uint32_t *control_index_table;
-static const uint32_t *datatype_table;
-static const uint32_t *subreg_table;
-static const uint32_t *src_index_table;
+/* per thread, so that programs for different gens can be built concurrently */
+static __thread const uint32_t *control_index_table;
+static __thread const uint32_t *datatype_table;
+static __thread const uint32_t *subreg_table;
+static __thread const uint32_t *src_index_table;
 
 static bool
 set_control_index(struct intel_context *intel,
@@ -23,98 +23,361 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <stdint.h>
 #include <getopt.h>
 #include <unistd.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 
 #include "gen4asm.h"
+#include "gen4bin.h"
 #include "brw_eu.h"
 
 static const struct option longopts[] = {
+	{"binary", no_argument, 0, 'b'},
+	{"raw", no_argument, 0, 'r'},
+	{"output", required_argument, 0, 'o'},
+	{"gen", required_argument, 0, 'g'},
+	{"jobs", required_argument, 0, 'j'},
 	{ NULL, 0, NULL, 0 }
 };
 
-static struct brw_program *
-read_program (FILE *input)
+/* the input, mapped if it is a regular file, else read into memory */
+struct input {
+    const char	*data;
+    size_t	size;
+    void	*map;
+};
+
+static int
+open_input (FILE *file, struct input *input)
 {
-    uint32_t			    inst[4];
-    struct brw_program		    *program;
-    struct brw_program_instruction  *entry, **prev;
-    int			c;
-    int			n = 0;
-
-    program = malloc (sizeof (struct brw_program));
-    program->first = NULL;
-    prev = &program->first;
-    while ((c = getc (input)) != EOF) {
-	if (c == '0') {
-	    if (fscanf (input, "x%x", &inst[n]) == 1) {
-		++n;
-		if (n == 4) {
-		    entry = malloc (sizeof (struct brw_program_instruction));
-		    memcpy (&entry->insn, inst, 4 * sizeof (uint32_t));
-		    entry->next = NULL;
-		    *prev = entry;
-		    prev = &entry->next;
-		    n = 0;
-		}
-	    }
+    struct stat	st;
+
+    input->map = NULL;
+    if (fstat (fileno (file), &st) == 0 && S_ISREG (st.st_mode) &&
+	st.st_size > 0) {
+	input->map = mmap (NULL, st.st_size, PROT_READ, MAP_PRIVATE,
+			   fileno (file), 0);
+	if (input->map != MAP_FAILED) {
+	    input->data = input->map;
+	    input->size = st.st_size;
+	    return 0;
 	}
+	input->map = NULL;
     }
-    return program;
+
+    input->data = gen4bin_read_file (file, &input->size);
+    return input->data ? 0 : -1;
 }
 
-static struct brw_program *
-read_program_binary (FILE *input)
+static void
+close_input (struct input *input)
 {
-    uint32_t			    temp;
-    uint8_t			    inst[16];
-    struct brw_program		    *program;
-    struct brw_program_instruction  *entry, **prev;
-    int			c;
-    int			n = 0;
-
-    program = malloc (sizeof (struct brw_program));
-    program->first = NULL;
-    prev = &program->first;
-    while ((c = getc (input)) != EOF) {
-	if (c == '0') {
-	    if (fscanf (input, "x%2x", &temp) == 1) {
-		inst[n++] = (uint8_t)temp;
-		if (n == 16) {
-		    entry = malloc (sizeof (struct brw_program_instruction));
-		    memcpy (&entry->insn, inst, 16 * sizeof (uint8_t));
-		    entry->next = NULL;
-		    *prev = entry;
-		    prev = &entry->next;
-		    n = 0;
-		}
-	    }
+    if (input->map)
+	munmap (input->map, input->size);
+    else
+	free ((void *)input->data);
+}
+
+/*
+ * The text formats: every "0x" starts a number, of up to 8 digits for
+ * the 32 bit words intel-gen4asm prints by default, or 2 for the bytes of
+ * -b. Anything else in between is ignored. Returns the instruction bytes,
+ * a trailing partial instruction is left for disassemble_all to reject.
+ */
+static unsigned char *
+parse_hex (const char *data, size_t size, int bytes, size_t *length)
+{
+    unsigned char   *code;
+    size_t	    i, len = 0;
+    int		    max_digits = bytes ? 2 : 8;
+
+    /* "0x1 " is the shortest way to write a word: 4 bytes for 4 chars */
+    code = malloc (bytes ? size / 3 + 16 : (size / 2 + 1) * 4);
+    if (code == NULL)
+	return NULL;
+
+    for (i = 0; i + 2 < size; i++) {
+	uint32_t    value = 0;
+	int	    digits = 0;
+
+	if (data[i] != '0' || data[i + 1] != 'x')
+	    continue;
+
+	for (i += 2; i < size && digits < max_digits; i++, digits++) {
+	    char    c = data[i];
+
+	    if (c >= '0' && c <= '9')
+		value = value << 4 | (c - '0');
+	    else if (c >= 'a' && c <= 'f')
+		value = value << 4 | (c - 'a' + 10);
+	    else if (c >= 'A' && c <= 'F')
+		value = value << 4 | (c - 'A' + 10);
+	    else
+		break;
+	}
+	i--;
+	if (digits == 0)
+	    continue;
+
+	if (bytes) {
+	    code[len++] = value;
+	} else {
+	    memcpy (code + len, &value, sizeof (value));
+	    len += sizeof (value);
 	}
     }
-    return program;
+
+    *length = len;
+    return code;
+}
+
+/* compacted instructions (gen6+) take 8 bytes */
+static size_t
+instruction_length (const unsigned char *code, int gen)
+{
+    uint32_t	dw0;
+
+    memcpy (&dw0, code, sizeof (dw0));
+    return gen >= 60 && (dw0 >> 29) & 1 ? 8 : 16;
+}
+
+/* the labels of a container, sorted by offset */
+struct labels {
+    const struct gen4bin_image	*image;
+    const struct gen4bin_symbol	**symbols;
+    unsigned			count;
+};
+
+static int
+compare_symbols (const void *a, const void *b)
+{
+    const struct gen4bin_symbol	*x = *(const struct gen4bin_symbol **)a;
+    const struct gen4bin_symbol	*y = *(const struct gen4bin_symbol **)b;
+
+    if (x->offset != y->offset)
+	return x->offset < y->offset ? -1 : 1;
+    return x < y ? -1 : x > y;
+}
+
+static void
+init_labels (struct labels *labels, const struct gen4bin_image *image)
+{
+    unsigned	n;
+
+    labels->image = image;
+    labels->count = image ? image->num_symbols : 0;
+    labels->symbols = calloc (labels->count + 1, sizeof (*labels->symbols));
+    if (labels->symbols == NULL) {
+	perror ("calloc");
+	exit (1);
+    }
+    for (n = 0; n < labels->count; n++)
+	labels->symbols[n] = &image->symbols[n];
+    qsort (labels->symbols, labels->count, sizeof (*labels->symbols),
+	   compare_symbols);
+}
+
+/* the first label at or after offset */
+static unsigned
+find_label (const struct labels *labels, unsigned offset)
+{
+    unsigned	lo = 0, hi = labels->count;
+
+    while (lo < hi) {
+	unsigned mid = lo + (hi - lo) / 2;
+
+	if (labels->symbols[mid]->offset < offset)
+	    lo = mid + 1;
+	else
+	    hi = mid;
+    }
+    return lo;
+}
+
+/* print the labels at offset in front of their instruction */
+static void
+print_labels (FILE *output, const struct labels *labels, unsigned *cursor,
+	      unsigned offset)
+{
+    while (*cursor < labels->count &&
+	   labels->symbols[*cursor]->offset < offset)
+	(*cursor)++;
+
+    for (; *cursor < labels->count &&
+	 labels->symbols[*cursor]->offset == offset; (*cursor)++) {
+	const struct gen4bin_symbol *symbol = labels->symbols[*cursor];
+
+	fprintf (output, "%s:", gen4bin_symbol_name (labels->image, symbol));
+	if (symbol->flags & GEN4BIN_SYMBOL_ENTRY_POINT)
+	    fprintf (output, "\t\t/* entry point */");
+	fprintf (output, "\n");
+    }
+}
+
+/*
+ * Disassemble [start, end) of code, which has to start and end on
+ * instruction boundaries. Compacted instructions are expanded on the
+ * stack, nothing is allocated per instruction.
+ */
+static void
+disassemble (FILE *output, const unsigned char *code, size_t start,
+	     size_t end, int gen, const struct labels *labels)
+{
+    struct brw_context	    brw;
+    struct brw_instruction  insn;
+    size_t		    offset, len;
+    unsigned		    cursor = find_label (labels, start);
+
+    brw_init_context (&brw, gen);
+    brw_init_compaction_tables (&brw.intel);
+
+    for (offset = start; offset < end; offset += len) {
+	len = instruction_length (code + offset, gen);
+	if (len == 8)
+	    brw_uncompact_instruction (&brw.intel, &insn,
+				       (struct brw_compact_instruction *)(code + offset));
+	else
+	    memcpy (&insn, code + offset, sizeof (insn));
+
+	print_labels (output, labels, &cursor, offset);
+	brw_disasm (output, &insn, gen / 10);
+    }
+}
+
+struct chunk {
+    const unsigned char	    *code;
+    size_t		    start, end;
+    int			    gen;
+    const struct labels	    *labels;
+
+    pthread_t		    thread;
+    char		    *buffer;
+    size_t		    length;
+    int			    err;
+};
+
+static void *
+disassemble_chunk (void *data)
+{
+    struct chunk    *chunk = data;
+    FILE	    *output;
+
+    output = open_memstream (&chunk->buffer, &chunk->length);
+    if (output == NULL) {
+	chunk->err = 1;
+	return NULL;
+    }
+    disassemble (output, chunk->code, chunk->start, chunk->end,
+		 chunk->gen, chunk->labels);
+    if (fclose (output))
+	chunk->err = 1;
+    return NULL;
+}
+
+/*
+ * Split the code into up to jobs pieces of about the same size, at
+ * instruction boundaries, and disassemble them on threads of their own.
+ * The output comes out in order. Returns 0, or -1 if the code ends within
+ * an instruction.
+ */
+static int
+disassemble_all (FILE *output, const unsigned char *code, size_t size,
+		 int gen, const struct labels *labels, unsigned jobs)
+{
+    struct chunk    *chunks;
+    size_t	    offset, len, target;
+    unsigned	    n = 0, i;
+    int		    err = 0;
+
+    chunks = calloc (jobs, sizeof (*chunks));
+    if (chunks == NULL) {
+	perror ("calloc");
+	exit (1);
+    }
+
+    /* the lengths are needed for the split, check them all up front */
+    target = size / jobs;
+    chunks[0].start = 0;
+    for (offset = 0; offset < size; offset += len) {
+	len = size - offset < 4 ? 16 : instruction_length (code + offset, gen);
+	if (size - offset < len) {
+	    fprintf (stderr, "Truncated instruction at offset %zu\n", offset);
+	    free (chunks);
+	    return -1;
+	}
+	if (n + 1 < jobs && offset >= target * (n + 1)) {
+	    chunks[n].end = offset;
+	    chunks[++n].start = offset;
+	}
+    }
+    chunks[n++].end = size;
+
+    if (n == 1) {
+	disassemble (output, code, 0, size, gen, labels);
+	free (chunks);
+	return 0;
+    }
+
+    for (i = 0; i < n; i++) {
+	chunks[i].code = code;
+	chunks[i].gen = gen;
+	chunks[i].labels = labels;
+	if (pthread_create (&chunks[i].thread, NULL, disassemble_chunk,
+			    &chunks[i])) {
+	    /* do it here instead */
+	    chunks[i].thread = pthread_self ();
+	    disassemble_chunk (&chunks[i]);
+	}
+    }
+
+    for (i = 0; i < n; i++) {
+	if (!pthread_equal (chunks[i].thread, pthread_self ()))
+	    pthread_join (chunks[i].thread, NULL);
+	if (chunks[i].err) {
+	    perror ("Couldn't buffer the output");
+	    err = 1;
+	} else {
+	    fwrite (chunks[i].buffer, 1, chunks[i].length, output);
+	}
+	free (chunks[i].buffer);
+    }
+
+    free (chunks);
+    return err ? -1 : 0;
 }
 
 static void usage(void)
 {
     fprintf(stderr, "usage: intel-gen4disasm [options] inputfile\n");
-    fprintf(stderr, "\t-b, --binary                         C style binary output\n");
+    fprintf(stderr, "\t-b, --binary                         C style binary input\n");
+    fprintf(stderr, "\t-r, --raw                            Raw binary input\n");
     fprintf(stderr, "\t-o, --output {outputfile}            Specify output file\n");
     fprintf(stderr, "\t-g, --gen <4|5|6|7>                  Specify GPU generation\n");
+    fprintf(stderr, "\t-j, --jobs {count}                   Disassemble on that many threads\n");
 }
 
 int main(int argc, char **argv)
 {
-    struct brw_program	*program;
     FILE		*input = stdin;
     FILE		*output = stdout;
     char		*input_filename = NULL;
     char		*output_file = NULL;
     int			byte_array_input = 0;
+    int			raw_input = 0;
+    struct gen4bin_image image;
+    struct labels	labels;
+    struct input	in;
+    const unsigned char	*code;
+    unsigned char	*text_code = NULL;
+    size_t		size;
+    unsigned		jobs = 1;
     int			o;
     int			gen = 4;
-    struct brw_program_instruction  *inst;
 
-    while ((o = getopt_long(argc, argv, "o:bg:", longopts, NULL)) != -1) {
+    while ((o = getopt_long(argc, argv, "o:brg:j:", longopts, NULL)) != -1) {
 	switch (o) {
 	case 'o':
 	    if (strcmp(optarg, "-") != 0)
@@ -123,6 +386,9 @@ int main(int argc, char **argv)
 	case 'b':
 	    byte_array_input = 1;
 	    break;
+	case 'r':
+	    raw_input = 1;
+	    break;
 	case 'g':
 	    gen = strtol(optarg, NULL, 10);
 
@@ -132,6 +398,13 @@ int main(int argc, char **argv)
 	    }
 
 	    break;
+	case 'j':
+	    jobs = strtoul(optarg, NULL, 10);
+	    if (jobs == 0)
+		jobs = sysconf(_SC_NPROCESSORS_ONLN);
+	    if (jobs == 0)
+		jobs = 1;
+	    break;
 	default:
 	    usage();
 	    exit(1);
@@ -152,12 +425,35 @@ int main(int argc, char **argv)
 	    exit(1);
 	}
     }
-    if (byte_array_input)
-	program = read_program_binary (input);
-    else
-	program = read_program (input);
-    if (!program)
-	exit (1);
+    if (open_input (input, &in)) {
+	perror("Couldn't read input file");
+	exit(1);
+    }
+    gen *= 10;
+
+    /* containers are recognised whatever the input format */
+    if (gen4bin_is_container (in.data, in.size)) {
+	if (gen4bin_parse (in.data, in.size, &image)) {
+	    fprintf (stderr, "Invalid container\n");
+	    exit (1);
+	}
+	gen = image.header.gen;
+	code = image.code;
+	size = image.code_size;
+	init_labels (&labels, &image);
+    } else if (raw_input) {
+	code = (const unsigned char *)in.data;
+	size = in.size;
+	init_labels (&labels, NULL);
+    } else {
+	text_code = parse_hex (in.data, in.size, byte_array_input, &size);
+	if (text_code == NULL) {
+	    perror("Couldn't read input file");
+	    exit(1);
+	}
+	code = text_code;
+	init_labels (&labels, NULL);
+    }
     if (output_file) {
 	output = fopen (output_file, "w");
 	if (output == NULL) {
@@ -166,7 +462,18 @@ int main(int argc, char **argv)
 	}
     }
 
-    for (inst = program->first; inst; inst = inst->next)
-	brw_disasm (output, &inst->insn.gen, gen);
+    if (disassemble_all (output, code, size, gen, &labels, jobs))
+	exit (1);
+    if (labels.count) {
+	unsigned cursor = find_label (&labels, size);
+
+	print_labels (output, &labels, &cursor, size);
+    }
+
+    free (labels.symbols);
+    if (labels.image)
+	gen4bin_fini (&image);
+    free (text_code);
+    close_input (&in);
     exit (0);
 }
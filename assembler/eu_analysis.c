@@ -0,0 +1,1155 @@
+/*
+ * Copyright © 2013 Intel Corporation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+#include "brw_context.h"
+#include "brw_defines.h"
+#include "brw_eu.h"
+#include "eu_analysis.h"
+
+/*
+ * The numbers are estimates pieced together from the PRMs and from
+ * measurements of simple loops, good enough to compare two versions of a
+ * kernel but not to predict its runtime. Latencies are from issue to the
+ * result being available to a dependent instruction, for a single thread
+ * with nothing else competing for the shared functions.
+ */
+static const struct eu_gen_info gen_info[] = {
+	{
+		.gen = 40, .name = "gen4",
+		.alu_lanes = 4, .alu_latency = 14,
+		.math_lanes = 1, .math_latency = 40,
+		.branch_cycles = 4,
+		.send_latency = {
+			[BRW_SFID_MATH] = 40,
+			[BRW_SFID_SAMPLER] = 300,
+			[BRW_SFID_DATAPORT_READ] = 200,
+			[BRW_SFID_DATAPORT_WRITE] = 60,
+			[BRW_SFID_URB] = 60,
+		},
+		.send_default_latency = 20,
+	},
+	{
+		.gen = 45, .name = "g4x",
+		.alu_lanes = 4, .alu_latency = 14,
+		.math_lanes = 1, .math_latency = 36,
+		.branch_cycles = 4,
+		.send_latency = {
+			[BRW_SFID_MATH] = 36,
+			[BRW_SFID_SAMPLER] = 280,
+			[BRW_SFID_DATAPORT_READ] = 200,
+			[BRW_SFID_DATAPORT_WRITE] = 60,
+			[BRW_SFID_URB] = 60,
+		},
+		.send_default_latency = 20,
+	},
+	{
+		.gen = 50, .name = "gen5",
+		.alu_lanes = 4, .alu_latency = 12,
+		.math_lanes = 1, .math_latency = 32,
+		.branch_cycles = 4,
+		.send_latency = {
+			[BRW_SFID_MATH] = 32,
+			[BRW_SFID_SAMPLER] = 250,
+			[BRW_SFID_DATAPORT_READ] = 180,
+			[BRW_SFID_DATAPORT_WRITE] = 50,
+			[BRW_SFID_URB] = 50,
+		},
+		.send_default_latency = 20,
+	},
+	{
+		.gen = 60, .name = "gen6",
+		.alu_lanes = 4, .alu_latency = 10,
+		.math_lanes = 2, .math_latency = 22,
+		.branch_cycles = 4,
+		.send_latency = {
+			[BRW_SFID_SAMPLER] = 220,
+			[GEN6_SFID_DATAPORT_SAMPLER_CACHE] = 160,
+			[GEN6_SFID_DATAPORT_RENDER_CACHE] = 50,
+			[GEN6_SFID_DATAPORT_CONSTANT_CACHE] = 120,
+			[BRW_SFID_URB] = 40,
+		},
+		.send_default_latency = 20,
+	},
+	{
+		.gen = 70, .name = "gen7",
+		.alu_lanes = 4, .alu_latency = 8,
+		.math_lanes = 2, .math_latency = 18,
+		.branch_cycles = 3,
+		.send_latency = {
+			[BRW_SFID_SAMPLER] = 180,
+			[GEN6_SFID_DATAPORT_SAMPLER_CACHE] = 140,
+			[GEN6_SFID_DATAPORT_RENDER_CACHE] = 40,
+			[GEN6_SFID_DATAPORT_CONSTANT_CACHE] = 100,
+			[GEN7_SFID_DATAPORT_DATA_CACHE] = 120,
+			[BRW_SFID_URB] = 40,
+		},
+		.send_default_latency = 20,
+	},
+	{
+		.gen = 75, .name = "gen7.5",
+		.alu_lanes = 4, .alu_latency = 8,
+		.math_lanes = 2, .math_latency = 18,
+		.branch_cycles = 3,
+		.send_latency = {
+			[BRW_SFID_SAMPLER] = 160,
+			[GEN6_SFID_DATAPORT_SAMPLER_CACHE] = 120,
+			[GEN6_SFID_DATAPORT_RENDER_CACHE] = 40,
+			[GEN6_SFID_DATAPORT_CONSTANT_CACHE] = 90,
+			[GEN7_SFID_DATAPORT_DATA_CACHE] = 100,
+			[BRW_SFID_URB] = 40,
+		},
+		.send_default_latency = 20,
+	},
+};
+
+/* the entry for gen, or for the closest older one */
+const struct eu_gen_info *eu_gen_info(int gen)
+{
+	const struct eu_gen_info *info = &gen_info[0];
+	unsigned n;
+
+	for (n = 0; n < sizeof(gen_info) / sizeof(gen_info[0]); n++)
+		if (gen_info[n].gen <= gen)
+			info = &gen_info[n];
+
+	return info;
+}
+
+static unsigned type_size(unsigned type)
+{
+	switch (type) {
+	case BRW_REGISTER_TYPE_UB:
+	case BRW_REGISTER_TYPE_B:
+		return 1;
+	case BRW_REGISTER_TYPE_UW:
+	case BRW_REGISTER_TYPE_W:
+	case BRW_REGISTER_TYPE_HF:
+		return 2;
+	default:
+		return 4;
+	}
+}
+
+static unsigned horiz_stride(unsigned encoding)
+{
+	return encoding ? 1 << (encoding - 1) : 0;
+}
+
+static unsigned vert_stride(unsigned encoding)
+{
+	return encoding && encoding != 0xf ? 1 << (encoding - 1) : 0;
+}
+
+/* Note down bytes [start, start + bytes) of register nr of file as used */
+static void add_access(struct eu_insn *e, bool write, unsigned file,
+		       unsigned nr, unsigned start, unsigned bytes)
+{
+	struct eu_reg_range *r;
+	unsigned base, limit, first, last;
+
+	switch (file) {
+	case BRW_GENERAL_REGISTER_FILE:
+		base = 0;
+		limit = EU_NUM_GRF;
+		break;
+	case BRW_MESSAGE_REGISTER_FILE:
+		/* bit 7 is the compression hint of implied moves */
+		nr &= EU_NUM_MRF - 1;
+		base = EU_NUM_GRF;
+		limit = EU_NUM_MRF;
+		break;
+	default:
+		return;
+	}
+
+	if (bytes == 0)
+		bytes = 1;
+	first = nr + start / 32;
+	last = nr + (start + bytes - 1) / 32;
+	if (first >= limit)
+		return;
+	if (last >= limit)
+		last = limit - 1;
+
+	if (write) {
+		if (e->num_writes == sizeof(e->writes) / sizeof(e->writes[0]))
+			return;
+		r = &e->writes[e->num_writes++];
+	} else {
+		if (e->num_reads == sizeof(e->reads) / sizeof(e->reads[0]))
+			return;
+		r = &e->reads[e->num_reads++];
+	}
+	r->first = base + first;
+	r->last = base + last;
+	r->partial = start % 32 || (start + bytes) % 32;
+}
+
+/* the bytes covered by an align1 region */
+static unsigned region_bytes(unsigned exec_size, unsigned vs, unsigned width,
+			     unsigned hs, unsigned size)
+{
+	unsigned w = 1 << width;
+	unsigned rows = exec_size > w ? exec_size / w : 1;
+
+	return ((rows - 1) * vert_stride(vs) +
+		(w - 1) * horiz_stride(hs) + 1) * size;
+}
+
+static void decode_align1(struct eu_insn *e, bool has_dest)
+{
+	struct brw_instruction *insn = &e->insn;
+	unsigned exec = e->exec_size;
+	unsigned size;
+
+	if (has_dest) {
+		if (insn->bits1.da1.dest_address_mode != BRW_ADDRESS_DIRECT) {
+			e->indirect = true;
+		} else {
+			size = type_size(insn->bits1.da1.dest_reg_type);
+			add_access(e, true, insn->bits1.da1.dest_reg_file,
+				   insn->bits1.da1.dest_reg_nr,
+				   insn->bits1.da1.dest_subreg_nr,
+				   ((exec - 1) *
+				    (horiz_stride(insn->bits1.da1.dest_horiz_stride) ?: 1) + 1) *
+				   size);
+		}
+	}
+
+	if (insn->bits1.da1.src0_reg_file != BRW_IMMEDIATE_VALUE) {
+		if (insn->bits2.da1.src0_address_mode != BRW_ADDRESS_DIRECT) {
+			e->indirect = true;
+		} else {
+			size = type_size(insn->bits1.da1.src0_reg_type);
+			add_access(e, false, insn->bits1.da1.src0_reg_file,
+				   insn->bits2.da1.src0_reg_nr,
+				   insn->bits2.da1.src0_subreg_nr,
+				   region_bytes(exec,
+						insn->bits2.da1.src0_vert_stride,
+						insn->bits2.da1.src0_width,
+						insn->bits2.da1.src0_horiz_stride,
+						size));
+		}
+	} else {
+		return; /* the immediate takes the src1 bits */
+	}
+
+	if (insn->bits1.da1.src1_reg_file != BRW_IMMEDIATE_VALUE) {
+		if (insn->bits3.da1.src1_address_mode != BRW_ADDRESS_DIRECT) {
+			e->indirect = true;
+		} else {
+			size = type_size(insn->bits1.da1.src1_reg_type);
+			add_access(e, false, insn->bits1.da1.src1_reg_file,
+				   insn->bits3.da1.src1_reg_nr,
+				   insn->bits3.da1.src1_subreg_nr,
+				   region_bytes(exec,
+						insn->bits3.da1.src1_vert_stride,
+						insn->bits3.da1.src1_width,
+						insn->bits3.da1.src1_horiz_stride,
+						size));
+		}
+	}
+}
+
+static void decode_align16(struct eu_insn *e, bool has_dest)
+{
+	struct brw_instruction *insn = &e->insn;
+	unsigned exec = e->exec_size;
+	unsigned size;
+
+	if (has_dest) {
+		if (insn->bits1.da16.dest_address_mode != BRW_ADDRESS_DIRECT) {
+			e->indirect = true;
+		} else {
+			size = type_size(insn->bits1.da16.dest_reg_type);
+			add_access(e, true, insn->bits1.da16.dest_reg_file,
+				   insn->bits1.da16.dest_reg_nr,
+				   insn->bits1.da16.dest_subreg_nr * 16,
+				   exec * size);
+		}
+	}
+
+	if (insn->bits1.da16.src0_reg_file != BRW_IMMEDIATE_VALUE) {
+		if (insn->bits2.da16.src0_address_mode != BRW_ADDRESS_DIRECT) {
+			e->indirect = true;
+		} else {
+			size = type_size(insn->bits1.da16.src0_reg_type);
+			add_access(e, false, insn->bits1.da16.src0_reg_file,
+				   insn->bits2.da16.src0_reg_nr,
+				   insn->bits2.da16.src0_subreg_nr * 16,
+				   insn->bits2.da16.src0_vert_stride ?
+				   exec * size : 16);
+		}
+	} else {
+		return;
+	}
+
+	if (insn->bits1.da16.src1_reg_file != BRW_IMMEDIATE_VALUE) {
+		if (insn->bits3.da16.src1_address_mode != BRW_ADDRESS_DIRECT) {
+			e->indirect = true;
+		} else {
+			size = type_size(insn->bits1.da16.src1_reg_type);
+			add_access(e, false, insn->bits1.da16.src1_reg_file,
+				   insn->bits3.da16.src1_reg_nr,
+				   insn->bits3.da16.src1_subreg_nr * 16,
+				   insn->bits3.da16.src1_vert_stride ?
+				   exec * size : 16);
+		}
+	}
+}
+
+/* MAD and LRP, always align16 with 32 bit operands */
+static void decode_3src(struct eu_insn *e)
+{
+	struct brw_instruction *insn = &e->insn;
+	unsigned bytes = e->exec_size * 4;
+
+	add_access(e, true,
+		   insn->bits1.da3src.dest_reg_file ?
+		   BRW_MESSAGE_REGISTER_FILE : BRW_GENERAL_REGISTER_FILE,
+		   insn->bits1.da3src.dest_reg_nr,
+		   insn->bits1.da3src.dest_subreg_nr * 4, bytes);
+	add_access(e, false, BRW_GENERAL_REGISTER_FILE,
+		   insn->bits2.da3src.src0_reg_nr,
+		   insn->bits2.da3src.src0_subreg_nr * 4,
+		   insn->bits2.da3src.src0_rep_ctrl ? 4 : bytes);
+	add_access(e, false, BRW_GENERAL_REGISTER_FILE,
+		   insn->bits3.da3src.src1_reg_nr,
+		   (insn->bits2.da3src.src1_subreg_nr_low |
+		    insn->bits3.da3src.src1_subreg_nr_high << 2) * 4,
+		   insn->bits2.da3src.src1_rep_ctrl ? 4 : bytes);
+	add_access(e, false, BRW_GENERAL_REGISTER_FILE,
+		   insn->bits3.da3src.src2_reg_nr,
+		   insn->bits3.da3src.src2_subreg_nr * 4,
+		   insn->bits3.da3src.src2_rep_ctrl ? 4 : bytes);
+}
+
+static void decode_send(struct eu_kernel *kernel, struct eu_insn *e)
+{
+	struct brw_instruction *insn = &e->insn;
+	unsigned mlen, rlen;
+
+	if (kernel->gen < 50) {
+		e->sfid = insn->bits3.generic.msg_target;
+		e->eot = insn->bits3.generic.end_of_thread;
+		mlen = insn->bits3.generic.msg_length;
+		rlen = insn->bits3.generic.response_length;
+	} else {
+		if (kernel->gen < 60) {
+			e->sfid = insn->bits2.send_gen5.sfid;
+			e->eot = insn->bits2.send_gen5.end_of_thread;
+		} else {
+			e->sfid = insn->header.destreg__conditionalmod;
+			e->eot = insn->bits3.generic_gen5.end_of_thread;
+		}
+		mlen = insn->bits3.generic_gen5.msg_length;
+		rlen = insn->bits3.generic_gen5.response_length;
+	}
+
+	if (kernel->gen < 60) {
+		/* the payload is in the MRFs, src0 is moved into the first */
+		if (mlen)
+			add_access(e, false, BRW_MESSAGE_REGISTER_FILE,
+				   insn->header.destreg__conditionalmod, 0,
+				   mlen * 32);
+		add_access(e, false, insn->bits1.da1.src0_reg_file,
+			   insn->bits2.da1.src0_reg_nr, 0, 32);
+	} else if (mlen) {
+		add_access(e, false, insn->bits1.da1.src0_reg_file,
+			   insn->bits2.da1.src0_reg_nr, 0, mlen * 32);
+	}
+
+	if (rlen)
+		add_access(e, true, insn->bits1.da1.dest_reg_file,
+			   insn->bits1.da1.dest_reg_nr, 0, rlen * 32);
+
+	e->issue = mlen ?: 1;
+	if (e->sfid == BRW_SFID_MATH && kernel->gen < 60)
+		e->latency = kernel->info->math_latency *
+			((e->exec_size + 7) / 8);
+	else
+		e->latency = kernel->info->send_latency[e->sfid & 0xf] ?:
+			kernel->info->send_default_latency;
+	e->latency += rlen;
+}
+
+static void add_target(struct eu_kernel *kernel, struct eu_insn *e,
+		       long target)
+{
+	unsigned n;
+
+	if (target < 0 || target > (long)kernel->size)
+		return;
+	for (n = 0; n < e->num_targets; n++)
+		if (e->targets[n] == target)
+			return;
+	e->targets[e->num_targets++] = target;
+}
+
+/* The jump distances are encoded the way gen4asm's resolve_relocations()
+ * writes them: in 16 byte units on gen4, 8 byte units after that, and
+ * Haswell's JMPI counts bytes. JMPI is relative to the next instruction,
+ * everything else to the branch itself. */
+static void decode_branch(struct eu_kernel *kernel, struct eu_insn *e)
+{
+	struct brw_instruction *insn = &e->insn;
+	unsigned unit = kernel->gen < 50 ? 16 : 8;
+	long ip = e->offset;
+
+	e->falls_through = true;
+
+	switch (insn->header.opcode) {
+	case BRW_OPCODE_JMPI:
+		if (kernel->gen == 75)
+			unit = 1;
+		add_target(kernel, e, ip + 16 + (long)insn->bits3.JIP * unit);
+		/* an unpredicated jump always goes */
+		e->falls_through = insn->header.predicate_control != 0;
+		break;
+
+	case BRW_OPCODE_IF:
+	case BRW_OPCODE_IFF:
+	case BRW_OPCODE_ELSE:
+	case BRW_OPCODE_ENDIF:
+	case BRW_OPCODE_WHILE:
+		if (kernel->gen < 60) {
+			if (insn->header.opcode != BRW_OPCODE_ENDIF)
+				add_target(kernel, e,
+					   ip + (long)insn->bits3.if_else.jump_count * unit);
+		} else if (kernel->gen < 70) {
+			add_target(kernel, e,
+				   ip + (long)insn->bits1.branch_gen6.jump_count * unit);
+		} else {
+			add_target(kernel, e,
+				   ip + (long)insn->bits3.break_cont.jip * unit);
+			if (insn->header.opcode == BRW_OPCODE_IF ||
+			    insn->header.opcode == BRW_OPCODE_ELSE)
+				add_target(kernel, e,
+					   ip + (long)insn->bits3.break_cont.uip * unit);
+		}
+		break;
+
+	case BRW_OPCODE_BREAK:
+	case BRW_OPCODE_CONTINUE:
+	case BRW_OPCODE_HALT:
+		add_target(kernel, e, ip + (long)insn->bits3.break_cont.jip * unit);
+		add_target(kernel, e, ip + (long)insn->bits3.break_cont.uip * unit);
+		break;
+
+	case BRW_OPCODE_CALL:
+		if (kernel->gen < 70)
+			add_target(kernel, e, ip + (long)insn->bits3.JIP * unit);
+		else
+			add_target(kernel, e,
+				   ip + (long)insn->bits3.break_cont.jip * unit);
+		break;
+
+	case BRW_OPCODE_RET:
+		e->falls_through = false;
+		break;
+
+	default:
+		break;
+	}
+}
+
+static void decode_insn(struct eu_kernel *kernel, struct eu_insn *e)
+{
+	const struct eu_gen_info *info = kernel->info;
+	struct brw_instruction *insn = &e->insn;
+	unsigned opcode = insn->header.opcode;
+	unsigned function;
+
+	e->exec_size = 1 << insn->header.execution_size;
+	e->falls_through = true;
+	e->issue = 1;
+	e->latency = 1;
+
+	switch (opcode) {
+	case BRW_OPCODE_NOP:
+		e->kind = EU_NOP;
+		return;
+
+	case BRW_OPCODE_SEND:
+	case BRW_OPCODE_SENDC:
+		e->kind = EU_SEND;
+		decode_send(kernel, e);
+		if (e->eot)
+			e->falls_through = false;
+		return;
+
+	case BRW_OPCODE_JMPI:
+	case BRW_OPCODE_IF:
+	case BRW_OPCODE_IFF:
+	case BRW_OPCODE_ELSE:
+	case BRW_OPCODE_ENDIF:
+	case BRW_OPCODE_DO:
+	case BRW_OPCODE_WHILE:
+	case BRW_OPCODE_BREAK:
+	case BRW_OPCODE_CONTINUE:
+	case BRW_OPCODE_HALT:
+	case BRW_OPCODE_CALL:
+	case BRW_OPCODE_RET:
+		e->kind = EU_BRANCH;
+		e->issue = e->latency = info->branch_cycles;
+		decode_branch(kernel, e);
+		return;
+
+	case BRW_OPCODE_MATH:
+		e->kind = EU_MATH;
+		function = insn->header.destreg__conditionalmod;
+		e->issue = (e->exec_size + info->math_lanes - 1) /
+			info->math_lanes;
+		e->latency = info->math_latency + e->issue - 1;
+		if (function == BRW_MATH_FUNCTION_POW ||
+		    function == BRW_MATH_FUNCTION_SINCOS ||
+		    function >= BRW_MATH_FUNCTION_INT_DIV_QUOTIENT_AND_REMAINDER)
+			e->latency += info->math_latency;
+		break;
+
+	default:
+		e->kind = EU_ALU;
+		e->issue = (e->exec_size + info->alu_lanes - 1) /
+			info->alu_lanes;
+		e->latency = info->alu_latency + e->issue - 1;
+		break;
+	}
+
+	if ((opcode == BRW_OPCODE_MAD || opcode == BRW_OPCODE_LRP) &&
+	    kernel->gen >= 60)
+		decode_3src(e);
+	else if (insn->header.access_mode == BRW_ALIGN_16)
+		decode_align16(e, true);
+	else
+		decode_align1(e, true);
+}
+
+/**
+ * eu_kernel_init - decode a kernel
+ *
+ * @code may contain compacted instructions. Returns 0, -ENOMEM, or -EINVAL
+ * if the last instruction is cut short.
+ */
+int eu_kernel_init(struct eu_kernel *kernel, int gen,
+		   const void *code, size_t size)
+{
+	struct brw_context brw;
+	size_t offset, len;
+	unsigned n = 0;
+
+	memset(kernel, 0, sizeof(*kernel));
+	kernel->gen = gen;
+	kernel->info = eu_gen_info(gen);
+	kernel->size = size;
+
+	brw_init_context(&brw, gen);
+	brw_init_compaction_tables(&brw.intel);
+
+	kernel->insns = calloc(size / 8 + 1, sizeof(*kernel->insns));
+	if (kernel->insns == NULL)
+		return -ENOMEM;
+
+	for (offset = 0; offset < size; offset += len) {
+		const struct brw_instruction *insn =
+			(const void *)((const char *)code + offset);
+		struct eu_insn *e = &kernel->insns[n++];
+
+		len = gen >= 60 && insn->header.cmpt_control ? 8 : 16;
+		if (size - offset < len)
+			return -EINVAL;
+
+		if (len == 8)
+			brw_uncompact_instruction(&brw.intel, &e->insn,
+						  (struct brw_compact_instruction *)insn);
+		else
+			memcpy(&e->insn, insn, sizeof(e->insn));
+		e->offset = offset;
+		e->size = len;
+		e->stall_reg = -1;
+		e->stall_producer = -1;
+		e->chain_prev = -1;
+	}
+	kernel->num_insns = n;
+
+	for (n = 0; n < kernel->num_insns; n++) {
+		decode_insn(kernel, &kernel->insns[n]);
+		kernel->num_indirect += kernel->insns[n].indirect;
+	}
+
+	return 0;
+}
+
+void eu_kernel_fini(struct eu_kernel *kernel)
+{
+	free(kernel->insns);
+	free(kernel->blocks);
+	free(kernel->path);
+	free(kernel->interference);
+}
+
+static int insn_at(const struct eu_kernel *kernel, unsigned offset)
+{
+	unsigned lo = 0, hi = kernel->num_insns;
+
+	while (lo < hi) {
+		unsigned mid = lo + (hi - lo) / 2;
+
+		if (kernel->insns[mid].offset < offset)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+
+	if (lo < kernel->num_insns && kernel->insns[lo].offset == offset)
+		return lo;
+	return -1;
+}
+
+/* the block starting at or containing offset, -1 past the end */
+int eu_block_of_offset(const struct eu_kernel *kernel, unsigned offset)
+{
+	int n = insn_at(kernel, offset);
+
+	return n < 0 ? -1 : (int)kernel->insns[n].block;
+}
+
+static void add_succ(struct eu_block *block, unsigned succ)
+{
+	unsigned n;
+
+	for (n = 0; n < block->num_succ; n++)
+		if (block->succ[n] == succ)
+			return;
+	block->succ[block->num_succ++] = succ;
+}
+
+/**
+ * eu_kernel_build_cfg - split the kernel into basic blocks
+ *
+ * A block starts at the entry, at every jump target and after every
+ * instruction which can jump or end the thread.
+ */
+void eu_kernel_build_cfg(struct eu_kernel *kernel)
+{
+	unsigned n = kernel->num_insns, i, t, b;
+	bool *leader;
+
+	if (n == 0)
+		return;
+
+	leader = calloc(n, sizeof(*leader));
+	kernel->blocks = calloc(n, sizeof(*kernel->blocks));
+	if (leader == NULL || kernel->blocks == NULL) {
+		free(leader);
+		return;
+	}
+
+	leader[0] = true;
+	for (i = 0; i < n; i++) {
+		struct eu_insn *e = &kernel->insns[i];
+
+		for (t = 0; t < e->num_targets; t++) {
+			int target = insn_at(kernel, e->targets[t]);
+			if (target >= 0)
+				leader[target] = true;
+		}
+		if ((e->kind == EU_BRANCH || e->eot) && i + 1 < n)
+			leader[i + 1] = true;
+	}
+
+	b = 0;
+	for (i = 0; i < n; i++) {
+		if (leader[i] && i) {
+			kernel->blocks[b].last = i - 1;
+			b++;
+		}
+		if (leader[i])
+			kernel->blocks[b].first = i;
+		kernel->insns[i].block = b;
+	}
+	kernel->blocks[b].last = n - 1;
+	kernel->num_blocks = b + 1;
+
+	for (b = 0; b < kernel->num_blocks; b++) {
+		struct eu_block *block = &kernel->blocks[b];
+		struct eu_insn *e = &kernel->insns[block->last];
+
+		for (t = 0; t < e->num_targets; t++) {
+			int target = insn_at(kernel, e->targets[t]);
+			if (target >= 0)
+				add_succ(block, kernel->insns[target].block);
+			else
+				block->exits = true;
+		}
+		if (e->falls_through) {
+			if (block->last + 1 < n)
+				add_succ(block, b + 1);
+			else
+				block->exits = true;
+		}
+		if (e->eot || e->insn.header.opcode == BRW_OPCODE_RET)
+			block->exits = true;
+	}
+
+	free(leader);
+}
+
+static void schedule_block(struct eu_kernel *kernel, struct eu_block *block)
+{
+	unsigned ready[EU_NUM_REGS];
+	int writer[EU_NUM_REGS];
+	unsigned t = 0, drain = 0, i, r, k;
+
+	memset(ready, 0, sizeof(ready));
+	memset(writer, -1, sizeof(writer));
+
+	block->critical_path = 0;
+	block->critical_end = block->first;
+
+	for (i = block->first; i <= block->last; i++) {
+		struct eu_insn *e = &kernel->insns[i];
+		unsigned start = t, chain = 0;
+
+		/* wait for the sources (RAW) and the destination (WAW) */
+		for (k = 0; k < e->num_reads + e->num_writes; k++) {
+			const struct eu_reg_range *range = k < e->num_reads ?
+				&e->reads[k] : &e->writes[k - e->num_reads];
+
+			for (r = range->first; r <= range->last; r++) {
+				if (ready[r] > start) {
+					start = ready[r];
+					e->stall_reg = r;
+					e->stall_producer = writer[r];
+				}
+				if (k < e->num_reads && writer[r] >= 0 &&
+				    kernel->insns[writer[r]].chain > chain) {
+					chain = kernel->insns[writer[r]].chain;
+					e->chain_prev = writer[r];
+				}
+			}
+		}
+
+		e->start = start;
+		e->stall = start - t;
+		e->chain = chain + e->latency;
+		t = start + e->issue;
+
+		for (k = 0; k < e->num_writes; k++) {
+			for (r = e->writes[k].first; r <= e->writes[k].last; r++) {
+				ready[r] = start + e->latency;
+				writer[r] = i;
+			}
+		}
+		if (start + e->latency > drain)
+			drain = start + e->latency;
+
+		block->issue += e->issue;
+		block->stall += e->stall;
+		if (e->chain > block->critical_path) {
+			block->critical_path = e->chain;
+			block->critical_end = i;
+		}
+	}
+
+	block->cycles = t;
+	block->drain = drain > t ? drain - t : 0;
+}
+
+/**
+ * eu_kernel_schedule - run the cost model over every block
+ *
+ * Each block is issued in order by a single thread, starting with all
+ * registers ready. An instruction waits until the registers it reads or
+ * writes have been written by earlier ones. The longest path through the
+ * CFG is found with the back edges removed, so every loop counts once.
+ */
+void eu_kernel_schedule(struct eu_kernel *kernel)
+{
+	unsigned b, s, best = 0, n;
+	int p;
+
+	for (b = 0; b < kernel->num_blocks; b++) {
+		struct eu_block *block = &kernel->blocks[b];
+
+		schedule_block(kernel, block);
+		kernel->issue += block->issue;
+		kernel->stall += block->stall;
+		block->path_cycles = 0;
+		block->path_prev = -1;
+	}
+
+	if (kernel->num_blocks == 0)
+		return;
+
+	/* blocks are in program order, so forward edges go up */
+	kernel->blocks[0].path_cycles = kernel->blocks[0].cycles;
+	for (b = 0; b < kernel->num_blocks; b++) {
+		struct eu_block *block = &kernel->blocks[b];
+
+		if (block->path_cycles == 0)
+			continue; /* not reachable without a back edge */
+
+		for (s = 0; s < block->num_succ; s++) {
+			struct eu_block *succ = &kernel->blocks[block->succ[s]];
+			unsigned cycles;
+
+			if (block->succ[s] <= b)
+				continue;
+
+			cycles = block->path_cycles + succ->cycles;
+			if (cycles > succ->path_cycles) {
+				succ->path_cycles = cycles;
+				succ->path_prev = b;
+			}
+		}
+
+		if (block->path_cycles + block->drain >
+		    kernel->blocks[best].path_cycles + kernel->blocks[best].drain)
+			best = b;
+	}
+
+	kernel->path_cycles = kernel->blocks[best].path_cycles +
+		kernel->blocks[best].drain;
+
+	n = 0;
+	for (p = best; p >= 0; p = kernel->blocks[p].path_prev)
+		n++;
+	kernel->path = calloc(n, sizeof(*kernel->path));
+	if (kernel->path == NULL)
+		return;
+	kernel->path_len = n;
+	for (p = best; p >= 0; p = kernel->blocks[p].path_prev)
+		kernel->path[--n] = p;
+}
+
+static void regset_add(struct eu_regset *set, unsigned reg)
+{
+	set->bits[reg / 32] |= 1u << (reg % 32);
+}
+
+static void regset_add_range(struct eu_regset *set,
+			     const struct eu_reg_range *range)
+{
+	unsigned r;
+
+	for (r = range->first; r <= range->last; r++)
+		regset_add(set, r);
+}
+
+static void regset_remove_range(struct eu_regset *set,
+				const struct eu_reg_range *range)
+{
+	unsigned r;
+
+	for (r = range->first; r <= range->last; r++)
+		set->bits[r / 32] &= ~(1u << (r % 32));
+}
+
+/* returns whether it changed anything */
+static bool regset_or(struct eu_regset *set, const struct eu_regset *other)
+{
+	uint32_t changed = 0;
+	unsigned n;
+
+	for (n = 0; n < sizeof(set->bits) / sizeof(set->bits[0]); n++) {
+		changed |= other->bits[n] & ~set->bits[n];
+		set->bits[n] |= other->bits[n];
+	}
+	return changed;
+}
+
+static unsigned regset_count_grf(const struct eu_regset *set)
+{
+	unsigned n, count = 0;
+
+	for (n = 0; n < EU_NUM_GRF / 32; n++)
+		count += __builtin_popcount(set->bits[n]);
+	return count;
+}
+
+/*
+ * Whether a write replaces the whole of the registers. Predicated ones
+ * don't, except for SEL, and neither do those covering only some bytes.
+ * Channels disabled by the control flow are not taken into account.
+ */
+static bool write_kills(const struct eu_insn *e, const struct eu_reg_range *w)
+{
+	return !w->partial &&
+		(e->insn.header.predicate_control == BRW_PREDICATE_NONE ||
+		 e->insn.header.opcode == BRW_OPCODE_SEL);
+}
+
+/* live in front of e, given what is live after it */
+static void transfer(const struct eu_insn *e, struct eu_regset *live)
+{
+	unsigned k;
+
+	for (k = 0; k < e->num_writes; k++)
+		if (write_kills(e, &e->writes[k]))
+			regset_remove_range(live, &e->writes[k]);
+	for (k = 0; k < e->num_reads; k++)
+		regset_add_range(live, &e->reads[k]);
+}
+
+/*
+ * What a subroutine returns to: the blocks right after each call. Returns
+ * false if there are no calls, the kernel itself was called then.
+ */
+static bool return_live(const struct eu_kernel *kernel, struct eu_regset *set)
+{
+	bool found = false;
+	unsigned b;
+
+	for (b = 0; b + 1 < kernel->num_blocks; b++) {
+		const struct eu_block *block = &kernel->blocks[b];
+
+		if (kernel->insns[block->last].insn.header.opcode ==
+		    BRW_OPCODE_CALL) {
+			regset_or(set, &kernel->blocks[b + 1].live_in);
+			found = true;
+		}
+	}
+	return found;
+}
+
+/* every GRF in set interferes with every other one */
+static void interfere(struct eu_kernel *kernel, const struct eu_regset *set)
+{
+	unsigned r;
+
+	for (r = 0; r < EU_NUM_GRF; r++)
+		if (eu_regset_test(set, r))
+			regset_or(&kernel->interference[r], set);
+}
+
+/**
+ * eu_kernel_liveness - find the live registers before every instruction
+ *
+ * Needs the CFG. A register is live from a write to its last read on
+ * any path, a RET returns to behind every CALL. Leaving other than by
+ * EOT resumes whatever ran before, like a system routine does, so what
+ * was live at the entry stays live at such an exit. Also notes down the
+ * register pressure of every instruction, and which GRFs are taken at
+ * the same time. Returns 0 or -ENOMEM.
+ */
+int eu_kernel_liveness(struct eu_kernel *kernel)
+{
+	struct eu_regset live, taken;
+	const struct eu_insn *last;
+	bool changed;
+	unsigned b, i, s, k;
+
+	kernel->interference = calloc(EU_NUM_GRF,
+				      sizeof(*kernel->interference));
+	if (kernel->interference == NULL)
+		return -ENOMEM;
+
+	/* iterate to a fixed point, going backwards converges faster */
+	do {
+		changed = false;
+		for (b = kernel->num_blocks; b--; ) {
+			struct eu_block *block = &kernel->blocks[b];
+
+			for (s = 0; s < block->num_succ; s++)
+				regset_or(&block->live_out,
+					  &kernel->blocks[block->succ[s]].live_in);
+			last = &kernel->insns[block->last];
+			if (block->exits && !last->eot &&
+			    (last->insn.header.opcode != BRW_OPCODE_RET ||
+			     !return_live(kernel, &block->live_out)))
+				regset_or(&block->live_out,
+					  &kernel->blocks[0].live_in);
+
+			live = block->live_out;
+			for (i = block->last + 1; i-- > block->first; )
+				transfer(&kernel->insns[i], &live);
+			changed |= regset_or(&block->live_in, &live);
+		}
+	} while (changed);
+
+	kernel->peak_pressure = 0;
+	kernel->peak_insn = 0;
+	for (b = 0; b < kernel->num_blocks; b++) {
+		struct eu_block *block = &kernel->blocks[b];
+
+		live = block->live_out;
+		for (i = block->last + 1; i-- > block->first; ) {
+			struct eu_insn *e = &kernel->insns[i];
+
+			/* the results need room along with what lives on */
+			taken = live;
+			for (k = 0; k < e->num_writes; k++)
+				regset_add_range(&taken, &e->writes[k]);
+			for (k = 0; k < e->num_reads + e->num_writes; k++)
+				regset_add_range(&kernel->used, k < e->num_reads ?
+						 &e->reads[k] :
+						 &e->writes[k - e->num_reads]);
+
+			transfer(e, &live);
+			e->live = live;
+			e->pressure = regset_count_grf(&taken);
+			if (regset_count_grf(&live) > e->pressure)
+				e->pressure = regset_count_grf(&live);
+
+			interfere(kernel, &taken);
+			interfere(kernel, &live);
+		}
+	}
+
+	for (i = 0; i < kernel->num_insns; i++) {
+		if (kernel->insns[i].pressure > kernel->peak_pressure) {
+			kernel->peak_pressure = kernel->insns[i].pressure;
+			kernel->peak_insn = i;
+		}
+	}
+
+	return 0;
+}
+
+/**
+ * eu_kernel_renumber - pack the GRFs into as few as possible
+ *
+ * Needs eu_kernel_liveness(). Registers which are never live at the same
+ * time may share a number. Those read or written together by one operand
+ * stay together, in the same order and at the same parity. Registers live
+ * at the entry hold the thread payload and those sent with EOT have to stay
+ * where they are, so both are left alone, as is everything once there are
+ * indirect operands.
+ *
+ * Fills in the new number of every GRF, or -1 for unused ones, and
+ * returns how many GRFs the kernel takes then, or -1 if it can't be done.
+ */
+int eu_kernel_renumber(const struct eu_kernel *kernel, int map[EU_NUM_GRF])
+{
+	struct eu_regset slot[EU_NUM_GRF], fixed;
+	bool linked[EU_NUM_GRF];
+	int first_use[EU_NUM_GRF];
+	unsigned order[EU_NUM_GRF], num_groups = 0;
+	unsigned i, k, r, g, lo, hi, base, footprint = 0;
+
+	if (kernel->num_indirect || kernel->interference == NULL)
+		return -1;
+
+	memset(slot, 0, sizeof(slot));
+	memset(linked, 0, sizeof(linked));
+	memset(&fixed, 0, sizeof(fixed));
+	if (kernel->num_blocks)
+		fixed = kernel->blocks[0].live_in;
+	for (r = 0; r < EU_NUM_GRF; r++) {
+		map[r] = -1;
+		first_use[r] = -1;
+	}
+
+	for (i = kernel->num_insns; i--; ) {
+		const struct eu_insn *e = &kernel->insns[i];
+
+		for (k = 0; k < e->num_reads + e->num_writes; k++) {
+			const struct eu_reg_range *range = k < e->num_reads ?
+				&e->reads[k] : &e->writes[k - e->num_reads];
+
+			for (r = range->first;
+			     r <= range->last && r < EU_NUM_GRF; r++) {
+				first_use[r] = i;
+				if (r < range->last)
+					linked[r] = true;
+				if (e->eot && k < e->num_reads)
+					regset_add(&fixed, r);
+			}
+		}
+	}
+
+	/* groups of linked registers, those with a fixed one first */
+	for (r = 0; r < EU_NUM_GRF; r = hi + 1) {
+		bool is_fixed = false;
+
+		for (hi = r; hi + 1 < EU_NUM_GRF && linked[hi]; hi++)
+			;
+		for (k = r; k <= hi; k++)
+			is_fixed |= eu_regset_test(&fixed, k);
+		if (!eu_regset_test(&kernel->used, r))
+			continue;
+
+		if (is_fixed) {
+			for (k = r; k <= hi; k++) {
+				map[k] = k;
+				regset_add(&slot[k], k);
+			}
+		} else {
+			order[num_groups++] = r;
+		}
+	}
+
+	/* the rest first fit, in the order they are first used in */
+	for (g = 1; g < num_groups; g++) {
+		unsigned t = order[g];
+
+		for (k = g; k > 0; k--) {
+			if (first_use[order[k - 1]] <= first_use[t])
+				break;
+			order[k] = order[k - 1];
+		}
+		order[k] = t;
+	}
+
+	for (g = 0; g < num_groups; g++) {
+		lo = order[g];
+		for (hi = lo; hi + 1 < EU_NUM_GRF && linked[hi]; hi++)
+			;
+
+		for (base = 0; base + hi - lo < EU_NUM_GRF; base++) {
+			/* SIMD16 operands start on an even register */
+			if (hi > lo && (base ^ lo) & 1)
+				continue;
+			for (k = 0; k <= hi - lo; k++) {
+				const struct eu_regset *busy = &slot[base + k];
+				const struct eu_regset *clash =
+					&kernel->interference[lo + k];
+
+				for (r = 0; r < EU_NUM_GRF / 32; r++)
+					if (busy->bits[r] & clash->bits[r])
+						break;
+				if (r < EU_NUM_GRF / 32)
+					break;
+			}
+			if (k > hi - lo)
+				break;
+		}
+		if (base + hi - lo >= EU_NUM_GRF)
+			return -1;
+
+		for (k = 0; k <= hi - lo; k++) {
+			map[lo + k] = base + k;
+			regset_add(&slot[base + k], lo + k);
+		}
+	}
+
+	for (r = 0; r < EU_NUM_GRF; r++)
+		if (map[r] >= 0 && (unsigned)map[r] + 1 > footprint)
+			footprint = map[r] + 1;
+
+	return footprint;
+}
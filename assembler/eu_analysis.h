@@ -0,0 +1,183 @@
+/*
+ * Copyright © 2013 Intel Corporation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef __EU_ANALYSIS_H__
+#define __EU_ANALYSIS_H__
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "brw_structs.h"
+
+/*
+ * Static analysis of assembled EU kernels: decodes which registers every
+ * instruction reads and writes, splits the kernel into basic blocks,
+ * runs a simple in-order issue model over them and works out which
+ * registers are live where.
+ *
+ * Registers are tracked at a granularity of whole 32 byte registers. The
+ * MRFs are numbered after the GRFs, flags and the accumulator aren't
+ * tracked. Operands using indirect addressing are not tracked either,
+ * eu_insn.indirect tells which instructions have some.
+ */
+
+#define EU_NUM_GRF	128
+#define EU_NUM_MRF	16
+#define EU_MRF(n)	(EU_NUM_GRF + (n))
+#define EU_NUM_REGS	(EU_NUM_GRF + EU_NUM_MRF)
+
+enum eu_insn_kind {
+	EU_ALU,
+	EU_MATH,
+	EU_SEND,
+	EU_BRANCH,
+	EU_NOP,
+};
+
+struct eu_reg_range {
+	unsigned first, last;		/* inclusive */
+	bool partial;			/* a write leaving some bytes alone */
+};
+
+struct eu_regset {
+	uint32_t bits[(EU_NUM_REGS + 31) / 32];
+};
+
+static inline bool eu_regset_test(const struct eu_regset *set, unsigned reg)
+{
+	return set->bits[reg / 32] & (1u << (reg % 32));
+}
+
+struct eu_insn {
+	struct brw_instruction insn;	/* compacted ones are expanded */
+	unsigned offset;		/* in bytes */
+	unsigned size;			/* 8 if compacted, else 16 */
+
+	enum eu_insn_kind kind;
+	unsigned exec_size;		/* in channels */
+	unsigned sfid;			/* shared function of a send */
+	bool eot;
+	bool indirect;
+
+	struct eu_reg_range reads[4];
+	unsigned num_reads;
+	struct eu_reg_range writes[2];
+	unsigned num_writes;
+
+	/* jump targets in bytes, may be the end of the kernel */
+	unsigned targets[2];
+	unsigned num_targets;
+	bool falls_through;
+
+	/* cost model */
+	unsigned issue;			/* cycles the pipe is busy */
+	unsigned latency;		/* cycles until the result can be read */
+
+	/* filled in by eu_kernel_schedule() */
+	unsigned block;
+	unsigned start;			/* issue cycle within the block */
+	unsigned stall;
+	int stall_reg;			/* register waited for, or -1 */
+	int stall_producer;		/* instruction it waited for, or -1 */
+	unsigned chain;			/* longest dependency chain ending here */
+	int chain_prev;			/* previous link of that chain, or -1 */
+
+	/* filled in by eu_kernel_liveness() */
+	struct eu_regset live;		/* live in front of it */
+	unsigned pressure;		/* GRFs taken while it runs */
+};
+
+struct eu_block {
+	unsigned first, last;		/* instruction indices, inclusive */
+	unsigned succ[4];
+	unsigned num_succ;
+	bool exits;			/* EOT, RET or running off the end */
+
+	unsigned issue;			/* sum of the issue cycles */
+	unsigned stall;			/* cycles spent waiting on registers */
+	unsigned cycles;		/* issue + stall */
+	unsigned drain;			/* latency outstanding at the end */
+	unsigned critical_path;		/* longest dependency chain, cycles */
+	unsigned critical_end;		/* instruction where it ends */
+
+	/* longest path from the entry, loops taken once */
+	unsigned path_cycles;
+	int path_prev;
+
+	struct eu_regset live_in, live_out;
+};
+
+struct eu_gen_info {
+	int gen;			/* 10 * generation */
+	const char *name;
+	unsigned alu_lanes;		/* 32 bit channels per cycle */
+	unsigned alu_latency;
+	unsigned math_lanes;
+	unsigned math_latency;
+	unsigned branch_cycles;
+	unsigned send_latency[16];	/* by SFID, 0 for the default */
+	unsigned send_default_latency;
+};
+
+struct eu_kernel {
+	int gen;
+	const struct eu_gen_info *info;
+
+	struct eu_insn *insns;
+	unsigned num_insns;
+	size_t size;			/* in bytes */
+
+	struct eu_block *blocks;
+	unsigned num_blocks;
+
+	/* totals over all blocks */
+	unsigned issue;
+	unsigned stall;
+	unsigned num_indirect;
+
+	/* longest path through the CFG, loop bodies counted once */
+	unsigned path_cycles;
+	unsigned *path;			/* block indices */
+	unsigned path_len;
+
+	/* filled in by eu_kernel_liveness() */
+	struct eu_regset used;		/* read or written anywhere */
+	unsigned peak_pressure;
+	unsigned peak_insn;
+	struct eu_regset *interference;	/* per GRF, those live along with it */
+};
+
+const struct eu_gen_info *eu_gen_info(int gen);
+
+int eu_kernel_init(struct eu_kernel *kernel, int gen,
+		   const void *code, size_t size);
+void eu_kernel_build_cfg(struct eu_kernel *kernel);
+void eu_kernel_schedule(struct eu_kernel *kernel);
+int eu_kernel_liveness(struct eu_kernel *kernel);
+int eu_kernel_renumber(const struct eu_kernel *kernel, int map[EU_NUM_GRF]);
+void eu_kernel_fini(struct eu_kernel *kernel);
+
+int eu_block_of_offset(const struct eu_kernel *kernel, unsigned offset);
+
+#endif /* __EU_ANALYSIS_H__ */
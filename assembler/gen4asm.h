@@ -32,34 +32,27 @@
 #include <inttypes.h>
 #include <stdbool.h>
 #include <assert.h>
+#include <stdarg.h>
 
 #include "brw_reg.h"
 #include "brw_defines.h"
 #include "brw_structs.h"
-
-extern long int gen_level;
-extern int advanced_flag;
-extern int errors;
+#include "brw_eu.h"
+#include "libgen4asm.h"
+#include "arena.h"
 
 #define WARN_ALWAYS	(1 << 0)
 #define WARN_ALL	(1 << 31)
-extern unsigned int warning_flags;
-
-extern char *input_filename;
-
-extern struct brw_context genasm_context;
-extern struct brw_compile genasm_compile;
 
 /* Predicate for Gen X and above */
-#define IS_GENp(x) (gen_level >= (x)*10)
+#define IS_GENp(x) (gen4asm_ctx->gen_level >= (x)*10)
 
 /* Predicate for Gen X exactly */
-#define IS_GENx(x) (gen_level >= (x)*10 && gen_level < ((x)+1)*10)
+#define IS_GENx(x) (gen4asm_ctx->gen_level >= (x)*10 && \
+		    gen4asm_ctx->gen_level < ((x)+1)*10)
 
 /* Predicate to match Haswell processors */
-#define IS_HASWELL(x) (gen_level == 75)
-
-void yyerror (char *msg);
+#define IS_HASWELL(x) (gen4asm_ctx->gen_level == 75)
 
 #define STRUCT_SIZE_ASSERT(TYPE, SIZE) \
 typedef struct { \
@@ -76,6 +69,7 @@ struct condition {
     	int cond;
 	int flag_reg_nr;
 	int flag_subreg_nr;
+	int saturate;
 };
 
 struct predicate {
@@ -150,6 +144,7 @@ struct relocation {
 struct brw_program_instruction {
     enum assembler_instruction_type type;
     unsigned inst_offset;
+    int line;
     union {
 	struct brw_instruction gen;
 	struct label_instruction label;
@@ -183,7 +178,6 @@ struct brw_program {
 	struct brw_program_instruction *last;
 };
 
-extern struct brw_program compiled_program;
 
 #define TYPE_B_INDEX            0
 #define TYPE_UB_INDEX           1
@@ -205,7 +199,6 @@ struct program_defaults {
     struct region dest_region;
     struct region dest_region_type[TOTAL_TYPES];
 };
-extern struct program_defaults program_defaults;
 
 struct declared_register {
     char *name;
@@ -213,15 +206,93 @@ struct declared_register {
     int element_size;
     struct region src_region;
     int dst_region;
+    int line; /* of the declaration */
+    unsigned uses;
+};
+/*
+ * A chained string hash table which doubles as it fills up, for the
+ * declared registers and the labels.
+ */
+struct gen4asm_hash_entry {
+    const char *key;
+    unsigned hash;
+    void *data;
+    struct gen4asm_hash_entry *next;
 };
+
+struct gen4asm_hash {
+    struct gen4asm_hash_entry **buckets;
+    unsigned size; /* power of two */
+    unsigned count;
+    bool ignore_case;
+};
+
+/* All the labels of one name, in ascending address order */
+struct label_item {
+    char *name;
+    int *addr;
+    unsigned *index; /* in program order */
+    unsigned count, capacity;
+};
+
+/**
+ * All the state of one assembly, which used to be global.
+ */
+struct gen4asm_context {
+    long int gen_level;
+    int advanced_flag; /* 0: in unit of byte, 1: in unit of data element size */
+    unsigned int warning_flags;
+    char *input_filename;
+    int errors;
+
+    struct brw_context brw;
+    struct brw_compile compile;
+    struct brw_program program;
+    struct program_defaults defaults;
+
+    struct gen4asm_hash declared_register_table;
+    struct gen4asm_hash label_table;
+    unsigned num_labels;
+
+    /* allocated off the result, handed over by emit_program() */
+    struct gen4asm_relocation *relocations;
+    unsigned num_relocations;
+
+    const char *const *entry_points;
+    unsigned num_entry_points;
+
+    /* lexer state */
+    int lex_saved_state;
+    int lex_column;
+
+    /* scratch memory, freed once the program is assembled */
+    void *mem_ctx;
+
+    /* the parsed program and the names in it, freed along with mem_ctx */
+    struct gen4asm_arena arena;
+
+    /* the result, collecting the diagnostics */
+    struct gen4asm_program *result;
+    FILE *diagnostics;
+};
+
+/* The assembly in progress on the calling thread */
+extern __thread struct gen4asm_context *gen4asm_ctx;
+
+void gen4asm_message(enum gen4asm_severity severity, int line, int column,
+		     const char *fmt, ...)
+    __attribute__((format(printf, 4, 5)));
+void gen4asm_vmessage(enum gen4asm_severity severity, int line, int column,
+		      const char *fmt, va_list args);
+
 struct declared_register *find_register(char *name);
 void insert_register(struct declared_register *reg);
 
-int yyparse(void);
-int yylex(void);
-int yylex_destroy(void);
+/* optimize.c: peephole optimizations on ctx->program */
+void optimize_program(struct gen4asm_context *ctx);
 
-char *
-lex_text(void);
+/* lex.l: runs the parser over source */
+int gen4asm_parse(struct gen4asm_context *ctx,
+		  const char *source, size_t length);
 
 #endif /* __GEN4ASM_H__ */
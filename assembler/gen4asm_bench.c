@@ -0,0 +1,122 @@
+/*
+ * Copyright © 2013 Intel Corporation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/*
+ * Assembles large synthetic programs, to keep an eye on the parts of the
+ * assembler which scale with the program size, like the label resolution.
+ *
+ * Every variant is a straight run of movs, with a label every "spacing"
+ * instructions and a jmpi to it right in front of each one. With
+ * names=unique every label is different, with names=dup they are all
+ * called the same, so that each jump resolves to the next one of them.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "libgen4asm.h"
+#include "igt_bench.h"
+
+struct assemble {
+	char *source;
+	size_t length;
+	struct gen4asm_options options;
+};
+
+static char *generate(unsigned instructions, unsigned spacing, bool dup,
+		      size_t *length)
+{
+	size_t size = 64 * (instructions + 1);
+	char *source = malloc(size), *p = source;
+	unsigned n, label = 0;
+
+	if (source == NULL) {
+		perror("malloc");
+		exit(1);
+	}
+
+	for (n = 0; n < instructions; n++) {
+		if (spacing && n % spacing == spacing - 1) {
+			/* jump over nothing, to the label right after */
+			p += sprintf(p, dup ? "jmpi L;\nL:\n" :
+				     "jmpi L%u;\nL%u:\n", label, label);
+			label++;
+		} else {
+			p += sprintf(p, "mov (1) g%u<1>UD g1<0,1,0>UD "
+				     "{ align1 };\n", 2 + n % 64);
+		}
+	}
+
+	*length = p - source;
+	return source;
+}
+
+static void assemble(void *data)
+{
+	struct assemble *a = data;
+	struct gen4asm_program *program;
+
+	program = gen4asm_assemble(a->source, a->length, &a->options);
+	if (program == NULL || program->num_errors) {
+		fprintf(stderr, "assembly failed\n");
+		exit(1);
+	}
+	gen4asm_program_free(program);
+}
+
+int main(int argc, char **argv)
+{
+	static const unsigned spacings[] = { 0, 1000, 100, 10, 2 };
+	const unsigned instructions = 100000;
+	struct igt_bench bench;
+	char variant[128];
+	unsigned i, dup;
+
+	igt_bench_init(&bench, argc, argv);
+
+	for (i = 0; i < sizeof(spacings) / sizeof(spacings[0]); i++) {
+		for (dup = 0; dup <= (spacings[i] != 0); dup++) {
+			struct assemble a;
+
+			gen4asm_options_init(&a.options);
+			a.options.gen = 60;
+			a.source = generate(instructions, spacings[i], dup,
+					    &a.length);
+
+			snprintf(variant, sizeof(variant),
+				 "instructions=%u,labels=%u,names=%s",
+				 instructions,
+				 spacings[i] ? instructions / spacings[i] : 0,
+				 dup ? "dup" : "unique");
+			igt_bench_run(&bench, variant, assemble, NULL, &a,
+				      a.length);
+
+			free(a.source);
+		}
+	}
+
+	igt_bench_fini(&bench);
+
+	return 0;
+}
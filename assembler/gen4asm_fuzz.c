@@ -0,0 +1,719 @@
+/*
+ * Copyright © 2013 Intel Corporation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/*
+ * Differential fuzzing of the assembler against the disassembler.
+ *
+ * Every input starts with a byte selecting the generation and the mode.
+ * In the encoding mode the rest of the input is a stream of choices for
+ * building instructions with the brw_eu emitter, which keeps them valid
+ * by construction. Each one is disassembled with brw_disasm(), fed back
+ * to the parser and has to come out with the very same bits. In the
+ * source mode the rest is handed to the parser as is, which must not
+ * crash whatever it is given.
+ *
+ * Built with -DGEN4ASM_FUZZ_LIBFUZZER this is just LLVMFuzzerTestOneInput()
+ * for libFuzzer. Otherwise the program runs the files named on the
+ * command line as inputs, which is what AFL wants, or makes up random
+ * ones. -w writes those out to seed a corpus, -b times both directions
+ * over the instructions of a corpus instead of checking them.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <getopt.h>
+#include <time.h>
+#include <sys/wait.h>
+
+#include "gen4asm.h"
+#include "brw_eu.h"
+#include "ralloc.h"
+
+#define MAX_INSNS_PER_INPUT 16
+
+#define MODE_SOURCE 0x1
+
+static const int gens[] = { 40, 45, 50, 60, 70, 75 };
+#define NUM_GENS (sizeof(gens) / sizeof(gens[0]))
+
+enum result {
+	MATCH,
+	REJECTED,	/* the parser doesn't take what brw_disasm printed */
+	MISMATCH,	/* it does, but assembles it to something else */
+	NUM_RESULTS
+};
+
+struct stats {
+	unsigned count[NUM_RESULTS];
+	unsigned sources;
+	unsigned crashes;	/* sources the parser didn't survive */
+};
+
+static struct stats stats[NUM_GENS];
+static bool strict;
+static int verbose;
+
+/* the choices, as taken from the input; 0 once it runs dry */
+struct choices {
+	const uint8_t *data;
+	size_t size, pos;
+};
+
+static unsigned choose(struct choices *c, unsigned n)
+{
+	if (n <= 1 || c->pos >= c->size)
+		return 0;
+	return c->data[c->pos++] % n;
+}
+
+static uint32_t choose32(struct choices *c)
+{
+	uint32_t v = 0;
+	int i;
+
+	for (i = 0; i < 4; i++)
+		v = v << 8 | choose(c, 256);
+	return v;
+}
+
+#define FLOAT_TYPES	(1 << BRW_REGISTER_TYPE_F)
+#define INT_TYPES	((1 << BRW_REGISTER_TYPE_D) | \
+			 (1 << BRW_REGISTER_TYPE_UD) | \
+			 (1 << BRW_REGISTER_TYPE_W) | \
+			 (1 << BRW_REGISTER_TYPE_UW))
+#define DWORD_TYPES	((1 << BRW_REGISTER_TYPE_D) | \
+			 (1 << BRW_REGISTER_TYPE_UD))
+
+typedef struct brw_instruction *(*alu1_func)(struct brw_compile *p,
+					     struct brw_reg dest,
+					     struct brw_reg src0);
+typedef struct brw_instruction *(*alu2_func)(struct brw_compile *p,
+					     struct brw_reg dest,
+					     struct brw_reg src0,
+					     struct brw_reg src1);
+
+static const struct {
+	alu1_func alu1;
+	alu2_func alu2;
+	unsigned types;
+	bool saturate;
+} opcodes[] = {
+	{ brw_MOV, NULL, FLOAT_TYPES | INT_TYPES, true },
+	{ brw_NOT, NULL, INT_TYPES, false },
+	{ brw_FRC, NULL, FLOAT_TYPES, true },
+	{ brw_RNDD, NULL, FLOAT_TYPES, true },
+	{ brw_LZD, NULL, DWORD_TYPES, false },
+	{ NULL, brw_SEL, FLOAT_TYPES | INT_TYPES, true },
+	{ NULL, brw_AND, INT_TYPES, false },
+	{ NULL, brw_OR, INT_TYPES, false },
+	{ NULL, brw_XOR, INT_TYPES, false },
+	{ NULL, brw_SHR, INT_TYPES, false },
+	{ NULL, brw_SHL, INT_TYPES, false },
+	{ NULL, brw_ASR, INT_TYPES, false },
+	{ NULL, brw_ADD, FLOAT_TYPES | INT_TYPES, true },
+	{ NULL, brw_MUL, FLOAT_TYPES | INT_TYPES, true },
+	{ NULL, brw_AVG, INT_TYPES, false },
+	{ NULL, brw_MAC, FLOAT_TYPES, true },
+	{ NULL, brw_DP4, FLOAT_TYPES, true },
+	{ NULL, brw_DP3, FLOAT_TYPES, true },
+	{ NULL, brw_DP2, FLOAT_TYPES, true },
+};
+#define NUM_OPCODES (sizeof(opcodes) / sizeof(opcodes[0]))
+
+static unsigned choose_type(struct choices *c, unsigned types)
+{
+	unsigned type, n = __builtin_popcount(types), i = choose(c, n);
+
+	for (type = 0; ; type++)
+		if (types & (1 << type) && i-- == 0)
+			return type;
+}
+
+/* immediates brw_disasm prints exactly */
+static struct brw_reg choose_immediate(struct choices *c, unsigned type)
+{
+	switch (type) {
+	case BRW_REGISTER_TYPE_F:
+		return brw_imm_f(((int)choose(c, 256) - 128) / 8.0f);
+	case BRW_REGISTER_TYPE_D:
+		return brw_imm_d(choose32(c));
+	case BRW_REGISTER_TYPE_UD:
+		return brw_imm_ud(choose32(c));
+	case BRW_REGISTER_TYPE_W:
+		return brw_imm_w(choose32(c));
+	default:
+		return brw_imm_uw(choose32(c));
+	}
+}
+
+static struct brw_reg grf(unsigned width, unsigned nr, unsigned subnr)
+{
+	switch (width) {
+	case 1: return brw_vec1_grf(nr, subnr);
+	case 2: return brw_vec2_grf(nr, subnr);
+	case 4: return brw_vec4_grf(nr, subnr);
+	case 8: return brw_vec8_grf(nr, subnr);
+	default: return brw_vec16_reg(BRW_GENERAL_REGISTER_FILE, nr, subnr);
+	}
+}
+
+/* a source of the same width as the destination, a scalar or an immediate */
+static struct brw_reg choose_src(struct choices *c, unsigned width,
+				 unsigned type, bool immediate, bool modifiers)
+{
+	struct brw_reg reg;
+
+	switch (choose(c, immediate ? 3 : 2)) {
+	case 0:
+		reg = retype(grf(width, 2 + choose(c, 120), 0), type);
+		break;
+	case 1:
+		reg = suboffset(retype(brw_vec1_grf(2 + choose(c, 120), 0),
+				       type), choose(c, 32 / type_sz(type)));
+		break;
+	default:
+		return choose_immediate(c, type);
+	}
+
+	if (modifiers && choose(c, 4) == 0)
+		reg = negate(reg);
+	if (modifiers && choose(c, 4) == 0)
+		reg = brw_abs(reg);
+	return reg;
+}
+
+/* Emits one instruction as the choices say, returns false once they ran dry */
+static bool generate(struct brw_compile *p, struct choices *c)
+{
+	static const unsigned widths[] = { 1, 2, 4, 8, 16 };
+	unsigned op, type, width, subnr = 0;
+	struct brw_reg dst, src0, src1;
+	bool modifiers;
+
+	if (c->pos >= c->size)
+		return false;
+
+	op = choose(c, NUM_OPCODES);
+	type = choose_type(c, opcodes[op].types);
+	width = widths[choose(c, 5)];
+	if (width == 1)
+		subnr = choose(c, 32 / type_sz(type));
+	/* no source modifiers on the logic ops */
+	modifiers = opcodes[op].types != INT_TYPES || opcodes[op].saturate;
+
+	brw_push_insn_state(p);
+	if (width * type_sz(type) > 32)
+		brw_set_compression_control(p, BRW_COMPRESSION_COMPRESSED);
+	if (opcodes[op].saturate)
+		brw_set_saturate(p, choose(c, 4) == 0);
+	if (choose(c, 4) == 0)
+		brw_set_mask_control(p, BRW_MASK_DISABLE);
+	if (choose(c, 4) == 0) {
+		brw_set_predicate_control(p, BRW_PREDICATE_NORMAL);
+		brw_set_predicate_inverse(p, choose(c, 2));
+	} else if (choose(c, 4) == 0) {
+		brw_set_conditionalmod(p, 1 + choose(c, 6));
+	}
+
+	dst = suboffset(retype(grf(width, 2 + choose(c, 120), 0), type),
+			subnr);
+	if (opcodes[op].alu1) {
+		src0 = choose_src(c, width, type, true, modifiers);
+		opcodes[op].alu1(p, dst, src0);
+	} else {
+		src0 = choose_src(c, width, type, false, modifiers);
+		src1 = choose_src(c, width, type, true, modifiers);
+		opcodes[op].alu2(p, dst, src0, src1);
+	}
+	brw_pop_insn_state(p);
+
+	return true;
+}
+
+static void print_insn(const char *what, const void *insn)
+{
+	const uint32_t *dw = insn;
+
+	fprintf(stderr, "  %-8s %08x %08x %08x %08x\n",
+		what, dw[0], dw[1], dw[2], dw[3]);
+}
+
+/* brw_disasm() insn into a malloced string */
+static char *disassemble(const struct brw_instruction *insn, int gen,
+			 size_t *length)
+{
+	char *text = NULL;
+	FILE *file;
+
+	file = open_memstream(&text, length);
+	if (file == NULL) {
+		perror("open_memstream");
+		exit(1);
+	}
+	brw_disasm(file, (struct brw_instruction *)insn, gen / 10);
+	fclose(file);
+	return text;
+}
+
+static enum result roundtrip(const struct brw_instruction *insn, int gen)
+{
+	struct gen4asm_options options;
+	struct gen4asm_program *program;
+	enum result ret;
+	size_t length;
+	char *text;
+
+	text = disassemble(insn, gen, &length);
+
+	/* brw_disasm prints subregisters in units of the type, like -a */
+	gen4asm_options_init(&options);
+	options.gen = gen;
+	options.advanced = true;
+	program = gen4asm_assemble(text, length, &options);
+	if (program == NULL) {
+		perror("gen4asm_assemble");
+		exit(1);
+	}
+
+	if (program->num_errors || program->size != sizeof(*insn))
+		ret = REJECTED;
+	else if (memcmp(program->code, insn, sizeof(*insn)))
+		ret = MISMATCH;
+	else
+		ret = MATCH;
+
+	if (ret == MISMATCH || (ret == REJECTED && (strict || verbose > 1))) {
+		fprintf(stderr, "gen%d: %s: %s", gen / 10,
+			ret == MISMATCH ? "mismatch" : "rejected", text);
+		print_insn("expected", insn);
+		if (ret == MISMATCH)
+			print_insn("got", program->code);
+	}
+
+	gen4asm_program_free(program);
+	free(text);
+	return ret;
+}
+
+/* Builds the instructions an encoding mode input asks for, returns how many */
+static unsigned build(int gen, const uint8_t *data, size_t size,
+		      struct brw_instruction *insns)
+{
+	struct choices c = { data, size, 0 };
+	struct brw_context brw;
+	struct brw_compile p;
+	void *mem_ctx = ralloc_context(NULL);
+	unsigned n;
+
+	brw_init_context(&brw, gen);
+	brw_init_compile(&brw, &p, mem_ctx);
+	while (p.nr_insn < MAX_INSNS_PER_INPUT && generate(&p, &c))
+		;
+
+	n = p.nr_insn;
+	memcpy(insns, p.store, n * sizeof(*insns));
+	ralloc_free(mem_ctx);
+	return n;
+}
+
+static unsigned input_gen(const uint8_t *data)
+{
+	return (data[0] >> 1) % NUM_GENS;
+}
+
+/* Runs one input, returns how many instructions failed the round trip */
+static unsigned run_input(const uint8_t *data, size_t size)
+{
+	struct brw_instruction insns[MAX_INSNS_PER_INPUT];
+	unsigned g, n, i, failed = 0;
+
+	if (size == 0)
+		return 0;
+
+	g = input_gen(data);
+	if (data[0] & MODE_SOURCE) {
+		struct gen4asm_options options;
+
+		gen4asm_options_init(&options);
+		options.gen = gens[g];
+		gen4asm_program_free(gen4asm_assemble((const char *)data + 1,
+						      size - 1, &options));
+		stats[g].sources++;
+		return 0;
+	}
+
+	n = build(gens[g], data + 1, size - 1, insns);
+	for (i = 0; i < n; i++) {
+		enum result r = roundtrip(&insns[i], gens[g]);
+
+		stats[g].count[r]++;
+		failed += r == MISMATCH || (r == REJECTED && strict);
+	}
+
+	return failed;
+}
+
+int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size)
+{
+	if (getenv("GEN4ASM_FUZZ_STRICT"))
+		strict = true;
+
+	if (run_input(data, size))
+		abort();
+
+	return 0;
+}
+
+#ifndef GEN4ASM_FUZZ_LIBFUZZER
+
+static uint32_t rand_state;
+
+/* xorshift32, so that a seed makes for the same inputs everywhere */
+static uint32_t next_random(void)
+{
+	rand_state ^= rand_state << 13;
+	rand_state ^= rand_state >> 17;
+	rand_state ^= rand_state << 5;
+	return rand_state;
+}
+
+/*
+ * A random input: a run of choices, or the disassembly of one with a few
+ * characters mangled, as random bytes would rarely get past the lexer.
+ */
+static uint8_t *random_input(size_t *size)
+{
+	static const char mangle[] = " \n;:.,<>()-{}gmrF0123456789x";
+	struct brw_instruction insns[MAX_INSNS_PER_INPUT];
+	size_t len = 1 + next_random() % 160, text_len, pos;
+	uint8_t *data = malloc(len), *ret;
+	unsigned i, n;
+	FILE *file;
+
+	for (i = 0; i < len; i++)
+		data[i] = next_random();
+	data[0] &= ~MODE_SOURCE;
+	if (next_random() % 4)
+		goto out;
+
+	/* source mode */
+	n = build(gens[input_gen(data)], data + 1, len - 1, insns);
+	ret = NULL;
+	file = open_memstream((char **)&ret, &text_len);
+	fputc(data[0] | MODE_SOURCE, file);
+	for (i = 0; i < n; i++)
+		brw_disasm(file, &insns[i], gens[input_gen(data)] / 10);
+	fclose(file);
+	free(data);
+	data = ret;
+	len = text_len;
+
+	for (i = next_random() % 4; i && len > 1; i--) {
+		pos = 1 + next_random() % (len - 1);
+		switch (next_random() % 3) {
+		case 0: /* replace */
+			data[pos] = mangle[next_random() % (sizeof(mangle) - 1)];
+			break;
+		case 1: /* delete */
+			memmove(data + pos, data + pos + 1, len - pos - 1);
+			len--;
+			break;
+		default: /* duplicate */
+			data = realloc(data, len + 1);
+			memmove(data + pos + 1, data + pos, len - pos);
+			len++;
+			break;
+		}
+	}
+
+out:
+	*size = len;
+	return data;
+}
+
+static uint8_t *read_input(const char *filename, size_t *size)
+{
+	size_t len = 0, alloc = 4096;
+	uint8_t *data = malloc(alloc);
+	FILE *file = fopen(filename, "rb");
+
+	if (file == NULL) {
+		perror(filename);
+		exit(1);
+	}
+	while (!feof(file) && !ferror(file)) {
+		if (len == alloc)
+			data = realloc(data, alloc *= 2);
+		len += fread(data + len, 1, alloc - len, file);
+	}
+	fclose(file);
+
+	*size = len;
+	return data;
+}
+
+static void write_input(const char *dir, unsigned n,
+			const uint8_t *data, size_t size)
+{
+	char filename[4096];
+	FILE *file;
+
+	snprintf(filename, sizeof(filename), "%s/%06u", dir, n);
+	file = fopen(filename, "wb");
+	if (file == NULL || fwrite(data, 1, size, file) != size) {
+		perror(filename);
+		exit(1);
+	}
+	fclose(file);
+}
+
+static double now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+struct corpus {
+	struct brw_instruction *insns;
+	unsigned count, size;
+
+	/* the disassembly of those the parser takes */
+	FILE *file;
+	char *text;
+	size_t length;
+	unsigned accepted;
+};
+
+static void add_to_corpus(struct corpus *corpus, const uint8_t *data,
+			  size_t size)
+{
+	struct brw_instruction insns[MAX_INSNS_PER_INPUT];
+	struct corpus *c;
+	unsigned g, n, i;
+
+	if (size == 0 || data[0] & MODE_SOURCE)
+		return;
+
+	g = input_gen(data);
+	c = &corpus[g];
+	if (c->file == NULL)
+		c->file = open_memstream(&c->text, &c->length);
+
+	n = build(gens[g], data + 1, size - 1, insns);
+	for (i = 0; i < n; i++) {
+		if (c->count == c->size) {
+			c->size = c->size ? 2 * c->size : 1024;
+			c->insns = realloc(c->insns, c->size * sizeof(*c->insns));
+		}
+		c->insns[c->count++] = insns[i];
+
+		if (roundtrip(&insns[i], gens[g]) == MATCH) {
+			brw_disasm(c->file, &insns[i], gens[g] / 10);
+			c->accepted++;
+		}
+	}
+}
+
+/*
+ * Instructions per second in both directions, over a second or so each.
+ * All of the corpus is disassembled, the assembler gets what it takes.
+ */
+static void bench(struct corpus *corpus, int gen)
+{
+	struct gen4asm_options options;
+	double start, elapsed, disasm_rate, asm_rate = 0;
+	unsigned i, rounds;
+	FILE *null;
+
+	null = fopen("/dev/null", "w");
+	for (rounds = 0, start = now(); (elapsed = now() - start) < 1.0;
+	     rounds++) {
+		for (i = 0; i < corpus->count; i++)
+			brw_disasm(null, &corpus->insns[i], gen / 10);
+	}
+	fclose(null);
+	disasm_rate = (double)rounds * corpus->count / elapsed;
+
+	fclose(corpus->file);
+	gen4asm_options_init(&options);
+	options.gen = gen;
+	options.advanced = true;
+	for (rounds = 0, start = now();
+	     corpus->accepted && (elapsed = now() - start) < 1.0; rounds++) {
+		struct gen4asm_program *program;
+
+		program = gen4asm_assemble(corpus->text, corpus->length,
+					   &options);
+		if (program == NULL || program->num_errors) {
+			fprintf(stderr, "gen%d: corpus doesn't assemble\n",
+				gen / 10);
+			exit(1);
+		}
+		gen4asm_program_free(program);
+	}
+	if (corpus->accepted)
+		asm_rate = (double)rounds * corpus->accepted / elapsed;
+
+	printf("gen%-4.1f disassemble %8u insns %10.0f insns/s, "
+	       "assemble %8u insns %10.0f insns/s\n", gen / 10.0,
+	       corpus->count, disasm_rate, corpus->accepted, asm_rate);
+	free(corpus->text);
+}
+
+/* Parses a source in a child, so that a crash only gets counted */
+static void run_source(const uint8_t *data, size_t size)
+{
+	unsigned g = input_gen(data);
+	int status;
+	pid_t pid;
+
+	fflush(stdout);
+	pid = fork();
+	if (pid == 0) {
+		run_input(data, size);
+		_exit(0);
+	}
+	if (pid < 0 || waitpid(pid, &status, 0) != pid) {
+		perror("fork");
+		exit(1);
+	}
+
+	stats[g].sources++;
+	if (WIFSIGNALED(status)) {
+		stats[g].crashes++;
+		if (verbose)
+			fprintf(stderr, "gen%d: parser crashed on:\n%.*s\n",
+				gens[g] / 10, (int)size - 1, data + 1);
+	}
+}
+
+static void usage(void)
+{
+	fprintf(stderr, "usage: gen4asm_fuzz [options] [input...]\n"
+		"\t-n, --count N       random inputs to make up without any (10000)\n"
+		"\t-s, --seed N        for making them up (1)\n"
+		"\t-w, --write DIR     write them to DIR instead, as a corpus\n"
+		"\t-b, --bench         time both directions over the inputs\n"
+		"\t-S, --strict        fail on disassembly the parser rejects\n"
+		"\t-v, --verbose       print the crashing sources, twice for\n"
+		"\t                    the rejected instructions, too\n");
+}
+
+int main(int argc, char **argv)
+{
+	static const struct option longopts[] = {
+		{ "count", required_argument, 0, 'n' },
+		{ "seed", required_argument, 0, 's' },
+		{ "write", required_argument, 0, 'w' },
+		{ "bench", no_argument, 0, 'b' },
+		{ "strict", no_argument, 0, 'S' },
+		{ "verbose", no_argument, 0, 'v' },
+		{ NULL, 0, NULL, 0 }
+	};
+	struct corpus corpus[NUM_GENS];
+	const char *dir = NULL;
+	unsigned count = 10000, n, g, mismatches = 0, rejects = 0;
+	bool do_bench = false;
+	int o;
+
+	rand_state = 1;
+	while ((o = getopt_long(argc, argv, "n:s:w:bSv", longopts, NULL)) != -1) {
+		switch (o) {
+		case 'n':
+			count = strtoul(optarg, NULL, 0);
+			break;
+		case 's':
+			rand_state = strtoul(optarg, NULL, 0) ?: 1;
+			break;
+		case 'w':
+			dir = optarg;
+			break;
+		case 'b':
+			do_bench = true;
+			break;
+		case 'S':
+			strict = true;
+			break;
+		case 'v':
+			verbose++;
+			break;
+		default:
+			usage();
+			return 1;
+		}
+	}
+	if (optind < argc)
+		count = argc - optind;
+
+	memset(corpus, 0, sizeof(corpus));
+	for (n = 0; n < count; n++) {
+		uint8_t *data;
+		size_t size;
+
+		if (optind < argc)
+			data = read_input(argv[optind + n], &size);
+		else
+			data = random_input(&size);
+
+		if (dir)
+			write_input(dir, n, data, size);
+		else if (do_bench)
+			add_to_corpus(corpus, data, size);
+		else if (size && data[0] & MODE_SOURCE)
+			run_source(data, size);
+		else
+			run_input(data, size);
+		free(data);
+	}
+
+	if (dir)
+		return 0;
+
+	for (g = 0; g < NUM_GENS; g++) {
+		if (do_bench) {
+			if (corpus[g].count)
+				bench(&corpus[g], gens[g]);
+			free(corpus[g].insns);
+			continue;
+		}
+
+		printf("gen%-4.1f %8u insns: %u match, %u rejected, "
+		       "%u mismatch; %u sources, %u crashed\n", gens[g] / 10.0,
+		       stats[g].count[MATCH] + stats[g].count[REJECTED] +
+		       stats[g].count[MISMATCH],
+		       stats[g].count[MATCH], stats[g].count[REJECTED],
+		       stats[g].count[MISMATCH], stats[g].sources,
+		       stats[g].crashes);
+		mismatches += stats[g].count[MISMATCH] + stats[g].crashes;
+		rejects += stats[g].count[REJECTED];
+	}
+
+	return mismatches || (strict && rejects);
+}
+
+#endif
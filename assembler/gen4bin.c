@@ -0,0 +1,269 @@
+/*
+ * Copyright © 2013 Intel Corporation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <endian.h>
+
+#include "gen4bin.h"
+
+#define ALIGN(x, y) (((x) + (y) - 1) & ~((y) - 1))
+
+bool gen4bin_is_container(const void *data, size_t size)
+{
+	return size >= sizeof(struct gen4bin_header) &&
+		memcmp(data, GEN4BIN_MAGIC, 4) == 0;
+}
+
+static bool in_bounds(size_t size, uint32_t offset, uint64_t length)
+{
+	return offset <= size && length <= size - offset;
+}
+
+/* the tables are arrays of 32 bit fields */
+static void fields_from_le(void *dst, const void *src, size_t size)
+{
+	uint32_t *d = dst;
+	size_t n;
+
+	memcpy(dst, src, size);
+	for (n = 0; n < size / 4; n++)
+		d[n] = le32toh(d[n]);
+}
+
+static void fields_to_le(void *data, size_t size)
+{
+	uint32_t *d = data;
+	size_t n;
+
+	for (n = 0; n < size / 4; n++)
+		d[n] = htole32(d[n]);
+}
+
+/**
+ * gen4bin_parse - validate a container and locate its tables
+ *
+ * Returns 0 on success, -ENOMEM if the tables can't be copied, or -EINVAL
+ * if the data is not a well-formed container of a version we understand.
+ */
+int gen4bin_parse(const void *data, size_t size, struct gen4bin_image *image)
+{
+	struct gen4bin_header *h = &image->header;
+	const char *base = data;
+	unsigned n;
+
+	memset(image, 0, sizeof(*image));
+	if (!gen4bin_is_container(data, size))
+		return -EINVAL;
+
+	/* the magic is bytes, it stays as it is */
+	fields_from_le(h, data, sizeof(*h));
+	memcpy(h->magic, data, sizeof(h->magic));
+	if (h->version != GEN4BIN_VERSION)
+		return -EINVAL;
+
+	if (h->code_size % 16 ||
+	    !in_bounds(size, h->code_offset, h->code_size) ||
+	    !in_bounds(size, h->symbol_offset,
+		       (uint64_t)h->num_symbols * sizeof(struct gen4bin_symbol)) ||
+	    !in_bounds(size, h->reloc_offset,
+		       (uint64_t)h->num_relocs * sizeof(struct gen4bin_reloc)) ||
+	    !in_bounds(size, h->strtab_offset, h->strtab_size))
+		return -EINVAL;
+
+	if (h->code_offset % 4 || h->symbol_offset % 4 || h->reloc_offset % 4)
+		return -EINVAL;
+
+	/* every name must be terminated within the string table */
+	if (h->num_symbols &&
+	    (h->strtab_size == 0 || base[h->strtab_offset + h->strtab_size - 1]))
+		return -EINVAL;
+
+	image->code = base + h->code_offset;
+	image->code_size = h->code_size;
+	image->num_symbols = h->num_symbols;
+	image->num_relocs = h->num_relocs;
+	image->strtab = base + h->strtab_offset;
+
+	image->symbols = calloc(h->num_symbols ?: 1, sizeof(*image->symbols));
+	image->relocs = calloc(h->num_relocs ?: 1, sizeof(*image->relocs));
+	if (image->symbols == NULL || image->relocs == NULL) {
+		gen4bin_fini(image);
+		return -ENOMEM;
+	}
+	fields_from_le(image->symbols, base + h->symbol_offset,
+		       h->num_symbols * sizeof(*image->symbols));
+	fields_from_le(image->relocs, base + h->reloc_offset,
+		       h->num_relocs * sizeof(*image->relocs));
+
+	for (n = 0; n < image->num_symbols; n++)
+		if (image->symbols[n].name >= h->strtab_size)
+			goto err;
+	for (n = 0; n < image->num_relocs; n++)
+		if (image->relocs[n].symbol >= image->num_symbols)
+			goto err;
+
+	return 0;
+
+err:
+	gen4bin_fini(image);
+	return -EINVAL;
+}
+
+void gen4bin_fini(struct gen4bin_image *image)
+{
+	free(image->symbols);
+	free(image->relocs);
+	image->symbols = NULL;
+	image->relocs = NULL;
+}
+
+char *gen4bin_read_file(FILE *file, size_t *length)
+{
+	size_t size = 0, len = 0;
+	char *data = NULL;
+
+	do {
+		if (size - len < 4096) {
+			size = size * 2 + 4096;
+			data = realloc(data, size);
+			if (data == NULL)
+				return NULL;
+		}
+		len += fread(data + len, 1, size - len, file);
+	} while (!feof(file) && !ferror(file));
+
+	if (ferror(file)) {
+		free(data);
+		return NULL;
+	}
+
+	*length = len;
+	return data;
+}
+
+static int write_padding(FILE *file, size_t length)
+{
+	static const char zero[GEN4BIN_CODE_ALIGN];
+
+	return fwrite(zero, 1, length, file) == length ? 0 : -EIO;
+}
+
+/**
+ * gen4bin_write - store an assembled program as a container
+ *
+ * Labels are always stored, as the relocations refer to them; with
+ * @export_labels they are also marked for export, like -e does for the
+ * C include file.
+ */
+int gen4bin_write(FILE *file, const struct gen4asm_program *program,
+		  bool export_labels)
+{
+	struct gen4bin_header h, le;
+	struct gen4bin_symbol *symbols;
+	struct gen4bin_reloc *relocs;
+	uint32_t strtab_size = 0, offset;
+	unsigned n;
+	int ret = -EIO;
+
+	symbols = calloc(program->num_labels ?: 1, sizeof(*symbols));
+	relocs = calloc(program->num_relocations ?: 1, sizeof(*relocs));
+	if (symbols == NULL || relocs == NULL) {
+		ret = -ENOMEM;
+		goto out;
+	}
+
+	for (n = 0; n < program->num_labels; n++) {
+		const struct gen4asm_label *label = &program->labels[n];
+
+		symbols[n].name = strtab_size;
+		symbols[n].offset = label->offset;
+		if (label->entry_point)
+			symbols[n].flags |= GEN4BIN_SYMBOL_ENTRY_POINT;
+		if (export_labels)
+			symbols[n].flags |= GEN4BIN_SYMBOL_EXPORT;
+		strtab_size += strlen(label->name) + 1;
+	}
+
+	for (n = 0; n < program->num_relocations; n++) {
+		const struct gen4asm_relocation *r = &program->relocations[n];
+
+		relocs[n].offset = r->offset;
+		relocs[n].type = r->type == GEN4ASM_RELOC_UIP ?
+			GEN4BIN_RELOC_UIP : GEN4BIN_RELOC_JIP;
+		relocs[n].symbol = r->label;
+	}
+
+	memset(&h, 0, sizeof(h));
+	memcpy(h.magic, GEN4BIN_MAGIC, 4);
+	h.version = GEN4BIN_VERSION;
+	h.gen = program->gen;
+
+	offset = sizeof(h);
+	h.symbol_offset = offset;
+	h.num_symbols = program->num_labels;
+	offset += h.num_symbols * sizeof(*symbols);
+
+	h.reloc_offset = offset;
+	h.num_relocs = program->num_relocations;
+	offset += h.num_relocs * sizeof(*relocs);
+
+	h.strtab_offset = offset;
+	h.strtab_size = strtab_size;
+	offset += strtab_size;
+
+	h.code_offset = ALIGN(offset, GEN4BIN_CODE_ALIGN);
+	h.code_size = program->size;
+
+	le = h;
+	fields_to_le(&le, sizeof(le));
+	memcpy(le.magic, GEN4BIN_MAGIC, 4);
+	fields_to_le(symbols, h.num_symbols * sizeof(*symbols));
+	fields_to_le(relocs, h.num_relocs * sizeof(*relocs));
+
+	if (fwrite(&le, sizeof(le), 1, file) != 1)
+		goto out;
+	if (h.num_symbols &&
+	    fwrite(symbols, sizeof(*symbols), h.num_symbols, file) != h.num_symbols)
+		goto out;
+	if (h.num_relocs &&
+	    fwrite(relocs, sizeof(*relocs), h.num_relocs, file) != h.num_relocs)
+		goto out;
+	for (n = 0; n < program->num_labels; n++) {
+		const char *name = program->labels[n].name;
+
+		if (fwrite(name, strlen(name) + 1, 1, file) != 1)
+			goto out;
+	}
+	if (write_padding(file, h.code_offset - offset))
+		goto out;
+	if (h.code_size && fwrite(program->code, h.code_size, 1, file) != 1)
+		goto out;
+
+	ret = 0;
+out:
+	free(symbols);
+	free(relocs);
+	return ret;
+}
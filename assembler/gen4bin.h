@@ -0,0 +1,122 @@
+/*
+ * Copyright © 2013 Intel Corporation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef __GEN4BIN_H__
+#define __GEN4BIN_H__
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include "libgen4asm.h"
+
+/*
+ * A small container for assembled kernels, so that they can be mmapped and
+ * uploaded at runtime instead of being compiled in as C arrays.
+ *
+ * All fields are little-endian. The file starts with a struct gen4bin_header,
+ * the other tables are found through the offsets in there. The code is
+ * aligned to 64 bytes within the file, so entry points stay cacheline
+ * aligned when the file is mapped as is.
+ *
+ * gen4bin_parse() hands out the header, symbols and relocations converted
+ * to host byte order; the code and string table point into the caller's
+ * buffer.
+ */
+
+#define GEN4BIN_MAGIC		"G4BN"
+#define GEN4BIN_VERSION		1
+#define GEN4BIN_CODE_ALIGN	64
+
+struct gen4bin_header {
+	char magic[4];
+	uint32_t version;
+	uint32_t gen;			/* 10 * generation, as for -g */
+	uint32_t flags;			/* none defined yet */
+
+	uint32_t code_offset;
+	uint32_t code_size;		/* in bytes */
+
+	uint32_t symbol_offset;
+	uint32_t num_symbols;
+
+	uint32_t reloc_offset;
+	uint32_t num_relocs;
+
+	uint32_t strtab_offset;
+	uint32_t strtab_size;
+};
+
+#define GEN4BIN_SYMBOL_ENTRY_POINT	(1 << 0)
+#define GEN4BIN_SYMBOL_EXPORT		(1 << 1)
+
+/* one per label, in program order */
+struct gen4bin_symbol {
+	uint32_t name;			/* offset into the string table */
+	uint32_t offset;		/* in bytes */
+	uint32_t flags;
+};
+
+#define GEN4BIN_RELOC_JIP	0
+#define GEN4BIN_RELOC_UIP	1
+
+/* a branch target, already applied to the code */
+struct gen4bin_reloc {
+	uint32_t offset;		/* of the branch, in bytes */
+	uint32_t type;
+	uint32_t symbol;		/* index of the target */
+};
+
+/* A parsed container, release it with gen4bin_fini() */
+struct gen4bin_image {
+	struct gen4bin_header header;
+	const void *code;
+	size_t code_size;
+	struct gen4bin_symbol *symbols;
+	unsigned num_symbols;
+	struct gen4bin_reloc *relocs;
+	unsigned num_relocs;
+	const char *strtab;
+};
+
+bool gen4bin_is_container(const void *data, size_t size);
+int gen4bin_parse(const void *data, size_t size, struct gen4bin_image *image);
+void gen4bin_fini(struct gen4bin_image *image);
+
+/*
+ * Slurp all of a stream which can't be mapped, such as a pipe, to look for a
+ * container or assemble it from memory. Free the result.
+ */
+char *gen4bin_read_file(FILE *file, size_t *length);
+
+static inline const char *
+gen4bin_symbol_name(const struct gen4bin_image *image,
+		    const struct gen4bin_symbol *symbol)
+{
+	return image->strtab + symbol->name;
+}
+
+int gen4bin_write(FILE *file, const struct gen4asm_program *program,
+		  bool export_labels);
+
+#endif /* __GEN4BIN_H__ */
@@ -35,7 +35,7 @@
 #include "gen4asm.h"
 #include "brw_eu.h"
 
-#define DEFAULT_EXECSIZE (ffs(program_defaults.execute_size) - 1)
+#define DEFAULT_EXECSIZE (ffs(gen4asm_ctx->defaults.execute_size) - 1)
 #define DEFAULT_DSTREGION -1
 
 #define SWIZZLE(reg) (reg.dw1.bits.swizzle)
@@ -51,7 +51,6 @@ typedef struct YYLTYPE
  int last_column;
 } YYLTYPE;
 
-extern int need_export;
 static struct src_operand src_null_reg =
 {
     .reg.file = BRW_ARCHITECTURE_REGISTER_FILE,
@@ -123,23 +122,23 @@ enum message_level {
 static void message(enum message_level level, YYLTYPE *location,
 		    const char *fmt, ...)
 {
-    static const char *level_str[] = { "warning", "error" };
+    static const enum gen4asm_severity severity[] = {
+	GEN4ASM_WARNING, GEN4ASM_ERROR
+    };
     va_list args;
 
+    va_start(args, fmt);
     if (location)
-	fprintf(stderr, "%s:%d:%d: %s: ", input_filename, location->first_line,
-		location->first_column, level_str[level]);
+	gen4asm_vmessage(severity[level], location->first_line,
+			 location->first_column, fmt, args);
     else
-	fprintf(stderr, "%s:%s: ", input_filename, level_str[level]);
-
-    va_start(args, fmt);
-    vfprintf(stderr, fmt, args);
+	gen4asm_vmessage(severity[level], 0, 0, fmt, args);
     va_end(args);
 }
 
 #define warn(flag, l, fmt, ...)					\
     do {							\
-	if (warning_flags & WARN_ ## flag)			\
+	if (gen4asm_ctx->warning_flags & WARN_ ## flag)	\
 	    message(WARN, l, fmt, ## __VA_ARGS__);	\
     } while(0)
 
@@ -205,36 +204,40 @@ static void brw_program_append_entry(struct brw_program *p,
 
 static void
 brw_program_add_instruction(struct brw_program *p,
-			    struct brw_program_instruction *instruction)
+			    struct brw_program_instruction *instruction,
+			    int line)
 {
     struct brw_program_instruction *list_entry;
 
-    list_entry = calloc(sizeof(struct brw_program_instruction), 1);
+    list_entry = arena_new(&gen4asm_ctx->arena, struct brw_program_instruction);
     list_entry->type = GEN4ASM_INSTRUCTION_GEN;
+    list_entry->line = line;
     list_entry->insn.gen = instruction->insn.gen;
     brw_program_append_entry(p, list_entry);
 }
 
 static void
 brw_program_add_relocatable(struct brw_program *p,
-			    struct brw_program_instruction *instruction)
+			    struct brw_program_instruction *instruction,
+			    int line)
 {
     struct brw_program_instruction *list_entry;
 
-    list_entry = calloc(sizeof(struct brw_program_instruction), 1);
+    list_entry = arena_new(&gen4asm_ctx->arena, struct brw_program_instruction);
     list_entry->type = GEN4ASM_INSTRUCTION_GEN_RELOCATABLE;
+    list_entry->line = line;
     list_entry->insn.gen = instruction->insn.gen;
     list_entry->reloc = instruction->reloc;
     brw_program_append_entry(p, list_entry);
 }
 
-static void brw_program_add_label(struct brw_program *p, const char *label)
+static void brw_program_add_label(struct brw_program *p, char *label)
 {
     struct brw_program_instruction *list_entry;
 
-    list_entry = calloc(sizeof(struct brw_program_instruction), 1);
+    list_entry = arena_new(&gen4asm_ctx->arena, struct brw_program_instruction);
     list_entry->type = GEN4ASM_INSTRUCTION_LABEL;
-    list_entry->insn.label.name = strdup(label);
+    list_entry->insn.label.name = label;
     brw_program_append_entry(p, list_entry);
 }
 
@@ -288,17 +291,22 @@ static bool validate_src_reg(struct brw_instruction *insn,
 	return false;
     }
 
-    assert(reg.hstride >= 0 && reg.hstride < ARRAY_SIZE(hstride_for_reg));
+    if (reg.hstride < 0 || reg.hstride >= ARRAY_SIZE(hstride_for_reg) ||
+	(reg.vstride != 0xf &&
+	 (reg.vstride < 0 || reg.vstride >= ARRAY_SIZE(vstride_for_reg))) ||
+	reg.width < 0 || reg.width >= ARRAY_SIZE(width_for_reg))
+    {
+	error(location, "invalid source region\n");
+	return false;
+    }
+
     hstride = hstride_for_reg[reg.hstride];
 
-    if (reg.vstride == 0xf) {
+    if (reg.vstride == 0xf)
 	vstride = -1;
-    } else {
-	assert(reg.vstride >= 0 && reg.vstride < ARRAY_SIZE(vstride_for_reg));
+    else
 	vstride = vstride_for_reg[reg.vstride];
-    }
 
-    assert(reg.width >= 0 && reg.width < ARRAY_SIZE(width_for_reg));
     width = width_for_reg[reg.width];
 
     assert(insn->header.execution_size >= 0 &&
@@ -307,6 +315,21 @@ static bool validate_src_reg(struct brw_instruction *insn,
 
     /* Register Region Restrictions */
 
+    /* A. ExecSize must be greater than or equal to Width. */
+    if (execsize < width) {
+	error(location, "execution size %d is smaller than region width %d\n",
+	      execsize, width);
+	return false;
+    }
+
+    /* C. If VertStride = HorzStride = 0, Width must be 1 regardless of the
+     * value of ExecSize. */
+    if (vstride == 0 && hstride == 0 && width != 1) {
+	error(location, "region strides are 0 but width is %d "
+	      "(should be 1)\n", width);
+	return false;
+    }
+
     /* B. If ExecSize = Width and HorzStride ≠ 0, VertStride must be set to
      * Width * HorzStride. */
     if (execsize == width && hstride != 0) {
@@ -346,7 +369,7 @@ static int get_subreg_address(unsigned regfile, unsigned type, unsigned subreg,
     assert(address_mode == BRW_ADDRESS_DIRECT);
     assert(regfile != BRW_IMMEDIATE_VALUE);
 
-    if (advanced_flag)
+    if (gen4asm_ctx->advanced_flag)
 	unit_size = get_type_size(type);
 
     return subreg * unit_size;
@@ -372,7 +395,7 @@ static int get_subreg_address(unsigned regfile, unsigned type, unsigned subreg,
  */
 static int get_indirect_subreg_address(unsigned subreg)
 {
-    return advanced_flag == 0 ? subreg / 2 : subreg;
+    return gen4asm_ctx->advanced_flag == 0 ? subreg / 2 : subreg;
 }
 
 static void resolve_subnr(struct brw_reg *reg)
@@ -390,6 +413,9 @@ static void resolve_subnr(struct brw_reg *reg)
 
 %}
 %locations
+%define api.pure full
+%parse-param {void *scanner}
+%lex-param {void *scanner}
 
 %start ROOT
 
@@ -426,6 +452,7 @@ static void resolve_subnr(struct brw_reg *reg)
 
 %token ALIGN1 ALIGN16 SECHALF COMPR SWITCH ATOMIC NODDCHK NODDCLR
 %token MASK_DISABLE BREAKPOINT ACCWRCTRL EOT
+%token WE_NORMAL QTR_1Q QTR_2Q QTR_3Q QTR_4Q QTR_1H QTR_2H
 
 %token SEQ ANY2H ALL2H ANY4H ALL4H ANY8H ALL8H ANY16H ALL16H ANYV ALLV
 %token <integer> ZERO EQUAL NOT_ZERO NOT_EQUAL GREATER GREATER_EQUAL LESS LESS_EQUAL
@@ -495,10 +522,10 @@ static void resolve_subnr(struct brw_reg *reg)
 %type <integer> unaryop binaryop binaryaccop breakop
 %type <integer> trinaryop
 %type <integer> sendop
-%type <condition> conditionalmodifier 
+%type <condition> conditionalmodifier cond_saturate
 %type <predicate> predicate
 %type <options> instoptions instoption_list
-%type <integer> condition saturate negate abs chansel
+%type <integer> condition condition_nonempty saturate negate abs chansel
 %type <integer> writemask_x writemask_y writemask_z writemask_w
 %type <integer> srcimmtype execsize dstregion immaddroffset
 %type <integer> subregnum sampler_datatype
@@ -528,6 +555,10 @@ static void resolve_subnr(struct brw_reg *reg)
 
 %code {
 
+int yylex(YYSTYPE *lvalp, YYLTYPE *llocp, void *scanner);
+char *yyget_text(void *scanner);
+static void yyerror(YYLTYPE *location, void *scanner, const char *msg);
+
 #undef error
 #define error(l, fmt, ...)			\
     do {					\
@@ -575,6 +606,30 @@ static void add_option(struct options *options, int option)
     case EOT:
 	options->end_of_thread = 1;
 	break;
+    case QTR_1Q:
+	if (IS_GENp(6))
+	    options->compression_control = GEN6_COMPRESSION_1Q;
+	break;
+    case QTR_2Q:
+	if (IS_GENp(6))
+	    options->compression_control = GEN6_COMPRESSION_2Q;
+	break;
+    case QTR_3Q:
+	if (IS_GENp(6))
+	    options->compression_control = GEN6_COMPRESSION_3Q;
+	break;
+    case QTR_4Q:
+	if (IS_GENp(6))
+	    options->compression_control = GEN6_COMPRESSION_4Q;
+	break;
+    case QTR_1H:
+	if (IS_GENp(6))
+	    options->compression_control = GEN6_COMPRESSION_1H;
+	break;
+    case QTR_2H:
+	if (IS_GENp(6))
+	    options->compression_control = GEN6_COMPRESSION_2H;
+	break;
     }
 }
 
@@ -596,7 +651,7 @@ exp:		INTEGER { $$ = $1; }
 
 ROOT:		instrseq
 		{
-		  compiled_program = $1;
+		  gen4asm_ctx->program = $1;
 		}
 ;
 
@@ -651,16 +706,19 @@ declare_pragma:	DECLARE_PRAGMA STRING declare_base declare_elementsize declare_s
 		    reg.src_region = $5;
 		    reg.dst_region = $6;
 		    reg.reg.type = $7;
+		    reg.line = @1.first_line;
+		    reg.uses = 0;
 
 		    found = find_register($2);
 		    if (found) {
 		        if (!declared_register_equal(&reg, found))
 			    error(&@1, "%s already defined and definitions "
 				  "don't agree\n", $2);
-			free($2); // $2 has been malloc'ed by strdup
 		    } else {
-			new_reg = malloc(sizeof(struct declared_register));
+			new_reg = arena_new(&gen4asm_ctx->arena,
+					    struct declared_register);
 			*new_reg = reg;
+			new_reg->name = $2;
 			insert_register(new_reg);
 		    }
 		}
@@ -673,12 +731,12 @@ reg_count_payload_pragma: 	REG_COUNT_PAYLOAD_PRAGMA exp
 
 default_exec_size_pragma:	DEFAULT_EXEC_SIZE_PRAGMA exp
 				{
-				    program_defaults.execute_size = $2;
+				    gen4asm_ctx->defaults.execute_size = $2;
 				}
 ;
 default_reg_type_pragma:	DEFAULT_REG_TYPE_PRAGMA regtype
 				{
-				    program_defaults.register_type = $2.type;
+				    gen4asm_ctx->defaults.register_type = $2.type;
 				}
 ;
 pragma:		reg_count_total_pragma
@@ -694,23 +752,23 @@ instrseq:	instrseq pragma
 		}
 		| instrseq instruction SEMICOLON
 		{
-		  brw_program_add_instruction(&$1, &$2);
+		  brw_program_add_instruction(&$1, &$2, @2.last_line);
 		  $$ = $1;
 		}
 		| instruction SEMICOLON
 		{
 		  brw_program_init(&$$);
-		  brw_program_add_instruction(&$$, &$1);
+		  brw_program_add_instruction(&$$, &$1, @1.last_line);
 		}
 		| instrseq relocatableinstruction SEMICOLON
 		{
-		  brw_program_add_relocatable(&$1, &$2);
+		  brw_program_add_relocatable(&$1, &$2, @2.last_line);
 		  $$ = $1;
 		}
 		| relocatableinstruction SEMICOLON
 		{
 		  brw_program_init(&$$);
-		  brw_program_add_relocatable(&$$, &$1);
+		  brw_program_add_relocatable(&$$, &$1, @1.last_line);
 		}
 		| instrseq SEMICOLON
 		{
@@ -993,22 +1051,22 @@ subroutineinstruction:
 ;
 
 unaryinstruction:
-		predicate unaryop conditionalmodifier saturate execsize
+		predicate unaryop cond_saturate execsize
 		dst srcaccimm instoptions
 		{
 		  memset(&$$, 0, sizeof($$));
 		  set_instruction_opcode(&$$, $2);
-		  set_instruction_saturate(&$$, $4);
-		  $6.width = $5;
-		  set_instruction_options(&$$, $8);
+		  set_instruction_saturate(&$$, $3.saturate);
+		  $5.width = $4;
+		  set_instruction_options(&$$, $7);
 		  set_instruction_pred_cond(&$$, &$1, &$3, &@3);
-		  if (set_instruction_dest(&$$, &$6) != 0)
+		  if (set_instruction_dest(&$$, &$5) != 0)
 		    YYERROR;
-		  if (set_instruction_src0(&$$, &$7, &@7) != 0)
+		  if (set_instruction_src0(&$$, &$6, &@6) != 0)
 		    YYERROR;
 
 		  if (!IS_GENp(6) && 
-				get_type_size(GEN(&$$)->bits1.da1.dest_reg_type) * (1 << $6.width) == 64)
+				get_type_size(GEN(&$$)->bits1.da1.dest_reg_type) * (1 << $5.width) == 64)
 		    GEN(&$$)->header.compression_control = BRW_COMPRESSION_COMPRESSED;
 		}
 ;
@@ -1019,24 +1077,24 @@ unaryop:	MOV | FRC | RNDU | RNDD | RNDE | RNDZ | NOT | LZD | BFREV | CBIT
 
 // Source operands cannot be accumulators
 binaryinstruction:
-		predicate binaryop conditionalmodifier saturate execsize
+		predicate binaryop cond_saturate execsize
 		dst src srcimm instoptions
 		{
 		  memset(&$$, 0, sizeof($$));
 		  set_instruction_opcode(&$$, $2);
-		  set_instruction_saturate(&$$, $4);
-		  set_instruction_options(&$$, $9);
+		  set_instruction_saturate(&$$, $3.saturate);
+		  set_instruction_options(&$$, $8);
 		  set_instruction_pred_cond(&$$, &$1, &$3, &@3);
-		  $6.width = $5;
-		  if (set_instruction_dest(&$$, &$6) != 0)
+		  $5.width = $4;
+		  if (set_instruction_dest(&$$, &$5) != 0)
 		    YYERROR;
-		  if (set_instruction_src0(&$$, &$7, &@7) != 0)
+		  if (set_instruction_src0(&$$, &$6, &@6) != 0)
 		    YYERROR;
-		  if (set_instruction_src1(&$$, &$8, &@8) != 0)
+		  if (set_instruction_src1(&$$, &$7, &@7) != 0)
 		    YYERROR;
 
 		  if (!IS_GENp(6) && 
-				get_type_size(GEN(&$$)->bits1.da1.dest_reg_type) * (1 << $6.width) == 64)
+				get_type_size(GEN(&$$)->bits1.da1.dest_reg_type) * (1 << $5.width) == 64)
 		    GEN(&$$)->header.compression_control = BRW_COMPRESSION_COMPRESSED;
 		}
 ;
@@ -1047,24 +1105,24 @@ binaryop:	MUL | MAC | MACH | LINE | SAD2 | SADA2 | DP4 | DPH | DP3 | DP2 | PLN |
 
 // Source operands can be accumulators
 binaryaccinstruction:
-		predicate binaryaccop conditionalmodifier saturate execsize
+		predicate binaryaccop cond_saturate execsize
 		dst srcacc srcimm instoptions
 		{
 		  memset(&$$, 0, sizeof($$));
 		  set_instruction_opcode(&$$, $2);
-		  set_instruction_saturate(&$$, $4);
-		  $6.width = $5;
-		  set_instruction_options(&$$, $9);
+		  set_instruction_saturate(&$$, $3.saturate);
+		  $5.width = $4;
+		  set_instruction_options(&$$, $8);
 		  set_instruction_pred_cond(&$$, &$1, &$3, &@3);
-		  if (set_instruction_dest(&$$, &$6) != 0)
+		  if (set_instruction_dest(&$$, &$5) != 0)
 		    YYERROR;
-		  if (set_instruction_src0(&$$, &$7, &@7) != 0)
+		  if (set_instruction_src0(&$$, &$6, &@6) != 0)
 		    YYERROR;
-		  if (set_instruction_src1(&$$, &$8, &@8) != 0)
+		  if (set_instruction_src1(&$$, &$7, &@7) != 0)
 		    YYERROR;
 
 		  if (!IS_GENp(6) && 
-				get_type_size(GEN(&$$)->bits1.da1.dest_reg_type) * (1 << $6.width) == 64)
+				get_type_size(GEN(&$$)->bits1.da1.dest_reg_type) * (1 << $5.width) == 64)
 		    GEN(&$$)->header.compression_control = BRW_COMPRESSION_COMPRESSED;
 		}
 ;
@@ -1077,7 +1135,7 @@ trinaryop:	MAD | LRP | BFE | BFI2
 ;
 
 trinaryinstruction:
-		predicate trinaryop conditionalmodifier saturate execsize
+		predicate trinaryop cond_saturate execsize
 		dst src src src instoptions
 {
 		  memset(&$$, 0, sizeof($$));
@@ -1085,18 +1143,18 @@ trinaryinstruction:
 		  set_instruction_pred_cond(&$$, &$1, &$3, &@3);
 
 		  set_instruction_opcode(&$$, $2);
-		  set_instruction_saturate(&$$, $4);
+		  set_instruction_saturate(&$$, $3.saturate);
 
-		  $6.width = $5;
-		  if (set_instruction_dest_three_src(&$$, &$6))
+		  $5.width = $4;
+		  if (set_instruction_dest_three_src(&$$, &$5))
 		    YYERROR;
-		  if (set_instruction_src0_three_src(&$$, &$7))
+		  if (set_instruction_src0_three_src(&$$, &$6))
 		    YYERROR;
-		  if (set_instruction_src1_three_src(&$$, &$8))
+		  if (set_instruction_src1_three_src(&$$, &$7))
 		    YYERROR;
-		  if (set_instruction_src2_three_src(&$$, &$9))
+		  if (set_instruction_src2_three_src(&$$, &$8))
 		    YYERROR;
-		  set_instruction_options(&$$, $10);
+		  set_instruction_options(&$$, $9);
 }
 ;
 
@@ -1364,7 +1422,7 @@ jumpinstruction: predicate JMPI execsize relativelocation2
 		   */
 		  memset(&$$, 0, sizeof($$));
 		  set_instruction_opcode(&$$, $2);
-		  if(advanced_flag)
+		  if(gen4asm_ctx->advanced_flag)
 			GEN(&$$)->header.mask_control = BRW_MASK_DISABLE;
 		  set_instruction_predicate(&$$, &$1);
 		  ip_dst.width = BRW_WIDTH_1;
@@ -1696,7 +1754,7 @@ msgtarget:	NULL_TOKEN
 		} 
 		| CRE LPAREN INTEGER COMMA INTEGER RPAREN
 		{
-		   if (gen_level < 75)
+		   if (gen4asm_ctx->gen_level < 75)
                       error (&@1, "Below Gen7.5 doesn't have CRE function\n");
 
 		   GEN(&$$)->bits3.generic.msg_target = HSW_SFID_CRE;
@@ -1843,9 +1901,10 @@ symbol_reg:	STRING %prec STR_SYMBOL_REG
 
 		    if (dcl_reg == NULL)
 			error(&@1, "can't find register %s\n", $1);
+		    else
+			dcl_reg->uses++;
 
 		    memcpy(&$$, dcl_reg, sizeof(*dcl_reg));
-		    free($1); // $1 has been malloc'ed by strdup
 		}
 		| symbol_reg_p 
 		{
@@ -1859,10 +1918,11 @@ symbol_reg_p: STRING LPAREN exp RPAREN
 
 		    if (dcl_reg == NULL)
 			error(&@1, "can't find register %s\n", $1);
+		    else
+			dcl_reg->uses++;
 
 		    memcpy(&$$, dcl_reg, sizeof(*dcl_reg));
 		    $$.reg.nr += $3;
-		    free($1);
 		}
 		| STRING LPAREN exp COMMA exp RPAREN
 		{
@@ -1870,10 +1930,12 @@ symbol_reg_p: STRING LPAREN exp RPAREN
 
 		    if (dcl_reg == NULL)
 			error(&@1, "can't find register %s\n", $1);
+		    else
+			dcl_reg->uses++;
 
 		    memcpy(&$$, dcl_reg, sizeof(*dcl_reg));
 		    $$.reg.nr += $3;
-		    if(advanced_flag) {
+		    if(gen4asm_ctx->advanced_flag) {
 			int size = get_type_size(dcl_reg->reg.type);
 		        $$.reg.nr += ($$.reg.subnr + $5) / (32 / size);
 		        $$.reg.subnr = ($$.reg.subnr + $5) % (32 / size);
@@ -1881,7 +1943,6 @@ symbol_reg_p: STRING LPAREN exp RPAREN
 		        $$.reg.nr += ($$.reg.subnr + $5) / 32;
 		        $$.reg.subnr = ($$.reg.subnr + $5) % 32;
 		    }
-		    free($1);
 		}
 ;
 /* Returns a partially complete destination register consisting of the
@@ -1958,7 +2019,7 @@ imm32reg:	imm32 srcimmtype
 		      intfloat.f = $1.u.f;
 		      break;
 		    case imm32_d:
-		      intfloat.f = (float) $1.u.d;
+		      intfloat.f = (float) $1.u.signed_d;
 		      break;
 		    default:
 		      error (&@2, "non-float F representation\n");
@@ -2174,6 +2235,10 @@ subregnum:	DOT exp
 
 directgenreg:	GENREG subregnum
 		{
+		  if ($1 >= 128) {
+		    error(&@1, "general register number %d out of range\n", $1);
+		    $1 = 0;
+		  }
 		  memset (&$$, '\0', sizeof ($$));
 		  $$.file = BRW_GENERAL_REGISTER_FILE;
 		  $$.nr = $1;
@@ -2192,6 +2257,10 @@ indirectgenreg: GENREGFILE LSQUARE addrparam RSQUARE
 
 directmsgreg:	MSGREG subregnum
 		{
+		  if ($1 >= 16) {
+		    error(&@1, "message register number %d out of range\n", $1);
+		    $1 = 0;
+		  }
 		  memset (&$$, '\0', sizeof ($$));
 		  $$.file = BRW_MESSAGE_REGISTER_FILE;
 		  $$.nr = $1;
@@ -2539,7 +2608,7 @@ indirectregion:	region | region_wh
  * instruction.
  */
 regtype:	/* empty */
-		{ $$.type = program_defaults.register_type;$$.is_default = 1;}
+		{ $$.type = gen4asm_ctx->defaults.register_type;$$.is_default = 1;}
 		| TYPE_F { $$.type = BRW_REGISTER_TYPE_F;$$.is_default = 0; }
 		| TYPE_UD { $$.type = BRW_REGISTER_TYPE_UD;$$.is_default = 0; }
 		| TYPE_D { $$.type = BRW_REGISTER_TYPE_D;$$.is_default = 0; }
@@ -2668,7 +2737,7 @@ abs:		/* empty */ { $$ = 0; }
 
 execsize:	/* empty */ %prec EMPTEXECSIZE
 		{
-		  $$ = ffs(program_defaults.execute_size) - 1;
+		  $$ = ffs(gen4asm_ctx->defaults.execute_size) - 1;
 		}
 		|LPAREN exp RPAREN
 		{
@@ -2700,7 +2769,10 @@ conditionalmodifier: condition
 		}
 
 condition: /* empty */    { $$ = BRW_CONDITIONAL_NONE; }
-		| ZERO
+		| condition_nonempty
+;
+
+condition_nonempty: ZERO
 		| EQUAL
 		| NOT_ZERO
 		| NOT_EQUAL
@@ -2713,6 +2785,38 @@ condition: /* empty */    { $$ = BRW_CONDITIONAL_NONE; }
 		| UNORDERED
 ;
 
+/*
+ * The conditional modifier and saturation, in either order: brw_disasm()
+ * prints .sat first.
+ */
+cond_saturate:	/* empty */
+		{
+		    $$.cond = BRW_CONDITIONAL_NONE;
+		    $$.flag_reg_nr = 0;
+		    $$.flag_subreg_nr = -1;
+		    $$.saturate = BRW_INSTRUCTION_NORMAL;
+		}
+		| condition_nonempty saturate
+		{
+		    $$.cond = $1;
+		    $$.flag_reg_nr = 0;
+		    $$.flag_subreg_nr = -1;
+		    $$.saturate = $2;
+		}
+		| condition_nonempty DOT flagreg saturate
+		{
+		    $$.cond = $1;
+		    $$.flag_reg_nr = ($3.nr & 0xF);
+		    $$.flag_subreg_nr = $3.subnr;
+		    $$.saturate = $4;
+		}
+		| SATURATE conditionalmodifier
+		{
+		    $$ = $2;
+		    $$.saturate = BRW_INSTRUCTION_SATURATE;
+		}
+;
+
 /* 1.4.13: Instruction options */
 instoptions:	/* empty */
 		{ memset(&$$, 0, sizeof($$)); }
@@ -2748,16 +2852,22 @@ instoption:	ALIGN1 { $$ = ALIGN1; }
 		| BREAKPOINT { $$ = BREAKPOINT; }
 		| ACCWRCTRL { $$ = ACCWRCTRL; }
 		| EOT { $$ = EOT; }
+		| WE_NORMAL { $$ = WE_NORMAL; }
+		| QTR_1Q { $$ = QTR_1Q; }
+		| QTR_2Q { $$ = QTR_2Q; }
+		| QTR_3Q { $$ = QTR_3Q; }
+		| QTR_4Q { $$ = QTR_4Q; }
+		| QTR_1H { $$ = QTR_1H; }
+		| QTR_2H { $$ = QTR_2H; }
 ;
 
 %%
-extern int yylineno;
 
-void yyerror (char *msg)
+static void yyerror(YYLTYPE *location, void *scanner, const char *msg)
 {
-	fprintf(stderr, "%s: %d: %s at \"%s\"\n",
-		input_filename, yylineno, msg, lex_text());
-	++errors;
+	gen4asm_message(GEN4ASM_ERROR, location->first_line,
+			location->first_column, "%s at \"%s\"\n",
+			msg, yyget_text(scanner));
 }
 
 static int get_type_size(unsigned type)
@@ -2878,7 +2988,7 @@ static int set_instruction_dest(struct brw_program_instruction *instr,
 	 * elements. */
 	resolve_subnr(dest);
 
-	brw_set_dest(&genasm_compile, GEN(instr), *dest);
+	brw_set_dest(&gen4asm_ctx->compile, GEN(instr), *dest);
 
 	return 0;
 }
@@ -2889,7 +2999,7 @@ static int set_instruction_src0(struct brw_program_instruction *instr,
 				YYLTYPE *location)
 {
 
-	if (advanced_flag)
+	if (gen4asm_ctx->advanced_flag)
 		reset_instruction_src_region(GEN(instr), src);
 
 	if (!validate_src_reg(GEN(instr), src->reg, location))
@@ -2899,7 +3009,7 @@ static int set_instruction_src0(struct brw_program_instruction *instr,
 	 * elements. */
 	resolve_subnr(&src->reg);
 
-	brw_set_src0(&genasm_compile, GEN(instr), src->reg);
+	brw_set_src0(&gen4asm_ctx->compile, GEN(instr), src->reg);
 
 	return 0;
 }
@@ -2910,7 +3020,7 @@ static int set_instruction_src1(struct brw_program_instruction *instr,
 				struct src_operand *src,
 				YYLTYPE *location)
 {
-	if (advanced_flag)
+	if (gen4asm_ctx->advanced_flag)
 		reset_instruction_src_region(GEN(instr), src);
 
 	if (!validate_src_reg(GEN(instr), src->reg, location))
@@ -2920,7 +3030,7 @@ static int set_instruction_src1(struct brw_program_instruction *instr,
 	 * elements. */
 	resolve_subnr(&src->reg);
 
-	brw_set_src1(&genasm_compile, GEN(instr), src->reg);
+	brw_set_src1(&gen4asm_ctx->compile, GEN(instr), src->reg);
 
 	return 0;
 }
@@ -2929,46 +3039,46 @@ static int set_instruction_dest_three_src(struct brw_program_instruction *instr,
 					  struct brw_reg *dest)
 {
     resolve_subnr(dest);
-    brw_set_3src_dest(&genasm_compile, GEN(instr), *dest);
+    brw_set_3src_dest(&gen4asm_ctx->compile, GEN(instr), *dest);
     return 0;
 }
 
 static int set_instruction_src0_three_src(struct brw_program_instruction *instr,
 					  struct src_operand *src)
 {
-    if (advanced_flag)
+    if (gen4asm_ctx->advanced_flag)
 	reset_instruction_src_region(GEN(instr), src);
 
     resolve_subnr(&src->reg);
 
     // TODO: src0 modifier, src0 rep_ctrl
-    brw_set_3src_src0(&genasm_compile, GEN(instr), src->reg);
+    brw_set_3src_src0(&gen4asm_ctx->compile, GEN(instr), src->reg);
     return 0;
 }
 
 static int set_instruction_src1_three_src(struct brw_program_instruction *instr,
 					  struct src_operand *src)
 {
-    if (advanced_flag)
+    if (gen4asm_ctx->advanced_flag)
 	reset_instruction_src_region(GEN(instr), src);
 
     resolve_subnr(&src->reg);
 
     // TODO: src1 modifier, src1 rep_ctrl
-    brw_set_3src_src1(&genasm_compile, GEN(instr), src->reg);
+    brw_set_3src_src1(&gen4asm_ctx->compile, GEN(instr), src->reg);
     return 0;
 }
 
 static int set_instruction_src2_three_src(struct brw_program_instruction *instr,
 					  struct src_operand *src)
 {
-    if (advanced_flag)
+    if (gen4asm_ctx->advanced_flag)
 	reset_instruction_src_region(GEN(instr), src);
 
     resolve_subnr(&src->reg);
 
     // TODO: src2 modifier, src2 rep_ctrl
-    brw_set_3src_src2(&genasm_compile, GEN(instr), src->reg);
+    brw_set_3src_src2(&gen4asm_ctx->compile, GEN(instr), src->reg);
     return 0;
 }
 
@@ -0,0 +1,753 @@
+/* -*- c-basic-offset: 8 -*- */
+/*
+ * Copyright © 2006, 2013 Intel Corporation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ * Authors:
+ *    Eric Anholt <eric@anholt.net>
+ *
+ */
+
+/*
+ * The assembler proper: runs the parser over a source buffer, lays out the
+ * instructions, resolves the labels and hands back the binary. Everything
+ * which used to be global lives in a struct gen4asm_context on the stack of
+ * gen4asm_assemble(), with all allocations in a ralloc context of its own.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <assert.h>
+
+#include "ralloc.h"
+#include "gen4asm.h"
+#include "brw_eu.h"
+
+__thread struct gen4asm_context *gen4asm_ctx;
+
+void gen4asm_vmessage(enum gen4asm_severity severity, int line, int column,
+		      const char *fmt, va_list args)
+{
+	static const char *severity_str[] = { "warning", "error" };
+	struct gen4asm_context *ctx = gen4asm_ctx;
+	struct gen4asm_program *result = ctx->result;
+	struct gen4asm_diagnostic *d;
+	char *message;
+	size_t len;
+
+	message = ralloc_vasprintf(result, fmt, args);
+	len = strlen(message);
+	if (len && message[len - 1] == '\n')
+		message[len - 1] = '\0';
+
+	if (ctx->diagnostics) {
+		if (line)
+			fprintf(ctx->diagnostics, "%s:%d:%d: %s: %s\n",
+				ctx->input_filename, line, column,
+				severity_str[severity], message);
+		else
+			fprintf(ctx->diagnostics, "%s:%s: %s\n",
+				ctx->input_filename, severity_str[severity],
+				message);
+	}
+
+	d = reralloc(result, (void *)result->diagnostics,
+		     struct gen4asm_diagnostic, result->num_diagnostics + 1);
+	result->diagnostics = d;
+	d += result->num_diagnostics++;
+
+	d->severity = severity;
+	d->filename = ralloc_strdup(result, ctx->input_filename);
+	d->line = line;
+	d->column = column;
+	d->message = message;
+
+	if (severity == GEN4ASM_ERROR) {
+		result->num_errors++;
+		ctx->errors++;
+	}
+}
+
+void gen4asm_message(enum gen4asm_severity severity, int line, int column,
+		     const char *fmt, ...)
+{
+	va_list args;
+
+	va_start(args, fmt);
+	gen4asm_vmessage(severity, line, column, fmt, args);
+	va_end(args);
+}
+
+static void hash_init(struct gen4asm_hash *table, bool ignore_case)
+{
+    table->size = 64;
+    table->count = 0;
+    table->ignore_case = ignore_case;
+    table->buckets = rzalloc_array(gen4asm_ctx->mem_ctx,
+				   struct gen4asm_hash_entry *, table->size);
+}
+
+/* FNV-1a, folding the case if the table does */
+static unsigned hash_string(const struct gen4asm_hash *table, const char *key)
+{
+    unsigned ret = 2166136261u;
+
+    while (*key) {
+	unsigned char c = *key++;
+	if (table->ignore_case && c >= 'A' && c <= 'Z')
+	    c += 'a' - 'A';
+	ret = (ret ^ c) * 16777619u;
+    }
+    return ret;
+}
+
+static void *hash_find(const struct gen4asm_hash *table, const char *key)
+{
+    unsigned h = hash_string(table, key);
+    struct gen4asm_hash_entry *p;
+
+    for (p = table->buckets[h & (table->size - 1)]; p; p = p->next) {
+	if (p->hash != h)
+	    continue;
+	if (table->ignore_case ? strcasecmp(p->key, key) == 0
+			       : strcmp(p->key, key) == 0)
+	    return p->data;
+    }
+    return NULL;
+}
+
+static void hash_grow(struct gen4asm_hash *table)
+{
+    struct gen4asm_hash_entry **buckets, *p, *next;
+    unsigned size = table->size * 2, i;
+
+    buckets = rzalloc_array(gen4asm_ctx->mem_ctx,
+			    struct gen4asm_hash_entry *, size);
+    for (i = 0; i < table->size; i++) {
+	for (p = table->buckets[i]; p; p = next) {
+	    next = p->next;
+	    p->next = buckets[p->hash & (size - 1)];
+	    buckets[p->hash & (size - 1)] = p;
+	}
+    }
+    ralloc_free(table->buckets);
+    table->buckets = buckets;
+    table->size = size;
+}
+
+static void hash_insert(struct gen4asm_hash *table, const char *key,
+			void *data)
+{
+    struct gen4asm_hash_entry *p;
+    unsigned h = hash_string(table, key);
+
+    if (table->count >= table->size)
+	hash_grow(table);
+
+    p = arena_new(&gen4asm_ctx->arena, struct gen4asm_hash_entry);
+    p->key = key;
+    p->hash = h;
+    p->data = data;
+    p->next = table->buckets[h & (table->size - 1)];
+    table->buckets[h & (table->size - 1)] = p;
+    table->count++;
+}
+
+struct declared_register *find_register(char *name)
+{
+    return hash_find(&gen4asm_ctx->declared_register_table, name);
+}
+
+void insert_register(struct declared_register *reg)
+{
+    hash_insert(&gen4asm_ctx->declared_register_table, reg->name, reg);
+}
+
+// jump distance used in branch instructions as JIP or UIP
+static int jump_distance(int offset)
+{
+    // Gen4- bspec: the jump distance is in number of sixteen-byte units
+    // Gen5+ bspec: the jump distance is in number of eight-byte units
+    if(IS_GENp(5))
+        offset *= 2;
+    return offset;
+}
+
+/* Labels are added in program order, so the addresses come sorted */
+static void add_label(struct gen4asm_context *ctx,
+		      struct brw_program_instruction *i)
+{
+    struct label_item *label;
+
+    assert(is_label(i));
+
+    label = hash_find(&ctx->label_table, label_name(i));
+    if (label == NULL) {
+	label = rzalloc(ctx->mem_ctx, struct label_item);
+	label->name = label_name(i);
+	hash_insert(&ctx->label_table, label->name, label);
+    }
+
+    if (label->count == label->capacity) {
+	label->capacity = label->capacity ? 2 * label->capacity : 1;
+	label->addr = reralloc(label, label->addr, int, label->capacity);
+	label->index = reralloc(label, label->index, unsigned,
+				label->capacity);
+    }
+
+    assert(label->count == 0 ||
+	   label->addr[label->count - 1] <= i->inst_offset);
+    label->addr[label->count] = i->inst_offset;
+    label->index[label->count] = ctx->num_labels++;
+    label->count++;
+}
+
+/* Some assembly code have duplicated labels.
+   Return the first label at or after start_addr, or else the first one.
+   Returns the position in label->addr, or -1 if there's no such label. */
+static int find_label(struct gen4asm_context *ctx, char *name,
+		      int start_addr, struct label_item **out)
+{
+    struct label_item *label;
+    unsigned lo, hi;
+
+    label = hash_find(&ctx->label_table, name);
+    if (label == NULL) {
+        gen4asm_message(GEN4ASM_ERROR, 0, 0, "Can't find label %s\n", name);
+        return -1;
+    }
+
+    /* lower bound of start_addr */
+    lo = 0;
+    hi = label->count;
+    while (lo < hi) {
+	unsigned mid = lo + (hi - lo) / 2;
+	if (label->addr[mid] < start_addr)
+	    lo = mid + 1;
+	else
+	    hi = mid;
+    }
+
+    *out = label;
+    return lo < label->count ? lo : 0;
+}
+
+/* Resolve a branch target, and note it down for the relocation table */
+static int label_to_addr(struct gen4asm_context *ctx, char *name,
+			 int start_addr, enum gen4asm_reloc_type type)
+{
+    struct gen4asm_relocation *r;
+    struct label_item *label;
+    int n;
+
+    n = find_label(ctx, name, start_addr, &label);
+    if (n < 0)
+	return -1;
+
+    r = &ctx->relocations[ctx->num_relocations++];
+    r->offset = start_addr * sizeof(struct brw_instruction);
+    r->type = type;
+    r->label = label->index[n];
+
+    return label->addr[n];
+}
+
+static int is_entry_point(struct gen4asm_context *ctx,
+			  struct brw_program_instruction *i)
+{
+	unsigned n;
+
+	assert(i->type == GEN4ASM_INSTRUCTION_LABEL);
+
+	for (n = 0; n < ctx->num_entry_points; n++) {
+	    if (strcmp(ctx->entry_points[n], i->insn.label.name) == 0)
+		return 1;
+	}
+	return 0;
+}
+
+/* Assign offsets, padding with NOPs so that entry points are aligned */
+static void layout_program(struct gen4asm_context *ctx)
+{
+	struct brw_program_instruction *entry, *entry1, *tmp_entry;
+	int inst_offset = 0;
+
+	for (entry = ctx->program.first;
+		entry != NULL; entry = entry->next) {
+	    entry->inst_offset = inst_offset;
+	    entry1 = entry->next;
+	    if (entry1 && is_label(entry1) && is_entry_point(ctx, entry1)) {
+		// insert NOP instructions until (inst_offset+1) % 4 == 0
+		while (((inst_offset+1) % 4) != 0) {
+		    tmp_entry = arena_new(&ctx->arena,
+					  struct brw_program_instruction);
+		    tmp_entry->insn.gen.header.opcode = BRW_OPCODE_NOP;
+		    entry->next = tmp_entry;
+		    tmp_entry->next = entry1;
+		    entry = tmp_entry;
+		    tmp_entry->inst_offset = ++inst_offset;
+		}
+	    }
+	    if (!is_label(entry))
+              inst_offset++;
+	}
+
+	for (entry = ctx->program.first; entry; entry = entry->next)
+	    if (is_label(entry))
+		add_label(ctx, entry);
+}
+
+static void resolve_relocations(struct gen4asm_context *ctx)
+{
+	struct brw_program_instruction *entry;
+	unsigned num_targets = 0;
+
+	for (entry = ctx->program.first; entry; entry = entry->next) {
+	    if (!is_relocatable(entry))
+		continue;
+	    num_targets += entry->reloc.first_reloc_target != NULL;
+	    num_targets += entry->reloc.second_reloc_target != NULL;
+	}
+	ctx->relocations = ralloc_array(ctx->result,
+					struct gen4asm_relocation,
+					num_targets ?: 1);
+
+	for (entry = ctx->program.first; entry; entry = entry->next) {
+	    struct relocation *reloc = &entry->reloc;
+	    struct brw_instruction *inst = &entry->insn.gen;
+
+	    if (!is_relocatable(entry))
+		continue;
+
+	    if (reloc->first_reloc_target)
+		reloc->first_reloc_offset = label_to_addr(ctx, reloc->first_reloc_target, entry->inst_offset, GEN4ASM_RELOC_JIP) - entry->inst_offset;
+
+	    if (reloc->second_reloc_target)
+		reloc->second_reloc_offset = label_to_addr(ctx, reloc->second_reloc_target, entry->inst_offset, GEN4ASM_RELOC_UIP) - entry->inst_offset;
+
+	    if (reloc->second_reloc_offset) {
+		// this is a branch instruction with two offset arguments
+		inst->bits3.break_cont.jip = jump_distance(reloc->first_reloc_offset);
+		inst->bits3.break_cont.uip = jump_distance(reloc->second_reloc_offset);
+	    } else if (reloc->first_reloc_offset) {
+		// this is a branch instruction with one offset argument
+		int offset = reloc->first_reloc_offset;
+		/* bspec: Unlike other flow control instructions, the offset used by JMPI is relative to the incremented instruction pointer rather than the IP value for the instruction itself. */
+
+		int is_jmpi = inst->header.opcode == BRW_OPCODE_JMPI; // target relative to the post-incremented IP, so delta == 1 if JMPI
+		if(is_jmpi)
+		    offset --;
+		offset = jump_distance(offset);
+		if (is_jmpi && (ctx->gen_level == 75))
+			offset = offset * 8;
+
+		if(!IS_GENp(6)) {
+		    inst->bits3.JIP = offset;
+		    if(inst->header.opcode == BRW_OPCODE_ELSE)
+			inst->bits3.break_cont.uip = 1; /* Set the istack pop count, which must always be 1. */
+		} else if(IS_GENx(6)) {
+		    /* TODO: endif JIP pos is not in Gen6 spec. may be bits1 */
+		    int opcode = inst->header.opcode;
+		    if(opcode == BRW_OPCODE_CALL || opcode == BRW_OPCODE_JMPI)
+			inst->bits3.JIP = offset; // for CALL, JMPI
+		    else
+			inst->bits1.branch_gen6.jump_count = offset; // for CASE,ELSE,FORK,IF,WHILE
+		} else if(IS_GENp(7)) {
+		    int opcode = inst->header.opcode;
+		    /* Gen7 JMPI Restrictions in bspec:
+		     * The JIP data type must be Signed DWord
+		     */
+		    if(opcode == BRW_OPCODE_JMPI)
+			inst->bits3.JIP = offset;
+		    else
+			inst->bits3.break_cont.jip = offset;
+		}
+	    }
+	}
+}
+
+static int register_line_cmp(const void *a, const void *b)
+{
+	const struct gen4asm_register *ra = a, *rb = b;
+
+	return ra->line - rb->line;
+}
+
+static void emit_registers(struct gen4asm_context *ctx)
+{
+	struct gen4asm_program *result = ctx->result;
+	struct gen4asm_hash *table = &ctx->declared_register_table;
+	struct gen4asm_hash_entry *p;
+	struct gen4asm_register *registers;
+	unsigned i, n = 0;
+
+	registers = ralloc_array(result, struct gen4asm_register,
+				 table->count ?: 1);
+	for (i = 0; i < table->size; i++) {
+	    for (p = table->buckets[i]; p; p = p->next) {
+		struct declared_register *reg = p->data;
+
+		registers[n].name = ralloc_strdup(result, reg->name);
+		registers[n].line = reg->line;
+		registers[n].file = reg->reg.file;
+		registers[n].nr = reg->reg.nr;
+		registers[n].subnr = reg->reg.subnr;
+		registers[n].uses = reg->uses;
+		n++;
+	    }
+	}
+	qsort(registers, n, sizeof(*registers), register_line_cmp);
+
+	result->registers = registers;
+	result->num_registers = n;
+}
+
+/* Copy the instructions and labels out of the scratch context */
+static void emit_program(struct gen4asm_context *ctx)
+{
+	struct gen4asm_program *result = ctx->result;
+	struct brw_program_instruction *entry;
+	struct brw_instruction *code;
+	struct gen4asm_label *labels;
+	unsigned num_instructions = 0, num_labels = 0;
+
+	for (entry = ctx->program.first; entry; entry = entry->next) {
+	    if (is_label(entry))
+		num_labels++;
+	    else
+		num_instructions++;
+	}
+
+	code = ralloc_array(result, struct brw_instruction,
+			    num_instructions ?: 1);
+	labels = ralloc_array(result, struct gen4asm_label, num_labels ?: 1);
+
+	num_instructions = num_labels = 0;
+	for (entry = ctx->program.first; entry; entry = entry->next) {
+	    if (is_label(entry)) {
+		labels[num_labels].name = ralloc_strdup(result,
+							label_name(entry));
+		labels[num_labels].offset = entry->inst_offset *
+					    sizeof(struct brw_instruction);
+		labels[num_labels].entry_point = is_entry_point(ctx, entry);
+		num_labels++;
+	    } else {
+		code[num_instructions++] = entry->insn.gen;
+	    }
+	}
+
+	result->code = code;
+	result->size = num_instructions * sizeof(*code);
+	result->num_instructions = num_instructions;
+	result->labels = labels;
+	result->num_labels = num_labels;
+	result->relocations = ctx->relocations;
+	result->num_relocations = ctx->num_relocations;
+
+	emit_registers(ctx);
+}
+
+static bool is_flow_control(const struct brw_instruction *insn)
+{
+	switch (insn->header.opcode) {
+	case BRW_OPCODE_JMPI:
+	case BRW_OPCODE_IF:
+	case BRW_OPCODE_IFF:
+	case BRW_OPCODE_ELSE:
+	case BRW_OPCODE_ENDIF:
+	case BRW_OPCODE_DO:
+	case BRW_OPCODE_WHILE:
+	case BRW_OPCODE_BREAK:
+	case BRW_OPCODE_CONTINUE:
+	case BRW_OPCODE_HALT:
+	case BRW_OPCODE_CALL:
+	case BRW_OPCODE_RET:
+		return true;
+	default:
+		return false;
+	}
+}
+
+/*
+ * Move a jump from the old layout to the compacted one. The jump is taken
+ * relative to old_base/new_base, in units of unit bytes.
+ */
+static int relocate_jump(struct gen4asm_context *ctx, const unsigned *new_offset,
+			 unsigned num_instructions, unsigned ip,
+			 int jump, unsigned old_base, unsigned new_base,
+			 unsigned unit)
+{
+	long target = old_base + (long)jump * unit;
+
+	if (target < 0 || target > 16L * num_instructions || target % 16) {
+		gen4asm_message(GEN4ASM_ERROR, 0, 0,
+				"can't compact, instruction %u jumps to "
+				"offset %ld\n", ip, target);
+		return jump;
+	}
+
+	return ((long)new_offset[target / 16] - (long)new_base) / (long)unit;
+}
+
+static void compact_nop(char *store, unsigned *offset)
+{
+	struct brw_compact_instruction *nop = (void *)(store + *offset);
+
+	memset(nop, 0, sizeof(*nop));
+	nop->dw0.opcode = BRW_OPCODE_NOP;
+	nop->dw0.cmpt_ctrl = 1;
+	*offset += sizeof(*nop);
+}
+
+/*
+ * Replace instructions with their 8 byte compacted form where there is one,
+ * once the labels are resolved. Only instructions which come back unchanged
+ * from brw_uncompact_instruction() are compacted. Flow control is left
+ * alone, but its jumps are fixed up for the new layout, and entry points
+ * are realigned to 64 bytes.
+ *
+ * This follows brw_compact_instructions(), which only knows about the
+ * branches the compiler emits and works on a struct brw_compile.
+ */
+static void compact_program(struct gen4asm_context *ctx)
+{
+	struct gen4asm_program *result = ctx->result;
+	const struct brw_instruction *code = result->code;
+	unsigned n = result->num_instructions, i;
+	unsigned *new_offset, offset = 0, unit;
+	bool *entry_point;
+	char *store;
+
+	new_offset = ralloc_array(ctx->mem_ctx, unsigned, n + 1);
+	entry_point = rzalloc_array(ctx->mem_ctx, bool, n + 1);
+	/* worst case: an alignment NOP in front of every instruction and label */
+	store = ralloc_size(result, 24 * n + 64 * result->num_labels + 8);
+
+	for (i = 0; i < result->num_labels; i++)
+		if (result->labels[i].entry_point)
+			entry_point[result->labels[i].offset / 16] = true;
+
+	for (i = 0; i < n; i++) {
+		struct brw_instruction insn = code[i], check;
+		struct brw_compact_instruction compact;
+
+		if (entry_point[i])
+			while (offset % 64)
+				compact_nop(store, &offset);
+
+		if (!is_flow_control(&insn) &&
+		    brw_try_compact_instruction(&ctx->compile, &compact, &insn)) {
+			brw_uncompact_instruction(&ctx->brw.intel, &check,
+						  &compact);
+			if (memcmp(&check, &insn, sizeof(insn)) == 0) {
+				new_offset[i] = offset;
+				memcpy(store + offset, &compact, sizeof(compact));
+				offset += sizeof(compact);
+				result->num_compacted++;
+				continue;
+			}
+
+			if (ctx->warning_flags & WARN_ALL)
+				gen4asm_message(GEN4ASM_WARNING, 0, 0,
+						"instruction %u changes when "
+						"compacted, left as is\n", i);
+		}
+
+		/* the end of thread SEND needs to be aligned, or the GPU hangs */
+		if ((insn.header.opcode == BRW_OPCODE_SEND ||
+		     insn.header.opcode == BRW_OPCODE_SENDC) &&
+		    insn.bits3.generic.end_of_thread && offset % 16)
+			compact_nop(store, &offset);
+
+		new_offset[i] = offset;
+		memcpy(store + offset, &insn, sizeof(insn));
+		offset += sizeof(insn);
+	}
+
+	/* keep the program a whole number of full instructions */
+	if (offset % 16)
+		compact_nop(store, &offset);
+	new_offset[n] = offset;
+
+	for (i = 0; i < n; i++) {
+		struct brw_instruction *insn = (void *)(store + new_offset[i]);
+		unsigned old_ip = 16 * i, new_ip = new_offset[i];
+
+		if (!is_flow_control(insn))
+			continue;
+
+		switch (insn->header.opcode) {
+		case BRW_OPCODE_JMPI:
+			/* relative to the next instruction, in bytes on Haswell */
+			unit = ctx->gen_level == 75 ? 1 : 8;
+			insn->bits3.JIP = relocate_jump(ctx, new_offset, n, i,
+							insn->bits3.JIP,
+							old_ip + 16,
+							new_ip + 16, unit);
+			break;
+
+		case BRW_OPCODE_IF:
+		case BRW_OPCODE_ELSE:
+		case BRW_OPCODE_ENDIF:
+		case BRW_OPCODE_WHILE:
+		case BRW_OPCODE_CALL:
+			if (IS_GENx(6)) {
+				if (insn->header.opcode == BRW_OPCODE_CALL)
+					insn->bits3.JIP =
+						relocate_jump(ctx, new_offset, n, i,
+							      insn->bits3.JIP,
+							      old_ip, new_ip, 8);
+				else
+					insn->bits1.branch_gen6.jump_count =
+						relocate_jump(ctx, new_offset, n, i,
+							      insn->bits1.branch_gen6.jump_count,
+							      old_ip, new_ip, 8);
+				break;
+			}
+			/* fall through */
+		case BRW_OPCODE_BREAK:
+		case BRW_OPCODE_CONTINUE:
+		case BRW_OPCODE_HALT:
+			insn->bits3.break_cont.jip =
+				relocate_jump(ctx, new_offset, n, i,
+					      insn->bits3.break_cont.jip,
+					      old_ip, new_ip, 8);
+			insn->bits3.break_cont.uip =
+				relocate_jump(ctx, new_offset, n, i,
+					      insn->bits3.break_cont.uip,
+					      old_ip, new_ip, 8);
+			break;
+		}
+	}
+
+	for (i = 0; i < result->num_labels; i++) {
+		struct gen4asm_label *label = (void *)&result->labels[i];
+		label->offset = new_offset[label->offset / 16];
+	}
+	for (i = 0; i < result->num_relocations; i++) {
+		struct gen4asm_relocation *r = &ctx->relocations[i];
+		r->offset = new_offset[r->offset / 16];
+	}
+
+	ralloc_free((void *)result->code);
+	result->code = store;
+	result->uncompacted_size = result->size;
+	result->size = offset;
+}
+
+void gen4asm_options_init(struct gen4asm_options *options)
+{
+	memset(options, 0, sizeof(*options));
+	options->gen = 40;
+	options->filename = "<stdin>";
+}
+
+/**
+ * gen4asm_assemble - assemble a program from source
+ *
+ * Returns NULL only if running out of memory. Whether the assembly worked
+ * out is up to program->num_errors, the diagnostics explain what went wrong.
+ */
+struct gen4asm_program *
+gen4asm_assemble(const char *source, size_t length,
+		 const struct gen4asm_options *options)
+{
+	struct gen4asm_context ctx, *saved_ctx = gen4asm_ctx;
+	struct gen4asm_program *result;
+	int err;
+
+	result = rzalloc(NULL, struct gen4asm_program);
+	if (result == NULL)
+		return NULL;
+	result->gen = options->gen;
+
+	memset(&ctx, 0, sizeof(ctx));
+	ctx.gen_level = options->gen;
+	ctx.advanced_flag = options->advanced;
+	ctx.warning_flags = WARN_ALWAYS;
+	if (options->all_warnings)
+		ctx.warning_flags |= WARN_ALL;
+	ctx.defaults.register_type = BRW_REGISTER_TYPE_F;
+	ctx.entry_points = options->entry_points;
+	ctx.num_entry_points = options->num_entry_points;
+	ctx.result = result;
+	ctx.diagnostics = options->diagnostics;
+
+	ctx.mem_ctx = ralloc_context(result);
+	arena_init(&ctx.arena);
+	ctx.input_filename = ralloc_strdup(ctx.mem_ctx,
+					   options->filename ?: "<stdin>");
+
+	brw_init_context(&ctx.brw, ctx.gen_level);
+	brw_init_compile(&ctx.brw, &ctx.compile, ctx.mem_ctx);
+
+	/* the parser and the emit helpers find the state through gen4asm_ctx */
+	gen4asm_ctx = &ctx;
+
+	hash_init(&ctx.declared_register_table, true);
+	hash_init(&ctx.label_table, false);
+
+	err = gen4asm_parse(&ctx, source, length);
+	if (err && ctx.errors == 0)
+		gen4asm_message(GEN4ASM_ERROR, 0, 0, "parse failed\n");
+
+	if (ctx.errors == 0 && options->optimize)
+		optimize_program(&ctx);
+
+	if (ctx.errors == 0) {
+		layout_program(&ctx);
+		resolve_relocations(&ctx);
+	}
+
+	if (ctx.errors == 0)
+		emit_program(&ctx);
+
+	if (ctx.errors == 0 && options->compact && IS_GENp(6))
+		compact_program(&ctx);
+
+	gen4asm_ctx = saved_ctx;
+	ralloc_free(ctx.mem_ctx);
+	arena_fini(&ctx.arena);
+
+	return result;
+}
+
+void gen4asm_program_free(struct gen4asm_program *program)
+{
+	ralloc_free(program);
+}
+
+const char *gen4asm_pass_name(enum gen4asm_pass pass)
+{
+	static const char *const names[] = {
+		[GEN4ASM_PASS_NOP] = "nop removal",
+		[GEN4ASM_PASS_REDUNDANT_MOV] = "redundant mov",
+		[GEN4ASM_PASS_COPY_PROPAGATION] = "copy propagation",
+		[GEN4ASM_PASS_IMMEDIATE] = "immediate folding",
+		[GEN4ASM_PASS_DEAD_CODE] = "dead code",
+	};
+
+	if (pass >= sizeof(names) / sizeof(names[0]))
+		return "unknown";
+	return names[pass];
+}
@@ -0,0 +1,167 @@
+/*
+ * Copyright © 2013 Intel Corporation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef __LIBGEN4ASM_H__
+#define __LIBGEN4ASM_H__
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * In-memory interface to the gen4asm assembler.
+ *
+ * Every call to gen4asm_assemble() runs on state of its own, so several
+ * threads can assemble at the same time. All memory of the result hangs off
+ * the returned program and is released with gen4asm_program_free().
+ */
+
+enum gen4asm_severity {
+	GEN4ASM_WARNING,
+	GEN4ASM_ERROR,
+};
+
+struct gen4asm_diagnostic {
+	enum gen4asm_severity severity;
+	const char *filename;
+	int line;		/* 0 if there is no location */
+	int column;
+	const char *message;	/* without the trailing newline */
+};
+
+struct gen4asm_register {
+	const char *name;
+	int line;		/* of the declaration */
+	unsigned file, nr, subnr;
+	unsigned uses;		/* operands naming it */
+};
+
+struct gen4asm_label {
+	const char *name;
+	unsigned offset;	/* in bytes */
+	bool entry_point;	/* listed in options->entry_points */
+};
+
+enum gen4asm_reloc_type {
+	GEN4ASM_RELOC_JIP,
+	GEN4ASM_RELOC_UIP,
+};
+
+/* a branch to a label, already applied to the code */
+struct gen4asm_relocation {
+	unsigned offset;	/* of the branch, in bytes */
+	enum gen4asm_reloc_type type;
+	unsigned label;		/* index into program->labels */
+};
+
+enum gen4asm_pass {
+	GEN4ASM_PASS_NOP,		/* NOP removed */
+	GEN4ASM_PASS_REDUNDANT_MOV,	/* MOV of a value already in place */
+	GEN4ASM_PASS_COPY_PROPAGATION,	/* source read from the MOV's source */
+	GEN4ASM_PASS_IMMEDIATE,		/* MOV of an immediate folded in */
+	GEN4ASM_PASS_DEAD_CODE,		/* result never read */
+};
+
+/* an instruction changed or removed by options->optimize */
+struct gen4asm_change {
+	enum gen4asm_pass pass;
+	int line;		/* of the instruction in the source */
+	bool removed;
+	uint32_t before[4];
+	uint32_t after[4];	/* unless removed */
+};
+
+struct gen4asm_options {
+	int gen;		/* 10 * generation, e.g. 45 or 75 */
+	bool advanced;		/* subregister numbers in units of the type */
+	bool all_warnings;
+	bool compact;		/* use compacted instructions where possible */
+	bool optimize;		/* run the peephole optimizations */
+	const char *filename;	/* used for the diagnostics */
+
+	/*
+	 * Labels which are kernel entry points and need to start on a 64 byte
+	 * boundary, NOPs are inserted in front of them as needed.
+	 */
+	const char *const *entry_points;
+	unsigned num_entry_points;
+
+	/* if set, diagnostics are also printed here as they are found */
+	FILE *diagnostics;
+};
+
+struct gen4asm_program {
+	int gen;
+
+	/*
+	 * 16 bytes per instruction, or 8 for compacted ones; NULL if the
+	 * assembly failed
+	 */
+	const void *code;
+	size_t size;
+	unsigned num_instructions;
+
+	/* with options->compact, how many and the size without compaction */
+	unsigned num_compacted;
+	size_t uncompacted_size;
+
+	/* all labels, in program order */
+	const struct gen4asm_label *labels;
+	unsigned num_labels;
+
+	const struct gen4asm_relocation *relocations;
+	unsigned num_relocations;
+
+	/* the registers declared with .declare, in source order */
+	const struct gen4asm_register *registers;
+	unsigned num_registers;
+
+	/* with options->optimize, everything it did in the order it did it */
+	const struct gen4asm_change *changes;
+	unsigned num_changes;
+
+	const struct gen4asm_diagnostic *diagnostics;
+	unsigned num_diagnostics;
+	unsigned num_errors;
+};
+
+void gen4asm_options_init(struct gen4asm_options *options);
+
+struct gen4asm_program *
+gen4asm_assemble(const char *source, size_t length,
+		 const struct gen4asm_options *options);
+
+void gen4asm_program_free(struct gen4asm_program *program);
+
+const char *gen4asm_pass_name(enum gen4asm_pass pass);
+
+#ifdef __cplusplus
+} /* end of extern "C" */
+#endif
+
+#endif /* __LIBGEN4ASM_H__ */
@@ -33,52 +33,28 @@
 #include <unistd.h>
 #include <assert.h>
 
-#include "ralloc.h"
-#include "gen4asm.h"
-#include "brw_eu.h"
-
-extern FILE *yyin;
-
-long int gen_level = 40;
-int advanced_flag = 0; /* 0: in unit of byte, 1: in unit of data element size */
-unsigned int warning_flags = WARN_ALWAYS;
-int need_export = 0;
-char *input_filename = "<stdin>";
-int errors;
-
-struct brw_context genasm_brw_context;
-struct brw_compile genasm_compile;
-
-struct brw_program compiled_program;
-struct program_defaults program_defaults = {.register_type = BRW_REGISTER_TYPE_F};
-
-/* 0: default output style, 1: nice C-style output */
-static int binary_like_output = 0;
+#include "libgen4asm.h"
+#include "gen4bin.h"
+#include "brw_structs.h"
+#include "brw_context.h"
+
+static enum {
+	OUTPUT_HEX,		/* default output style */
+	OUTPUT_BYTES,		/* nice C-style output */
+	OUTPUT_RAW,		/* just the instructions */
+	OUTPUT_CONTAINER,	/* instructions, labels and relocations */
+} output_format = OUTPUT_HEX;
 static char *export_filename = NULL;
 static const char binary_prepend[] = "static const char gen_eu_bytes[] = {\n";
 
-#define HASH_SIZE 37
-
-struct hash_item {
-	char *key;
-	void *value;
-	struct hash_item *next;
-};
-
-typedef struct hash_item *hash_table[HASH_SIZE];
-
-static hash_table declared_register_table;
-
-struct label_item {
-	char *name;
-	int addr;
-	struct label_item *next;
-};
-static struct label_item *label_table;
-
 static const struct option longopts[] = {
 	{"advanced", no_argument, 0, 'a'},
 	{"binary", no_argument, 0, 'b'},
+	{"raw", no_argument, 0, 'r'},
+	{"container", no_argument, 0, 'c'},
+	{"compact", no_argument, 0, 'C'},
+	{"optimize", no_argument, 0, 'O'},
+	{"report", required_argument, 0, 'R'},
 	{"export", required_argument, 0, 'e'},
 	{"input_list", required_argument, 0, 'l'},
 	{"output", required_argument, 0, 'o'},
@@ -86,134 +62,30 @@ static const struct option longopts[] = {
 	{ NULL, 0, NULL, 0 }
 };
 
-// jump distance used in branch instructions as JIP or UIP
-static int jump_distance(int offset)
-{
-    // Gen4- bspec: the jump distance is in number of sixteen-byte units
-    // Gen5+ bspec: the jump distance is in number of eight-byte units
-    if(IS_GENp(5))
-        offset *= 2;
-    return offset;
-}
-
 static void usage(void)
 {
 	fprintf(stderr, "usage: intel-gen4asm [options] inputfile\n");
 	fprintf(stderr, "OPTIONS:\n");
 	fprintf(stderr, "\t-a, --advanced                       Set advanced flag\n");
 	fprintf(stderr, "\t-b, --binary                         C style binary output\n");
+	fprintf(stderr, "\t-r, --raw                            Raw binary output\n");
+	fprintf(stderr, "\t-c, --container                      Binary container output\n");
+	fprintf(stderr, "\t-C, --compact                        Compact instructions (gen6+)\n");
+	fprintf(stderr, "\t-O, --optimize                       Run the peephole optimizations\n");
+	fprintf(stderr, "\t-R, --report {reportfile}            Write what -O changed\n");
 	fprintf(stderr, "\t-e, --export {exportfile}            Export label file\n");
 	fprintf(stderr, "\t-l, --input_list {entrytablefile}    Input entry_table_list file\n");
 	fprintf(stderr, "\t-o, --output {outputfile}            Specify output file\n");
 	fprintf(stderr, "\t-g, --gen <4|5|6|7>                  Specify GPU generation\n");
 }
 
-static int hash(char *key)
-{
-    unsigned ret = 0;
-    while(*key)
-        ret = (ret << 1) + (*key++);
-    return ret % HASH_SIZE;
-}
-
-static void *find_hash_item(hash_table t, char *key)
-{
-    struct hash_item *p;
-    for(p = t[hash(key)]; p; p = p->next)
-	if(strcasecmp(p->key, key) == 0)
-	    return p->value;
-    return NULL;
-}
-
-static void insert_hash_item(hash_table t, char *key, void *v)
-{
-    int index = hash(key);
-    struct hash_item *p = malloc(sizeof(*p));
-    p->key = key;
-    p->value = v;
-    p->next = t[index];
-    t[index] = p;
-}
-
-static void free_hash_table(hash_table t)
-{
-    struct hash_item *p, *next;
-    int i;
-    for (i = 0; i < HASH_SIZE; i++) {
-	p = t[i];
-	while(p) {
-	    next = p->next;
-	    free(p->key);
-	    free(p->value);
-	    free(p);
-	    p = next;
-	}
-    }
-}
-
-struct declared_register *find_register(char *name)
-{
-    return find_hash_item(declared_register_table, name);
-}
-
-void insert_register(struct declared_register *reg)
-{
-    insert_hash_item(declared_register_table, reg->name, reg);
-}
-
-static void add_label(struct brw_program_instruction *i)
-{
-    struct label_item **p = &label_table;
-
-    assert(is_label(i));
-
-    while(*p)
-        p = &((*p)->next);
-    *p = calloc(1, sizeof(**p));
-    (*p)->name = label_name(i);
-    (*p)->addr = i->inst_offset;
-}
-
-/* Some assembly code have duplicated labels.
-   Start from start_addr. Search as a loop. Return the first label found. */
-static int label_to_addr(char *name, int start_addr)
-{
-    /* return the first label just after start_addr, or the first label from the head */
-    struct label_item *p;
-    int r = -1;
-    for(p = label_table; p; p = p->next) {
-        if(strcmp(p->name, name) == 0) {
-            if(p->addr >= start_addr) // the first label just after start_addr
-                return p->addr;
-            else if(r == -1) // the first label from the head
-                r = p->addr;
-        }
-    }
-    if(r == -1) {
-        fprintf(stderr, "Can't find label %s\n", name);
-        exit(1);
-    }
-    return r;
-}
-
-static void free_label_table(struct label_item *p)
-{
-    if(p) {
-        free_label_table(p->next);
-        free(p);
-    }
-}
-
-struct entry_point_item {
-	char *str;
-	struct entry_point_item *next;
-} *entry_point_table;
+static char **entry_point_table;
+static unsigned num_entry_points;
 
 static int read_entry_file(char *fn)
 {
 	FILE *entry_table_file;
 	char buf[2048];
-	struct entry_point_item **p = &entry_point_table;
 	if (!fn)
 		return 0;
 	if ((entry_table_file = fopen(fn, "r")) == NULL)
@@ -222,79 +94,103 @@ static int read_entry_file(char *fn)
 		// drop the final char '\n'
 		if(buf[strlen(buf)-1] == '\n')
 			buf[strlen(buf)-1] = 0;
-		*p = calloc(1, sizeof(struct entry_point_item));
-		(*p)->str = strdup(buf);
-		p = &((*p)->next);
+		entry_point_table = realloc(entry_point_table,
+					    (num_entry_points + 1) *
+					    sizeof(*entry_point_table));
+		entry_point_table[num_entry_points++] = strdup(buf);
 	}
 	fclose(entry_table_file);
 	return 0;
 }
 
-static int is_entry_point(struct brw_program_instruction *i)
+static void free_entry_point_table(void)
 {
-	struct entry_point_item *p;
-
-	assert(i->type == GEN4ASM_INSTRUCTION_LABEL);
+	unsigned i;
 
-	for (p = entry_point_table; p; p = p->next) {
-	    if (strcmp(p->str, i->insn.label.name) == 0)
-		return 1;
-	}
-	return 0;
-}
-
-static void free_entry_point_table(struct entry_point_item *p) {
-	if (p) {
-		free_entry_point_table(p->next);
-		free(p->str);
-		free(p);
-	}
+	for (i = 0; i < num_entry_points; i++)
+		free(entry_point_table[i]);
+	free(entry_point_table);
 }
 
 static void
-print_instruction(FILE *output, struct brw_instruction *instruction)
+print_instruction(FILE *output, const struct brw_instruction *instruction)
 {
-	if (binary_like_output) {
+	if (output_format == OUTPUT_BYTES) {
 		fprintf(output, "\t0x%02x, 0x%02x, 0x%02x, 0x%02x, "
 				"0x%02x, 0x%02x, 0x%02x, 0x%02x,\n"
 				"\t0x%02x, 0x%02x, 0x%02x, 0x%02x, "
 				"0x%02x, 0x%02x, 0x%02x, 0x%02x,\n",
-			((unsigned char *)instruction)[0],
-			((unsigned char *)instruction)[1],
-			((unsigned char *)instruction)[2],
-			((unsigned char *)instruction)[3],
-			((unsigned char *)instruction)[4],
-			((unsigned char *)instruction)[5],
-			((unsigned char *)instruction)[6],
-			((unsigned char *)instruction)[7],
-			((unsigned char *)instruction)[8],
-			((unsigned char *)instruction)[9],
-			((unsigned char *)instruction)[10],
-			((unsigned char *)instruction)[11],
-			((unsigned char *)instruction)[12],
-			((unsigned char *)instruction)[13],
-			((unsigned char *)instruction)[14],
-			((unsigned char *)instruction)[15]);
+			((const unsigned char *)instruction)[0],
+			((const unsigned char *)instruction)[1],
+			((const unsigned char *)instruction)[2],
+			((const unsigned char *)instruction)[3],
+			((const unsigned char *)instruction)[4],
+			((const unsigned char *)instruction)[5],
+			((const unsigned char *)instruction)[6],
+			((const unsigned char *)instruction)[7],
+			((const unsigned char *)instruction)[8],
+			((const unsigned char *)instruction)[9],
+			((const unsigned char *)instruction)[10],
+			((const unsigned char *)instruction)[11],
+			((const unsigned char *)instruction)[12],
+			((const unsigned char *)instruction)[13],
+			((const unsigned char *)instruction)[14],
+			((const unsigned char *)instruction)[15]);
 	} else {
 		fprintf(output, "   { 0x%08x, 0x%08x, 0x%08x, 0x%08x },\n",
-			((int *)instruction)[0],
-			((int *)instruction)[1],
-			((int *)instruction)[2],
-			((int *)instruction)[3]);
+			((const int *)instruction)[0],
+			((const int *)instruction)[1],
+			((const int *)instruction)[2],
+			((const int *)instruction)[3]);
+	}
+}
+
+/* what the optimizations did, as a diff of the disassembly */
+static void print_changes(FILE *file, const struct gen4asm_program *program,
+			  const char *filename)
+{
+	struct brw_instruction insn;
+	unsigned i;
+
+	for (i = 0; i < program->num_changes; i++) {
+		const struct gen4asm_change *c = &program->changes[i];
+
+		fprintf(file, "%s:%d: %s\n", filename, c->line,
+			gen4asm_pass_name(c->pass));
+		memcpy(&insn, c->before, sizeof(insn));
+		fprintf(file, "-\t");
+		brw_disasm(file, &insn, program->gen / 10);
+		if (!c->removed) {
+			memcpy(&insn, c->after, sizeof(insn));
+			fprintf(file, "+\t");
+			brw_disasm(file, &insn, program->gen / 10);
+		}
 	}
 }
+
 int main(int argc, char **argv)
 {
+	struct gen4asm_options options;
+	struct gen4asm_program *program;
+	const struct brw_instruction *code;
 	char *output_file = NULL;
 	char *entry_table_file = NULL;
+	char *report_file = NULL;
+	char *input_filename = "<stdin>";
+	FILE *input = stdin;
 	FILE *output = stdout;
 	FILE *export_file;
-	struct brw_program_instruction *entry, *entry1, *tmp_entry;
-	int err, inst_offset;
+	long int gen_level = 40;
+	int need_export = 0;
+	char *source;
+	size_t length;
+	unsigned i;
+	int err = 0;
 	char o;
-	void *mem_ctx;
 
-	while ((o = getopt_long(argc, argv, "e:l:o:g:abW", longopts, NULL)) != -1) {
+	gen4asm_options_init(&options);
+
+	while ((o = getopt_long(argc, argv, "e:l:o:g:R:abrcCOW", longopts, NULL)) != -1) {
 		switch (o) {
 		case 'o':
 			if (strcmp(optarg, "-") != 0)
@@ -328,10 +224,25 @@ int main(int argc, char **argv)
 		}
 
 		case 'a':
-			advanced_flag = 1;
+			options.advanced = true;
 			break;
 		case 'b':
-			binary_like_output = 1;
+			output_format = OUTPUT_BYTES;
+			break;
+		case 'r':
+			output_format = OUTPUT_RAW;
+			break;
+		case 'c':
+			output_format = OUTPUT_CONTAINER;
+			break;
+		case 'C':
+			options.compact = true;
+			break;
+		case 'O':
+			options.optimize = true;
+			break;
+		case 'R':
+			report_file = optarg;
 			break;
 
 		case 'e':
@@ -346,7 +257,7 @@ int main(int argc, char **argv)
 			break;
 
 		case 'W':
-			warning_flags |= WARN_ALL;
+			options.all_warnings = true;
 			break;
 
 		default:
@@ -363,27 +274,72 @@ int main(int argc, char **argv)
 
 	if (strcmp(argv[0], "-") != 0) {
 		input_filename = argv[0];
-		yyin = fopen(input_filename, "r");
-		if (yyin == NULL) {
+		input = fopen(input_filename, "r");
+		if (input == NULL) {
 			perror("Couldn't open input file");
 			exit(1);
 		}
 	}
 
-	brw_init_context(&genasm_brw_context, gen_level);
-	mem_ctx = ralloc_context(NULL);
-	brw_init_compile(&genasm_brw_context, &genasm_compile, mem_ctx);
+	source = gen4bin_read_file(input, &length);
+	if (source == NULL) {
+		perror("Couldn't read input file");
+		exit(1);
+	}
 
-	err = yyparse();
+	if (input != stdin)
+		fclose(input);
 
-	if (strcmp(argv[0], "-"))
-		fclose(yyin);
+	if (read_entry_file(entry_table_file)) {
+		fprintf(stderr, "Read entry file error\n");
+		exit(1);
+	}
 
-	yylex_destroy();
+	options.gen = gen_level;
+	options.filename = input_filename;
+	options.entry_points = (const char *const *)entry_point_table;
+	options.num_entry_points = num_entry_points;
+	options.diagnostics = stderr;
 
-	if (err || errors)
+	program = gen4asm_assemble(source, length, &options);
+	free(source);
+	free_entry_point_table();
+
+	if (program == NULL) {
+		fprintf(stderr, "Out of memory\n");
+		exit(1);
+	}
+
+	if (program->num_errors)
 		exit (1);
 
+	if (report_file) {
+		FILE *report = strcmp(report_file, "-") ?
+			fopen(report_file, "w") : stderr;
+
+		if (report == NULL) {
+			perror("Couldn't open report file");
+			exit(1);
+		}
+		print_changes(report, program, input_filename);
+		if (report != stderr)
+			fclose(report);
+	}
+
+	if (options.compact) {
+		if (gen_level < 60)
+			fprintf(stderr, "Compaction needs gen6+, ignored\n");
+		else
+			fprintf(stderr, "Compacted %u of %u instructions, "
+				"%zu -> %zu bytes (%.1f%% smaller)\n",
+				program->num_compacted,
+				program->num_instructions,
+				program->uncompacted_size, program->size,
+				program->uncompacted_size ?
+				100. * (program->uncompacted_size - program->size) /
+				program->uncompacted_size : 0.);
+	}
+
 	if (output_file) {
 		output = fopen(output_file, "w");
 		if (output == NULL) {
@@ -393,121 +349,53 @@ int main(int argc, char **argv)
 
 	}
 
-	if (read_entry_file(entry_table_file)) {
-		fprintf(stderr, "Read entry file error\n");
-		exit(1);
-	}
-	inst_offset = 0 ;
-	for (entry = compiled_program.first;
-		entry != NULL; entry = entry->next) {
-	    entry->inst_offset = inst_offset;
-	    entry1 = entry->next;
-	    if (entry1 && is_label(entry1) && is_entry_point(entry1)) {
-		// insert NOP instructions until (inst_offset+1) % 4 == 0
-		while (((inst_offset+1) % 4) != 0) {
-		    tmp_entry = calloc(sizeof(*tmp_entry), 1);
-		    tmp_entry->insn.gen.header.opcode = BRW_OPCODE_NOP;
-		    entry->next = tmp_entry;
-		    tmp_entry->next = entry1;
-		    entry = tmp_entry;
-		    tmp_entry->inst_offset = ++inst_offset;
-		}
-	    }
-	    if (!is_label(entry))
-              inst_offset++;
-	}
-
-	for (entry = compiled_program.first; entry; entry = entry->next)
-	    if (is_label(entry))
-		add_label(entry);
-
-	if (need_export) {
+	/* with a container the labels are exported through the container */
+	if (need_export && output_format != OUTPUT_CONTAINER) {
 		if (export_filename) {
 			export_file = fopen(export_filename, "w");
 		} else {
 			export_file = fopen("export.inc", "w");
 		}
-		for (entry = compiled_program.first;
-			entry != NULL; entry = entry->next) {
-		    if (is_label(entry))
-			fprintf(export_file, "#define %s_IP %d\n",
-				label_name(entry), (IS_GENx(5) ? 2 : 1)*(entry->inst_offset));
+		for (i = 0; i < program->num_labels; i++) {
+			const struct gen4asm_label *label = &program->labels[i];
+
+			/* the IPs count full instructions */
+			if (label->offset % 16)
+				fprintf(stderr, "Label %s is not 16 byte aligned, "
+					"not exported\n", label->name);
+			else
+				fprintf(export_file, "#define %s_IP %d\n",
+					label->name,
+					(gen_level >= 50 && gen_level < 60 ? 2 : 1) *
+					label->offset / 16);
 		}
 		fclose(export_file);
 	}
 
-	for (entry = compiled_program.first; entry; entry = entry->next) {
-	    struct relocation *reloc = &entry->reloc;
-	    struct brw_instruction *inst = &entry->insn.gen;
-
-	    if (!is_relocatable(entry))
-		continue;
-
-	    if (reloc->first_reloc_target)
-		reloc->first_reloc_offset = label_to_addr(reloc->first_reloc_target, entry->inst_offset) - entry->inst_offset;
-
-	    if (reloc->second_reloc_target)
-		reloc->second_reloc_offset = label_to_addr(reloc->second_reloc_target, entry->inst_offset) - entry->inst_offset;
-
-	    if (reloc->second_reloc_offset) {
-		// this is a branch instruction with two offset arguments
-		inst->bits3.break_cont.jip = jump_distance(reloc->first_reloc_offset);
-		inst->bits3.break_cont.uip = jump_distance(reloc->second_reloc_offset);
-	    } else if (reloc->first_reloc_offset) {
-		// this is a branch instruction with one offset argument
-		int offset = reloc->first_reloc_offset;
-		/* bspec: Unlike other flow control instructions, the offset used by JMPI is relative to the incremented instruction pointer rather than the IP value for the instruction itself. */
-
-		int is_jmpi = inst->header.opcode == BRW_OPCODE_JMPI; // target relative to the post-incremented IP, so delta == 1 if JMPI
-		if(is_jmpi)
-		    offset --;
-		offset = jump_distance(offset);
-		if (is_jmpi && (gen_level == 75))
-			offset = offset * 8;
-
-		if(!IS_GENp(6)) {
-		    inst->bits3.JIP = offset;
-		    if(inst->header.opcode == BRW_OPCODE_ELSE)
-			inst->bits3.break_cont.uip = 1; /* Set the istack pop count, which must always be 1. */
-		} else if(IS_GENx(6)) {
-		    /* TODO: endif JIP pos is not in Gen6 spec. may be bits1 */
-		    int opcode = inst->header.opcode;
-		    if(opcode == BRW_OPCODE_CALL || opcode == BRW_OPCODE_JMPI)
-			inst->bits3.JIP = offset; // for CALL, JMPI
-		    else
-			inst->bits1.branch_gen6.jump_count = offset; // for CASE,ELSE,FORK,IF,WHILE
-		} else if(IS_GENp(7)) {
-		    int opcode = inst->header.opcode;
-		    /* Gen7 JMPI Restrictions in bspec:
-		     * The JIP data type must be Signed DWord
-		     */
-		    if(opcode == BRW_OPCODE_JMPI)
-			inst->bits3.JIP = offset;
-		    else
-			inst->bits3.break_cont.jip = offset;
+	switch (output_format) {
+	case OUTPUT_RAW:
+		fwrite(program->code, 1, program->size, output);
+		break;
+	case OUTPUT_CONTAINER:
+		if (gen4bin_write(output, program, need_export)) {
+			perror("Couldn't write container");
+			err = 1;
 		}
-	    }
-	}
-
-	if (binary_like_output)
+		break;
+	case OUTPUT_BYTES:
 		fprintf(output, "%s", binary_prepend);
-
-	for (entry = compiled_program.first;
-		entry != NULL;
-		entry = entry1) {
-	    entry1 = entry->next;
-	    if (!is_label(entry))
-		print_instruction(output, &entry->insn.gen);
-	    else
-		free(entry->insn.label.name);
-	    free(entry);
+		/* fall through */
+	case OUTPUT_HEX:
+		code = program->code;
+		/* compacted instructions come in pairs per line */
+		for (i = 0; i < program->size / sizeof(*code); i++)
+			print_instruction(output, &code[i]);
+		if (output_format == OUTPUT_BYTES)
+			fprintf(output, "};");
+		break;
 	}
-	if (binary_like_output)
-		fprintf(output, "};");
 
-	free_entry_point_table(entry_point_table);
-	free_hash_table(declared_register_table);
-	free_label_table(label_table);
+	gen4asm_program_free(program);
 
 	fflush (output);
 	if (ferror (output)) {
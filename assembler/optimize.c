@@ -0,0 +1,802 @@
+/*
+ * Copyright © 2013 Intel Corporation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/*
+ * Peephole optimizations on the parsed program, run before the layout so
+ * that removed instructions leave no holes and the labels resolve to the
+ * new offsets.
+ *
+ * Only direct align1 operands of the plain ALU instructions are looked at.
+ * Anything else is taken to read every register, labels and flow control
+ * end the stretch of code a copy is known in, and sends are neither changed
+ * nor removed. Instructions with dependency control hints are left alone as
+ * they are only right for the exact sequence they were written for.
+ */
+
+#include <stdint.h>
+#include <string.h>
+
+#include "ralloc.h"
+#include "gen4asm.h"
+#include "brw_eu.h"
+
+/* GRFs and MRFs share one space of byte addresses, the MRFs come last */
+#define GRF_BYTES	(128 * 32)
+#define MRF_BASE	GRF_BYTES
+#define MAX_COPIES	32
+
+struct span {
+	unsigned start, end;		/* [start, end) */
+};
+
+struct operand {
+	unsigned file;
+	unsigned type;
+	unsigned addr;			/* for GRFs and MRFs */
+	unsigned vstride, width, hstride;	/* as encoded */
+	struct span span;
+};
+
+enum insn_class {
+	CLASS_BARRIER,
+	CLASS_ALU,
+	CLASS_SEND,
+};
+
+struct insn_info {
+	enum insn_class class;
+	unsigned exec_size;
+	unsigned num_srcs;
+	struct operand dst, src[2];
+
+	/* for sends, the GRF payload and response */
+	struct span reads, writes;
+	bool eot;
+};
+
+struct copy {
+	struct brw_program_instruction *entry;
+	struct insn_info info;
+	bool propagate;		/* not just good for spotting a repeat */
+};
+
+static unsigned type_size(unsigned type)
+{
+	switch (type) {
+	case BRW_REGISTER_TYPE_UB:
+	case BRW_REGISTER_TYPE_B:
+		return 1;
+	case BRW_REGISTER_TYPE_UW:
+	case BRW_REGISTER_TYPE_W:
+		return 2;
+	default:
+		return 4;
+	}
+}
+
+static unsigned region_stride(unsigned encoding)
+{
+	return encoding ? 1 << (encoding - 1) : 0;
+}
+
+static bool overlaps(struct span a, struct span b)
+{
+	return a.start < b.end && b.start < a.end;
+}
+
+static bool inside(struct span a, struct span b)
+{
+	return a.start >= b.start && a.end <= b.end;
+}
+
+static bool is_tracked(unsigned file)
+{
+	return file == BRW_GENERAL_REGISTER_FILE ||
+		file == BRW_MESSAGE_REGISTER_FILE;
+}
+
+static void set_operand(struct operand *op, unsigned file, unsigned type,
+			unsigned nr, unsigned subnr)
+{
+	op->file = file;
+	op->type = type;
+	op->span.start = op->span.end = 0;
+	if (file == BRW_GENERAL_REGISTER_FILE)
+		op->addr = nr * 32 + subnr;
+	else if (file == BRW_MESSAGE_REGISTER_FILE)
+		op->addr = MRF_BASE + (nr & 0x1f) * 32 + subnr;
+	else
+		op->addr = 0;
+}
+
+static void set_source_span(struct operand *op, unsigned exec_size)
+{
+	unsigned width = 1 << op->width;
+	unsigned rows = exec_size > width ? exec_size / width : 1;
+
+	if (!is_tracked(op->file))
+		return;
+	op->span.start = op->addr;
+	op->span.end = op->addr + ((rows - 1) * region_stride(op->vstride) +
+				   (width - 1) * region_stride(op->hstride) + 1) *
+		type_size(op->type);
+}
+
+static bool is_alu(struct gen4asm_context *ctx, unsigned opcode)
+{
+	switch (opcode) {
+	case BRW_OPCODE_MOV:
+	case BRW_OPCODE_SEL:
+	case BRW_OPCODE_NOT:
+	case BRW_OPCODE_AND:
+	case BRW_OPCODE_OR:
+	case BRW_OPCODE_XOR:
+	case BRW_OPCODE_SHR:
+	case BRW_OPCODE_SHL:
+	case BRW_OPCODE_ASR:
+	case BRW_OPCODE_CMP:
+	case BRW_OPCODE_CMPN:
+	case BRW_OPCODE_ADD:
+	case BRW_OPCODE_MUL:
+	case BRW_OPCODE_AVG:
+	case BRW_OPCODE_FRC:
+	case BRW_OPCODE_RNDU:
+	case BRW_OPCODE_RNDD:
+	case BRW_OPCODE_RNDE:
+	case BRW_OPCODE_RNDZ:
+	case BRW_OPCODE_LZD:
+	case BRW_OPCODE_MAC:
+	case BRW_OPCODE_MACH:
+		return true;
+	case BRW_OPCODE_MATH:
+		return IS_GENp(6);
+	default:
+		return false;
+	}
+}
+
+static void decode_send(struct gen4asm_context *ctx,
+			const struct brw_instruction *insn,
+			struct insn_info *info)
+{
+	unsigned mlen, rlen, src0;
+
+	if (IS_GENp(5)) {
+		mlen = insn->bits3.generic_gen5.msg_length;
+		rlen = insn->bits3.generic_gen5.response_length;
+		info->eot = IS_GENp(6) ? insn->bits3.generic_gen5.end_of_thread :
+			insn->bits2.send_gen5.end_of_thread;
+	} else {
+		mlen = insn->bits3.generic.msg_length;
+		rlen = insn->bits3.generic.response_length;
+		info->eot = insn->bits3.generic.end_of_thread;
+	}
+
+	/* before gen6 src0 is moved into the first MRF of the payload */
+	src0 = insn->bits2.da1.src0_reg_nr * 32;
+	if (insn->bits1.da1.src0_reg_file == BRW_GENERAL_REGISTER_FILE) {
+		info->reads.start = src0;
+		info->reads.end = src0 + 32 * (IS_GENp(6) ? mlen : 1);
+	}
+	if (insn->bits1.da1.dest_reg_file == BRW_GENERAL_REGISTER_FILE) {
+		info->writes.start = insn->bits1.da1.dest_reg_nr * 32;
+		info->writes.end = info->writes.start + 32 * rlen;
+	}
+}
+
+/*
+ * Work out what an instruction reads and writes. Returns false, with
+ * info->class set to CLASS_BARRIER, for everything this file doesn't
+ * follow.
+ */
+static bool decode(struct gen4asm_context *ctx,
+		   const struct brw_instruction *insn, struct insn_info *info)
+{
+	unsigned opcode = insn->header.opcode, s;
+
+	memset(info, 0, sizeof(*info));
+	info->class = CLASS_BARRIER;
+	info->exec_size = 1 << insn->header.execution_size;
+
+	if (insn->header.dependency_control ||
+	    insn->header.access_mode != BRW_ALIGN_1)
+		return false;
+
+	if (opcode == BRW_OPCODE_SEND || opcode == BRW_OPCODE_SENDC) {
+		if (insn->bits2.da1.src0_address_mode != BRW_ADDRESS_DIRECT)
+			return false;
+		decode_send(ctx, insn, info);
+		info->class = CLASS_SEND;
+		return true;
+	}
+
+	if (!is_alu(ctx, opcode))
+		return false;
+	/* writes the remainder into the register after dst */
+	if (opcode == BRW_OPCODE_MATH &&
+	    insn->header.destreg__conditionalmod ==
+	    BRW_MATH_FUNCTION_INT_DIV_QUOTIENT_AND_REMAINDER)
+		return false;
+	info->num_srcs = opcode_descs[opcode].nsrc;
+
+	if (insn->bits1.da1.dest_address_mode != BRW_ADDRESS_DIRECT)
+		return false;
+	set_operand(&info->dst, insn->bits1.da1.dest_reg_file,
+		    insn->bits1.da1.dest_reg_type,
+		    insn->bits1.da1.dest_reg_nr, insn->bits1.da1.dest_subreg_nr);
+	info->dst.hstride = insn->bits1.da1.dest_horiz_stride;
+	if (is_tracked(info->dst.file)) {
+		info->dst.span.start = info->dst.addr;
+		info->dst.span.end = info->dst.addr +
+			((info->exec_size - 1) * (region_stride(info->dst.hstride) ?: 1) + 1) *
+			type_size(info->dst.type);
+	}
+
+	set_operand(&info->src[0], insn->bits1.da1.src0_reg_file,
+		    insn->bits1.da1.src0_reg_type,
+		    insn->bits2.da1.src0_reg_nr, insn->bits2.da1.src0_subreg_nr);
+	if (info->src[0].file != BRW_IMMEDIATE_VALUE) {
+		if (insn->bits2.da1.src0_address_mode != BRW_ADDRESS_DIRECT)
+			return false;
+		info->src[0].vstride = insn->bits2.da1.src0_vert_stride;
+		info->src[0].width = insn->bits2.da1.src0_width;
+		info->src[0].hstride = insn->bits2.da1.src0_horiz_stride;
+	}
+
+	if (info->num_srcs > 1) {
+		set_operand(&info->src[1], insn->bits1.da1.src1_reg_file,
+			    insn->bits1.da1.src1_reg_type,
+			    insn->bits3.da1.src1_reg_nr,
+			    insn->bits3.da1.src1_subreg_nr);
+		if (info->src[1].file != BRW_IMMEDIATE_VALUE) {
+			if (info->src[0].file == BRW_IMMEDIATE_VALUE ||
+			    insn->bits3.da1.src1_address_mode != BRW_ADDRESS_DIRECT)
+				return false;
+			info->src[1].vstride = insn->bits3.da1.src1_vert_stride;
+			info->src[1].width = insn->bits3.da1.src1_width;
+			info->src[1].hstride = insn->bits3.da1.src1_horiz_stride;
+		}
+	}
+
+	for (s = 0; s < info->num_srcs; s++) {
+		/* VxH regions are only for indirect addressing */
+		if (info->src[s].vstride == 0xf)
+			return false;
+		set_source_span(&info->src[s], info->exec_size);
+	}
+
+	info->class = CLASS_ALU;
+	return true;
+}
+
+static bool is_contiguous(const struct operand *op, unsigned exec_size)
+{
+	unsigned width = 1 << op->width;
+
+	return op->hstride == 1 &&
+		(region_stride(op->vstride) == width || exec_size <= width);
+}
+
+static bool is_scalar(const struct operand *op)
+{
+	return op->vstride == 0 && op->width == 0 && op->hstride == 0;
+}
+
+/* a MOV whose repeats can be dropped, and maybe its uses rewritten */
+static bool is_copy(const struct brw_instruction *insn,
+		    const struct insn_info *info, bool *propagate)
+{
+	const struct operand *dst = &info->dst, *src = &info->src[0];
+
+	if (insn->header.opcode != BRW_OPCODE_MOV ||
+	    insn->header.predicate_control ||
+	    insn->header.destreg__conditionalmod ||
+	    insn->header.acc_wr_control ||
+	    !is_tracked(dst->file) ||
+	    (src->file != BRW_IMMEDIATE_VALUE &&
+	     src->file != BRW_GENERAL_REGISTER_FILE) ||
+	    overlaps(dst->span, src->span))
+		return false;
+
+	*propagate = dst->file == BRW_GENERAL_REGISTER_FILE &&
+		dst->hstride == 1 &&
+		dst->type == src->type &&
+		!insn->header.saturate &&
+		!insn->bits2.da1.src0_abs && !insn->bits2.da1.src0_negate;
+	if (src->file == BRW_IMMEDIATE_VALUE)
+		*propagate &= src->type == BRW_REGISTER_TYPE_UD ||
+			src->type == BRW_REGISTER_TYPE_D ||
+			src->type == BRW_REGISTER_TYPE_UW ||
+			src->type == BRW_REGISTER_TYPE_W ||
+			src->type == BRW_REGISTER_TYPE_F;
+
+	return true;
+}
+
+static void record_change(struct gen4asm_context *ctx, enum gen4asm_pass pass,
+			  const struct brw_program_instruction *entry,
+			  const struct brw_instruction *before, bool removed)
+{
+	struct gen4asm_program *result = ctx->result;
+	struct gen4asm_change *c;
+
+	c = reralloc(result, (void *)result->changes,
+		     struct gen4asm_change, result->num_changes + 1);
+	result->changes = c;
+	c += result->num_changes++;
+
+	c->pass = pass;
+	c->line = entry->line;
+	c->removed = removed;
+	memcpy(c->before, before, sizeof(c->before));
+	if (removed)
+		memset(c->after, 0, sizeof(c->after));
+	else
+		memcpy(c->after, &entry->insn.gen, sizeof(c->after));
+}
+
+static void set_source(struct brw_instruction *insn, unsigned s,
+		       unsigned addr, unsigned vstride, unsigned width,
+		       unsigned hstride)
+{
+	if (s == 0) {
+		insn->bits2.da1.src0_reg_nr = addr / 32;
+		insn->bits2.da1.src0_subreg_nr = addr % 32;
+		insn->bits2.da1.src0_vert_stride = vstride;
+		insn->bits2.da1.src0_width = width;
+		insn->bits2.da1.src0_horiz_stride = hstride;
+	} else {
+		insn->bits3.da1.src1_reg_nr = addr / 32;
+		insn->bits3.da1.src1_subreg_nr = addr % 32;
+		insn->bits3.da1.src1_vert_stride = vstride;
+		insn->bits3.da1.src1_width = width;
+		insn->bits3.da1.src1_horiz_stride = hstride;
+	}
+}
+
+static bool can_take_immediate(const struct brw_instruction *insn,
+			       const struct insn_info *info, unsigned s)
+{
+	switch (insn->header.opcode) {
+	case BRW_OPCODE_MOV:
+	case BRW_OPCODE_NOT:
+		return s == 0;
+	case BRW_OPCODE_SEL:
+	case BRW_OPCODE_AND:
+	case BRW_OPCODE_OR:
+	case BRW_OPCODE_XOR:
+	case BRW_OPCODE_SHR:
+	case BRW_OPCODE_SHL:
+	case BRW_OPCODE_ASR:
+	case BRW_OPCODE_CMP:
+	case BRW_OPCODE_ADD:
+	case BRW_OPCODE_MUL:
+		/* only src1 can be an immediate, and only one of them */
+		return s == 1 && info->src[0].file != BRW_IMMEDIATE_VALUE;
+	default:
+		return false;
+	}
+}
+
+/*
+ * Read source s of entry from where copy got its value, or fold in its
+ * immediate. The source has to read what the MOV wrote with the same
+ * layout, or be a scalar out of it. Unless the MOV ignores the execution
+ * mask, it also has to run with the same channels enabled.
+ */
+static bool propagate_copy(struct gen4asm_context *ctx,
+			   struct brw_program_instruction *entry,
+			   const struct insn_info *info, unsigned s,
+			   const struct copy *copy)
+{
+	struct brw_instruction *insn = &entry->insn.gen, before = *insn;
+	const struct brw_instruction *mov = &copy->entry->insn.gen;
+	const struct operand *use = &info->src[s];
+	const struct operand *dst = &copy->info.dst, *src = &copy->info.src[0];
+	unsigned exec_size = copy->info.exec_size, size, k, addr;
+	bool mask_disable, same_layout, scalar;
+
+	if (use->type != dst->type || !inside(use->span, dst->span))
+		return false;
+
+	size = type_size(use->type);
+	mask_disable = mov->header.mask_control == BRW_MASK_DISABLE;
+	same_layout = use->addr == dst->addr &&
+		is_contiguous(use, info->exec_size) &&
+		((info->exec_size == exec_size &&
+		  insn->header.compression_control ==
+		  mov->header.compression_control &&
+		  insn->header.mask_control == mov->header.mask_control) ||
+		 (mask_disable && info->exec_size <= exec_size &&
+		  (1u << src->width) <= info->exec_size));
+	scalar = is_scalar(use) && mask_disable &&
+		(use->addr - dst->addr) % size == 0;
+	if (!same_layout && !scalar)
+		return false;
+
+	if (src->file == BRW_IMMEDIATE_VALUE) {
+		if (!can_take_immediate(insn, info, s))
+			return false;
+		if (s == 0) {
+			insn->bits1.da1.src0_reg_file = BRW_IMMEDIATE_VALUE;
+			insn->bits1.da1.src0_reg_type = src->type;
+			/* as brw_set_src0() does */
+			insn->bits1.da1.src1_reg_file = BRW_ARCHITECTURE_REGISTER_FILE;
+			insn->bits1.da1.src1_reg_type = src->type;
+		} else {
+			insn->bits1.da1.src1_reg_file = BRW_IMMEDIATE_VALUE;
+			insn->bits1.da1.src1_reg_type = src->type;
+		}
+		insn->bits3.ud = mov->bits3.ud;
+		record_change(ctx, GEN4ASM_PASS_IMMEDIATE, entry, &before, false);
+		return true;
+	}
+
+	/* gen6 math has its own restrictions on the regions */
+	if (insn->header.opcode == BRW_OPCODE_MATH)
+		return false;
+
+	if (same_layout) {
+		set_source(insn, s, src->addr, src->vstride, src->width,
+			   src->hstride);
+	} else {
+		k = (use->addr - dst->addr) / size;
+		addr = src->addr +
+			((k >> src->width) * region_stride(src->vstride) +
+			 (k & ((1 << src->width) - 1)) * region_stride(src->hstride)) *
+			size;
+		set_source(insn, s, addr, 0, 0, 0);
+	}
+	record_change(ctx, GEN4ASM_PASS_COPY_PROPAGATION, entry, &before, false);
+	return true;
+}
+
+/* forget the copies the instruction overwrites the source or result of */
+static void kill_copies(struct copy *copies, unsigned *num_copies,
+			const struct insn_info *info)
+{
+	struct span writes = info->class == CLASS_SEND ?
+		info->writes : info->dst.span;
+	unsigned n, i = 0;
+
+	for (n = 0; n < *num_copies; n++) {
+		const struct insn_info *copy = &copies[n].info;
+
+		if (overlaps(writes, copy->dst.span) ||
+		    overlaps(writes, copy->src[0].span))
+			continue;
+		/* the message may be built in place */
+		if (info->class == CLASS_SEND && copy->dst.addr >= MRF_BASE)
+			continue;
+		copies[i++] = copies[n];
+	}
+	*num_copies = i;
+}
+
+/*
+ * Copy propagation, immediate folding and dropping MOVs of what is already
+ * in place, in one walk over the program.
+ */
+static bool propagate_copies(struct gen4asm_context *ctx, bool can_remove)
+{
+	struct copy copies[MAX_COPIES];
+	struct brw_program_instruction **link, *entry, *last = NULL;
+	unsigned num_copies = 0, n, s;
+	bool progress = false, propagate;
+
+	for (link = &ctx->program.first; (entry = *link) != NULL; ) {
+		struct brw_instruction *insn = &entry->insn.gen;
+		struct insn_info info;
+
+		if (is_label(entry) || is_relocatable(entry) ||
+		    !decode(ctx, insn, &info)) {
+			num_copies = 0;
+			goto next;
+		}
+
+		if (info.class == CLASS_ALU) {
+			for (s = 0; s < info.num_srcs; s++) {
+				if (info.src[s].file != BRW_GENERAL_REGISTER_FILE)
+					continue;
+				/* the copies don't overlap, at most one matches */
+				for (n = 0; n < num_copies; n++) {
+					if (!copies[n].propagate ||
+					    !overlaps(info.src[s].span,
+						      copies[n].info.dst.span))
+						continue;
+					if (propagate_copy(ctx, entry, &info, s,
+							   &copies[n])) {
+						decode(ctx, insn, &info);
+						progress = true;
+					}
+					break;
+				}
+			}
+		}
+
+		if (info.class == CLASS_ALU && is_copy(insn, &info, &propagate)) {
+			for (n = 0; n < num_copies; n++)
+				if (memcmp(&copies[n].entry->insn.gen, insn,
+					   sizeof(*insn)) == 0)
+					break;
+			if (n < num_copies && can_remove) {
+				record_change(ctx, GEN4ASM_PASS_REDUNDANT_MOV,
+					      entry, insn, true);
+				*link = entry->next;
+				progress = true;
+				continue;
+			}
+		}
+
+		kill_copies(copies, &num_copies, &info);
+
+		if (info.class == CLASS_ALU && is_copy(insn, &info, &propagate)) {
+			if (num_copies == MAX_COPIES)
+				memmove(copies, copies + 1,
+					--num_copies * sizeof(*copies));
+			copies[num_copies].entry = entry;
+			copies[num_copies].info = info;
+			copies[num_copies].propagate = propagate;
+			num_copies++;
+		}
+
+	next:
+		last = entry;
+		link = &entry->next;
+	}
+	ctx->program.last = last;
+
+	return progress;
+}
+
+static void set_live(uint64_t *live, struct span span, bool value)
+{
+	unsigned n;
+
+	if (span.end > GRF_BYTES)
+		span.end = GRF_BYTES;
+	for (n = span.start; n < span.end; n++) {
+		if (value)
+			live[n / 64] |= 1ull << (n % 64);
+		else
+			live[n / 64] &= ~(1ull << (n % 64));
+	}
+}
+
+static bool any_live(const uint64_t *live, struct span span)
+{
+	unsigned n;
+
+	if (span.end > GRF_BYTES)
+		span.end = GRF_BYTES;
+	for (n = span.start; n < span.end; n++)
+		if (live[n / 64] & (1ull << (n % 64)))
+			return true;
+	return false;
+}
+
+static bool is_removable(const struct brw_instruction *insn,
+			 const struct insn_info *info)
+{
+	switch (insn->header.opcode) {
+	case BRW_OPCODE_MAC:
+	case BRW_OPCODE_MACH:
+	case BRW_OPCODE_CMP:
+	case BRW_OPCODE_CMPN:
+		return false;
+	case BRW_OPCODE_MATH:
+		/* the conditional modifier bits hold the function */
+		break;
+	default:
+		if (insn->header.destreg__conditionalmod)
+			return false;
+		break;
+	}
+
+	return info->dst.file == BRW_GENERAL_REGISTER_FILE &&
+		!insn->header.acc_wr_control;
+}
+
+/*
+ * Remove instructions whose GRF result nobody reads. Walking backwards,
+ * everything is live at the end of the program unless it ends the thread,
+ * and at every jump. A register only stops being live where it is written
+ * without a predicate and regardless of the execution mask, as otherwise
+ * some channels may keep the old value.
+ */
+static bool eliminate_dead_code(struct gen4asm_context *ctx)
+{
+	struct brw_program_instruction *entry, **entries, **link;
+	uint64_t live[GRF_BYTES / 64];
+	unsigned num_entries = 0, n, s;
+	bool progress = false;
+
+	for (entry = ctx->program.first; entry; entry = entry->next)
+		num_entries++;
+	entries = ralloc_array(ctx->mem_ctx, struct brw_program_instruction *,
+			       num_entries ?: 1);
+	num_entries = 0;
+	for (entry = ctx->program.first; entry; entry = entry->next)
+		entries[num_entries++] = entry;
+
+	memset(live, 0xff, sizeof(live));
+	for (n = num_entries; n--; ) {
+		struct brw_instruction *insn;
+		struct insn_info info;
+
+		entry = entries[n];
+		insn = &entry->insn.gen;
+
+		/* nothing jumps backwards past a label */
+		if (is_label(entry))
+			continue;
+
+		if (is_relocatable(entry) || !decode(ctx, insn, &info)) {
+			memset(live, 0xff, sizeof(live));
+			continue;
+		}
+
+		if (info.class == CLASS_SEND) {
+			if (info.eot)
+				memset(live, 0, sizeof(live));
+			set_live(live, info.reads, true);
+			continue;
+		}
+
+		if (is_removable(insn, &info) && !any_live(live, info.dst.span)) {
+			record_change(ctx, GEN4ASM_PASS_DEAD_CODE, entry, insn,
+				      true);
+			entries[n] = NULL;
+			progress = true;
+			continue;
+		}
+
+		if (!insn->header.predicate_control &&
+		    insn->header.mask_control == BRW_MASK_DISABLE &&
+		    info.dst.hstride == 1)
+			set_live(live, info.dst.span, false);
+		for (s = 0; s < info.num_srcs; s++)
+			set_live(live, info.src[s].span, true);
+	}
+
+	if (progress) {
+		/* the changes were recorded last to first */
+		struct gen4asm_change *changes = (void *)ctx->result->changes;
+		unsigned first = ctx->result->num_changes, i;
+
+		for (i = 0; i < num_entries; i++)
+			first -= entries[i] == NULL;
+		for (i = 0; i < (ctx->result->num_changes - first) / 2; i++) {
+			struct gen4asm_change tmp = changes[first + i];
+			changes[first + i] =
+				changes[ctx->result->num_changes - 1 - i];
+			changes[ctx->result->num_changes - 1 - i] = tmp;
+		}
+
+		link = &ctx->program.first;
+		ctx->program.last = NULL;
+		for (i = 0; i < num_entries; i++) {
+			if (entries[i] == NULL)
+				continue;
+			*link = entries[i];
+			link = &entries[i]->next;
+			ctx->program.last = entries[i];
+		}
+		*link = NULL;
+	}
+
+	ralloc_free(entries);
+	return progress;
+}
+
+static bool remove_nops(struct gen4asm_context *ctx)
+{
+	struct brw_program_instruction **link, *entry, *last = NULL;
+	bool progress = false;
+
+	for (link = &ctx->program.first; (entry = *link) != NULL; ) {
+		if (!is_label(entry) && !is_relocatable(entry) &&
+		    entry->insn.gen.header.opcode == BRW_OPCODE_NOP) {
+			record_change(ctx, GEN4ASM_PASS_NOP, entry,
+				      &entry->insn.gen, true);
+			*link = entry->next;
+			progress = true;
+			continue;
+		}
+		last = entry;
+		link = &entry->next;
+	}
+	ctx->program.last = last;
+
+	return progress;
+}
+
+/* Jumps by a number of instructions rather than to a label */
+static bool has_fixed_jumps(struct gen4asm_context *ctx)
+{
+	struct brw_program_instruction *entry;
+
+	for (entry = ctx->program.first; entry; entry = entry->next) {
+		const struct relocation *reloc = &entry->reloc;
+		const struct brw_instruction *insn = &entry->insn.gen;
+
+		if (is_label(entry))
+			continue;
+
+		/* the parser puts every jump in here, with or without a label */
+		if (is_relocatable(entry)) {
+			if ((!reloc->first_reloc_target &&
+			     reloc->first_reloc_offset) ||
+			    (!reloc->second_reloc_target &&
+			     reloc->second_reloc_offset))
+				return true;
+			/* the distance is in a register */
+			if (insn->header.opcode == BRW_OPCODE_JMPI &&
+			    insn->bits1.da1.src1_reg_file != BRW_IMMEDIATE_VALUE)
+				return true;
+			continue;
+		}
+
+		switch (insn->header.opcode) {
+		case BRW_OPCODE_JMPI:
+		case BRW_OPCODE_IF:
+		case BRW_OPCODE_IFF:
+		case BRW_OPCODE_ELSE:
+		case BRW_OPCODE_WHILE:
+		case BRW_OPCODE_BREAK:
+		case BRW_OPCODE_CONTINUE:
+		case BRW_OPCODE_HALT:
+		case BRW_OPCODE_CALL:
+			return true;
+		case BRW_OPCODE_ENDIF:
+			if (IS_GENp(6))
+				return true;
+			break;
+		default:
+			break;
+		}
+	}
+
+	return false;
+}
+
+void optimize_program(struct gen4asm_context *ctx)
+{
+	bool can_remove = !has_fixed_jumps(ctx), progress;
+	unsigned rounds = 0;
+
+	if (!can_remove && (ctx->warning_flags & WARN_ALL))
+		gen4asm_message(GEN4ASM_WARNING, 0, 0,
+				"jumps without a label, no instruction "
+				"will be removed\n");
+
+	if (can_remove)
+		remove_nops(ctx);
+
+	/* each pass can open up more work for the other one */
+	do {
+		progress = propagate_copies(ctx, can_remove);
+		if (can_remove)
+			progress |= eliminate_dead_code(ctx);
+	} while (progress && ++rounds < 16);
+}
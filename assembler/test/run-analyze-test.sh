@@ -0,0 +1,14 @@
+#!/bin/sh
+
+SRCDIR=${srcdir-`pwd`}
+BUILDDIR=${top_builddir-`pwd`}
+
+# extra intel-gen4analyze options for the test, if any
+FLAGS=`cat $SRCDIR/TEST.flags 2> /dev/null`
+
+${BUILDDIR}/assembler/intel-gen4analyze $FLAGS -o TEST.out $SRCDIR/TEST.g4a
+if cmp TEST.out ${SRCDIR}/TEST.expected 2> /dev/null; then : ; else
+  echo "Output comparison for TEST"
+  diff -u ${SRCDIR}/TEST.expected TEST.out
+  exit 1;
+fi
@@ -0,0 +1,14 @@
+#!/bin/sh
+
+SRCDIR=${srcdir-`pwd`}
+BUILDDIR=${top_builddir-`pwd`}
+
+# extra intel-gen4disasm options for the test, if any
+FLAGS=`cat $SRCDIR/TEST.flags 2> /dev/null`
+
+${BUILDDIR}/assembler/intel-gen4disasm $FLAGS -o TEST.out $SRCDIR/TEST.bin
+if cmp TEST.out ${SRCDIR}/TEST.expected 2> /dev/null; then : ; else
+  echo "Output comparison for TEST"
+  diff -u ${SRCDIR}/TEST.expected TEST.out
+  exit 1;
+fi
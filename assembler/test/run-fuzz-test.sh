@@ -0,0 +1,8 @@
+#!/bin/sh
+
+BUILDDIR=${top_builddir-`pwd`}
+
+# A short run of gen4asm_fuzz with the fixed default seed: every
+# instruction has to come back from brw_disasm() with the same bits and
+# no source may crash the parser.
+exec ${BUILDDIR}/assembler/gen4asm_fuzz --strict --count 1000
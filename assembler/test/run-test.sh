@@ -3,7 +3,10 @@
 SRCDIR=${srcdir-`pwd`}
 BUILDDIR=${top_builddir-`pwd`}
 
-${BUILDDIR}/assembler/intel-gen4asm -o TEST.out $SRCDIR/TEST.g4a
+# extra intel-gen4asm options for the test, if any
+FLAGS=`cat $SRCDIR/TEST.flags 2> /dev/null`
+
+${BUILDDIR}/assembler/intel-gen4asm $FLAGS -o TEST.out $SRCDIR/TEST.g4a
 if cmp TEST.out ${SRCDIR}/TEST.expected 2> /dev/null; then : ; else
   echo "Output comparison for TEST"
   diff -u ${SRCDIR}/TEST.expected TEST.out
@@ -0,0 +1,396 @@
+/*
+ * Copyright © 2013 Intel Corporation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ *
+ */
+
+/**
+ * Throughput matrix of the ways the cpu can get at the contents of a bo.
+ *
+ * The variants sweep
+ *   path:    pwrite/pread, cpu mmap, gtt mmap and userptr
+ *   dir:     read or write
+ *   size:    4KiB to 256MiB
+ *   tiling:  none, x and y (only for the paths which go through the fence)
+ *   caching: the default of gem_create and llc (userptr objects are
+ *            always snooped)
+ *   cache:   warm, or cold with the cpu caches evicted before every iteration
+ *
+ * Every iteration moves the whole object, including the set-domain call a
+ * real client would need for coherency. Combinations which the kernel
+ * rejects (no userptr, no set-caching, no fence for the tiling mode) are
+ * skipped, as are gtt objects bigger than half the mappable aperture.
+ *
+ * Use --csv=- to get the matrix as a table, and --filter to cut it down, e.g.
+ *
+ *   intel_access_matrix --filter=path=gtt --csv=gtt.csv
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include "drm.h"
+#include "i915_drm.h"
+#include "drmtest.h"
+#include "intel_gpu_tools.h"
+#include "igt_bench.h"
+
+#define MIN_SIZE	(4 << 10)
+#define MAX_SIZE	(256 << 20)
+
+#define TILED_STRIDE	512
+
+struct local_i915_gem_userptr {
+	uint64_t user_ptr;
+	uint64_t user_size;
+	uint32_t flags;
+	uint32_t handle;
+};
+
+#define LOCAL_DRM_I915_GEM_USERPTR	0x33
+#define LOCAL_IOCTL_I915_GEM_USERPTR \
+	DRM_IOWR(DRM_COMMAND_BASE + LOCAL_DRM_I915_GEM_USERPTR, struct local_i915_gem_userptr)
+
+struct local_drm_i915_gem_caching {
+	uint32_t handle;
+	uint32_t caching;
+};
+
+#define LOCAL_DRM_I915_GEM_SET_CACHEING	0x2f
+#define LOCAL_DRM_IOCTL_I915_GEM_SET_CACHEING \
+	DRM_IOW(DRM_COMMAND_BASE + LOCAL_DRM_I915_GEM_SET_CACHEING, struct local_drm_i915_gem_caching)
+
+enum path { PWRITE, PREAD, CPU, GTT, USERPTR };
+
+static const char *path_str[] = {
+	[PWRITE] = "pwrite",
+	[PREAD] = "pread",
+	[CPU] = "cpu",
+	[GTT] = "gtt",
+	[USERPTR] = "userptr",
+};
+
+static const char *tiling_str[] = {
+	[I915_TILING_NONE] = "none",
+	[I915_TILING_X] = "x",
+	[I915_TILING_Y] = "y",
+};
+
+static const char *caching_str[] = { "default", "llc" };
+
+struct access {
+	int fd;
+	enum path path;
+	bool write;
+	bool cold;
+	uint32_t handle;
+	size_t size;
+	void *ptr;		/* cpu/gtt mapping or userptr backing store */
+	void *user;		/* the client side of the copy */
+	char *trash;		/* evicts the cpu caches for cold runs */
+	size_t trash_size;
+};
+
+static bool set_tiling(int fd, uint32_t handle, int tiling)
+{
+	struct drm_i915_gem_set_tiling st;
+
+	memset(&st, 0, sizeof(st));
+	st.handle = handle;
+	st.tiling_mode = tiling;
+	st.stride = tiling ? TILED_STRIDE : 0;
+
+	return drmIoctl(fd, DRM_IOCTL_I915_GEM_SET_TILING, &st) == 0 &&
+		st.tiling_mode == tiling;
+}
+
+static bool set_caching(int fd, uint32_t handle, int caching)
+{
+	struct local_drm_i915_gem_caching arg;
+
+	arg.handle = handle;
+	arg.caching = caching;
+
+	return drmIoctl(fd, LOCAL_DRM_IOCTL_I915_GEM_SET_CACHEING, &arg) == 0;
+}
+
+static uint32_t userptr(int fd, void *ptr, size_t size)
+{
+	struct local_i915_gem_userptr arg;
+
+	memset(&arg, 0, sizeof(arg));
+	arg.user_ptr = (uintptr_t)ptr;
+	arg.user_size = size;
+
+	if (drmIoctl(fd, LOCAL_IOCTL_I915_GEM_USERPTR, &arg))
+		return 0;
+
+	return arg.handle;
+}
+
+static void *alloc_pages(size_t size)
+{
+	void *ptr;
+
+	if (posix_memalign(&ptr, 4096, size))
+		return NULL;
+
+	/* fault everything in up front, we're not measuring the page allocator */
+	memset(ptr, 0x5a, size);
+	return ptr;
+}
+
+static uint64_t mappable_size;
+
+static bool access_init(struct access *a, int fd, enum path path, bool write,
+			size_t size, int tiling, int caching)
+{
+	memset(a, 0, sizeof(*a));
+	a->fd = fd;
+	a->path = path;
+	a->write = write;
+	a->size = size;
+
+	a->user = alloc_pages(size);
+	if (a->user == NULL)
+		return false;
+
+	if (path == USERPTR) {
+		a->ptr = alloc_pages(size);
+		if (a->ptr == NULL)
+			return false;
+
+		a->handle = userptr(fd, a->ptr, size);
+		return a->handle != 0;
+	}
+
+	/*
+	 * Faulting in an object the aperture can't take is a SIGBUS, so leave
+	 * room for the scanout and whatever else is bound.
+	 */
+	if (path == GTT && size > mappable_size / 2)
+		return false;
+
+	a->handle = gem_create(fd, size);
+	if (tiling != I915_TILING_NONE && !set_tiling(fd, a->handle, tiling))
+		return false;
+	/* without set-caching only the default variants are left */
+	if (caching && !set_caching(fd, a->handle, caching))
+		return false;
+
+	switch (path) {
+	case CPU:
+		a->ptr = gem_mmap__cpu(fd, a->handle, size,
+				       PROT_READ | PROT_WRITE);
+		break;
+	case GTT:
+		a->ptr = gem_mmap__gtt(fd, a->handle, size,
+				       PROT_READ | PROT_WRITE);
+		break;
+	default:
+		/* pread/pwrite need the backing storage, not the mapping */
+		gem_write(fd, a->handle, 0, a->user, size);
+		return true;
+	}
+	if (a->ptr == NULL)
+		return false;
+
+	/* fault in the whole object before the first sample */
+	gem_set_domain(fd, a->handle,
+		       path == GTT ? I915_GEM_DOMAIN_GTT : I915_GEM_DOMAIN_CPU,
+		       path == GTT ? I915_GEM_DOMAIN_GTT : I915_GEM_DOMAIN_CPU);
+	memcpy(a->ptr, a->user, size);
+
+	return true;
+}
+
+static void access_fini(struct access *a)
+{
+	if (a->ptr && a->path != USERPTR)
+		munmap(a->ptr, a->size);
+	if (a->handle)
+		gem_close(a->fd, a->handle);
+	if (a->path == USERPTR)
+		free(a->ptr);
+	free(a->user);
+}
+
+static void evict_caches(void *data)
+{
+	struct access *a = data;
+	size_t i;
+
+	for (i = 0; i < a->trash_size; i += 64)
+		a->trash[i]++;
+}
+
+static void access_once(void *data)
+{
+	struct access *a = data;
+	unsigned domain;
+
+	switch (a->path) {
+	case PWRITE:
+		gem_write(a->fd, a->handle, 0, a->user, a->size);
+		return;
+	case PREAD:
+		gem_read(a->fd, a->handle, 0, a->user, a->size);
+		return;
+	case GTT:
+		domain = I915_GEM_DOMAIN_GTT;
+		break;
+	default:
+		domain = I915_GEM_DOMAIN_CPU;
+		break;
+	}
+
+	gem_set_domain(a->fd, a->handle, domain, a->write ? domain : 0);
+	if (a->write)
+		memcpy(a->ptr, a->user, a->size);
+	else
+		memcpy(a->user, a->ptr, a->size);
+}
+
+static void access_sync(void *data)
+{
+	struct access *a = data;
+
+	gem_sync(a->fd, a->handle);
+}
+
+static size_t cache_size(void)
+{
+	long size = -1;
+
+#ifdef _SC_LEVEL3_CACHE_SIZE
+	size = sysconf(_SC_LEVEL3_CACHE_SIZE);
+#endif
+	if (size <= 0)
+		size = 32 << 20;
+
+	/* twice the llc to be reasonably sure nothing of ours survives */
+	return 2 * size;
+}
+
+static void measure(struct igt_bench *bench, int fd, enum path path,
+		    bool write, size_t size, int tiling, int caching,
+		    char *trash, size_t trash_size)
+{
+	struct access a;
+	char variant[128];
+	int cold;
+
+	for (cold = 0; cold <= 1; cold++) {
+		snprintf(variant, sizeof(variant),
+			 "path=%s,dir=%s,size=%zu,tiling=%s,caching=%s,cache=%s",
+			 path_str[path], write ? "write" : "read", size,
+			 tiling_str[tiling],
+			 path == USERPTR ? "llc" : caching_str[caching],
+			 cold ? "cold" : "warm");
+
+		if (bench->filter && !strstr(variant, bench->filter))
+			continue;
+
+		if (!access_init(&a, fd, path, write, size, tiling, caching)) {
+			fprintf(stderr, "%s: skipped\n", variant);
+			access_fini(&a);
+			continue;
+		}
+
+		if (cold) {
+			a.trash = trash;
+			a.trash_size = trash_size;
+		}
+
+		igt_bench_run_setup(bench, variant,
+				    cold ? evict_caches : NULL,
+				    access_once, access_sync, &a, size);
+		access_fini(&a);
+	}
+}
+
+int main(int argc, char **argv)
+{
+	static const struct {
+		enum path path;
+		bool write;
+	} paths[] = {
+		{ PWRITE, true },
+		{ PREAD, false },
+		{ CPU, true },
+		{ CPU, false },
+		{ GTT, true },
+		{ GTT, false },
+		{ USERPTR, true },
+		{ USERPTR, false },
+	};
+	struct igt_bench bench;
+	size_t size, trash_size;
+	char *trash;
+	unsigned i;
+	int fd, tiling, caching;
+
+	igt_bench_init(&bench, argc, argv);
+
+	fd = drm_open_any();
+	mappable_size = gem_mappable_aperture_size();
+
+	trash_size = cache_size();
+	trash = alloc_pages(trash_size);
+	igt_assert(trash);
+
+	for (size = MIN_SIZE; size <= MAX_SIZE; size *= 4) {
+		for (i = 0; i < ARRAY_SIZE(paths); i++) {
+			enum path path = paths[i].path;
+
+			for (tiling = I915_TILING_NONE;
+			     tiling <= I915_TILING_Y; tiling++) {
+				/* only the fenced and the kernel paths detile */
+				if (tiling != I915_TILING_NONE &&
+				    (path == CPU || path == USERPTR))
+					continue;
+
+				for (caching = 0; caching <= 1; caching++) {
+					if (path == USERPTR && caching)
+						continue;
+
+					measure(&bench, fd, path,
+						paths[i].write, size,
+						tiling, caching,
+						trash, trash_size);
+				}
+			}
+		}
+	}
+
+	free(trash);
+	close(fd);
+
+	igt_bench_fini(&bench);
+
+	return 0;
+}
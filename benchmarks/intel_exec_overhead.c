@@ -0,0 +1,260 @@
+/*
+ * Copyright © 2013 Intel Corporation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ *
+ */
+
+/**
+ * Measures the cpu cost of a single execbuf2 call.
+ *
+ * Each sample is one ioctl, submitting a batch which does nothing but
+ * MI_BATCH_BUFFER_END. The variants sweep the size of the validation list,
+ * the number of relocations in the batch, handle vs. LUT relocation targets,
+ * and whether the relocations must be processed or are skipped with
+ * I915_EXEC_NO_RELOC. Every ring is measured with a minimal batch.
+ *
+ * Since the gpu never does any real work this runs just as well against the
+ * fake device, which isolates the userspace side of the submission path:
+ *
+ *   LD_PRELOAD=lib/.libs/libintel_fake_drm.so benchmarks/intel_exec_overhead
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <errno.h>
+#include "drm.h"
+#include "i915_drm.h"
+#include "drmtest.h"
+#include "intel_gpu_tools.h"
+#include "igt_bench.h"
+
+#define LOCAL_I915_EXEC_VEBOX		(4<<0)
+#define LOCAL_I915_EXEC_NO_RELOC	(1<<11)
+#define LOCAL_I915_EXEC_HANDLE_LUT	(1<<12)
+
+#define USE_LUT		0x1
+#define NO_RELOC	0x2
+
+struct exec {
+	int fd;
+	struct drm_i915_gem_execbuffer2 execbuf;
+	struct drm_i915_gem_exec_object2 *obj;
+	struct drm_i915_gem_relocation_entry *reloc;
+	unsigned num_objects;
+	unsigned num_relocs;
+	unsigned flags;
+};
+
+static void exec_init(struct exec *e, int fd, unsigned num_objects,
+		      unsigned num_relocs, unsigned flags, unsigned ring)
+{
+	uint32_t bbe = MI_BATCH_BUFFER_END;
+	unsigned batch_size, n;
+
+	memset(e, 0, sizeof(*e));
+	e->fd = fd;
+	e->num_objects = num_objects;
+	e->num_relocs = num_relocs;
+	e->flags = flags;
+
+	e->obj = calloc(num_objects + 1, sizeof(*e->obj));
+	e->reloc = calloc(num_relocs ?: 1, sizeof(*e->reloc));
+	igt_assert(e->obj && e->reloc);
+
+	for (n = 0; n < num_objects; n++)
+		e->obj[n].handle = gem_create(fd, 4096);
+
+	/* every relocation gets its own dword after the MI_BATCH_BUFFER_END */
+	batch_size = (8 + 4 * num_relocs + 4095) & ~4095;
+	e->obj[num_objects].handle = gem_create(fd, batch_size);
+	gem_write(fd, e->obj[num_objects].handle, 0, &bbe, sizeof(bbe));
+	e->obj[num_objects].relocation_count = num_relocs;
+	e->obj[num_objects].relocs_ptr = (uintptr_t)e->reloc;
+
+	for (n = 0; n < num_relocs; n++) {
+		unsigned target = n % (num_objects + 1);
+
+		e->reloc[n].target_handle =
+			flags & USE_LUT ? target : e->obj[target].handle;
+		e->reloc[n].offset = 8 + 4 * n;
+		e->reloc[n].presumed_offset = -1;
+		e->reloc[n].read_domains = I915_GEM_DOMAIN_RENDER;
+	}
+
+	e->execbuf.buffers_ptr = (uintptr_t)e->obj;
+	e->execbuf.buffer_count = num_objects + 1;
+	e->execbuf.batch_len = 8;
+	e->execbuf.flags = ring;
+	if (flags & USE_LUT)
+		e->execbuf.flags |= LOCAL_I915_EXEC_HANDLE_LUT;
+	if (flags & NO_RELOC)
+		e->execbuf.flags |= LOCAL_I915_EXEC_NO_RELOC;
+
+	/* prime the offsets, so that NO_RELOC really can skip the relocations */
+	gem_execbuf(fd, &e->execbuf);
+}
+
+static void exec_fini(struct exec *e)
+{
+	unsigned n;
+
+	gem_sync(e->fd, e->obj[e->num_objects].handle);
+	for (n = 0; n <= e->num_objects; n++)
+		gem_close(e->fd, e->obj[n].handle);
+
+	free(e->obj);
+	free(e->reloc);
+}
+
+static void exec_reset(void *data)
+{
+	struct exec *e = data;
+	unsigned n;
+
+	/*
+	 * Without NO_RELOC pretend the buffers moved, so that the kernel has
+	 * to process every relocation. This is kept out of the sample.
+	 */
+	if ((e->flags & NO_RELOC) == 0)
+		for (n = 0; n < e->num_relocs; n++)
+			e->reloc[n].presumed_offset = -1;
+}
+
+static void exec_once(void *data)
+{
+	struct exec *e = data;
+
+	gem_execbuf(e->fd, &e->execbuf);
+}
+
+static void exec_sync(void *data)
+{
+	struct exec *e = data;
+
+	gem_sync(e->fd, e->obj[e->num_objects].handle);
+}
+
+static void measure(struct igt_bench *bench, const char *variant,
+		    struct exec *e)
+{
+	igt_bench_run_setup(bench, variant, exec_reset, exec_once, exec_sync,
+			    e, 0);
+}
+
+static const char *mode_str(unsigned flags)
+{
+	return flags & USE_LUT ? "lut" : "handle";
+}
+
+static const char *reloc_str(unsigned flags)
+{
+	return flags & NO_RELOC ? "no-reloc" : "reloc";
+}
+
+static void sweep_relocs(struct igt_bench *bench, int fd)
+{
+	static const unsigned objects[] = { 1, 16, 64, 256, 1024 };
+	static const unsigned relocs_per_object[] = { 0, 1, 4 };
+	char variant[128];
+	unsigned i, j, flags;
+
+	for (i = 0; i < ARRAY_SIZE(objects); i++) {
+		for (j = 0; j < ARRAY_SIZE(relocs_per_object); j++) {
+			for (flags = 0; flags <= (USE_LUT | NO_RELOC); flags++) {
+				unsigned relocs = objects[i] * relocs_per_object[j];
+				struct exec e;
+
+				snprintf(variant, sizeof(variant),
+					 "ring=render,objects=%u,relocs=%u,mode=%s,reloc=%s",
+					 objects[i] + 1, relocs,
+					 mode_str(flags), reloc_str(flags));
+
+				if (bench->filter &&
+				    !strstr(variant, bench->filter))
+					continue;
+
+				exec_init(&e, fd, objects[i], relocs, flags,
+					  I915_EXEC_RENDER);
+				measure(bench, variant, &e);
+				exec_fini(&e);
+			}
+		}
+	}
+}
+
+static void sweep_rings(struct igt_bench *bench, int fd)
+{
+	static const struct {
+		const char *name;
+		unsigned id;
+	} rings[] = {
+		{ "render", I915_EXEC_RENDER },
+		{ "bsd", I915_EXEC_BSD },
+		{ "blt", I915_EXEC_BLT },
+		{ "vebox", LOCAL_I915_EXEC_VEBOX },
+	};
+	char variant[128];
+	unsigned i;
+
+	for (i = 0; i < ARRAY_SIZE(rings); i++) {
+		struct exec e;
+
+		if (rings[i].id == I915_EXEC_BSD && !gem_has_bsd(fd))
+			continue;
+		if (rings[i].id == I915_EXEC_BLT && !gem_has_blt(fd))
+			continue;
+		if (rings[i].id == LOCAL_I915_EXEC_VEBOX && !gem_has_vebox(fd))
+			continue;
+
+		snprintf(variant, sizeof(variant),
+			 "ring=%s,objects=1,relocs=0,mode=handle,reloc=no-reloc",
+			 rings[i].name);
+
+		if (bench->filter && !strstr(variant, bench->filter))
+			continue;
+
+		exec_init(&e, fd, 0, 0, NO_RELOC, rings[i].id);
+		measure(bench, variant, &e);
+		exec_fini(&e);
+	}
+}
+
+int main(int argc, char **argv)
+{
+	struct igt_bench bench;
+	int fd;
+
+	igt_bench_init(&bench, argc, argv);
+
+	fd = drm_open_any();
+
+	sweep_rings(&bench, fd);
+	sweep_relocs(&bench, fd);
+
+	close(fd);
+
+	igt_bench_fini(&bench);
+
+	return 0;
+}
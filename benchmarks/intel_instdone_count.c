@@ -0,0 +1,230 @@
+/*
+ * Copyright © 2013 Intel Corporation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ *
+ */
+
+/**
+ * Measures what it costs intel_gpu_top to account one second worth of
+ * INSTDONE samples, without touching the hardware.
+ *
+ * The samples are synthetic: an idle gpu with every unit done, a busy one
+ * where every bit is random in every sample, and a mixed one where each
+ * unit stays busy or idle for a random run of samples. They are counted
+ * one bit at a time, as intel_gpu_top used to, and with the bit-sliced
+ * instdone_counter. Both have to agree before anything is timed.
+ *
+ * A second of samples never fills the counter, so it is also checked on a
+ * few times more samples than it holds, which it has to flush by itself.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <inttypes.h>
+#include "drmtest.h"
+#include "intel_gpu_tools.h"
+#include "instdone.h"
+#include "igt_bench.h"
+
+#define SAMPLES	10000
+#define OVERFLOW_SAMPLES	(3 << INSTDONE_COUNTER_PLANES)
+
+struct count {
+	uint32_t instdone[SAMPLES];
+	uint32_t instdone1[SAMPLES];
+	int index[MAX_INSTDONE_BITS];
+	int count[MAX_INSTDONE_BITS];
+	struct instdone_counter counter;
+};
+
+static void count_scalar(void *data)
+{
+	struct count *c = data;
+	int i, j;
+
+	memset(c->count, 0, sizeof(c->count));
+	for (i = 0; i < SAMPLES; i++) {
+		for (j = 0; j < num_instdone_bits; j++) {
+			uint32_t val;
+
+			if (instdone_bits[j].reg == INST_DONE_1)
+				val = c->instdone1[i];
+			else
+				val = c->instdone[i];
+
+			if ((val & instdone_bits[j].bit) == 0)
+				c->count[j]++;
+		}
+	}
+}
+
+static void count_bitslice(void *data)
+{
+	struct count *c = data;
+	int i;
+
+	instdone_counter_reset(&c->counter);
+	for (i = 0; i < SAMPLES; i++)
+		instdone_counter_add(&c->counter,
+				     ~((uint64_t)c->instdone1[i] << 32 |
+				       c->instdone[i]));
+	instdone_counter_flush(&c->counter);
+
+	for (i = 0; i < num_instdone_bits; i++)
+		c->count[i] = c->counter.counts[c->index[i]];
+}
+
+static void fill_idle(struct count *c)
+{
+	memset(c->instdone, 0xff, sizeof(c->instdone));
+	memset(c->instdone1, 0xff, sizeof(c->instdone1));
+}
+
+static void fill_busy(struct count *c)
+{
+	int i;
+
+	for (i = 0; i < SAMPLES; i++) {
+		c->instdone[i] = random() ^ random() << 16;
+		c->instdone1[i] = random() ^ random() << 16;
+	}
+}
+
+static void fill_mixed(struct count *c)
+{
+	uint64_t state = 0;
+	int run[64] = { 0 };
+	int i, bit;
+
+	for (i = 0; i < SAMPLES; i++) {
+		for (bit = 0; bit < 64; bit++) {
+			if (run[bit]-- > 0)
+				continue;
+			state ^= 1ull << bit;
+			run[bit] = random() % 200;
+		}
+		c->instdone[i] = state;
+		c->instdone1[i] = state >> 32;
+	}
+}
+
+static uint32_t random32(void)
+{
+	return random() ^ random() << 16;
+}
+
+static void check_overflow(void)
+{
+	struct instdone_counter counter;
+	uint32_t expected[64];
+	int all_busy, i, bit;
+
+	for (all_busy = 0; all_busy < 2; all_busy++) {
+		srandom(1);
+		memset(expected, 0, sizeof(expected));
+		instdone_counter_reset(&counter);
+
+		for (i = 0; i < OVERFLOW_SAMPLES + 1; i++) {
+			uint64_t sample = ~0ull;
+
+			if (!all_busy)
+				sample = (uint64_t)random32() << 32 | random32();
+
+			for (bit = 0; bit < 64; bit++)
+				expected[bit] += sample >> bit & 1;
+			instdone_counter_add(&counter, sample);
+		}
+		instdone_counter_flush(&counter);
+
+		igt_assert(memcmp(expected, counter.counts,
+				  sizeof(expected)) == 0);
+	}
+}
+
+int main(int argc, char **argv)
+{
+	static const struct {
+		const char *name;
+		uint32_t devid;
+	} gens[] = {
+		{ "g4x", 0x2a42 },
+		{ "ivb", 0x0166 },
+	};
+	static const struct {
+		const char *name;
+		void (*fill)(struct count *c);
+	} streams[] = {
+		{ "idle", fill_idle },
+		{ "busy", fill_busy },
+		{ "mixed", fill_mixed },
+	};
+	int expected[MAX_INSTDONE_BITS];
+	struct igt_bench bench;
+	struct count *c;
+	char variant[128];
+	int g, s, i;
+
+	igt_bench_init(&bench, argc, argv);
+
+	check_overflow();
+
+	c = malloc(sizeof(*c));
+	igt_assert(c);
+
+	for (g = 0; g < ARRAY_SIZE(gens); g++) {
+		num_instdone_bits = 0;
+		init_instdone_definitions(gens[g].devid);
+		for (i = 0; i < num_instdone_bits; i++)
+			c->index[i] = instdone_bit_index(&instdone_bits[i]);
+
+		for (s = 0; s < ARRAY_SIZE(streams); s++) {
+			srandom(1);
+			streams[s].fill(c);
+
+			count_scalar(c);
+			memcpy(expected, c->count, sizeof(expected));
+			count_bitslice(c);
+			igt_assert(memcmp(expected, c->count,
+					  num_instdone_bits * sizeof(int)) == 0);
+
+			snprintf(variant, sizeof(variant),
+				 "gen=%s,bits=%d,stream=%s,method=scalar",
+				 gens[g].name, num_instdone_bits,
+				 streams[s].name);
+			igt_bench_run(&bench, variant, count_scalar, NULL, c,
+				      0);
+
+			snprintf(variant, sizeof(variant),
+				 "gen=%s,bits=%d,stream=%s,method=bitslice",
+				 gens[g].name, num_instdone_bits,
+				 streams[s].name);
+			igt_bench_run(&bench, variant, count_bitslice, NULL, c,
+				      0);
+		}
+	}
+
+	free(c);
+
+	igt_bench_fini(&bench);
+
+	return 0;
+}
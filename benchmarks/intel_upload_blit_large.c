@@ -52,36 +52,41 @@
 #include <inttypes.h>
 #include <errno.h>
 #include <sys/stat.h>
-#include <sys/time.h>
 #include "drm.h"
 #include "i915_drm.h"
 #include "drmtest.h"
 #include "intel_bufmgr.h"
 #include "intel_batchbuffer.h"
 #include "intel_gpu_tools.h"
+#include "igt_bench.h"
 
-#define OBJECT_WIDTH	1280
-#define OBJECT_HEIGHT	720
+static const struct {
+	int width, height;
+} frame_sizes[] = {
+	{ 640, 480 },
+	{ 1280, 720 },
+	{ 1920, 1080 },
+};
 
-static double
-get_time_in_secs(void)
-{
-	struct timeval tv;
-
-	gettimeofday(&tv, NULL);
-
-	return (double)tv.tv_sec + tv.tv_usec / 1000000.0;
-}
+struct upload {
+	drm_intel_bufmgr *bufmgr;
+	struct intel_batchbuffer *batch;
+	drm_intel_bo *dst_bo;
+	int width, height;
+};
 
 static void
 do_render(drm_intel_bufmgr *bufmgr, struct intel_batchbuffer *batch,
 	  drm_intel_bo *dst_bo, int width, int height)
 {
-	uint32_t data[width * height];
+	uint32_t *data;
 	drm_intel_bo *src_bo;
 	int i;
 	static uint32_t seed = 1;
 
+	data = malloc(width * height * 4);
+	assert(data);
+
 	/* Generate some junk.  Real workloads would be doing a lot more
 	 * work to generate the junk.
 	 */
@@ -90,8 +95,9 @@ do_render(drm_intel_bufmgr *bufmgr, struct intel_batchbuffer *batch,
 	}
 
 	/* Upload the junk. */
-	src_bo = drm_intel_bo_alloc(bufmgr, "src", sizeof(data), 4096);
-	drm_intel_bo_subdata(src_bo, 0, sizeof(data), data);
+	src_bo = drm_intel_bo_alloc(bufmgr, "src", width * height * 4, 4096);
+	drm_intel_bo_subdata(src_bo, 0, width * height * 4, data);
+	free(data);
 
 	/* Render the junk to the dst. */
 	BEGIN_BATCH(8);
@@ -114,48 +120,58 @@ do_render(drm_intel_bufmgr *bufmgr, struct intel_batchbuffer *batch,
 	drm_intel_bo_unreference(src_bo);
 }
 
+static void
+render_iteration(void *data)
+{
+	struct upload *u = data;
+
+	do_render(u->bufmgr, u->batch, u->dst_bo, u->width, u->height);
+}
+
+static void
+render_sync(void *data)
+{
+	struct upload *u = data;
+
+	drm_intel_bo_wait_rendering(u->dst_bo);
+}
+
 int main(int argc, char **argv)
 {
-	int fd;
-	int object_size = OBJECT_WIDTH * OBJECT_HEIGHT * 4;
-	double start_time, end_time;
-	drm_intel_bo *dst_bo;
-	drm_intel_bufmgr *bufmgr;
-	struct intel_batchbuffer *batch;
-	int i;
+	struct igt_bench bench;
+	struct upload u;
+	char variant[64];
+	int fd, i;
+
+	igt_bench_init(&bench, argc, argv);
 
 	fd = drm_open_any();
 
-	bufmgr = drm_intel_bufmgr_gem_init(fd, 4096);
-	drm_intel_bufmgr_gem_enable_reuse(bufmgr);
+	u.bufmgr = drm_intel_bufmgr_gem_init(fd, 4096);
+	drm_intel_bufmgr_gem_enable_reuse(u.bufmgr);
 
-	batch = intel_batchbuffer_alloc(bufmgr, intel_get_drm_devid(fd));
+	u.batch = intel_batchbuffer_alloc(u.bufmgr, intel_get_drm_devid(fd));
 
-	dst_bo = drm_intel_bo_alloc(bufmgr, "dst", object_size, 4096);
+	for (i = 0; i < ARRAY_SIZE(frame_sizes); i++) {
+		u.width = frame_sizes[i].width;
+		u.height = frame_sizes[i].height;
+		u.dst_bo = drm_intel_bo_alloc(u.bufmgr, "dst",
+					      u.width * u.height * 4, 4096);
 
-	/* Prep loop to get us warmed up. */
-	for (i = 0; i < 60; i++) {
-		do_render(bufmgr, batch, dst_bo, OBJECT_WIDTH, OBJECT_HEIGHT);
-	}
-	drm_intel_bo_wait_rendering(dst_bo);
+		snprintf(variant, sizeof(variant), "size=%dx%d",
+			 u.width, u.height);
+		igt_bench_run(&bench, variant, render_iteration, render_sync,
+			      &u, u.width * u.height * 4);
 
-	/* Do the actual timing. */
-	start_time = get_time_in_secs();
-	for (i = 0; i < 200; i++) {
-		do_render(bufmgr, batch, dst_bo, OBJECT_WIDTH, OBJECT_HEIGHT);
+		drm_intel_bo_unreference(u.dst_bo);
 	}
-	drm_intel_bo_wait_rendering(dst_bo);
-	end_time = get_time_in_secs();
-
-	printf("%d iterations in %.03f secs: %.01f MB/sec\n", i,
-	       end_time - start_time,
-	       (double)i * OBJECT_WIDTH * OBJECT_HEIGHT * 4 / 1024.0 / 1024.0 /
-	       (end_time - start_time));
 
-	intel_batchbuffer_free(batch);
-	drm_intel_bufmgr_destroy(bufmgr);
+	intel_batchbuffer_free(u.batch);
+	drm_intel_bufmgr_destroy(u.bufmgr);
 
 	close(fd);
 
+	igt_bench_fini(&bench);
+
 	return 0;
 }
@@ -48,33 +48,31 @@
 #include <inttypes.h>
 #include <errno.h>
 #include <sys/stat.h>
-#include <sys/time.h>
 #include "drm.h"
 #include "i915_drm.h"
 #include "drmtest.h"
 #include "intel_bufmgr.h"
 #include "intel_batchbuffer.h"
 #include "intel_gpu_tools.h"
+#include "igt_bench.h"
 
 /* Happens to be 128k, the size of the VBOs used by i965's Mesa driver. */
 #define OBJECT_WIDTH	256
 #define OBJECT_HEIGHT	128
 
-static double
-get_time_in_secs(void)
-{
-	struct timeval tv;
-
-	gettimeofday(&tv, NULL);
-
-	return (double)tv.tv_sec + tv.tv_usec / 1000000.0;
-}
+struct upload {
+	drm_intel_bufmgr *bufmgr;
+	struct intel_batchbuffer *batch;
+	drm_intel_bo *dst_bo;
+	int width, height;
+	int max_upload;
+};
 
 static void
 do_render(drm_intel_bufmgr *bufmgr, struct intel_batchbuffer *batch,
-	  drm_intel_bo *dst_bo, int width, int height)
+	  drm_intel_bo *dst_bo, int width, int height, int max_upload)
 {
-	uint32_t data[64];
+	uint32_t data[max_upload];
 	drm_intel_bo *src_bo;
 	int i;
 	static uint32_t seed = 1;
@@ -87,13 +85,13 @@ do_render(drm_intel_bufmgr *bufmgr, struct intel_batchbuffer *batch,
 	for (i = 0; i < width * height;) {
 		int size, j;
 
-		/* Choose a size from 1 to 64 dwords to upload.
+		/* Choose a size from 1 to max_upload dwords to upload.
 		 * Normal workloads have a distribution of sizes with a
 		 * large tail (something in your scene's going to have a big
 		 * pile of vertices, most likely), but I'm trying to get at
 		 * the cost of the small uploads here.
 		 */
-		size = random() % 64 + 1;
+		size = random() % max_upload + 1;
 		if (i + size > width * height)
 			size = width * height - i;
 
@@ -127,48 +125,60 @@ do_render(drm_intel_bufmgr *bufmgr, struct intel_batchbuffer *batch,
 	drm_intel_bo_unreference(src_bo);
 }
 
+static void
+render_iteration(void *data)
+{
+	struct upload *u = data;
+
+	do_render(u->bufmgr, u->batch, u->dst_bo, u->width, u->height,
+		  u->max_upload);
+}
+
+static void
+render_sync(void *data)
+{
+	struct upload *u = data;
+
+	drm_intel_bo_wait_rendering(u->dst_bo);
+}
+
 int main(int argc, char **argv)
 {
-	int fd;
-	int object_size = OBJECT_WIDTH * OBJECT_HEIGHT * 4;
-	double start_time, end_time;
-	drm_intel_bo *dst_bo;
-	drm_intel_bufmgr *bufmgr;
-	struct intel_batchbuffer *batch;
-	int i;
+	static const int max_uploads[] = { 16, 64, 256 };
+	struct igt_bench bench;
+	struct upload u;
+	char variant[64];
+	int fd, i;
 
-	fd = drm_open_any();
+	igt_bench_init(&bench, argc, argv);
 
-	bufmgr = drm_intel_bufmgr_gem_init(fd, 4096);
-	drm_intel_bufmgr_gem_enable_reuse(bufmgr);
+	fd = drm_open_any();
 
-	batch = intel_batchbuffer_alloc(bufmgr, intel_get_drm_devid(fd));
+	u.bufmgr = drm_intel_bufmgr_gem_init(fd, 4096);
+	drm_intel_bufmgr_gem_enable_reuse(u.bufmgr);
 
-	dst_bo = drm_intel_bo_alloc(bufmgr, "dst", object_size, 4096);
+	u.batch = intel_batchbuffer_alloc(u.bufmgr, intel_get_drm_devid(fd));
 
-	/* Prep loop to get us warmed up. */
-	for (i = 0; i < 20; i++) {
-		do_render(bufmgr, batch, dst_bo, OBJECT_WIDTH, OBJECT_HEIGHT);
-	}
-	drm_intel_bo_wait_rendering(dst_bo);
+	u.width = OBJECT_WIDTH;
+	u.height = OBJECT_HEIGHT;
+	u.dst_bo = drm_intel_bo_alloc(u.bufmgr, "dst",
+				      u.width * u.height * 4, 4096);
 
-	/* Do the actual timing. */
-	start_time = get_time_in_secs();
-	for (i = 0; i < 1000; i++) {
-		do_render(bufmgr, batch, dst_bo, OBJECT_WIDTH, OBJECT_HEIGHT);
+	for (i = 0; i < ARRAY_SIZE(max_uploads); i++) {
+		u.max_upload = max_uploads[i];
+		snprintf(variant, sizeof(variant), "max_dwords=%d",
+			 u.max_upload);
+		igt_bench_run(&bench, variant, render_iteration, render_sync,
+			      &u, u.width * u.height * 4);
 	}
-	drm_intel_bo_wait_rendering(dst_bo);
-	end_time = get_time_in_secs();
-
-	printf("%d iterations in %.03f secs: %.01f MB/sec\n", i,
-	       end_time - start_time,
-	       (double)i * OBJECT_WIDTH * OBJECT_HEIGHT * 4 / 1024.0 / 1024.0 /
-	       (end_time - start_time));
 
-	intel_batchbuffer_free(batch);
-	drm_intel_bufmgr_destroy(bufmgr);
+	drm_intel_bo_unreference(u.dst_bo);
+	intel_batchbuffer_free(u.batch);
+	drm_intel_bufmgr_destroy(u.bufmgr);
 
 	close(fd);
 
+	igt_bench_fini(&bench);
+
 	return 0;
 }
@@ -0,0 +1,130 @@
+/*
+ * Copyright © 2013 Intel Corporation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ *
+ */
+
+/**
+ * Measures how many WRPLL divider solutions per second the exhaustive and
+ * the pruned search find. Every iteration solves one clock, so the
+ * iteration rate is the solution rate.
+ *
+ * The clocks are either the common CEA and VESA modes, which have no
+ * budget and need the pruned search to fall back to its slower path, or
+ * arbitrary kHz between 25 and 300 MHz as seen during mode validation.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include "drmtest.h"
+#include "intel_gpu_tools.h"
+#include "intel_wrpll.h"
+#include "igt_bench.h"
+
+#define NUM_CLOCKS	1024
+
+struct solve {
+	const int *clocks;
+	int num_clocks;
+	int next;
+};
+
+static void solve_slow(void *data)
+{
+	struct solve *s = data;
+	unsigned r2, n2, p;
+
+	intel_wrpll_compute_rnp_slow(s->clocks[s->next], &r2, &n2, &p);
+	s->next = (s->next + 1) % s->num_clocks;
+}
+
+static void solve_pruned(void *data)
+{
+	struct solve *s = data;
+	unsigned r2, n2, p;
+
+	intel_wrpll_compute_rnp(s->clocks[s->next], &r2, &n2, &p);
+	s->next = (s->next + 1) % s->num_clocks;
+}
+
+int main(int argc, char **argv)
+{
+	static const int modes[] = {
+		25175000, 27000000, 40000000, 65000000, 74250000, 108000000,
+		148500000, 162000000, 297000000,
+	};
+	static int random_khz[NUM_CLOCKS];
+	static const struct {
+		const char *name;
+		const int *clocks;
+		int num_clocks;
+	} sets[] = {
+		{ "modes", modes, ARRAY_SIZE(modes) },
+		{ "random", random_khz, NUM_CLOCKS },
+	};
+	static const struct {
+		const char *name;
+		igt_bench_func_t func;
+	} methods[] = {
+		{ "exhaustive", solve_slow },
+		{ "pruned", solve_pruned },
+	};
+	struct igt_bench bench;
+	struct solve s;
+	char variant[128];
+	int i, m;
+
+	igt_bench_init(&bench, argc, argv);
+
+	srandom(1);
+	for (i = 0; i < NUM_CLOCKS; i++)
+		random_khz[i] = (25000 + random() % 275001) * 1000;
+
+	for (i = 0; i < ARRAY_SIZE(sets); i++) {
+		int j;
+
+		for (j = 0; j < sets[i].num_clocks; j++) {
+			unsigned r2[2], n2[2], p[2];
+
+			intel_wrpll_compute_rnp_slow(sets[i].clocks[j],
+						     &r2[0], &n2[0], &p[0]);
+			intel_wrpll_compute_rnp(sets[i].clocks[j],
+						&r2[1], &n2[1], &p[1]);
+			igt_assert(r2[0] == r2[1] && n2[0] == n2[1] &&
+				   p[0] == p[1]);
+		}
+
+		for (m = 0; m < ARRAY_SIZE(methods); m++) {
+			s.clocks = sets[i].clocks;
+			s.num_clocks = sets[i].num_clocks;
+			s.next = 0;
+
+			snprintf(variant, sizeof(variant), "clocks=%s,method=%s",
+				 sets[i].name, methods[m].name);
+			igt_bench_run(&bench, variant, methods[m].func, NULL,
+				      &s, 0);
+		}
+	}
+
+	igt_bench_fini(&bench);
+
+	return 0;
+}
@@ -0,0 +1,582 @@
+/*
+ * Copyright © 2013 Intel Corporation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ *
+ */
+
+/*
+ * Shared harness for the microbenchmarks.
+ *
+ * A benchmark calls igt_bench_run() once per variant with a callback doing a
+ * single iteration. Every iteration is timed on its own against
+ * CLOCK_MONOTONIC, so besides the overall throughput we get the distribution
+ * of per-iteration costs. Work which completes asynchronously on the gpu is
+ * accounted for by the optional sync callback, which is run once after the
+ * timed loop and included in the total (but not in the samples). Per-iteration
+ * preparation which must not be timed, like evicting the cpu caches, goes into
+ * the setup callback of igt_bench_run_setup().
+ *
+ * Variant names are of the form "key=value,key=value" and are split into a
+ * parameter object in the json output, which makes it easy to plot e.g.
+ * throughput against object size for each tiling mode.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <getopt.h>
+#include <math.h>
+#include <sched.h>
+#include <time.h>
+
+#include "igt_bench.h"
+
+#define MIN_ITERATIONS		10
+#define MAX_ITERATIONS		1000000
+#define MIN_WARMUP		3
+
+struct igt_bench_result {
+	char *variant;
+	double total;
+	double bytes;
+	double *samples;
+	struct igt_bench_stats stats;
+};
+
+double igt_bench_time(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static int cmp_double(const void *a, const void *b)
+{
+	double x = *(const double *)a, y = *(const double *)b;
+
+	return x < y ? -1 : x > y;
+}
+
+void igt_bench_stats(double *samples, unsigned count,
+		     struct igt_bench_stats *stats)
+{
+	double *sorted, sum, sq;
+	unsigned i;
+
+	memset(stats, 0, sizeof(*stats));
+	stats->count = count;
+	if (count == 0)
+		return;
+
+	sorted = malloc(count * sizeof(*sorted));
+	if (sorted == NULL)
+		return;
+
+	memcpy(sorted, samples, count * sizeof(*sorted));
+	qsort(sorted, count, sizeof(*sorted), cmp_double);
+
+	sum = 0;
+	for (i = 0; i < count; i++)
+		sum += sorted[i];
+	stats->mean = sum / count;
+
+	sq = 0;
+	for (i = 0; i < count; i++)
+		sq += (sorted[i] - stats->mean) * (sorted[i] - stats->mean);
+	stats->stddev = count > 1 ? sqrt(sq / (count - 1)) : 0;
+
+	stats->min = sorted[0];
+	stats->max = sorted[count - 1];
+	if (count & 1)
+		stats->median = sorted[count / 2];
+	else
+		stats->median = (sorted[count / 2 - 1] + sorted[count / 2]) / 2;
+
+	/* nearest-rank percentile */
+	i = (95 * count + 99) / 100;
+	stats->p95 = sorted[i ? i - 1 : 0];
+
+	free(sorted);
+}
+
+static void usage(const char *name)
+{
+	fprintf(stderr,
+		"Usage: %s [options]\n"
+		"  --cpu=N          pin to cpu N\n"
+		"  --warmup=N       warmup iterations (default: calibrate)\n"
+		"  --iterations=N   timed iterations (default: calibrate)\n"
+		"  --min-time=SECS  target runtime per variant (default: 1)\n"
+		"  --filter=STR     only run variants containing STR\n"
+		"  --json=FILE      write results as json, - for stdout\n"
+		"  --csv=FILE       write results as csv, - for stdout\n"
+		"  --samples        include every sample in the json output\n",
+		name);
+}
+
+void igt_bench_init(struct igt_bench *bench, int argc, char **argv)
+{
+	static const struct option long_options[] = {
+		{ "cpu", required_argument, NULL, 'c' },
+		{ "warmup", required_argument, NULL, 'w' },
+		{ "iterations", required_argument, NULL, 'i' },
+		{ "min-time", required_argument, NULL, 't' },
+		{ "filter", required_argument, NULL, 'f' },
+		{ "json", required_argument, NULL, 'j' },
+		{ "csv", required_argument, NULL, 'C' },
+		{ "samples", no_argument, NULL, 's' },
+		{ "help", no_argument, NULL, 'h' },
+		{ NULL, 0, NULL, 0 }
+	};
+	const char *name;
+	int c;
+
+	name = strrchr(argv[0], '/');
+	name = name ? name + 1 : argv[0];
+
+	memset(bench, 0, sizeof(*bench));
+	bench->name = name;
+	bench->cpu = -1;
+	bench->min_time = 1.0;
+
+	while ((c = getopt_long(argc, argv, "", long_options, NULL)) != -1) {
+		switch (c) {
+		case 'c':
+			bench->cpu = atoi(optarg);
+			break;
+		case 'w':
+			bench->warmup = strtoul(optarg, NULL, 0);
+			break;
+		case 'i':
+			bench->iterations = strtoul(optarg, NULL, 0);
+			break;
+		case 't':
+			bench->min_time = atof(optarg);
+			break;
+		case 'f':
+			bench->filter = optarg;
+			break;
+		case 'j':
+			bench->json = optarg;
+			break;
+		case 'C':
+			bench->csv = optarg;
+			break;
+		case 's':
+			bench->samples = true;
+			break;
+		case 'h':
+			usage(name);
+			exit(0);
+		default:
+			usage(name);
+			exit(1);
+		}
+	}
+
+	if (bench->cpu >= 0) {
+		cpu_set_t set;
+
+		CPU_ZERO(&set);
+		CPU_SET(bench->cpu, &set);
+		if (sched_setaffinity(0, sizeof(set), &set))
+			perror("sched_setaffinity");
+	}
+}
+
+static void print_result(FILE *f, const struct igt_bench_result *r)
+{
+	const struct igt_bench_stats *s = &r->stats;
+
+	if (r->variant[0])
+		fprintf(f, "%s: ", r->variant);
+
+	fprintf(f, "%u iterations in %.03f secs", s->count, r->total);
+	if (r->bytes)
+		fprintf(f, ": %.01f MB/sec",
+			s->count * r->bytes / 1024.0 / 1024.0 / r->total);
+	fprintf(f, " (median %.2fus, p95 %.2fus, stddev %.2fus)\n",
+		s->median * 1e6, s->p95 * 1e6, s->stddev * 1e6);
+	fflush(f);
+}
+
+/**
+ * igt_bench_record - add externally collected samples
+ *
+ * For benchmarks which need to time something finer grained than a whole
+ * callback invocation. Takes ownership of @samples, which must be malloced.
+ */
+void igt_bench_record(struct igt_bench *bench, const char *variant,
+		      double *samples, unsigned count, double total,
+		      double bytes_per_iteration)
+{
+	struct igt_bench_result *r;
+
+	bench->results = realloc(bench->results,
+				 (bench->num_results + 1) * sizeof(*r));
+	if (bench->results == NULL) {
+		perror("realloc");
+		exit(1);
+	}
+
+	r = &bench->results[bench->num_results++];
+	r->variant = strdup(variant ? variant : "");
+	r->total = total;
+	r->bytes = bytes_per_iteration;
+	r->samples = samples;
+	igt_bench_stats(samples, count, &r->stats);
+
+	/* keep stdout clean for the json/csv report */
+	if ((bench->json && strcmp(bench->json, "-") == 0) ||
+	    (bench->csv && strcmp(bench->csv, "-") == 0))
+		print_result(stderr, r);
+	else
+		print_result(stdout, r);
+}
+
+/**
+ * igt_bench_run - time one benchmark variant
+ *
+ * Runs @func for the warmup and then for the timed iterations, calibrating
+ * the counts against bench->min_time unless they were given explicitly.
+ * @sync (if not NULL) is called after the warmup and after the timed loop to
+ * wait for outstanding asynchronous work. @bytes_per_iteration is used to
+ * report throughput, pass 0 if that doesn't make sense.
+ *
+ * Returns false if the variant was filtered out.
+ */
+bool igt_bench_run(struct igt_bench *bench, const char *variant,
+		   igt_bench_func_t func, igt_bench_func_t sync, void *data,
+		   double bytes_per_iteration)
+{
+	return igt_bench_run_setup(bench, variant, NULL, func, sync, data,
+				   bytes_per_iteration);
+}
+
+/**
+ * igt_bench_run_setup - time one benchmark variant with untimed preparation
+ *
+ * Like igt_bench_run(), but calls @setup before every invocation of @func.
+ * The setup is excluded from the samples and the total, but does count
+ * towards bench->min_time when calibrating, so that an expensive setup
+ * doesn't blow up the runtime of a variant.
+ */
+bool igt_bench_run_setup(struct igt_bench *bench, const char *variant,
+			 igt_bench_func_t setup, igt_bench_func_t func,
+			 igt_bench_func_t sync, void *data,
+			 double bytes_per_iteration)
+{
+	unsigned warmup, iterations, i;
+	double start, end, total, *samples;
+
+	if (variant == NULL)
+		variant = "";
+
+	if (bench->filter && !strstr(variant, bench->filter))
+		return false;
+
+	warmup = bench->warmup;
+	start = igt_bench_time();
+	if (warmup) {
+		for (i = 0; i < warmup; i++) {
+			if (setup)
+				setup(data);
+			func(data);
+		}
+	} else {
+		for (i = 0; i < MIN_WARMUP ||
+		     igt_bench_time() - start < bench->min_time / 10; i++) {
+			if (setup)
+				setup(data);
+			func(data);
+		}
+		warmup = i;
+	}
+	if (sync)
+		sync(data);
+	end = igt_bench_time();
+
+	iterations = bench->iterations;
+	if (iterations == 0) {
+		double per_iteration = (end - start) / warmup;
+
+		if (per_iteration > 0)
+			iterations = bench->min_time / per_iteration;
+		else
+			iterations = MAX_ITERATIONS;
+
+		if (iterations < MIN_ITERATIONS)
+			iterations = MIN_ITERATIONS;
+		if (iterations > MAX_ITERATIONS)
+			iterations = MAX_ITERATIONS;
+	}
+
+	samples = malloc(iterations * sizeof(*samples));
+	if (samples == NULL) {
+		perror("malloc");
+		exit(1);
+	}
+
+	total = 0;
+	end = igt_bench_time();
+	for (i = 0; i < iterations; i++) {
+		double t;
+
+		if (setup) {
+			setup(data);
+			end = igt_bench_time();
+		}
+
+		t = end;
+		func(data);
+		end = igt_bench_time();
+		samples[i] = end - t;
+		total += samples[i];
+	}
+	if (sync) {
+		sync(data);
+		total += igt_bench_time() - end;
+	}
+
+	igt_bench_record(bench, variant, samples, iterations, total,
+			 bytes_per_iteration);
+
+	return true;
+}
+
+static void json_string(FILE *f, const char *s, size_t len)
+{
+	size_t i;
+
+	fputc('"', f);
+	for (i = 0; i < len && s[i]; i++) {
+		if (s[i] == '"' || s[i] == '\\')
+			fprintf(f, "\\%c", s[i]);
+		else if ((unsigned char)s[i] < 0x20)
+			fprintf(f, "\\u%04x", s[i]);
+		else
+			fputc(s[i], f);
+	}
+	fputc('"', f);
+}
+
+static void json_params(FILE *f, const char *variant)
+{
+	const char *p = variant;
+	bool first = true;
+
+	fprintf(f, "{");
+	while (*p) {
+		size_t len = strcspn(p, ",");
+		const char *eq = memchr(p, '=', len);
+
+		if (eq) {
+			fprintf(f, "%s", first ? "" : ", ");
+			json_string(f, p, eq - p);
+			fprintf(f, ": ");
+			json_string(f, eq + 1, p + len - eq - 1);
+			first = false;
+		}
+
+		p += len;
+		if (*p == ',')
+			p++;
+	}
+	fprintf(f, "}");
+}
+
+static void write_json(struct igt_bench *bench, FILE *f)
+{
+	unsigned i, j;
+
+	fprintf(f, "{\n  \"benchmark\": ");
+	json_string(f, bench->name, strlen(bench->name));
+	fprintf(f, ",\n  \"cpu\": %d,\n  \"results\": [", bench->cpu);
+
+	for (i = 0; i < bench->num_results; i++) {
+		struct igt_bench_result *r = &bench->results[i];
+		struct igt_bench_stats *s = &r->stats;
+
+		fprintf(f, "%s\n    {\n      \"variant\": ", i ? "," : "");
+		json_string(f, r->variant, strlen(r->variant));
+		fprintf(f, ",\n      \"params\": ");
+		json_params(f, r->variant);
+		fprintf(f, ",\n      \"iterations\": %u", s->count);
+		fprintf(f, ",\n      \"total_secs\": %.9f", r->total);
+		if (r->bytes)
+			fprintf(f, ",\n      \"mb_per_sec\": %.3f",
+				s->count * r->bytes / 1024.0 / 1024.0 / r->total);
+		fprintf(f, ",\n      \"min_us\": %.3f", s->min * 1e6);
+		fprintf(f, ",\n      \"max_us\": %.3f", s->max * 1e6);
+		fprintf(f, ",\n      \"mean_us\": %.3f", s->mean * 1e6);
+		fprintf(f, ",\n      \"median_us\": %.3f", s->median * 1e6);
+		fprintf(f, ",\n      \"p95_us\": %.3f", s->p95 * 1e6);
+		fprintf(f, ",\n      \"stddev_us\": %.3f", s->stddev * 1e6);
+		if (bench->samples) {
+			fprintf(f, ",\n      \"samples_us\": [");
+			for (j = 0; j < s->count; j++)
+				fprintf(f, "%s%.3f", j ? ", " : "",
+					r->samples[j] * 1e6);
+			fprintf(f, "]");
+		}
+		fprintf(f, "\n    }");
+	}
+
+	fprintf(f, "\n  ]\n}\n");
+}
+
+static bool csv_param(const char *variant, const char *key,
+		      const char **value, size_t *len)
+{
+	size_t key_len = strlen(key);
+	const char *p = variant;
+
+	while (*p) {
+		size_t n = strcspn(p, ",");
+		const char *eq = memchr(p, '=', n);
+
+		if (eq && (size_t)(eq - p) == key_len &&
+		    memcmp(p, key, key_len) == 0) {
+			*value = eq + 1;
+			*len = p + n - eq - 1;
+			return true;
+		}
+
+		p += n;
+		if (*p == ',')
+			p++;
+	}
+
+	return false;
+}
+
+static void write_csv(struct igt_bench *bench, FILE *f)
+{
+	char **keys = NULL;
+	unsigned num_keys = 0, i, k;
+
+	/* one column per parameter, in order of first appearance */
+	for (i = 0; i < bench->num_results; i++) {
+		const char *p = bench->results[i].variant;
+
+		while (*p) {
+			size_t len = strcspn(p, ",");
+			const char *eq = memchr(p, '=', len);
+
+			if (eq) {
+				for (k = 0; k < num_keys; k++)
+					if (strlen(keys[k]) == (size_t)(eq - p) &&
+					    memcmp(keys[k], p, eq - p) == 0)
+						break;
+				if (k == num_keys) {
+					keys = realloc(keys, (num_keys + 1) *
+						       sizeof(*keys));
+					if (keys == NULL)
+						return;
+					keys[num_keys++] = strndup(p, eq - p);
+				}
+			}
+
+			p += len;
+			if (*p == ',')
+				p++;
+		}
+	}
+
+	if (num_keys == 0)
+		fprintf(f, "variant,");
+	for (k = 0; k < num_keys; k++)
+		fprintf(f, "%s,", keys[k]);
+	fprintf(f, "iterations,total_secs,mb_per_sec,min_us,max_us,mean_us,"
+		"median_us,p95_us,stddev_us\n");
+
+	for (i = 0; i < bench->num_results; i++) {
+		struct igt_bench_result *r = &bench->results[i];
+		struct igt_bench_stats *s = &r->stats;
+
+		if (num_keys == 0)
+			fprintf(f, "%s,", r->variant);
+		for (k = 0; k < num_keys; k++) {
+			const char *value;
+			size_t len;
+
+			if (csv_param(r->variant, keys[k], &value, &len))
+				fprintf(f, "%.*s", (int)len, value);
+			fputc(',', f);
+		}
+
+		fprintf(f, "%u,%.9f,", s->count, r->total);
+		if (r->bytes)
+			fprintf(f, "%.3f",
+				s->count * r->bytes / 1024.0 / 1024.0 / r->total);
+		fprintf(f, ",%.3f,%.3f,%.3f,%.3f,%.3f,%.3f\n",
+			s->min * 1e6, s->max * 1e6, s->mean * 1e6,
+			s->median * 1e6, s->p95 * 1e6, s->stddev * 1e6);
+	}
+
+	for (k = 0; k < num_keys; k++)
+		free(keys[k]);
+	free(keys);
+}
+
+static void write_report(struct igt_bench *bench, const char *filename,
+			 void (*write)(struct igt_bench *bench, FILE *f))
+{
+	FILE *f = stdout;
+
+	if (strcmp(filename, "-"))
+		f = fopen(filename, "w");
+
+	if (f) {
+		write(bench, f);
+		if (f != stdout)
+			fclose(f);
+	} else {
+		perror(filename);
+	}
+}
+
+/**
+ * igt_bench_fini - write out the json/csv reports and free all results
+ */
+void igt_bench_fini(struct igt_bench *bench)
+{
+	unsigned i;
+
+	if (bench->json)
+		write_report(bench, bench->json, write_json);
+	if (bench->csv)
+		write_report(bench, bench->csv, write_csv);
+
+	for (i = 0; i < bench->num_results; i++) {
+		free(bench->results[i].variant);
+		free(bench->results[i].samples);
+	}
+	free(bench->results);
+	bench->results = NULL;
+	bench->num_results = 0;
+}
@@ -0,0 +1,86 @@
+/*
+ * Copyright © 2013 Intel Corporation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ *
+ */
+
+#ifndef IGT_BENCH_H
+#define IGT_BENCH_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+struct igt_bench_stats {
+	unsigned count;
+	double min;
+	double max;
+	double mean;
+	double median;
+	double p95;
+	double stddev;
+};
+
+struct igt_bench_result;
+
+/**
+ * struct igt_bench - state of a benchmark binary
+ *
+ * All the knobs are filled in from the command line by igt_bench_init(), see
+ * --help for the list. Benchmarks can override them afterwards if some
+ * variant needs e.g. a fixed iteration count.
+ */
+struct igt_bench {
+	const char *name;
+
+	int cpu;		/* cpu to pin to, -1 to leave the affinity alone */
+	unsigned warmup;	/* warmup iterations, 0 to calibrate */
+	unsigned iterations;	/* timed iterations, 0 to calibrate */
+	double min_time;	/* target runtime per variant in seconds */
+	const char *filter;	/* only run variants containing this string */
+	const char *json;	/* json output file, "-" for stdout */
+	const char *csv;	/* csv output file, "-" for stdout */
+	bool samples;		/* include raw samples in the json output */
+
+	/* private */
+	struct igt_bench_result *results;
+	unsigned num_results;
+};
+
+typedef void (*igt_bench_func_t)(void *data);
+
+double igt_bench_time(void);
+void igt_bench_stats(double *samples, unsigned count,
+		     struct igt_bench_stats *stats);
+
+void igt_bench_init(struct igt_bench *bench, int argc, char **argv);
+bool igt_bench_run(struct igt_bench *bench, const char *variant,
+		   igt_bench_func_t func, igt_bench_func_t sync, void *data,
+		   double bytes_per_iteration);
+bool igt_bench_run_setup(struct igt_bench *bench, const char *variant,
+			 igt_bench_func_t setup, igt_bench_func_t func,
+			 igt_bench_func_t sync, void *data,
+			 double bytes_per_iteration);
+void igt_bench_record(struct igt_bench *bench, const char *variant,
+		      double *samples, unsigned count, double total,
+		      double bytes_per_iteration);
+void igt_bench_fini(struct igt_bench *bench);
+
+#endif /* IGT_BENCH_H */
@@ -26,6 +26,7 @@
  */
 
 #include <assert.h>
+#include <string.h>
 #include "instdone.h"
 
 #include "intel_chipset.h"
@@ -356,3 +357,49 @@ init_instdone_definitions(uint32_t devid)
 		gen3_instdone_bit(I830_PRIMARY_RING_0_DONE, "Primary ring 0");
 	}
 }
+
+void
+instdone_counter_reset(struct instdone_counter *counter)
+{
+	memset(counter, 0, sizeof(*counter));
+}
+
+/* Adds the planes and a pending sample to the counts and clears them. */
+void
+instdone_counter_flush(struct instdone_counter *counter)
+{
+	int plane, bit;
+
+	for (plane = 0; plane < INSTDONE_COUNTER_PLANES; plane++) {
+		uint64_t val = counter->planes[plane];
+
+		while (val) {
+			bit = __builtin_ctzll(val);
+			counter->counts[bit] += 1 << plane;
+			val &= val - 1;
+		}
+		counter->planes[plane] = 0;
+	}
+
+	if (counter->samples & 1) {
+		uint64_t val = counter->pending;
+
+		while (val) {
+			bit = __builtin_ctzll(val);
+			counter->counts[bit]++;
+			val &= val - 1;
+		}
+	}
+
+	counter->samples = 0;
+}
+
+/*
+ * The position of an instdone bit in a sample of the form
+ * INST_DONE_1 << 32 | INST_DONE (or INST_DONE_I965).
+ */
+int
+instdone_bit_index(const struct instdone_bit *bit)
+{
+	return (bit->reg == INST_DONE_1 ? 32 : 0) + __builtin_ctz(bit->bit);
+}
@@ -39,3 +39,53 @@ extern struct instdone_bit instdone_bits[MAX_INSTDONE_BITS];
 extern int num_instdone_bits;
 
 void init_instdone_definitions(uint32_t devid);
+
+/*
+ * Counts, for each bit of a 64 bit sample, in how many samples it was set.
+ * The counts are kept bit-sliced: bit k of plane n is bit n of the count of
+ * bit k. That way a sample is added to all 64 counts with a few logic ops
+ * per plane, rather than with a test and an increment per bit. Samples are
+ * taken in pairs through a carry-save adder, so only every other one has
+ * to ripple a carry through the planes.
+ *
+ * The planes are expanded into counts[] by instdone_counter_flush(), which
+ * happens by itself before they can overflow.
+ */
+#define INSTDONE_COUNTER_PLANES	16
+
+struct instdone_counter {
+	uint64_t planes[INSTDONE_COUNTER_PLANES];
+	uint64_t pending;
+	unsigned samples;	/* in the planes and pending */
+	uint32_t counts[64];
+};
+
+void instdone_counter_reset(struct instdone_counter *counter);
+void instdone_counter_flush(struct instdone_counter *counter);
+int instdone_bit_index(const struct instdone_bit *bit);
+
+static inline void
+instdone_counter_add(struct instdone_counter *counter, uint64_t sample)
+{
+	uint64_t carry, sum, *plane;
+
+	if ((++counter->samples & 1) == 1) {
+		counter->pending = sample;
+		return;
+	}
+
+	plane = counter->planes;
+	sum = plane[0] ^ counter->pending;
+	carry = (plane[0] & counter->pending) | (sum & sample);
+	plane[0] = sum ^ sample;
+
+	while (carry) {
+		plane++;
+		sum = *plane;
+		*plane = sum ^ carry;
+		carry &= sum;
+	}
+
+	if (counter->samples == (1 << INSTDONE_COUNTER_PLANES) - 2)
+		instdone_counter_flush(counter);
+}
@@ -90,6 +90,48 @@ int intel_gen(uint32_t devid)
 	return -1;
 }
 
+/*
+ * The length of the command starting with header, in dwords, or 0 if that
+ * can't be told from the header alone. This only needs to agree with
+ * libdrm's decoder well enough to find where commands start.
+ */
+unsigned intel_command_dwords(uint32_t devid, uint32_t header)
+{
+	uint32_t opcode;
+
+	switch (header >> 29) {
+	case 0:	/* MI */
+		opcode = (header >> 23) & 0x3f;
+		if (opcode < 0x10)
+			return 1;
+		return (header & 0xff) + 2;
+	case 2:	/* 2D */
+		return (header & 0xff) + 2;
+	case 3:
+		if (IS_965(devid)) {
+			opcode = header >> 16;
+			/* PIPELINE_SELECT and 3DSTATE_VF_STATISTICS */
+			if (opcode == 0x6104 || opcode == 0x6904 ||
+			    opcode == 0x780b)
+				return 1;
+			return (header & 0xffff) + 2;
+		}
+
+		opcode = (header >> 24) & 0x1f;
+		if (opcode == 0x1f)	/* primitives, maybe with inline data */
+			return 0;
+		if (opcode == 0x1d) {
+			/* 3DSTATE_LOAD_STATE_IMMEDIATE_1 keeps flags above */
+			if (((header >> 16) & 0xff) == 0x04)
+				return (header & 0xf) + 2;
+			return (header & 0xff) + 2;
+		}
+		return 1;
+	default:
+		return 1;
+	}
+}
+
 uint64_t
 intel_get_total_ram_mb(void)
 {
@@ -0,0 +1,2262 @@
+/*
+ * Copyright © 2013 Intel Corporation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ *
+ */
+
+/**
+ * A userspace stand-in for the i915 GEM and KMS ioctls.
+ *
+ * Preload this module (LD_PRELOAD=libintel_fake_drm.so) and the first
+ * /dev/dri/card node opened by the process becomes a fake i915 device.
+ * Buffer objects are backed by anonymous shared memory, execbuf2 performs
+ * the full relocation pass (including the HANDLE_LUT and NO_RELOC fast
+ * paths) and then retires synchronously, so busy/wait always report an idle
+ * GPU. This lets us profile and regression-test the CPU side of command
+ * submission on machines without Intel graphics.
+ *
+ * Environment variables:
+ *
+ *   INTEL_DEVID_OVERRIDE   PCI id reported by the fake device, defaults to
+ *                          an Ivybridge GT2 so that all rings are present.
+ *   INTEL_FAKE_DRM_BLITTER If set to 1, batches are run through a small
+ *                          software blitter which implements MI_NOOP,
+ *                          MI_STORE_DWORD_IMM, XY_COLOR_BLT and
+ *                          XY_SRC_COPY_BLT. All other commands are skipped.
+ *   INTEL_FAKE_DRM_PIPES   Number of crtcs, each with one HDMI connector
+ *                          always connected to it. Defaults to what the
+ *                          device has.
+ *   INTEL_FAKE_DRM_REFRESH Refresh rate of the connectors in Hz, as a comma
+ *                          separated list with the last one repeated for
+ *                          the remaining connectors. Defaults to 60.
+ *   INTEL_FAKE_DRM_JITTER  Upper bound in microseconds of a random delay
+ *                          added to the delivery of every vblank and flip
+ *                          event, the timestamps stay on the vblank.
+ *   INTEL_FAKE_DRM_SEED    Seed of that random delay, defaults to 1 so that
+ *                          runs are repeatable.
+ *
+ * The crtcs have no hardware behind them either: a vblank counter is
+ * derived from CLOCK_MONOTONIC and the mode timings from the moment the
+ * pipe was lit up, page flips complete on the next vblank and framebuffers
+ * are just views of the buffer objects. A thread per device writes the
+ * vblank and flip events into the device fd when they are due, so
+ * poll()/drmHandleEvent() work as usual. That thread is not around in a
+ * forked child, which can't wait for events of its parent's device: the
+ * child forgets about them and only starts a thread of its own once it
+ * queues events itself.
+ *
+ * There is no fence detiling: objects are always stored linearly, and both
+ * the CPU and GTT mmaps see the same linear layout. The software blitter
+ * uses that layout for tiled surfaces too, so data round-trips through the
+ * fake device even though the bits would be laid out differently in memory
+ * on real hardware.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <stdarg.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <dlfcn.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <time.h>
+
+#include "drm.h"
+#include "drm_fourcc.h"
+#include "i915_drm.h"
+#include "intel_chipset.h"
+#include "intel_reg.h"
+
+#define LOCAL_I915_PARAM_HAS_VEBOX		22
+#define LOCAL_I915_PARAM_HAS_SECURE_BATCHES	23
+#define LOCAL_I915_PARAM_HAS_PINNED_BATCHES	24
+#define LOCAL_I915_PARAM_HAS_EXEC_NO_RELOC	25
+#define LOCAL_I915_PARAM_HAS_EXEC_HANDLE_LUT	26
+
+#define LOCAL_I915_EXEC_VEBOX			(4 << 0)
+#define LOCAL_I915_EXEC_NO_RELOC		(1 << 11)
+#define LOCAL_I915_EXEC_HANDLE_LUT		(1 << 12)
+
+struct local_drm_i915_gem_caching {
+	uint32_t handle;
+	uint32_t caching;
+};
+
+#define LOCAL_DRM_I915_GEM_SET_CACHEING    0x2f
+#define LOCAL_DRM_I915_GEM_GET_CACHEING    0x30
+#define LOCAL_DRM_IOCTL_I915_GEM_SET_CACHEING \
+	DRM_IOW(DRM_COMMAND_BASE + LOCAL_DRM_I915_GEM_SET_CACHEING, struct local_drm_i915_gem_caching)
+#define LOCAL_DRM_IOCTL_I915_GEM_GET_CACHEING \
+	DRM_IOWR(DRM_COMMAND_BASE + LOCAL_DRM_I915_GEM_GET_CACHEING, struct local_drm_i915_gem_caching)
+
+#define FAKE_APERTURE_SIZE	(2048ULL << 20)
+#define FAKE_GTT_START		(1 << 20)
+#define FAKE_MMAP_SHIFT		32
+#define FAKE_NUM_FENCES		16
+
+#define FAKE_MAX_PIPES		4
+#define FAKE_NUM_MODES		3
+#define FAKE_CRTC_ID(i)		(0x10 + (i))
+#define FAKE_ENCODER_ID(i)	(0x20 + (i))
+#define FAKE_CONNECTOR_ID(i)	(0x30 + (i))
+#define FAKE_FIRST_FB_ID	0x100
+#define FAKE_PROP_DPMS		1
+
+#define from_user_pointer(x)	((void *)(uintptr_t)(x))
+#define ARRAY_SIZE(x)		(sizeof(x) / sizeof((x)[0]))
+
+struct fake_bo {
+	int refcount;
+	int memfd;
+	void *ptr;
+	uint64_t size;
+	uint32_t gtt_offset;
+	uint32_t name;
+	uint32_t tiling_mode;
+	uint32_t stride;
+	uint32_t caching;
+	uint32_t madv;
+
+	/* execbuf serial this bo was last validated for, catches duplicates */
+	uint32_t exec_serial;
+	uint32_t exec_index;
+
+	struct fake_bo *name_next;
+};
+
+struct fake_fb {
+	uint32_t id;
+	uint32_t width, height;
+	uint32_t pitch, offset;
+	uint32_t bpp, depth;
+	struct fake_bo *bo;
+
+	struct fake_fb *next;
+};
+
+struct fake_crtc {
+	uint32_t fb;		/* 0 when the crtc is off */
+	uint32_t x, y;
+	struct drm_mode_modeinfo mode;
+
+	/* scanning out to at least one connector which is powered up */
+	bool active;
+	bool flip_pending;
+
+	/*
+	 * While active, vblank seq0 happened at t0 and then one every period
+	 * ns. While not, the counter stays at seq0.
+	 */
+	uint64_t t0;
+	uint64_t period;
+	uint32_t seq0;
+};
+
+struct fake_connector {
+	int crtc;		/* the one driving it, -1 if none */
+	uint32_t dpms;
+	struct drm_mode_modeinfo modes[FAKE_NUM_MODES];
+};
+
+struct fake_event {
+	uint64_t time;		/* when it is delivered, CLOCK_MONOTONIC ns */
+	int crtc;
+	bool flip;		/* completes the pending flip of the crtc */
+	bool send;		/* false for flips without an event */
+	struct drm_event_vblank ev;
+
+	struct fake_event *next;
+};
+
+struct fake_device {
+	int fd;
+	int event_fd;
+	uint32_t devid;
+	int gen;
+	bool blitter;
+
+	struct fake_bo **handles;
+	uint32_t num_handles;
+	uint32_t free_hint;
+
+	uint32_t next_context;
+	uint32_t exec_serial;
+
+	/* scratch space for the execbuf validation list */
+	struct fake_bo **exec_bos;
+	uint32_t exec_bos_size;
+
+	int num_pipes;
+	struct fake_crtc crtcs[FAKE_MAX_PIPES];
+	struct fake_connector connectors[FAKE_MAX_PIPES];
+	struct fake_fb *fbs;
+	uint32_t next_fb_id;
+	uint64_t jitter;
+	uint32_t jitter_state;
+
+	/* pending vblank and flip events, in delivery order */
+	struct fake_event *events;
+	pthread_cond_t event_cond;
+	pthread_t event_thread;
+	bool event_thread_running;
+	bool event_thread_stop;
+
+	struct fake_device *next;
+};
+
+static pthread_mutex_t fake_lock = PTHREAD_MUTEX_INITIALIZER;
+static struct fake_device *fake_devices;
+static struct fake_bo *fake_names;
+static uint32_t fake_next_name = 1;
+static uint64_t fake_next_offset = FAKE_GTT_START;
+
+static int (*real_open)(const char *path, int flags, ...);
+static int (*real_close)(int fd);
+static int (*real_ioctl)(int fd, unsigned long request, ...);
+static void *(*real_mmap)(void *addr, size_t len, int prot, int flags,
+			  int fd, off64_t offset);
+
+static void fake_atfork_prepare(void)
+{
+	pthread_mutex_lock(&fake_lock);
+}
+
+static void fake_atfork_parent(void)
+{
+	pthread_mutex_unlock(&fake_lock);
+}
+
+/*
+ * Only the forking thread survives, so the event threads are gone along
+ * with the state of the condition variables they were waiting on. Forget
+ * about both, and about the events the parent will deliver, so that
+ * closing the device doesn't join a thread which doesn't exist.
+ */
+static void fake_atfork_child(void)
+{
+	struct fake_device *dev;
+	pthread_condattr_t attr;
+
+	for (dev = fake_devices; dev; dev = dev->next) {
+		while (dev->events) {
+			struct fake_event *e = dev->events;
+
+			dev->events = e->next;
+			free(e);
+		}
+
+		dev->event_thread_running = false;
+		dev->event_thread_stop = false;
+
+		pthread_condattr_init(&attr);
+		pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+		pthread_cond_init(&dev->event_cond, &attr);
+		pthread_condattr_destroy(&attr);
+	}
+
+	pthread_mutex_unlock(&fake_lock);
+}
+
+static void fake_init_symbols(void)
+{
+	if (real_ioctl)
+		return;
+
+	real_open = dlsym(RTLD_NEXT, "open");
+	real_close = dlsym(RTLD_NEXT, "close");
+	real_mmap = dlsym(RTLD_NEXT, "mmap64");
+	real_ioctl = dlsym(RTLD_NEXT, "ioctl");
+
+	pthread_atfork(fake_atfork_prepare, fake_atfork_parent,
+		       fake_atfork_child);
+}
+
+static struct fake_device *fake_lookup_device(int fd)
+{
+	struct fake_device *dev;
+
+	for (dev = fake_devices; dev; dev = dev->next)
+		if (dev->fd == fd)
+			return dev;
+
+	return NULL;
+}
+
+static bool fake_is_card_node(const char *path, int *minor)
+{
+	return path && sscanf(path, "/dev/dri/card%d", minor) == 1;
+}
+
+/*
+ * Buffer objects
+ */
+
+static struct fake_bo *fake_bo_create(uint64_t size)
+{
+	struct fake_bo *bo;
+
+	bo = calloc(1, sizeof(*bo));
+	if (bo == NULL)
+		return NULL;
+
+	bo->memfd = syscall(SYS_memfd_create, "fake-i915-bo", 0);
+	if (bo->memfd < 0)
+		goto err_free;
+
+	if (ftruncate(bo->memfd, size))
+		goto err_close;
+
+	bo->ptr = real_mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED,
+			    bo->memfd, 0);
+	if (bo->ptr == MAP_FAILED)
+		goto err_close;
+
+	bo->refcount = 1;
+	bo->size = size;
+
+	/* Pretend everything is bound into one big GTT, wrap when it's full. */
+	if (fake_next_offset + size > FAKE_APERTURE_SIZE)
+		fake_next_offset = FAKE_GTT_START;
+	bo->gtt_offset = fake_next_offset;
+	fake_next_offset += size;
+
+	return bo;
+
+err_close:
+	real_close(bo->memfd);
+err_free:
+	free(bo);
+	return NULL;
+}
+
+static void fake_bo_unreference(struct fake_bo *bo)
+{
+	struct fake_bo **p;
+
+	if (--bo->refcount)
+		return;
+
+	if (bo->name) {
+		for (p = &fake_names; *p; p = &(*p)->name_next) {
+			if (*p == bo) {
+				*p = bo->name_next;
+				break;
+			}
+		}
+	}
+
+	munmap(bo->ptr, bo->size);
+	real_close(bo->memfd);
+	free(bo);
+}
+
+static struct fake_bo *fake_lookup_bo(struct fake_device *dev, uint32_t handle)
+{
+	if (handle == 0 || handle >= dev->num_handles)
+		return NULL;
+
+	return dev->handles[handle];
+}
+
+static int fake_add_handle(struct fake_device *dev, struct fake_bo *bo,
+			   uint32_t *handle)
+{
+	uint32_t i;
+
+	for (i = dev->free_hint ?: 1; i < dev->num_handles; i++)
+		if (dev->handles[i] == NULL)
+			break;
+
+	if (i >= dev->num_handles) {
+		uint32_t count = dev->num_handles ? 2 * dev->num_handles : 256;
+		struct fake_bo **handles;
+
+		handles = realloc(dev->handles, count * sizeof(*handles));
+		if (handles == NULL)
+			return -ENOMEM;
+
+		memset(handles + dev->num_handles, 0,
+		       (count - dev->num_handles) * sizeof(*handles));
+		dev->handles = handles;
+		dev->num_handles = count;
+	}
+
+	dev->handles[i] = bo;
+	dev->free_hint = i + 1;
+	*handle = i;
+
+	return 0;
+}
+
+static void fake_remove_handle(struct fake_device *dev, uint32_t handle)
+{
+	fake_bo_unreference(dev->handles[handle]);
+	dev->handles[handle] = NULL;
+
+	if (handle < dev->free_hint)
+		dev->free_hint = handle;
+}
+
+/*
+ * Software blitter
+ */
+
+static void *fake_gtt_to_cpu(struct fake_bo **bos, uint32_t count,
+			     uint32_t addr, uint64_t len)
+{
+	uint32_t i;
+
+	for (i = 0; i < count; i++) {
+		struct fake_bo *bo = bos[i];
+
+		if (addr >= bo->gtt_offset &&
+		    addr - bo->gtt_offset + len <= bo->size)
+			return (char *)bo->ptr + (addr - bo->gtt_offset);
+	}
+
+	return NULL;
+}
+
+static int fake_blt_cpp(uint32_t br13)
+{
+	switch ((br13 >> 24) & 3) {
+	case 0:
+		return 1;
+	case 1:
+	case 2:
+		return 2;
+	default:
+		return 4;
+	}
+}
+
+static void fake_blt_fill(void *dst, int cpp, uint32_t color)
+{
+	switch (cpp) {
+	case 1:
+		*(uint8_t *)dst = color;
+		break;
+	case 2:
+		*(uint16_t *)dst = color;
+		break;
+	default:
+		*(uint32_t *)dst = color;
+		break;
+	}
+}
+
+static void fake_xy_color_blt(struct fake_bo **bos, uint32_t count,
+			      const uint32_t *cmd, bool dst_tiled)
+{
+	int cpp = fake_blt_cpp(cmd[1]);
+	int pitch = (int16_t)(cmd[1] & 0xffff);
+	int x1 = cmd[2] & 0xffff, y1 = cmd[2] >> 16;
+	int x2 = cmd[3] & 0xffff, y2 = cmd[3] >> 16;
+	char *dst;
+	int x, y;
+
+	if (dst_tiled)
+		pitch *= 4;
+
+	if (x2 <= x1 || y2 <= y1 || pitch <= 0)
+		return;
+
+	dst = fake_gtt_to_cpu(bos, count, cmd[4] + y1 * pitch + x1 * cpp,
+			      (uint64_t)(y2 - y1 - 1) * pitch + (x2 - x1) * cpp);
+	if (dst == NULL)
+		return;
+
+	for (y = 0; y < y2 - y1; y++)
+		for (x = 0; x < x2 - x1; x++)
+			fake_blt_fill(dst + y * pitch + x * cpp, cpp, cmd[5]);
+}
+
+static void fake_xy_src_copy_blt(struct fake_bo **bos, uint32_t count,
+				 const uint32_t *cmd, bool src_tiled,
+				 bool dst_tiled)
+{
+	int cpp = fake_blt_cpp(cmd[1]);
+	int dst_pitch = (int16_t)(cmd[1] & 0xffff);
+	int src_pitch = (int16_t)(cmd[6] & 0xffff);
+	int dst_x1 = cmd[2] & 0xffff, dst_y1 = cmd[2] >> 16;
+	int dst_x2 = cmd[3] & 0xffff, dst_y2 = cmd[3] >> 16;
+	int src_x1 = cmd[5] & 0xffff, src_y1 = cmd[5] >> 16;
+	int width = dst_x2 - dst_x1, height = dst_y2 - dst_y1;
+	char *dst, *src;
+	int y;
+
+	if (dst_tiled)
+		dst_pitch *= 4;
+	if (src_tiled)
+		src_pitch *= 4;
+
+	if (width <= 0 || height <= 0 || dst_pitch <= 0 || src_pitch <= 0)
+		return;
+
+	dst = fake_gtt_to_cpu(bos, count,
+			      cmd[4] + dst_y1 * dst_pitch + dst_x1 * cpp,
+			      (uint64_t)(height - 1) * dst_pitch + width * cpp);
+	src = fake_gtt_to_cpu(bos, count,
+			      cmd[7] + src_y1 * src_pitch + src_x1 * cpp,
+			      (uint64_t)(height - 1) * src_pitch + width * cpp);
+	if (dst == NULL || src == NULL)
+		return;
+
+	for (y = 0; y < height; y++)
+		memmove(dst + y * dst_pitch, src + y * src_pitch, width * cpp);
+}
+
+static void fake_run_batch(struct fake_device *dev,
+			   struct fake_bo **bos, uint32_t count,
+			   const uint32_t *batch, uint32_t len)
+{
+	const uint32_t *end = batch + len / 4;
+	uint32_t *dst;
+
+	while (batch < end) {
+		uint32_t cmd = *batch;
+		uint32_t opcode, length;
+
+		switch (cmd >> 29) {
+		case 0: /* MI */
+			opcode = (cmd >> 23) & 0x3f;
+			length = opcode < 0x10 ? 1 : (cmd & 0x3f) + 2;
+			if (cmd == MI_BATCH_BUFFER_END)
+				return;
+
+			if (batch + length > end)
+				return;
+
+			if (opcode == 0x20 && length >= 4) {
+				dst = fake_gtt_to_cpu(bos, count, batch[2], 4);
+				if (dst)
+					*dst = batch[3];
+			}
+			break;
+		case 2: /* 2D */
+			opcode = (cmd >> 22) & 0x7f;
+			length = (cmd & 0xff) + 2;
+			if (batch + length > end)
+				return;
+
+			if (opcode == 0x50 && length >= 6)
+				fake_xy_color_blt(bos, count, batch,
+						  cmd & XY_COLOR_BLT_TILED &&
+						  dev->gen >= 4);
+			else if (opcode == 0x53 && length >= 8)
+				fake_xy_src_copy_blt(bos, count, batch,
+						     cmd & XY_SRC_COPY_BLT_SRC_TILED &&
+						     dev->gen >= 4,
+						     cmd & XY_SRC_COPY_BLT_DST_TILED &&
+						     dev->gen >= 4);
+			break;
+		case 3: /* 3D/media, only ever skipped */
+			if ((cmd >> 16) == 0x6904)
+				length = 1; /* PIPELINE_SELECT */
+			else
+				length = (cmd & 0xff) + 2;
+			break;
+		default:
+			length = 1;
+			break;
+		}
+
+		batch += length;
+	}
+}
+
+/*
+ * Ioctl implementations
+ */
+
+static int fake_getparam(struct fake_device *dev, drm_i915_getparam_t *gp)
+{
+	int value;
+
+	switch (gp->param) {
+	case I915_PARAM_CHIPSET_ID:
+		value = dev->devid;
+		break;
+	case I915_PARAM_HAS_GEM:
+	case I915_PARAM_HAS_EXECBUF2:
+	case I915_PARAM_HAS_RELAXED_FENCING:
+	case I915_PARAM_HAS_RELAXED_DELTA:
+	case I915_PARAM_HAS_WAIT_TIMEOUT:
+	case LOCAL_I915_PARAM_HAS_EXEC_NO_RELOC:
+	case LOCAL_I915_PARAM_HAS_EXEC_HANDLE_LUT:
+		value = 1;
+		break;
+	case I915_PARAM_NUM_FENCES_AVAIL:
+		value = FAKE_NUM_FENCES;
+		break;
+	case I915_PARAM_HAS_BSD:
+		value = HAS_BSD_RING(dev->devid);
+		break;
+	case I915_PARAM_HAS_BLT:
+		value = HAS_BLT_RING(dev->devid);
+		break;
+	case LOCAL_I915_PARAM_HAS_VEBOX:
+		value = HAS_VEBOX_RING(dev->devid);
+		break;
+	case I915_PARAM_HAS_LLC:
+		value = dev->gen >= 6;
+		break;
+	case I915_PARAM_HAS_ALIASING_PPGTT:
+	case I915_PARAM_HAS_SEMAPHORES:
+	case I915_PARAM_HAS_GEN7_SOL_RESET:
+		value = dev->gen >= 6;
+		break;
+	default:
+		return -EINVAL;
+	}
+
+	*gp->value = value;
+	return 0;
+}
+
+static int fake_copy_string(char *dst, size_t *len, const char *src)
+{
+	size_t src_len = strlen(src);
+
+	if (dst && *len)
+		memcpy(dst, src, *len < src_len ? *len : src_len);
+	*len = src_len;
+
+	return 0;
+}
+
+static int fake_get_version(struct drm_version *v)
+{
+	v->version_major = 1;
+	v->version_minor = 6;
+	v->version_patchlevel = 0;
+	fake_copy_string(v->name, &v->name_len, "i915");
+	fake_copy_string(v->date, &v->date_len, "20080730");
+	fake_copy_string(v->desc, &v->desc_len, "Fake Intel Graphics");
+
+	return 0;
+}
+
+static int fake_gem_create(struct fake_device *dev,
+			   struct drm_i915_gem_create *create)
+{
+	struct fake_bo *bo;
+	uint64_t size;
+	int ret;
+
+	size = (create->size + 4095) & ~4095ULL;
+	if (size == 0 || size > FAKE_APERTURE_SIZE)
+		return -EINVAL;
+
+	bo = fake_bo_create(size);
+	if (bo == NULL)
+		return -ENOMEM;
+
+	ret = fake_add_handle(dev, bo, &create->handle);
+	if (ret)
+		fake_bo_unreference(bo);
+
+	return ret;
+}
+
+static int fake_gem_close(struct fake_device *dev, struct drm_gem_close *arg)
+{
+	if (fake_lookup_bo(dev, arg->handle) == NULL)
+		return -EINVAL;
+
+	fake_remove_handle(dev, arg->handle);
+	return 0;
+}
+
+static int fake_gem_flink(struct fake_device *dev, struct drm_gem_flink *arg)
+{
+	struct fake_bo *bo = fake_lookup_bo(dev, arg->handle);
+
+	if (bo == NULL)
+		return -ENOENT;
+
+	if (bo->name == 0) {
+		bo->name = fake_next_name++;
+		bo->name_next = fake_names;
+		fake_names = bo;
+	}
+
+	arg->name = bo->name;
+	return 0;
+}
+
+static int fake_gem_open(struct fake_device *dev, struct drm_gem_open *arg)
+{
+	struct fake_bo *bo;
+	int ret;
+
+	for (bo = fake_names; bo; bo = bo->name_next)
+		if (bo->name == arg->name)
+			break;
+
+	if (bo == NULL)
+		return -ENOENT;
+
+	ret = fake_add_handle(dev, bo, &arg->handle);
+	if (ret)
+		return ret;
+
+	bo->refcount++;
+	arg->size = bo->size;
+
+	return 0;
+}
+
+static int fake_gem_pread(struct fake_device *dev,
+			  struct drm_i915_gem_pread *arg)
+{
+	struct fake_bo *bo = fake_lookup_bo(dev, arg->handle);
+
+	if (bo == NULL)
+		return -ENOENT;
+
+	if (arg->offset > bo->size || arg->size > bo->size - arg->offset)
+		return -EINVAL;
+
+	memcpy(from_user_pointer(arg->data_ptr),
+	       (char *)bo->ptr + arg->offset, arg->size);
+	return 0;
+}
+
+static int fake_gem_pwrite(struct fake_device *dev,
+			   struct drm_i915_gem_pwrite *arg)
+{
+	struct fake_bo *bo = fake_lookup_bo(dev, arg->handle);
+
+	if (bo == NULL)
+		return -ENOENT;
+
+	if (arg->offset > bo->size || arg->size > bo->size - arg->offset)
+		return -EINVAL;
+
+	memcpy((char *)bo->ptr + arg->offset,
+	       from_user_pointer(arg->data_ptr), arg->size);
+	return 0;
+}
+
+static int fake_gem_mmap(struct fake_device *dev,
+			 struct drm_i915_gem_mmap *arg)
+{
+	struct fake_bo *bo = fake_lookup_bo(dev, arg->handle);
+	void *ptr;
+
+	if (bo == NULL)
+		return -ENOENT;
+
+	if (arg->offset > bo->size || arg->size > bo->size - arg->offset)
+		return -EINVAL;
+
+	ptr = real_mmap(NULL, arg->size, PROT_READ | PROT_WRITE, MAP_SHARED,
+			bo->memfd, arg->offset);
+	if (ptr == MAP_FAILED)
+		return -errno;
+
+	arg->addr_ptr = (uintptr_t)ptr;
+	return 0;
+}
+
+static int fake_gem_mmap_gtt(struct fake_device *dev,
+			     struct drm_i915_gem_mmap_gtt *arg)
+{
+	if (fake_lookup_bo(dev, arg->handle) == NULL)
+		return -ENOENT;
+
+	arg->offset = (uint64_t)arg->handle << FAKE_MMAP_SHIFT;
+	return 0;
+}
+
+static int fake_gem_set_tiling(struct fake_device *dev,
+			       struct drm_i915_gem_set_tiling *arg)
+{
+	struct fake_bo *bo = fake_lookup_bo(dev, arg->handle);
+
+	if (bo == NULL)
+		return -ENOENT;
+
+	if (arg->tiling_mode > I915_TILING_Y)
+		return -EINVAL;
+
+	if (arg->tiling_mode == I915_TILING_Y && dev->gen < 4 &&
+	    !IS_915(dev->devid) && !IS_945(dev->devid))
+		return -EINVAL;
+
+	if (arg->tiling_mode != I915_TILING_NONE &&
+	    (arg->stride == 0 || arg->stride & 127))
+		return -EINVAL;
+
+	bo->tiling_mode = arg->tiling_mode;
+	bo->stride = arg->tiling_mode == I915_TILING_NONE ? 0 : arg->stride;
+	arg->swizzle_mode = I915_BIT_6_SWIZZLE_NONE;
+
+	return 0;
+}
+
+static int fake_gem_get_tiling(struct fake_device *dev,
+			       struct drm_i915_gem_get_tiling *arg)
+{
+	struct fake_bo *bo = fake_lookup_bo(dev, arg->handle);
+
+	if (bo == NULL)
+		return -ENOENT;
+
+	arg->tiling_mode = bo->tiling_mode;
+	arg->swizzle_mode = I915_BIT_6_SWIZZLE_NONE;
+
+	return 0;
+}
+
+static int fake_gem_set_caching(struct fake_device *dev,
+				struct local_drm_i915_gem_caching *arg)
+{
+	struct fake_bo *bo = fake_lookup_bo(dev, arg->handle);
+
+	if (bo == NULL)
+		return -ENOENT;
+
+	if (arg->caching > 2)
+		return -EINVAL;
+
+	bo->caching = arg->caching;
+	return 0;
+}
+
+static int fake_gem_get_caching(struct fake_device *dev,
+				struct local_drm_i915_gem_caching *arg)
+{
+	struct fake_bo *bo = fake_lookup_bo(dev, arg->handle);
+
+	if (bo == NULL)
+		return -ENOENT;
+
+	arg->caching = bo->caching;
+	return 0;
+}
+
+static int fake_gem_madvise(struct fake_device *dev,
+			    struct drm_i915_gem_madvise *arg)
+{
+	struct fake_bo *bo = fake_lookup_bo(dev, arg->handle);
+
+	if (bo == NULL)
+		return -ENOENT;
+
+	/* We never reap purgeable objects, so the backing store is retained */
+	bo->madv = arg->madv;
+	arg->retained = 1;
+
+	return 0;
+}
+
+static int fake_gem_busy(struct fake_device *dev,
+			 struct drm_i915_gem_busy *arg)
+{
+	if (fake_lookup_bo(dev, arg->handle) == NULL)
+		return -ENOENT;
+
+	arg->busy = 0;
+	return 0;
+}
+
+static int fake_gem_handle_only(struct fake_device *dev, uint32_t handle)
+{
+	return fake_lookup_bo(dev, handle) ? 0 : -ENOENT;
+}
+
+static int fake_gem_wait(struct fake_device *dev,
+			 struct drm_i915_gem_wait *arg)
+{
+	if (fake_lookup_bo(dev, arg->bo_handle) == NULL)
+		return -ENOENT;
+
+	arg->timeout_ns = arg->timeout_ns > 0 ? arg->timeout_ns : 0;
+	return 0;
+}
+
+static int fake_gem_get_aperture(struct drm_i915_gem_get_aperture *arg)
+{
+	arg->aper_size = FAKE_APERTURE_SIZE;
+	arg->aper_available_size = FAKE_APERTURE_SIZE;
+
+	return 0;
+}
+
+static int fake_context_create(struct fake_device *dev,
+			       struct drm_i915_gem_context_create *arg)
+{
+	if (dev->gen < 6)
+		return -ENODEV;
+
+	arg->ctx_id = ++dev->next_context;
+	return 0;
+}
+
+static int fake_context_destroy(struct fake_device *dev,
+				struct drm_i915_gem_context_destroy *arg)
+{
+	if (arg->ctx_id == 0 || arg->ctx_id > dev->next_context)
+		return -ENOENT;
+
+	return 0;
+}
+
+static bool fake_ring_valid(struct fake_device *dev, uint64_t flags)
+{
+	switch (flags & I915_EXEC_RING_MASK) {
+	case I915_EXEC_DEFAULT:
+	case I915_EXEC_RENDER:
+		return true;
+	case I915_EXEC_BSD:
+		return HAS_BSD_RING(dev->devid);
+	case I915_EXEC_BLT:
+		return HAS_BLT_RING(dev->devid);
+	case LOCAL_I915_EXEC_VEBOX:
+		return HAS_VEBOX_RING(dev->devid);
+	default:
+		return false;
+	}
+}
+
+static int fake_relocate(struct fake_device *dev,
+			 struct drm_i915_gem_execbuffer2 *eb,
+			 struct drm_i915_gem_exec_object2 *exec,
+			 struct fake_bo *bo)
+{
+	struct drm_i915_gem_relocation_entry *reloc;
+	struct fake_bo **bos = dev->exec_bos;
+	uint32_t i;
+
+	reloc = from_user_pointer(exec->relocs_ptr);
+	for (i = 0; i < exec->relocation_count; i++, reloc++) {
+		struct fake_bo *target;
+
+		if (eb->flags & LOCAL_I915_EXEC_HANDLE_LUT) {
+			if (reloc->target_handle >= eb->buffer_count)
+				return -ENOENT;
+			target = bos[reloc->target_handle];
+		} else {
+			target = fake_lookup_bo(dev, reloc->target_handle);
+			if (target == NULL ||
+			    target->exec_serial != dev->exec_serial)
+				return -ENOENT;
+		}
+
+		if (reloc->offset & 3 || reloc->offset > bo->size - 4)
+			return -EINVAL;
+
+		/* The kernel skips relocations which are already correct. */
+		if (reloc->presumed_offset == target->gtt_offset)
+			continue;
+
+		*(uint32_t *)((char *)bo->ptr + reloc->offset) =
+			target->gtt_offset + reloc->delta;
+		reloc->presumed_offset = target->gtt_offset;
+	}
+
+	return 0;
+}
+
+static int fake_execbuf2(struct fake_device *dev,
+			 struct drm_i915_gem_execbuffer2 *eb)
+{
+	struct drm_i915_gem_exec_object2 *exec;
+	struct fake_bo *batch;
+	bool need_relocs;
+	uint32_t len, i;
+	int ret;
+
+	if (eb->buffer_count == 0)
+		return -EINVAL;
+
+	if (!fake_ring_valid(dev, eb->flags))
+		return -EINVAL;
+
+	if (eb->rsvd1 > dev->next_context)
+		return -ENOENT;
+
+	if (eb->buffer_count > dev->exec_bos_size) {
+		struct fake_bo **bos;
+
+		bos = realloc(dev->exec_bos, eb->buffer_count * sizeof(*bos));
+		if (bos == NULL)
+			return -ENOMEM;
+
+		dev->exec_bos = bos;
+		dev->exec_bos_size = eb->buffer_count;
+	}
+
+	/* Build the validation list, rejecting unknown and duplicate handles */
+	dev->exec_serial++;
+	exec = from_user_pointer(eb->buffers_ptr);
+	need_relocs = false;
+	for (i = 0; i < eb->buffer_count; i++) {
+		struct fake_bo *bo = fake_lookup_bo(dev, exec[i].handle);
+
+		if (bo == NULL)
+			return -ENOENT;
+
+		if (bo->exec_serial == dev->exec_serial)
+			return -EINVAL;
+
+		bo->exec_serial = dev->exec_serial;
+		bo->exec_index = i;
+		dev->exec_bos[i] = bo;
+
+		if (exec[i].offset != bo->gtt_offset)
+			need_relocs = true;
+	}
+
+	/*
+	 * With NO_RELOC userspace promises that the presumed offsets are
+	 * correct if every object is still where it claims it was.
+	 */
+	if (!(eb->flags & LOCAL_I915_EXEC_NO_RELOC))
+		need_relocs = true;
+
+	if (need_relocs) {
+		for (i = 0; i < eb->buffer_count; i++) {
+			ret = fake_relocate(dev, eb, &exec[i], dev->exec_bos[i]);
+			if (ret)
+				return ret;
+		}
+	}
+
+	for (i = 0; i < eb->buffer_count; i++)
+		exec[i].offset = dev->exec_bos[i]->gtt_offset;
+
+	batch = dev->exec_bos[eb->buffer_count - 1];
+	len = eb->batch_len;
+	if (eb->batch_start_offset & 7 || len & 7 ||
+	    eb->batch_start_offset + (uint64_t)len > batch->size)
+		return -EINVAL;
+
+	if (dev->blitter)
+		fake_run_batch(dev, dev->exec_bos, eb->buffer_count,
+			       (uint32_t *)((char *)batch->ptr +
+					    eb->batch_start_offset),
+			       len);
+
+	return 0;
+}
+
+/*
+ * Mode setting
+ */
+
+static const struct {
+	uint16_t hdisplay, hsync_start, hsync_end, htotal;
+	uint16_t vdisplay, vsync_start, vsync_end, vtotal;
+	uint32_t flags;
+} fake_timings[FAKE_NUM_MODES] = {
+	{ 1920, 2008, 2052, 2200, 1080, 1084, 1089, 1125,
+	  DRM_MODE_FLAG_PHSYNC | DRM_MODE_FLAG_PVSYNC },
+	{ 1280, 1390, 1430, 1650, 720, 725, 730, 750,
+	  DRM_MODE_FLAG_PHSYNC | DRM_MODE_FLAG_PVSYNC },
+	{ 1024, 1048, 1184, 1344, 768, 771, 777, 806,
+	  DRM_MODE_FLAG_NHSYNC | DRM_MODE_FLAG_NVSYNC },
+};
+
+static const struct {
+	uint32_t format;
+	uint32_t bpp, depth;
+} fake_formats[] = {
+	{ DRM_FORMAT_C8, 8, 8 },
+	{ DRM_FORMAT_XRGB1555, 16, 15 },
+	{ DRM_FORMAT_RGB565, 16, 16 },
+	{ DRM_FORMAT_XRGB8888, 32, 24 },
+	{ DRM_FORMAT_XRGB2101010, 32, 30 },
+	{ DRM_FORMAT_ARGB8888, 32, 32 },
+};
+
+static const char * const fake_dpms_names[] = {
+	[DRM_MODE_DPMS_ON] = "On",
+	[DRM_MODE_DPMS_STANDBY] = "Standby",
+	[DRM_MODE_DPMS_SUSPEND] = "Suspend",
+	[DRM_MODE_DPMS_OFF] = "Off",
+};
+
+static uint64_t fake_now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static void fake_to_timespec(uint64_t t, struct timespec *ts)
+{
+	ts->tv_sec = t / 1000000000;
+	ts->tv_nsec = t % 1000000000;
+}
+
+static void fake_init_mode(struct drm_mode_modeinfo *mode, int i, int refresh)
+{
+	memset(mode, 0, sizeof(*mode));
+	mode->hdisplay = fake_timings[i].hdisplay;
+	mode->hsync_start = fake_timings[i].hsync_start;
+	mode->hsync_end = fake_timings[i].hsync_end;
+	mode->htotal = fake_timings[i].htotal;
+	mode->vdisplay = fake_timings[i].vdisplay;
+	mode->vsync_start = fake_timings[i].vsync_start;
+	mode->vsync_end = fake_timings[i].vsync_end;
+	mode->vtotal = fake_timings[i].vtotal;
+	mode->flags = fake_timings[i].flags;
+	mode->clock = ((uint64_t)mode->htotal * mode->vtotal * refresh +
+		       500) / 1000;
+	mode->vrefresh = refresh;
+	mode->type = DRM_MODE_TYPE_DRIVER;
+	if (i == 0)
+		mode->type |= DRM_MODE_TYPE_PREFERRED;
+	snprintf(mode->name, sizeof(mode->name), "%dx%d",
+		 mode->hdisplay, mode->vdisplay);
+}
+
+static void fake_init_kms(struct fake_device *dev)
+{
+	const char *refresh, *env;
+	int i, j, rate = 60;
+
+	env = getenv("INTEL_FAKE_DRM_PIPES");
+	dev->num_pipes = env ? atoi(env) :
+		dev->gen >= 7 && !IS_VALLEYVIEW(dev->devid) ? 3 : 2;
+	if (dev->num_pipes < 1)
+		dev->num_pipes = 1;
+	if (dev->num_pipes > FAKE_MAX_PIPES)
+		dev->num_pipes = FAKE_MAX_PIPES;
+
+	refresh = getenv("INTEL_FAKE_DRM_REFRESH");
+	for (i = 0; i < dev->num_pipes; i++) {
+		struct fake_connector *connector = &dev->connectors[i];
+
+		if (refresh && *refresh) {
+			char *end;
+			long r = strtol(refresh, &end, 10);
+
+			if (r > 0 && r <= 1000)
+				rate = r;
+			refresh = *end == ',' ? end + 1 : end;
+		}
+
+		connector->crtc = -1;
+		connector->dpms = DRM_MODE_DPMS_ON;
+		for (j = 0; j < FAKE_NUM_MODES; j++)
+			fake_init_mode(&connector->modes[j], j, rate);
+	}
+
+	env = getenv("INTEL_FAKE_DRM_JITTER");
+	dev->jitter = env ? strtoull(env, NULL, 0) * 1000 : 0;
+	env = getenv("INTEL_FAKE_DRM_SEED");
+	dev->jitter_state = env ? strtoul(env, NULL, 0) : 1;
+	if (dev->jitter_state == 0)
+		dev->jitter_state = 1;
+
+	dev->next_fb_id = FAKE_FIRST_FB_ID;
+}
+
+static int fake_crtc_index(struct fake_device *dev, uint32_t id)
+{
+	uint32_t i = id - FAKE_CRTC_ID(0);
+
+	return i < dev->num_pipes ? (int)i : -1;
+}
+
+static int fake_connector_index(struct fake_device *dev, uint32_t id)
+{
+	uint32_t i = id - FAKE_CONNECTOR_ID(0);
+
+	return i < dev->num_pipes ? (int)i : -1;
+}
+
+static struct fake_fb *fake_lookup_fb(struct fake_device *dev, uint32_t id)
+{
+	struct fake_fb *fb;
+
+	for (fb = dev->fbs; fb; fb = fb->next)
+		if (fb->id == id)
+			return fb;
+
+	return NULL;
+}
+
+/* xorshift32, so that a given seed always gives the same delays */
+static uint64_t fake_jitter(struct fake_device *dev)
+{
+	uint32_t x = dev->jitter_state;
+
+	if (dev->jitter == 0)
+		return 0;
+
+	x ^= x << 13;
+	x ^= x >> 17;
+	x ^= x << 5;
+	dev->jitter_state = x;
+
+	return x % (dev->jitter + 1);
+}
+
+static uint32_t fake_crtc_seq(struct fake_crtc *crtc, uint64_t now)
+{
+	if (!crtc->active)
+		return crtc->seq0;
+
+	return crtc->seq0 + (now - crtc->t0) / crtc->period;
+}
+
+static uint64_t fake_crtc_vblank_time(struct fake_crtc *crtc, uint32_t seq)
+{
+	return crtc->t0 + (uint64_t)(seq - crtc->seq0) * crtc->period;
+}
+
+static void fake_set_event_time(struct drm_event_vblank *ev, uint64_t t)
+{
+	ev->tv_sec = t / 1000000000;
+	ev->tv_usec = t % 1000000000 / 1000;
+}
+
+static void fake_deliver_event(struct fake_device *dev, struct fake_event *e)
+{
+	if (e->flip)
+		dev->crtcs[e->crtc].flip_pending = false;
+
+	if (e->send &&
+	    write(dev->event_fd, &e->ev, sizeof(e->ev)) != sizeof(e->ev))
+		fprintf(stderr, "fake drm: event pipe full, dropping an event\n");
+
+	free(e);
+}
+
+static void *fake_event_thread(void *arg)
+{
+	struct fake_device *dev = arg;
+	struct timespec ts;
+
+	pthread_mutex_lock(&fake_lock);
+	while (!dev->event_thread_stop) {
+		struct fake_event *e = dev->events;
+
+		if (e == NULL) {
+			pthread_cond_wait(&dev->event_cond, &fake_lock);
+		} else if (fake_now() < e->time) {
+			fake_to_timespec(e->time, &ts);
+			pthread_cond_timedwait(&dev->event_cond, &fake_lock,
+					       &ts);
+		} else {
+			dev->events = e->next;
+			fake_deliver_event(dev, e);
+		}
+	}
+	pthread_mutex_unlock(&fake_lock);
+
+	return NULL;
+}
+
+static int fake_queue_event(struct fake_device *dev, struct fake_event *e)
+{
+	struct fake_event **p;
+
+	if (!dev->event_thread_running) {
+		if (pthread_create(&dev->event_thread, NULL,
+				   fake_event_thread, dev)) {
+			free(e);
+			return -ENOMEM;
+		}
+		dev->event_thread_running = true;
+	}
+
+	for (p = &dev->events; *p; p = &(*p)->next)
+		if ((*p)->time > e->time)
+			break;
+	e->next = *p;
+	*p = e;
+
+	if (p == &dev->events)
+		pthread_cond_signal(&dev->event_cond);
+
+	return 0;
+}
+
+static struct fake_event *fake_alloc_event(int crtc, uint32_t type,
+					   uint64_t user_data)
+{
+	struct fake_event *e;
+
+	e = calloc(1, sizeof(*e));
+	if (e == NULL)
+		return NULL;
+
+	e->crtc = crtc;
+	e->send = true;
+	e->ev.base.type = type;
+	e->ev.base.length = sizeof(e->ev);
+	e->ev.user_data = user_data;
+
+	return e;
+}
+
+/*
+ * Like the kernel when the pipe goes down: waits for vblanks are sent
+ * right away with a zero timestamp and flips complete at once.
+ */
+static void fake_flush_events(struct fake_device *dev, int crtc, uint64_t now)
+{
+	struct fake_event **p = &dev->events;
+
+	while (*p) {
+		struct fake_event *e = *p;
+
+		if (e->crtc != crtc) {
+			p = &e->next;
+			continue;
+		}
+
+		*p = e->next;
+		e->ev.sequence = dev->crtcs[crtc].seq0;
+		fake_set_event_time(&e->ev, e->flip ? now : 0);
+		fake_deliver_event(dev, e);
+	}
+}
+
+static uint64_t fake_mode_period(const struct drm_mode_modeinfo *mode)
+{
+	return (uint64_t)mode->htotal * mode->vtotal * 1000000 / mode->clock;
+}
+
+/*
+ * Starts or stops the vblank counter when the crtc gains or loses its
+ * last powered up connector, or its framebuffer.
+ */
+static void fake_crtc_update(struct fake_device *dev, int c)
+{
+	struct fake_crtc *crtc = &dev->crtcs[c];
+	bool active = false;
+	uint64_t now;
+	int i;
+
+	if (crtc->fb) {
+		for (i = 0; i < dev->num_pipes; i++)
+			if (dev->connectors[i].crtc == c &&
+			    dev->connectors[i].dpms == DRM_MODE_DPMS_ON)
+				active = true;
+	}
+
+	if (active == crtc->active)
+		return;
+
+	now = fake_now();
+	if (crtc->active) {
+		crtc->seq0 = fake_crtc_seq(crtc, now);
+		crtc->active = false;
+		fake_flush_events(dev, c, now);
+	} else {
+		crtc->t0 = now;
+		crtc->period = fake_mode_period(&crtc->mode);
+		crtc->active = true;
+	}
+}
+
+static void fake_crtc_disable(struct fake_device *dev, int c)
+{
+	struct fake_crtc *crtc = &dev->crtcs[c];
+	int i;
+
+	for (i = 0; i < dev->num_pipes; i++)
+		if (dev->connectors[i].crtc == c)
+			dev->connectors[i].crtc = -1;
+
+	crtc->fb = 0;
+	crtc->x = crtc->y = 0;
+	memset(&crtc->mode, 0, sizeof(crtc->mode));
+	fake_crtc_update(dev, c);
+}
+
+static int fake_get_cap(struct drm_get_cap *cap)
+{
+	switch (cap->capability) {
+	case DRM_CAP_TIMESTAMP_MONOTONIC:
+		cap->value = 1;
+		return 0;
+	default:
+		return -EINVAL;
+	}
+}
+
+static void fake_copy_ids(uint64_t ptr, uint32_t *count, uint32_t first,
+			  uint32_t n)
+{
+	uint32_t *ids = from_user_pointer(ptr);
+	uint32_t i;
+
+	if (*count >= n && ids)
+		for (i = 0; i < n; i++)
+			ids[i] = first + i;
+	*count = n;
+}
+
+static int fake_get_resources(struct fake_device *dev,
+			      struct drm_mode_card_res *res)
+{
+	uint32_t *ids = from_user_pointer(res->fb_id_ptr);
+	struct fake_fb *fb;
+	uint32_t n = 0;
+
+	for (fb = dev->fbs; fb; fb = fb->next)
+		n++;
+	if (res->count_fbs >= n && ids)
+		for (fb = dev->fbs; fb; fb = fb->next)
+			*ids++ = fb->id;
+	res->count_fbs = n;
+
+	fake_copy_ids(res->crtc_id_ptr, &res->count_crtcs,
+		      FAKE_CRTC_ID(0), dev->num_pipes);
+	fake_copy_ids(res->connector_id_ptr, &res->count_connectors,
+		      FAKE_CONNECTOR_ID(0), dev->num_pipes);
+	fake_copy_ids(res->encoder_id_ptr, &res->count_encoders,
+		      FAKE_ENCODER_ID(0), dev->num_pipes);
+
+	res->min_width = res->min_height = 0;
+	res->max_width = res->max_height = dev->gen >= 5 ? 8192 : 4096;
+
+	return 0;
+}
+
+static int fake_get_crtc(struct fake_device *dev, struct drm_mode_crtc *arg)
+{
+	int c = fake_crtc_index(dev, arg->crtc_id);
+	struct fake_crtc *crtc;
+
+	if (c < 0)
+		return -ENOENT;
+
+	crtc = &dev->crtcs[c];
+	arg->fb_id = crtc->fb;
+	arg->x = crtc->x;
+	arg->y = crtc->y;
+	arg->gamma_size = 256;
+	arg->mode_valid = crtc->fb != 0;
+	arg->mode = crtc->mode;
+
+	return 0;
+}
+
+static int fake_set_crtc(struct fake_device *dev, struct drm_mode_crtc *arg)
+{
+	uint32_t *ids = from_user_pointer(arg->set_connectors_ptr);
+	int connectors[FAKE_MAX_PIPES];
+	int c = fake_crtc_index(dev, arg->crtc_id);
+	struct fake_crtc *crtc;
+	struct fake_fb *fb;
+	bool modeset;
+	uint32_t i;
+	int j;
+
+	if (c < 0)
+		return -ENOENT;
+	crtc = &dev->crtcs[c];
+
+	if (!arg->mode_valid) {
+		if (arg->count_connectors)
+			return -EINVAL;
+
+		fake_crtc_disable(dev, c);
+		return 0;
+	}
+
+	fb = fake_lookup_fb(dev, arg->fb_id == -1U ? crtc->fb : arg->fb_id);
+	if (fb == NULL)
+		return -ENOENT;
+	if (fb->bo->tiling_mode == I915_TILING_Y)
+		return -EINVAL;
+
+	if (arg->mode.clock == 0 || arg->mode.hdisplay == 0 ||
+	    arg->mode.vdisplay == 0 ||
+	    arg->mode.htotal < arg->mode.hdisplay ||
+	    arg->mode.vtotal < arg->mode.vdisplay)
+		return -EINVAL;
+	if (arg->x + arg->mode.hdisplay > fb->width ||
+	    arg->y + arg->mode.vdisplay > fb->height)
+		return -ENOSPC;
+
+	if (arg->count_connectors == 0 ||
+	    arg->count_connectors > dev->num_pipes)
+		return -EINVAL;
+	for (i = 0; i < arg->count_connectors; i++) {
+		connectors[i] = fake_connector_index(dev, ids[i]);
+		if (connectors[i] < 0)
+			return -ENOENT;
+	}
+
+	/*
+	 * Only panning and switching framebuffers keeps the pipe running,
+	 * anything else is a full modeset which restarts the vblanks.
+	 */
+	modeset = crtc->fb == 0 ||
+		  memcmp(&crtc->mode, &arg->mode, sizeof(arg->mode)) != 0;
+	for (j = 0; j < dev->num_pipes; j++) {
+		bool wanted = false;
+
+		for (i = 0; i < arg->count_connectors; i++)
+			if (connectors[i] == j)
+				wanted = true;
+
+		if (wanted != (dev->connectors[j].crtc == c) ||
+		    (wanted && dev->connectors[j].dpms != DRM_MODE_DPMS_ON))
+			modeset = true;
+	}
+
+	if (modeset) {
+		fake_crtc_disable(dev, c);
+
+		for (i = 0; i < arg->count_connectors; i++) {
+			struct fake_connector *connector =
+				&dev->connectors[connectors[i]];
+			int old = connector->crtc;
+
+			connector->crtc = c;
+			connector->dpms = DRM_MODE_DPMS_ON;
+			if (old >= 0 && old != c)
+				fake_crtc_update(dev, old);
+		}
+
+		crtc->mode = arg->mode;
+	}
+
+	crtc->fb = fb->id;
+	crtc->x = arg->x;
+	crtc->y = arg->y;
+	fake_crtc_update(dev, c);
+
+	return 0;
+}
+
+static int fake_get_encoder(struct fake_device *dev,
+			    struct drm_mode_get_encoder *arg)
+{
+	uint32_t i = arg->encoder_id - FAKE_ENCODER_ID(0);
+	int c;
+
+	if (i >= dev->num_pipes)
+		return -ENOENT;
+
+	c = dev->connectors[i].crtc;
+	arg->encoder_type = DRM_MODE_ENCODER_TMDS;
+	arg->crtc_id = c >= 0 ? FAKE_CRTC_ID(c) : 0;
+	arg->possible_crtcs = (1 << dev->num_pipes) - 1;
+	arg->possible_clones = 0;
+
+	return 0;
+}
+
+static int fake_get_connector(struct fake_device *dev,
+			      struct drm_mode_get_connector *arg)
+{
+	int i = fake_connector_index(dev, arg->connector_id);
+	struct fake_connector *connector;
+
+	if (i < 0)
+		return -ENOENT;
+	connector = &dev->connectors[i];
+
+	if (arg->count_modes >= FAKE_NUM_MODES && arg->modes_ptr)
+		memcpy(from_user_pointer(arg->modes_ptr), connector->modes,
+		       sizeof(connector->modes));
+	arg->count_modes = FAKE_NUM_MODES;
+
+	if (arg->count_props >= 1 && arg->props_ptr && arg->prop_values_ptr) {
+		*(uint32_t *)from_user_pointer(arg->props_ptr) = FAKE_PROP_DPMS;
+		*(uint64_t *)from_user_pointer(arg->prop_values_ptr) =
+			connector->dpms;
+	}
+	arg->count_props = 1;
+
+	fake_copy_ids(arg->encoders_ptr, &arg->count_encoders,
+		      FAKE_ENCODER_ID(i), 1);
+
+	arg->encoder_id = connector->crtc >= 0 ? FAKE_ENCODER_ID(i) : 0;
+	arg->connector_type = DRM_MODE_CONNECTOR_HDMIA;
+	arg->connector_type_id = i + 1;
+	arg->connection = DRM_MODE_CONNECTED;
+	arg->mm_width = 527;
+	arg->mm_height = 296;
+	arg->subpixel = DRM_MODE_SUBPIXEL_UNKNOWN;
+
+	return 0;
+}
+
+static int fake_get_property(struct drm_mode_get_property *arg)
+{
+	struct drm_mode_property_enum *enums;
+	uint64_t *values;
+	uint32_t i, n = ARRAY_SIZE(fake_dpms_names);
+
+	if (arg->prop_id != FAKE_PROP_DPMS)
+		return -ENOENT;
+
+	arg->flags = DRM_MODE_PROP_ENUM;
+	snprintf(arg->name, sizeof(arg->name), "DPMS");
+
+	values = from_user_pointer(arg->values_ptr);
+	if (arg->count_values >= n && values)
+		for (i = 0; i < n; i++)
+			values[i] = i;
+	arg->count_values = n;
+
+	enums = from_user_pointer(arg->enum_blob_ptr);
+	if (arg->count_enum_blobs >= n && enums) {
+		for (i = 0; i < n; i++) {
+			enums[i].value = i;
+			snprintf(enums[i].name, sizeof(enums[i].name), "%s",
+				 fake_dpms_names[i]);
+		}
+	}
+	arg->count_enum_blobs = n;
+
+	return 0;
+}
+
+static int fake_set_property(struct fake_device *dev,
+			     struct drm_mode_connector_set_property *arg)
+{
+	int i = fake_connector_index(dev, arg->connector_id);
+	struct fake_connector *connector;
+
+	if (i < 0)
+		return -ENOENT;
+	if (arg->prop_id != FAKE_PROP_DPMS || arg->value > DRM_MODE_DPMS_OFF)
+		return -EINVAL;
+
+	connector = &dev->connectors[i];
+	connector->dpms = arg->value;
+	if (connector->crtc >= 0)
+		fake_crtc_update(dev, connector->crtc);
+
+	return 0;
+}
+
+static int fake_add_fb(struct fake_device *dev, uint32_t *fb_id,
+		       uint32_t width, uint32_t height, uint32_t format,
+		       uint32_t handle, uint32_t pitch, uint32_t offset)
+{
+	struct fake_bo *bo = fake_lookup_bo(dev, handle);
+	struct fake_fb *fb;
+	int i;
+
+	if (bo == NULL)
+		return -ENOENT;
+
+	for (i = 0; i < ARRAY_SIZE(fake_formats); i++)
+		if (fake_formats[i].format == format)
+			break;
+	if (i == ARRAY_SIZE(fake_formats))
+		return -EINVAL;
+
+	if (width == 0 || height == 0 || bo->tiling_mode == I915_TILING_Y ||
+	    pitch < (uint64_t)width * fake_formats[i].bpp / 8 ||
+	    offset + (uint64_t)pitch * height > bo->size)
+		return -EINVAL;
+
+	fb = calloc(1, sizeof(*fb));
+	if (fb == NULL)
+		return -ENOMEM;
+
+	fb->id = dev->next_fb_id++;
+	fb->width = width;
+	fb->height = height;
+	fb->pitch = pitch;
+	fb->offset = offset;
+	fb->bpp = fake_formats[i].bpp;
+	fb->depth = fake_formats[i].depth;
+	fb->bo = bo;
+	bo->refcount++;
+
+	fb->next = dev->fbs;
+	dev->fbs = fb;
+	*fb_id = fb->id;
+
+	return 0;
+}
+
+static int fake_add_fb1(struct fake_device *dev, struct drm_mode_fb_cmd *arg)
+{
+	int i;
+
+	for (i = 0; i < ARRAY_SIZE(fake_formats); i++)
+		if (fake_formats[i].bpp == arg->bpp &&
+		    fake_formats[i].depth == arg->depth)
+			break;
+	if (i == ARRAY_SIZE(fake_formats))
+		return -EINVAL;
+
+	return fake_add_fb(dev, &arg->fb_id, arg->width, arg->height,
+			   fake_formats[i].format, arg->handle, arg->pitch, 0);
+}
+
+static int fake_add_fb2(struct fake_device *dev, struct drm_mode_fb_cmd2 *arg)
+{
+	return fake_add_fb(dev, &arg->fb_id, arg->width, arg->height,
+			   arg->pixel_format, arg->handles[0],
+			   arg->pitches[0], arg->offsets[0]);
+}
+
+static int fake_get_fb(struct fake_device *dev, struct drm_mode_fb_cmd *arg)
+{
+	struct fake_fb *fb = fake_lookup_fb(dev, arg->fb_id);
+	int ret;
+
+	if (fb == NULL)
+		return -ENOENT;
+
+	/* like the kernel, hand out a new handle for the caller to close */
+	ret = fake_add_handle(dev, fb->bo, &arg->handle);
+	if (ret)
+		return ret;
+	fb->bo->refcount++;
+
+	arg->width = fb->width;
+	arg->height = fb->height;
+	arg->pitch = fb->pitch;
+	arg->bpp = fb->bpp;
+	arg->depth = fb->depth;
+
+	return 0;
+}
+
+static int fake_rm_fb(struct fake_device *dev, uint32_t *id)
+{
+	struct fake_fb **p, *fb;
+	int c;
+
+	for (p = &dev->fbs; *p; p = &(*p)->next)
+		if ((*p)->id == *id)
+			break;
+	if (*p == NULL)
+		return -ENOENT;
+
+	/* removing the framebuffer being scanned out turns the crtc off */
+	for (c = 0; c < dev->num_pipes; c++)
+		if (dev->crtcs[c].fb == *id)
+			fake_crtc_disable(dev, c);
+
+	fb = *p;
+	*p = fb->next;
+	fake_bo_unreference(fb->bo);
+	free(fb);
+
+	return 0;
+}
+
+static int fake_page_flip(struct fake_device *dev,
+			  struct drm_mode_crtc_page_flip *arg)
+{
+	int c = fake_crtc_index(dev, arg->crtc_id);
+	struct fake_crtc *crtc;
+	struct fake_event *e;
+	struct fake_fb *fb, *old;
+	uint32_t seq;
+
+	if (c < 0)
+		return -ENOENT;
+	crtc = &dev->crtcs[c];
+
+	fb = fake_lookup_fb(dev, arg->fb_id);
+	if (fb == NULL)
+		return -ENOENT;
+
+	if (arg->flags & ~DRM_MODE_PAGE_FLIP_EVENT)
+		return -EINVAL;
+
+	/* i915 says busy for a crtc without a framebuffer */
+	if (crtc->fb == 0 || crtc->flip_pending)
+		return -EBUSY;
+	if (!crtc->active)
+		return -EINVAL;
+
+	old = fake_lookup_fb(dev, crtc->fb);
+	if (fb->bo->tiling_mode == I915_TILING_Y ||
+	    fb->pitch != old->pitch || fb->offset != old->offset)
+		return -EINVAL;
+	if (crtc->x + crtc->mode.hdisplay > fb->width ||
+	    crtc->y + crtc->mode.vdisplay > fb->height)
+		return -ENOSPC;
+
+	e = fake_alloc_event(c, DRM_EVENT_FLIP_COMPLETE, arg->user_data);
+	if (e == NULL)
+		return -ENOMEM;
+
+	seq = fake_crtc_seq(crtc, fake_now()) + 1;
+	e->flip = true;
+	e->send = arg->flags & DRM_MODE_PAGE_FLIP_EVENT;
+	e->ev.sequence = seq;
+	fake_set_event_time(&e->ev, fake_crtc_vblank_time(crtc, seq));
+	e->time = fake_crtc_vblank_time(crtc, seq) + fake_jitter(dev);
+
+	/* as in the kernel, the crtc reports the new fb straight away */
+	crtc->fb = fb->id;
+	crtc->flip_pending = true;
+
+	return fake_queue_event(dev, e);
+}
+
+static int fake_wait_vblank(struct fake_device *dev,
+			    union drm_wait_vblank *vbl)
+{
+	uint32_t type = vbl->request.type;
+	uint32_t seq = vbl->request.sequence;
+	uint64_t signal = vbl->request.signal;
+	struct fake_crtc *crtc;
+	struct timespec ts;
+	uint64_t now, t;
+	uint32_t cur;
+	int c;
+
+	if (type & _DRM_VBLANK_SIGNAL)
+		return -EINVAL;
+
+	if (type & _DRM_VBLANK_SECONDARY)
+		c = 1;
+	else
+		c = (type & _DRM_VBLANK_HIGH_CRTC_MASK) >>
+			_DRM_VBLANK_HIGH_CRTC_SHIFT;
+	if (c >= dev->num_pipes || !dev->crtcs[c].active)
+		return -EINVAL;
+	crtc = &dev->crtcs[c];
+
+	now = fake_now();
+	cur = fake_crtc_seq(crtc, now);
+	if (type & _DRM_VBLANK_RELATIVE)
+		seq += cur;
+	if ((type & _DRM_VBLANK_NEXTONMISS) && cur - seq <= (1 << 23))
+		seq = cur + 1;
+
+	if (type & _DRM_VBLANK_EVENT) {
+		struct fake_event *e;
+
+		e = fake_alloc_event(c, DRM_EVENT_VBLANK, signal);
+		if (e == NULL)
+			return -ENOMEM;
+
+		vbl->reply.sequence = seq;
+
+		/* already passed, the event is sent for the current one */
+		if (cur - seq <= (1 << 23)) {
+			e->ev.sequence = cur;
+			fake_set_event_time(&e->ev,
+					    fake_crtc_vblank_time(crtc, cur));
+			fake_deliver_event(dev, e);
+			return 0;
+		}
+
+		e->ev.sequence = seq;
+		fake_set_event_time(&e->ev, fake_crtc_vblank_time(crtc, seq));
+		e->time = fake_crtc_vblank_time(crtc, seq) + fake_jitter(dev);
+
+		return fake_queue_event(dev, e);
+	}
+
+	if (cur - seq > (1 << 23))
+		cur = seq;
+
+	t = fake_crtc_vblank_time(crtc, cur);
+	vbl->reply.sequence = cur;
+	vbl->reply.tval_sec = t / 1000000000;
+	vbl->reply.tval_usec = t % 1000000000 / 1000;
+
+	/*
+	 * Everything needed is in the reply already, so the wait can
+	 * happen without holding up other ioctls and the event thread.
+	 */
+	if (t > now) {
+		fake_to_timespec(t + fake_jitter(dev), &ts);
+		pthread_mutex_unlock(&fake_lock);
+		while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME,
+				       &ts, NULL) == EINTR)
+			;
+		pthread_mutex_lock(&fake_lock);
+	}
+
+	return 0;
+}
+
+static int fake_get_pipe_from_crtc_id(struct fake_device *dev,
+				      struct drm_i915_get_pipe_from_crtc_id *arg)
+{
+	int c = fake_crtc_index(dev, arg->crtc_id);
+
+	if (c < 0)
+		return -EINVAL;
+
+	arg->pipe = c;
+	return 0;
+}
+
+static int fake_ioctl(struct fake_device *dev, unsigned long request,
+		      void *arg)
+{
+	switch (request) {
+	case DRM_IOCTL_VERSION:
+		return fake_get_version(arg);
+	case DRM_IOCTL_SET_MASTER:
+	case DRM_IOCTL_DROP_MASTER:
+		return 0;
+	case DRM_IOCTL_GEM_CLOSE:
+		return fake_gem_close(dev, arg);
+	case DRM_IOCTL_GEM_FLINK:
+		return fake_gem_flink(dev, arg);
+	case DRM_IOCTL_GEM_OPEN:
+		return fake_gem_open(dev, arg);
+	case DRM_IOCTL_I915_GETPARAM:
+		return fake_getparam(dev, arg);
+	case DRM_IOCTL_I915_GEM_CREATE:
+		return fake_gem_create(dev, arg);
+	case DRM_IOCTL_I915_GEM_PREAD:
+		return fake_gem_pread(dev, arg);
+	case DRM_IOCTL_I915_GEM_PWRITE:
+		return fake_gem_pwrite(dev, arg);
+	case DRM_IOCTL_I915_GEM_MMAP:
+		return fake_gem_mmap(dev, arg);
+	case DRM_IOCTL_I915_GEM_MMAP_GTT:
+		return fake_gem_mmap_gtt(dev, arg);
+	case DRM_IOCTL_I915_GEM_SET_DOMAIN:
+		return fake_gem_handle_only(dev,
+			((struct drm_i915_gem_set_domain *)arg)->handle);
+	case DRM_IOCTL_I915_GEM_SW_FINISH:
+		return fake_gem_handle_only(dev,
+			((struct drm_i915_gem_sw_finish *)arg)->handle);
+	case DRM_IOCTL_I915_GEM_SET_TILING:
+		return fake_gem_set_tiling(dev, arg);
+	case DRM_IOCTL_I915_GEM_GET_TILING:
+		return fake_gem_get_tiling(dev, arg);
+	case LOCAL_DRM_IOCTL_I915_GEM_SET_CACHEING:
+		return fake_gem_set_caching(dev, arg);
+	case LOCAL_DRM_IOCTL_I915_GEM_GET_CACHEING:
+		return fake_gem_get_caching(dev, arg);
+	case DRM_IOCTL_I915_GEM_MADVISE:
+		return fake_gem_madvise(dev, arg);
+	case DRM_IOCTL_I915_GEM_BUSY:
+		return fake_gem_busy(dev, arg);
+	case DRM_IOCTL_I915_GEM_WAIT:
+		return fake_gem_wait(dev, arg);
+	case DRM_IOCTL_I915_GEM_THROTTLE:
+		return 0;
+	case DRM_IOCTL_I915_GEM_GET_APERTURE:
+		return fake_gem_get_aperture(arg);
+	case DRM_IOCTL_I915_GEM_CONTEXT_CREATE:
+		return fake_context_create(dev, arg);
+	case DRM_IOCTL_I915_GEM_CONTEXT_DESTROY:
+		return fake_context_destroy(dev, arg);
+	case DRM_IOCTL_I915_GEM_EXECBUFFER2:
+		return fake_execbuf2(dev, arg);
+	case DRM_IOCTL_GET_CAP:
+		return fake_get_cap(arg);
+	case DRM_IOCTL_WAIT_VBLANK:
+		return fake_wait_vblank(dev, arg);
+	case DRM_IOCTL_MODE_GETRESOURCES:
+		return fake_get_resources(dev, arg);
+	case DRM_IOCTL_MODE_GETCRTC:
+		return fake_get_crtc(dev, arg);
+	case DRM_IOCTL_MODE_SETCRTC:
+		return fake_set_crtc(dev, arg);
+	case DRM_IOCTL_MODE_GETENCODER:
+		return fake_get_encoder(dev, arg);
+	case DRM_IOCTL_MODE_GETCONNECTOR:
+		return fake_get_connector(dev, arg);
+	case DRM_IOCTL_MODE_GETPROPERTY:
+		return fake_get_property(arg);
+	case DRM_IOCTL_MODE_SETPROPERTY:
+		return fake_set_property(dev, arg);
+	case DRM_IOCTL_MODE_GETFB:
+		return fake_get_fb(dev, arg);
+	case DRM_IOCTL_MODE_ADDFB:
+		return fake_add_fb1(dev, arg);
+	case DRM_IOCTL_MODE_ADDFB2:
+		return fake_add_fb2(dev, arg);
+	case DRM_IOCTL_MODE_RMFB:
+		return fake_rm_fb(dev, arg);
+	case DRM_IOCTL_MODE_PAGE_FLIP:
+		return fake_page_flip(dev, arg);
+	case DRM_IOCTL_I915_GET_PIPE_FROM_CRTC_ID:
+		return fake_get_pipe_from_crtc_id(dev, arg);
+	default:
+		return -ENOTTY;
+	}
+}
+
+static int fake_open_device(int flags)
+{
+	struct fake_device *dev;
+	pthread_condattr_t attr;
+	const char *env;
+	int fds[2];
+
+	dev = calloc(1, sizeof(*dev));
+	if (dev == NULL) {
+		errno = ENOMEM;
+		return -1;
+	}
+
+	/*
+	 * Hand out the read end of a pipe as the device fd: it's a real
+	 * descriptor for poll() and close(), and gives us somewhere to queue
+	 * drm events.
+	 */
+	if (pipe2(fds, (flags & O_CLOEXEC) | O_NONBLOCK)) {
+		free(dev);
+		return -1;
+	}
+	fcntl(fds[0], F_SETFL, flags & O_NONBLOCK);
+
+	dev->fd = fds[0];
+	dev->event_fd = fds[1];
+
+	env = getenv("INTEL_DEVID_OVERRIDE");
+	dev->devid = env ? strtol(env, NULL, 0) : PCI_CHIP_IVYBRIDGE_GT2;
+	if (!IS_INTEL(dev->devid))
+		dev->devid = PCI_CHIP_IVYBRIDGE_GT2;
+	dev->gen = IS_GEN2(dev->devid) ? 2 :
+		   IS_GEN3(dev->devid) ? 3 :
+		   IS_GEN4(dev->devid) ? 4 :
+		   IS_GEN5(dev->devid) ? 5 :
+		   IS_GEN6(dev->devid) ? 6 : 7;
+
+	env = getenv("INTEL_FAKE_DRM_BLITTER");
+	dev->blitter = env && atoi(env);
+
+	fake_init_kms(dev);
+	pthread_condattr_init(&attr);
+	pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+	pthread_cond_init(&dev->event_cond, &attr);
+	pthread_condattr_destroy(&attr);
+
+	pthread_mutex_lock(&fake_lock);
+	dev->next = fake_devices;
+	fake_devices = dev;
+	pthread_mutex_unlock(&fake_lock);
+
+	return dev->fd;
+}
+
+static void fake_close_device(struct fake_device *dev)
+{
+	struct fake_device **p;
+	uint32_t i;
+
+	for (p = &fake_devices; *p; p = &(*p)->next) {
+		if (*p == dev) {
+			*p = dev->next;
+			break;
+		}
+	}
+
+	/* The event thread needs the lock to notice it has to stop. */
+	if (dev->event_thread_running) {
+		dev->event_thread_stop = true;
+		pthread_cond_signal(&dev->event_cond);
+		pthread_mutex_unlock(&fake_lock);
+		pthread_join(dev->event_thread, NULL);
+		pthread_mutex_lock(&fake_lock);
+	}
+
+	while (dev->events) {
+		struct fake_event *e = dev->events;
+
+		dev->events = e->next;
+		free(e);
+	}
+
+	while (dev->fbs) {
+		struct fake_fb *fb = dev->fbs;
+
+		dev->fbs = fb->next;
+		fake_bo_unreference(fb->bo);
+		free(fb);
+	}
+
+	for (i = 0; i < dev->num_handles; i++)
+		if (dev->handles[i])
+			fake_bo_unreference(dev->handles[i]);
+
+	pthread_cond_destroy(&dev->event_cond);
+	real_close(dev->event_fd);
+	free(dev->handles);
+	free(dev->exec_bos);
+	free(dev);
+}
+
+/*
+ * Interposed libc entry points
+ */
+
+static int fake_open(const char *path, int flags, mode_t mode)
+{
+	int minor;
+
+	fake_init_symbols();
+
+	if (!fake_is_card_node(path, &minor))
+		return real_open(path, flags, mode);
+
+	/* Only card0 exists, so drm_get_card() stops searching there. */
+	if (minor != 0) {
+		errno = ENOENT;
+		return -1;
+	}
+
+	return fake_open_device(flags);
+}
+
+int open(const char *path, int flags, ...)
+{
+	mode_t mode = 0;
+
+	if (flags & O_CREAT) {
+		va_list ap;
+
+		va_start(ap, flags);
+		mode = va_arg(ap, int);
+		va_end(ap);
+	}
+
+	return fake_open(path, flags, mode);
+}
+
+int open64(const char *path, int flags, ...)
+{
+	mode_t mode = 0;
+
+	if (flags & O_CREAT) {
+		va_list ap;
+
+		va_start(ap, flags);
+		mode = va_arg(ap, int);
+		va_end(ap);
+	}
+
+	return fake_open(path, flags | O_LARGEFILE, mode);
+}
+
+int __open_2(const char *path, int flags)
+{
+	return fake_open(path, flags, 0);
+}
+
+int __open64_2(const char *path, int flags)
+{
+	return fake_open(path, flags | O_LARGEFILE, 0);
+}
+
+int close(int fd)
+{
+	struct fake_device *dev;
+
+	fake_init_symbols();
+
+	pthread_mutex_lock(&fake_lock);
+	dev = fake_lookup_device(fd);
+	if (dev)
+		fake_close_device(dev);
+	pthread_mutex_unlock(&fake_lock);
+
+	return real_close(fd);
+}
+
+int ioctl(int fd, unsigned long request, ...)
+{
+	struct fake_device *dev;
+	va_list ap;
+	void *arg;
+	int ret;
+
+	va_start(ap, request);
+	arg = va_arg(ap, void *);
+	va_end(ap);
+
+	fake_init_symbols();
+
+	pthread_mutex_lock(&fake_lock);
+	dev = fake_lookup_device(fd);
+	if (dev == NULL) {
+		pthread_mutex_unlock(&fake_lock);
+		return real_ioctl(fd, request, arg);
+	}
+
+	ret = fake_ioctl(dev, request, arg);
+	pthread_mutex_unlock(&fake_lock);
+
+	if (ret) {
+		errno = -ret;
+		return -1;
+	}
+
+	return 0;
+}
+
+static void *fake_mmap(void *addr, size_t len, int prot, int flags, int fd,
+		       off64_t offset)
+{
+	struct fake_device *dev;
+	struct fake_bo *bo = NULL;
+	void *ptr;
+
+	fake_init_symbols();
+
+	pthread_mutex_lock(&fake_lock);
+	dev = fake_lookup_device(fd);
+	if (dev == NULL) {
+		pthread_mutex_unlock(&fake_lock);
+		return real_mmap(addr, len, prot, flags, fd, offset);
+	}
+
+	bo = fake_lookup_bo(dev, (uint64_t)offset >> FAKE_MMAP_SHIFT);
+	if (bo == NULL || len > bo->size) {
+		pthread_mutex_unlock(&fake_lock);
+		errno = EINVAL;
+		return MAP_FAILED;
+	}
+
+	ptr = real_mmap(addr, len, prot, flags, bo->memfd, 0);
+	pthread_mutex_unlock(&fake_lock);
+
+	return ptr;
+}
+
+void *mmap(void *addr, size_t len, int prot, int flags, int fd, off_t offset)
+{
+	return fake_mmap(addr, len, prot, flags, fd, offset);
+}
+
+void *mmap64(void *addr, size_t len, int prot, int flags, int fd, off64_t offset)
+{
+	return fake_mmap(addr, len, prot, flags, fd, offset);
+}
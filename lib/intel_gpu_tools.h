@@ -44,6 +44,8 @@ void intel_get_mmio(struct pci_device *pci_dev);
 int intel_register_access_init(struct pci_device *pci_dev, int safe);
 void intel_register_access_fini(void);
 uint32_t intel_register_read(uint32_t reg);
+void intel_register_read_array(const uint32_t *regs, uint32_t *values,
+			       int count);
 void intel_register_write(uint32_t reg, uint32_t val);
 int intel_register_access_needs_fakewake(void);
 
@@ -93,6 +95,7 @@ struct pci_device *intel_get_pci_device(void);
 
 uint32_t intel_get_drm_devid(int fd);
 int intel_gen(uint32_t devid);
+unsigned intel_command_dwords(uint32_t devid, uint32_t header);
 uint64_t intel_get_total_ram_mb(void);
 uint64_t intel_get_total_swap_mb(void);
 
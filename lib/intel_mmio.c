@@ -267,6 +267,48 @@ out:
 	return ret;
 }
 
+/*
+ * Reads a whole set of registers, as intel_register_read() would one by
+ * one. The forcewake and register map checks are done once for the whole
+ * set, and the range lookup is only redone when a register falls outside
+ * of the range the previous one was found in.
+ */
+void
+intel_register_read_array(const uint32_t *regs, uint32_t *values, int count)
+{
+	struct intel_register_range *range = NULL;
+	uint32_t align = mmio_data.map.alignment_mask;
+	int i;
+
+	assert(mmio_data.inited);
+
+	if (intel_gen(mmio_data.i915_devid) >= 6)
+		assert(mmio_data.key != -1);
+
+	for (i = 0; i < count; i++) {
+		uint32_t reg = regs[i];
+
+		if (!mmio_data.safe)
+			goto read_out;
+
+		if (range && !(reg & align) && reg >= range->base &&
+		    reg + align <= range->base + range->size)
+			goto read_out;
+
+		range = intel_get_register_range(mmio_data.map, reg,
+						 INTEL_RANGE_READ);
+		if (!range) {
+			fprintf(stderr, "Register read blocked for safety "
+				"(*0x%08x)\n", reg);
+			values[i] = 0xffffffff;
+			continue;
+		}
+
+read_out:
+		values[i] = *(volatile uint32_t *)((volatile char *)mmio + reg);
+	}
+}
+
 void
 intel_register_write(uint32_t reg, uint32_t val)
 {
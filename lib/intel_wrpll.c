@@ -0,0 +1,435 @@
+/*
+ * Copyright © 2013 Intel Corporation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ *
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "intel_wrpll.h"
+
+#define LC_FREQ 2700
+#define LC_FREQ_2K (LC_FREQ * 2000)
+
+#define P_MIN 2
+#define P_MAX 64
+#define P_INC 2
+
+/* Constraints for PLL good behavior */
+#define REF_MIN 48
+#define REF_MAX 400
+#define VCO_MIN 2400
+#define VCO_MAX 4800
+
+#define ABS_DIFF(a, b) ((a > b) ? (a - b) : (b - a))
+
+#define R2_MIN (LC_FREQ * 2 / REF_MAX + 1)
+#define R2_MAX (LC_FREQ * 2 / REF_MIN)
+
+struct wrpll_rnp {
+	unsigned p, n2, r2;
+};
+
+static unsigned wrpll_get_budget_for_freq(int clock)
+{
+	unsigned budget;
+
+	switch (clock) {
+	case 25175000:
+	case 25200000:
+	case 27000000:
+	case 27027000:
+	case 37762500:
+	case 37800000:
+	case 40500000:
+	case 40541000:
+	case 54000000:
+	case 54054000:
+	case 59341000:
+	case 59400000:
+	case 72000000:
+	case 74176000:
+	case 74250000:
+	case 81000000:
+	case 81081000:
+	case 89012000:
+	case 89100000:
+	case 108000000:
+	case 108108000:
+	case 111264000:
+	case 111375000:
+	case 148352000:
+	case 148500000:
+	case 162000000:
+	case 162162000:
+	case 222525000:
+	case 222750000:
+	case 296703000:
+	case 297000000:
+		budget = 0;
+		break;
+	case 233500000:
+	case 245250000:
+	case 247750000:
+	case 253250000:
+	case 298000000:
+		budget = 1500;
+		break;
+	case 169128000:
+	case 169500000:
+	case 179500000:
+	case 202000000:
+		budget = 2000;
+		break;
+	case 256250000:
+	case 262500000:
+	case 270000000:
+	case 272500000:
+	case 273750000:
+	case 280750000:
+	case 281250000:
+	case 286000000:
+	case 291750000:
+		budget = 4000;
+		break;
+	case 267250000:
+	case 268500000:
+		budget = 5000;
+		break;
+	default:
+		budget = 1000;
+		break;
+	}
+
+	return budget;
+}
+
+static void wrpll_update_rnp(uint64_t freq2k, unsigned budget,
+			     unsigned r2, unsigned n2, unsigned p,
+			     struct wrpll_rnp *best)
+{
+	uint64_t a, b, c, d, diff, diff_best;
+
+	/* No best (r,n,p) yet */
+	if (best->p == 0) {
+		best->p = p;
+		best->n2 = n2;
+		best->r2 = r2;
+		return;
+	}
+
+	/*
+	 * Output clock is (LC_FREQ_2K / 2000) * N / (P * R), which compares to
+	 * freq2k.
+	 *
+	 * delta = 1e6 *
+	 *	   abs(freq2k - (LC_FREQ_2K * n2/(p * r2))) /
+	 *	   freq2k;
+	 *
+	 * and we would like delta <= budget.
+	 *
+	 * If the discrepancy is above the PPM-based budget, always prefer to
+	 * improve upon the previous solution.  However, if you're within the
+	 * budget, try to maximize Ref * VCO, that is N / (P * R^2).
+	 */
+	a = freq2k * budget * p * r2;
+	b = freq2k * budget * best->p * best->r2;
+	diff = ABS_DIFF((freq2k * p * r2), (LC_FREQ_2K * n2));
+	diff_best = ABS_DIFF((freq2k * best->p * best->r2),
+			     (LC_FREQ_2K * best->n2));
+	c = 1000000 * diff;
+	d = 1000000 * diff_best;
+
+	if (a < c && b < d) {
+		/* If both are above the budget, pick the closer */
+		if (best->p * best->r2 * diff < p * r2 * diff_best) {
+			best->p = p;
+			best->n2 = n2;
+			best->r2 = r2;
+		}
+	} else if (a >= c && b < d) {
+		/* If A is below the threshold but B is above it?  Update. */
+		best->p = p;
+		best->n2 = n2;
+		best->r2 = r2;
+	} else if (a >= c && b >= d) {
+		/* Both are below the limit, so pick the higher n2/(r2*r2) */
+		if (n2 * best->r2 * best->r2 > best->n2 * r2 * r2) {
+			best->p = p;
+			best->n2 = n2;
+			best->r2 = r2;
+		}
+	}
+	/* Otherwise a < c && b >= d, do nothing */
+}
+
+/*
+ * Below 100 Hz freq2k is 0 (or wraps around for negative clocks) and
+ * nothing is within the budget. Both searches hand out the divider with the
+ * slowest output clock then, the lowest n2 / (p * r2), which is what the
+ * exhaustive one ends up with for freq2k == 0 anyway.
+ */
+static bool wrpll_no_clock(int clock, unsigned *r2_out, unsigned *n2_out,
+			   unsigned *p_out)
+{
+	unsigned r2, n2;
+
+	if (clock >= 100)
+		return false;
+
+	*r2_out = 0;
+	for (r2 = R2_MIN; r2 <= R2_MAX; r2++) {
+		n2 = VCO_MIN * r2 / LC_FREQ + 1;
+		if (*r2_out == 0 || n2 * *r2_out < *n2_out * r2) {
+			*r2_out = r2;
+			*n2_out = n2;
+		}
+	}
+	*p_out = P_MAX;
+
+	return true;
+}
+
+void
+intel_wrpll_compute_rnp_slow(int clock /* in Hz */,
+			     unsigned *r2_out, unsigned *n2_out, unsigned *p_out)
+{
+	uint64_t freq2k;
+	unsigned p, n2, r2;
+	struct wrpll_rnp best = { 0, 0, 0 };
+	unsigned budget;
+
+	if (wrpll_no_clock(clock, r2_out, n2_out, p_out))
+		return;
+
+	freq2k = clock / 100;
+
+	budget = wrpll_get_budget_for_freq(clock);
+
+	/* Special case handling for 540 pixel clock: bypass WR PLL entirely
+	 * and directly pass the LC PLL to it. */
+	if (freq2k == 5400000) {
+		*n2_out = 2;
+		*p_out = 1;
+		*r2_out = 2;
+		return;
+	}
+
+	/*
+	 * Ref = LC_FREQ / R, where Ref is the actual reference input seen by
+	 * the WR PLL.
+	 *
+	 * We want R so that REF_MIN <= Ref <= REF_MAX.
+	 * Injecting R2 = 2 * R gives:
+	 *   REF_MAX * r2 > LC_FREQ * 2 and
+	 *   REF_MIN * r2 < LC_FREQ * 2
+	 *
+	 * Which means the desired boundaries for r2 are:
+	 *  LC_FREQ * 2 / REF_MAX < r2 < LC_FREQ * 2 / REF_MIN
+	 *
+	 */
+	for (r2 = LC_FREQ * 2 / REF_MAX + 1;
+	     r2 <= LC_FREQ * 2 / REF_MIN;
+	     r2++) {
+
+		/*
+		 * VCO = N * Ref, that is: VCO = N * LC_FREQ / R
+		 *
+		 * Once again we want VCO_MIN <= VCO <= VCO_MAX.
+		 * Injecting R2 = 2 * R and N2 = 2 * N, we get:
+		 *   VCO_MAX * r2 > n2 * LC_FREQ and
+		 *   VCO_MIN * r2 < n2 * LC_FREQ)
+		 *
+		 * Which means the desired boundaries for n2 are:
+		 * VCO_MIN * r2 / LC_FREQ < n2 < VCO_MAX * r2 / LC_FREQ
+		 */
+		for (n2 = VCO_MIN * r2 / LC_FREQ + 1;
+		     n2 <= VCO_MAX * r2 / LC_FREQ;
+		     n2++) {
+
+			for (p = P_MIN; p <= P_MAX; p += P_INC)
+				wrpll_update_rnp(freq2k, budget,
+						 r2, n2, p, &best);
+		}
+	}
+
+	*n2_out = best.n2;
+	*p_out = best.p;
+	*r2_out = best.r2;
+}
+
+
+/*
+ * The exhaustive search above ends up with the first (r2, n2, p), in the
+ * order it tries them, that is best according to wrpll_update_rnp():
+ *
+ *  - any divider within the budget beats any divider that isn't,
+ *  - within the budget, the higher n2 / r2^2 the better, p doesn't matter,
+ *  - outside of it, the lower relative error |freq2k * p * r2 - LC * n2| /
+ *    (p * r2) the better.
+ *
+ * which can be found without trying every divider:
+ *
+ * For a given r2 and p, the n2 within the budget are those where
+ *   1e6 * LC * n2 is in [freq2k * p * r2 * (1e6 - budget),
+ *                        freq2k * p * r2 * (1e6 + budget)]
+ * so only the highest n2 of that range needs to be looked at, and the
+ * range grows with p. For a given r2, n2 / r2^2 is at most
+ * VCO_MAX / (LC_FREQ * r2), so once that can't beat what we have, neither
+ * can any higher r2.
+ *
+ * Only if nothing is within the budget, for a given r2 and p the n2 either
+ * side of freq2k * p * r2 / LC are the closest.
+ */
+static bool wrpll_within_budget(uint64_t freq2k, unsigned budget,
+				unsigned r2, unsigned n2_min, unsigned n2_max,
+				unsigned *n2_out, unsigned *p_out)
+{
+	const uint64_t div = 1000000ull * LC_FREQ_2K;
+	uint64_t t, lo, hi;
+	unsigned p;
+
+	*n2_out = 0;
+
+	/* the lowest p for which the top of the range reaches n2_min */
+	p = div * n2_min / (freq2k * r2 * (1000000 + budget));
+	p = p > P_MIN ? p & ~(P_INC - 1) : P_MIN;
+
+	for (; p <= P_MAX; p += P_INC) {
+		t = freq2k * p * r2;
+		lo = (t * (1000000 - budget) + div - 1) / div;
+		if (lo > n2_max)
+			break;
+
+		hi = t * (1000000 + budget) / div;
+		if (hi > n2_max)
+			hi = n2_max;
+		if (lo < n2_min)
+			lo = n2_min;
+		if (lo > hi || hi <= *n2_out)
+			continue;
+
+		*n2_out = hi;
+		*p_out = p;
+		if (hi == n2_max)
+			break;
+	}
+
+	return *n2_out != 0;
+}
+
+static void wrpll_closest(uint64_t freq2k, unsigned r2, unsigned n2_min,
+			  unsigned n2_max, struct wrpll_rnp *best,
+			  uint64_t *diff_best)
+{
+	unsigned p, n2, i;
+
+	for (p = P_MIN; p <= P_MAX; p += P_INC) {
+		uint64_t t = freq2k * p * r2;
+
+		for (i = 0; i < 2; i++) {
+			uint64_t diff;
+
+			n2 = t / LC_FREQ_2K + i;
+			if (n2 < n2_min)
+				n2 = n2_min;
+			if (n2 > n2_max)
+				n2 = n2_max;
+			diff = ABS_DIFF(t, (uint64_t)LC_FREQ_2K * n2);
+
+			/*
+			 * The exhaustive search goes through n2 before p, so
+			 * on a tie within the same r2 the lower n2 came first.
+			 */
+			if (best->p == 0 ||
+			    best->p * best->r2 * diff < p * r2 * *diff_best ||
+			    (best->p * best->r2 * diff == p * r2 * *diff_best &&
+			     best->r2 == r2 &&
+			     (n2 < best->n2 || (n2 == best->n2 && p < best->p)))) {
+				best->p = p;
+				best->n2 = n2;
+				best->r2 = r2;
+				*diff_best = diff;
+			}
+		}
+	}
+}
+
+void
+intel_wrpll_compute_rnp(int clock /* in Hz */,
+			unsigned *r2_out, unsigned *n2_out, unsigned *p_out)
+{
+	struct wrpll_rnp best = { 0, 0, 0 };
+	uint64_t freq2k, diff_best = 0;
+	unsigned budget, r2, n2, p;
+
+	if (wrpll_no_clock(clock, r2_out, n2_out, p_out))
+		return;
+
+	freq2k = clock / 100;
+
+	budget = wrpll_get_budget_for_freq(clock);
+
+	if (freq2k == 5400000) {
+		*n2_out = 2;
+		*p_out = 1;
+		*r2_out = 2;
+		return;
+	}
+
+	for (r2 = R2_MIN; r2 <= R2_MAX; r2++) {
+		unsigned n2_min = VCO_MIN * r2 / LC_FREQ + 1;
+		unsigned n2_max = VCO_MAX * r2 / LC_FREQ;
+
+		if (best.p) {
+			/* neither this r2 nor any higher one can do better */
+			if (VCO_MAX * best.r2 * best.r2 <=
+			    LC_FREQ * best.n2 * r2)
+				break;
+			if (n2_max * best.r2 * best.r2 <= best.n2 * r2 * r2)
+				continue;
+		}
+
+		if (!wrpll_within_budget(freq2k, budget, r2, n2_min, n2_max,
+					 &n2, &p))
+			continue;
+
+		if (best.p == 0 ||
+		    n2 * best.r2 * best.r2 > best.n2 * r2 * r2) {
+			best.p = p;
+			best.n2 = n2;
+			best.r2 = r2;
+		}
+	}
+
+	if (best.p == 0) {
+		for (r2 = R2_MIN; r2 <= R2_MAX; r2++)
+			wrpll_closest(freq2k, r2,
+				      VCO_MIN * r2 / LC_FREQ + 1,
+				      VCO_MAX * r2 / LC_FREQ,
+				      &best, &diff_best);
+	}
+
+	*n2_out = best.n2;
+	*p_out = best.p;
+	*r2_out = best.r2;
+}
@@ -0,0 +1,42 @@
+/*
+ * Copyright © 2013 Intel Corporation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ *
+ */
+
+#ifndef INTEL_WRPLL_H
+#define INTEL_WRPLL_H
+
+/*
+ * Divider computation for the Haswell WRPLLs, as done by the kernel: for a
+ * pixel clock in Hz, the reference (r2), feedback (n2) and post (p)
+ * dividers, with r2 and n2 doubled.
+ *
+ * intel_wrpll_compute_rnp() is the one to use. intel_wrpll_compute_rnp_slow()
+ * is the kernel's exhaustive search over every divider, kept as the
+ * reference the former must agree with.
+ */
+void intel_wrpll_compute_rnp(int clock, unsigned *r2_out, unsigned *n2_out,
+			     unsigned *p_out);
+void intel_wrpll_compute_rnp_slow(int clock, unsigned *r2_out,
+				  unsigned *n2_out, unsigned *p_out);
+
+#endif /* INTEL_WRPLL_H */
@@ -2,225 +2,11 @@
 #include <stdbool.h>
 #include <stdint.h>
 #include <stdlib.h>
+#include <unistd.h>
+#include <pthread.h>
 
 #include "intel_gpu_tools.h"
-
-#define LC_FREQ 2700
-#define LC_FREQ_2K (LC_FREQ * 2000)
-
-#define P_MIN 2
-#define P_MAX 64
-#define P_INC 2
-
-/* Constraints for PLL good behavior */
-#define REF_MIN 48
-#define REF_MAX 400
-#define VCO_MIN 2400
-#define VCO_MAX 4800
-
-#define ABS_DIFF(a, b) ((a > b) ? (a - b) : (b - a))
-
-struct wrpll_rnp {
-	unsigned p, n2, r2;
-};
-
-static unsigned wrpll_get_budget_for_freq(int clock)
-{
-	unsigned budget;
-
-	switch (clock) {
-	case 25175000:
-	case 25200000:
-	case 27000000:
-	case 27027000:
-	case 37762500:
-	case 37800000:
-	case 40500000:
-	case 40541000:
-	case 54000000:
-	case 54054000:
-	case 59341000:
-	case 59400000:
-	case 72000000:
-	case 74176000:
-	case 74250000:
-	case 81000000:
-	case 81081000:
-	case 89012000:
-	case 89100000:
-	case 108000000:
-	case 108108000:
-	case 111264000:
-	case 111375000:
-	case 148352000:
-	case 148500000:
-	case 162000000:
-	case 162162000:
-	case 222525000:
-	case 222750000:
-	case 296703000:
-	case 297000000:
-		budget = 0;
-		break;
-	case 233500000:
-	case 245250000:
-	case 247750000:
-	case 253250000:
-	case 298000000:
-		budget = 1500;
-		break;
-	case 169128000:
-	case 169500000:
-	case 179500000:
-	case 202000000:
-		budget = 2000;
-		break;
-	case 256250000:
-	case 262500000:
-	case 270000000:
-	case 272500000:
-	case 273750000:
-	case 280750000:
-	case 281250000:
-	case 286000000:
-	case 291750000:
-		budget = 4000;
-		break;
-	case 267250000:
-	case 268500000:
-		budget = 5000;
-		break;
-	default:
-		budget = 1000;
-		break;
-	}
-
-	return budget;
-}
-
-static void wrpll_update_rnp(uint64_t freq2k, unsigned budget,
-			     unsigned r2, unsigned n2, unsigned p,
-			     struct wrpll_rnp *best)
-{
-	uint64_t a, b, c, d, diff, diff_best;
-
-	/* No best (r,n,p) yet */
-	if (best->p == 0) {
-		best->p = p;
-		best->n2 = n2;
-		best->r2 = r2;
-		return;
-	}
-
-	/*
-	 * Output clock is (LC_FREQ_2K / 2000) * N / (P * R), which compares to
-	 * freq2k.
-	 *
-	 * delta = 1e6 *
-	 *	   abs(freq2k - (LC_FREQ_2K * n2/(p * r2))) /
-	 *	   freq2k;
-	 *
-	 * and we would like delta <= budget.
-	 *
-	 * If the discrepancy is above the PPM-based budget, always prefer to
-	 * improve upon the previous solution.  However, if you're within the
-	 * budget, try to maximize Ref * VCO, that is N / (P * R^2).
-	 */
-	a = freq2k * budget * p * r2;
-	b = freq2k * budget * best->p * best->r2;
-	diff = ABS_DIFF((freq2k * p * r2), (LC_FREQ_2K * n2));
-	diff_best = ABS_DIFF((freq2k * best->p * best->r2),
-			     (LC_FREQ_2K * best->n2));
-	c = 1000000 * diff;
-	d = 1000000 * diff_best;
-
-	if (a < c && b < d) {
-		/* If both are above the budget, pick the closer */
-		if (best->p * best->r2 * diff < p * r2 * diff_best) {
-			best->p = p;
-			best->n2 = n2;
-			best->r2 = r2;
-		}
-	} else if (a >= c && b < d) {
-		/* If A is below the threshold but B is above it?  Update. */
-		best->p = p;
-		best->n2 = n2;
-		best->r2 = r2;
-	} else if (a >= c && b >= d) {
-		/* Both are below the limit, so pick the higher n2/(r2*r2) */
-		if (n2 * best->r2 * best->r2 > best->n2 * r2 * r2) {
-			best->p = p;
-			best->n2 = n2;
-			best->r2 = r2;
-		}
-	}
-	/* Otherwise a < c && b >= d, do nothing */
-}
-
-static void
-wrpll_compute_rnp(int clock /* in Hz */,
-		  unsigned *r2_out, unsigned *n2_out, unsigned *p_out)
-{
-	uint64_t freq2k;
-	unsigned p, n2, r2;
-	struct wrpll_rnp best = { 0, 0, 0 };
-	unsigned budget;
-
-	freq2k = clock / 100;
-
-	budget = wrpll_get_budget_for_freq(clock);
-
-	/* Special case handling for 540 pixel clock: bypass WR PLL entirely
-	 * and directly pass the LC PLL to it. */
-	if (freq2k == 5400000) {
-		*n2_out = 2;
-		*p_out = 1;
-		*r2_out = 2;
-		return;
-	}
-
-	/*
-	 * Ref = LC_FREQ / R, where Ref is the actual reference input seen by
-	 * the WR PLL.
-	 *
-	 * We want R so that REF_MIN <= Ref <= REF_MAX.
-	 * Injecting R2 = 2 * R gives:
-	 *   REF_MAX * r2 > LC_FREQ * 2 and
-	 *   REF_MIN * r2 < LC_FREQ * 2
-	 *
-	 * Which means the desired boundaries for r2 are:
-	 *  LC_FREQ * 2 / REF_MAX < r2 < LC_FREQ * 2 / REF_MIN
-	 *
-	 */
-        for (r2 = LC_FREQ * 2 / REF_MAX + 1;
-	     r2 <= LC_FREQ * 2 / REF_MIN;
-	     r2++) {
-
-		/*
-		 * VCO = N * Ref, that is: VCO = N * LC_FREQ / R
-		 *
-		 * Once again we want VCO_MIN <= VCO <= VCO_MAX.
-		 * Injecting R2 = 2 * R and N2 = 2 * N, we get:
-		 *   VCO_MAX * r2 > n2 * LC_FREQ and
-		 *   VCO_MIN * r2 < n2 * LC_FREQ)
-		 *
-		 * Which means the desired boundaries for n2 are:
-		 * VCO_MIN * r2 / LC_FREQ < n2 < VCO_MAX * r2 / LC_FREQ
-		 */
-		for (n2 = VCO_MIN * r2 / LC_FREQ + 1;
-		     n2 <= VCO_MAX * r2 / LC_FREQ;
-		     n2++) {
-
-			for (p = P_MIN; p <= P_MAX; p += P_INC)
-				wrpll_update_rnp(freq2k, budget,
-						 r2, n2, p, &best);
-		}
-	}
-
-	*n2_out = best.n2;
-	*p_out = best.p;
-	*r2_out = best.r2;
-}
+#include "intel_wrpll.h"
 
 /* WRPLL clock dividers */
 struct wrpll_tmds_clock {
@@ -608,26 +394,87 @@ static const struct wrpll_tmds_clock wrpll_tmds_clock_table[] = {
 	{298000000,	2,	21,	19},
 };
 
+/* Every kHz in between is checked against the exhaustive search */
+#define SWEEP_MIN	25000
+#define SWEEP_MAX	300000
+#define SWEEP_CHUNK	1000
+
+/* Clocks in Hz too small for the divider math, which must not trip on them */
+#define SMALL_CLOCK_MAX	1000
+
+static int sweep_next = SWEEP_MIN;
+
+static void check_clock(int clock, const char *name,
+			unsigned ref_r2, unsigned ref_n2, unsigned ref_p)
+{
+	unsigned r2, n2, p;
+
+	intel_wrpll_compute_rnp(clock, &r2, &n2, &p);
+	if (ref_r2 != r2 || ref_n2 != n2 || ref_p != p) {
+		printf("Computed value differs for %i Hz:\n"
+		       "  %-10s (%u,%u,%u)\n"
+		       "  Computed:  (%u,%u,%u)\n",
+		       clock, name,
+		       ref_r2, ref_n2, ref_p,
+		       r2, n2, p);
+
+		abort();
+	}
+}
+
+/* checks against the exhaustive search */
+static void check_clock_slow(int clock)
+{
+	unsigned r2, n2, p;
+
+	intel_wrpll_compute_rnp_slow(clock, &r2, &n2, &p);
+	check_clock(clock, "Exhaustive:", r2, n2, p);
+}
+
+static void *sweep(void *arg)
+{
+	int start, clock;
+
+	while ((start = __sync_fetch_and_add(&sweep_next, SWEEP_CHUNK)) <=
+	       SWEEP_MAX) {
+		for (clock = start;
+		     clock < start + SWEEP_CHUNK && clock <= SWEEP_MAX;
+		     clock++)
+			check_clock_slow(clock * 1000);
+	}
+
+	return NULL;
+}
+
 int main(void)
 {
-	int i;
+	pthread_t *threads;
+	int i, num_threads;
 
 	for (i = 0; i < ARRAY_SIZE(wrpll_tmds_clock_table); i++) {
 		const struct wrpll_tmds_clock *ref = &wrpll_tmds_clock_table[i];
-		unsigned r2, n2, p;
 
-		wrpll_compute_rnp(ref->clock, &r2, &n2, &p);
-		if (ref->r2 != r2 || ref->n2 != n2 || ref->p != p) {
-			printf("Computed value differs for %li Hz:\n"
-			       "  Reference: (%u,%u,%u)\n"
-			       "  Computed:  (%u,%u,%u)\n",
-			       (int64_t)ref->clock * 1000,
-			       ref->r2, ref->n2, ref->p,
-			       r2, n2, p);
+		check_clock(ref->clock, "Reference:", ref->r2, ref->n2, ref->p);
+		check_clock_slow(ref->clock);
+	}
+
+	for (i = -1; i <= SMALL_CLOCK_MAX; i++)
+		check_clock_slow(i);
 
+	num_threads = sysconf(_SC_NPROCESSORS_ONLN);
+	if (num_threads < 1)
+		num_threads = 1;
+	threads = calloc(num_threads, sizeof(*threads));
+	if (threads == NULL)
+		abort();
+
+	for (i = 0; i < num_threads; i++)
+		if (pthread_create(&threads[i], NULL, sweep, NULL))
 			abort();
-		}
-	}
+	for (i = 0; i < num_threads; i++)
+		pthread_join(threads[i], NULL);
+
+	free(threads);
 
 	return 0;
 }
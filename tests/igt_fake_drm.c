@@ -0,0 +1,409 @@
+/*
+ * Copyright © 2013 Intel Corporation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ *
+ */
+
+/*
+ * Sanity checks for the relocation, blitter and page flip paths, run by
+ * make check against the fake i915 device in lib/intel_fake_drm.c.
+ * Everything here is plain uabi though, so the test passes on real hardware
+ * just the same, given a connected output for the kms subtests.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <errno.h>
+#include <poll.h>
+#include "drm.h"
+#include "i915_drm.h"
+#include "drmtest.h"
+
+#define OBJECT_SIZE (16*1024)
+
+#define LOCAL_I915_EXEC_NO_RELOC	(1<<11)
+#define LOCAL_I915_EXEC_HANDLE_LUT	(1<<12)
+
+static int fd;
+
+static int exec(struct drm_i915_gem_exec_object2 *obj, int count,
+		int len, unsigned flags)
+{
+	struct drm_i915_gem_execbuffer2 execbuf;
+
+	memset(&execbuf, 0, sizeof(execbuf));
+	execbuf.buffers_ptr = (uintptr_t)obj;
+	execbuf.buffer_count = count;
+	execbuf.batch_len = len;
+	execbuf.flags = flags;
+
+	return drmIoctl(fd, DRM_IOCTL_I915_GEM_EXECBUFFER2, &execbuf);
+}
+
+static void relocations(unsigned flags)
+{
+	struct drm_i915_gem_relocation_entry reloc;
+	struct drm_i915_gem_exec_object2 obj[2];
+	uint32_t batch[4] = { MI_NOOP, 0, MI_BATCH_BUFFER_END, 0 };
+	uint32_t value;
+
+	memset(obj, 0, sizeof(obj));
+	obj[0].handle = gem_create(fd, 4096);
+	obj[1].handle = gem_create(fd, 4096);
+	gem_write(fd, obj[1].handle, 0, batch, sizeof(batch));
+
+	memset(&reloc, 0, sizeof(reloc));
+	reloc.target_handle = flags & LOCAL_I915_EXEC_HANDLE_LUT ? 0 : obj[0].handle;
+	reloc.offset = sizeof(uint32_t);
+	reloc.delta = 64;
+	reloc.presumed_offset = -1;
+	obj[1].relocation_count = 1;
+	obj[1].relocs_ptr = (uintptr_t)&reloc;
+
+	igt_assert(exec(obj, 2, sizeof(batch), flags) == 0);
+	igt_assert(reloc.presumed_offset == obj[0].offset);
+
+	gem_read(fd, obj[1].handle, reloc.offset, &value, sizeof(value));
+	igt_assert(value == obj[0].offset + reloc.delta);
+
+	/*
+	 * The objects haven't moved, so NO_RELOC must leave the batch alone
+	 * even with a stale presumed offset, which a normal exec patches.
+	 */
+	gem_write(fd, obj[1].handle, reloc.offset, &batch[1], sizeof(batch[1]));
+	reloc.presumed_offset = -1;
+	igt_assert(exec(obj, 2, sizeof(batch),
+			flags | LOCAL_I915_EXEC_NO_RELOC) == 0);
+	gem_read(fd, obj[1].handle, reloc.offset, &value, sizeof(value));
+	igt_assert(value == 0);
+	igt_assert(reloc.presumed_offset == -1);
+
+	igt_assert(exec(obj, 2, sizeof(batch), flags) == 0);
+	gem_read(fd, obj[1].handle, reloc.offset, &value, sizeof(value));
+	igt_assert(value == obj[0].offset + reloc.delta);
+	igt_assert(reloc.presumed_offset == obj[0].offset);
+
+	gem_close(fd, obj[0].handle);
+	gem_close(fd, obj[1].handle);
+}
+
+static void bad_handles(void)
+{
+	struct drm_i915_gem_exec_object2 obj[2];
+	uint32_t batch[2] = { MI_BATCH_BUFFER_END, 0 };
+
+	memset(obj, 0, sizeof(obj));
+	obj[0].handle = gem_create(fd, 4096);
+	gem_write(fd, obj[0].handle, 0, batch, sizeof(batch));
+
+	obj[1] = obj[0];
+	igt_assert(exec(obj, 2, sizeof(batch), 0) == -1 && errno == EINVAL);
+
+	obj[1].handle = obj[0].handle + 1000;
+	igt_assert(exec(obj, 2, sizeof(batch), 0) == -1 && errno == ENOENT);
+
+	gem_close(fd, obj[0].handle);
+}
+
+static void blt_copy(void)
+{
+	struct drm_i915_gem_relocation_entry reloc[2];
+	struct drm_i915_gem_exec_object2 obj[3];
+	uint32_t batch[10], *src, *dst;
+	int i;
+
+	src = malloc(OBJECT_SIZE);
+	dst = malloc(OBJECT_SIZE);
+	igt_assert(src && dst);
+	for (i = 0; i < OBJECT_SIZE / 4; i++)
+		src[i] = i;
+
+	memset(obj, 0, sizeof(obj));
+	obj[0].handle = gem_create(fd, OBJECT_SIZE);
+	obj[1].handle = gem_create(fd, OBJECT_SIZE);
+	obj[2].handle = gem_create(fd, 4096);
+	gem_write(fd, obj[0].handle, 0, src, OBJECT_SIZE);
+
+	batch[0] = XY_SRC_COPY_BLT_CMD |
+		   XY_SRC_COPY_BLT_WRITE_ALPHA |
+		   XY_SRC_COPY_BLT_WRITE_RGB;
+	batch[1] = 3 << 24 | 0xcc << 16 | 4096;
+	batch[2] = 0;
+	batch[3] = (OBJECT_SIZE / 4096) << 16 | 1024;
+	batch[4] = 0;
+	batch[5] = 0;
+	batch[6] = 4096;
+	batch[7] = 0;
+	batch[8] = MI_BATCH_BUFFER_END;
+	batch[9] = 0;
+	gem_write(fd, obj[2].handle, 0, batch, sizeof(batch));
+
+	memset(reloc, 0, sizeof(reloc));
+	reloc[0].target_handle = obj[1].handle;
+	reloc[0].offset = 4 * sizeof(uint32_t);
+	reloc[0].read_domains = I915_GEM_DOMAIN_RENDER;
+	reloc[0].write_domain = I915_GEM_DOMAIN_RENDER;
+	reloc[1].target_handle = obj[0].handle;
+	reloc[1].offset = 7 * sizeof(uint32_t);
+	reloc[1].read_domains = I915_GEM_DOMAIN_RENDER;
+	obj[2].relocation_count = 2;
+	obj[2].relocs_ptr = (uintptr_t)reloc;
+
+	igt_assert(exec(obj, 3, sizeof(batch),
+			HAS_BLT_RING(intel_get_drm_devid(fd)) ?
+			I915_EXEC_BLT : 0) == 0);
+
+	gem_read(fd, obj[1].handle, 0, dst, OBJECT_SIZE);
+	igt_assert(memcmp(src, dst, OBJECT_SIZE) == 0);
+
+	for (i = 0; i < 3; i++)
+		gem_close(fd, obj[i].handle);
+	free(src);
+	free(dst);
+}
+
+static void mmap_coherency(void)
+{
+	uint32_t handle, *gtt, *cpu, value;
+
+	handle = gem_create(fd, OBJECT_SIZE);
+
+	gtt = gem_mmap__gtt(fd, handle, OBJECT_SIZE, PROT_READ | PROT_WRITE);
+	cpu = gem_mmap__cpu(fd, handle, OBJECT_SIZE, PROT_READ | PROT_WRITE);
+	igt_assert(gtt && cpu);
+
+	gtt[17] = 0xdeadbeef;
+	gem_set_domain(fd, handle, I915_GEM_DOMAIN_CPU, 0);
+	igt_assert(cpu[17] == 0xdeadbeef);
+
+	gem_read(fd, handle, 17 * sizeof(uint32_t), &value, sizeof(value));
+	igt_assert(value == 0xdeadbeef);
+
+	munmap(gtt, OBJECT_SIZE);
+	munmap(cpu, OBJECT_SIZE);
+	gem_close(fd, handle);
+}
+
+struct output {
+	struct kmstest_connector_config config;
+	uint32_t handle[2];
+	uint32_t fb[2];
+};
+
+static struct {
+	unsigned count;
+	unsigned sequence;
+	int64_t usec;
+} last_event;
+
+static void event_handler(int fd, unsigned int sequence, unsigned int sec,
+			  unsigned int usec, void *data)
+{
+	last_event.count++;
+	last_event.sequence = sequence;
+	last_event.usec = (int64_t)sec * 1000000 + usec;
+}
+
+static void wait_for_events(unsigned count)
+{
+	drmEventContext evctx = {
+		.version = DRM_EVENT_CONTEXT_VERSION,
+		.vblank_handler = event_handler,
+		.page_flip_handler = event_handler,
+	};
+	struct pollfd pfd = { .fd = fd, .events = POLLIN };
+
+	while (last_event.count < count) {
+		igt_assert(poll(&pfd, 1, 1000) == 1);
+		igt_assert(drmHandleEvent(fd, &evctx) == 0);
+	}
+}
+
+static void setup_output(struct output *o)
+{
+	drmModeModeInfo *mode;
+	drmModeRes *res;
+	int i, ret = -1;
+
+	res = drmModeGetResources(fd);
+	igt_require(res);
+	for (i = 0; i < res->count_connectors && ret; i++)
+		ret = kmstest_get_connector_config(fd, res->connectors[i], -1,
+						   &o->config);
+	drmModeFreeResources(res);
+	igt_require(ret == 0);
+
+	mode = &o->config.default_mode;
+	for (i = 0; i < 2; i++) {
+		o->handle[i] = gem_create(fd, mode->hdisplay * 4 *
+					  mode->vdisplay);
+		igt_assert(drmModeAddFB(fd, mode->hdisplay, mode->vdisplay,
+					24, 32, mode->hdisplay * 4,
+					o->handle[i], &o->fb[i]) == 0);
+	}
+
+	igt_assert(drmModeSetCrtc(fd, o->config.crtc->crtc_id, o->fb[0], 0, 0,
+				  &o->config.connector->connector_id, 1,
+				  mode) == 0);
+}
+
+static void cleanup_output(struct output *o)
+{
+	int i;
+
+	drmModeSetCrtc(fd, o->config.crtc->crtc_id, 0, 0, 0, NULL, 0, NULL);
+	for (i = 0; i < 2; i++) {
+		drmModeRmFB(fd, o->fb[i]);
+		gem_close(fd, o->handle[i]);
+	}
+	kmstest_free_connector_config(&o->config);
+}
+
+static int set_dpms(struct output *o, int mode)
+{
+	drmModeConnector *connector = o->config.connector;
+	int i;
+
+	for (i = 0; i < connector->count_props; i++) {
+		struct drm_mode_get_property prop;
+
+		memset(&prop, 0, sizeof(prop));
+		prop.prop_id = connector->props[i];
+		if (drmIoctl(fd, DRM_IOCTL_MODE_GETPROPERTY, &prop) == 0 &&
+		    strcmp(prop.name, "DPMS") == 0)
+			return drmModeConnectorSetProperty(fd,
+					connector->connector_id,
+					prop.prop_id, mode);
+	}
+
+	return -ENOENT;
+}
+
+static void flip_timestamps(void)
+{
+	struct output o;
+	int64_t frame, last_usec = 0;
+	unsigned last_sequence = 0;
+	int i;
+
+	setup_output(&o);
+	frame = 1000000 / o.config.default_mode.vrefresh;
+
+	last_event.count = 0;
+	for (i = 1; i <= 10; i++) {
+		uint32_t crtc = o.config.crtc->crtc_id;
+
+		igt_assert(drmModePageFlip(fd, crtc, o.fb[i & 1],
+					   DRM_MODE_PAGE_FLIP_EVENT, NULL) == 0);
+		igt_assert(drmModePageFlip(fd, crtc, o.fb[~i & 1],
+					   DRM_MODE_PAGE_FLIP_EVENT,
+					   NULL) == -EBUSY);
+		wait_for_events(i);
+
+		/* every flip lands on the next vblank */
+		if (i > 1) {
+			int64_t delta = last_event.usec - last_usec - frame;
+
+			igt_assert(last_event.sequence == last_sequence + 1);
+			igt_assert(delta < frame / 200 && -delta < frame / 200);
+		}
+		last_sequence = last_event.sequence;
+		last_usec = last_event.usec;
+	}
+
+	cleanup_output(&o);
+}
+
+static int wait_vblank(struct output *o, unsigned type, unsigned sequence,
+		       unsigned *reply)
+{
+	drmVBlank vbl;
+
+	memset(&vbl, 0, sizeof(vbl));
+	vbl.request.type = type | DRM_VBLANK_RELATIVE |
+		o->config.crtc_idx << DRM_VBLANK_HIGH_CRTC_SHIFT;
+	vbl.request.sequence = sequence;
+	if (drmWaitVBlank(fd, &vbl))
+		return -errno;
+
+	*reply = vbl.reply.sequence;
+	return 0;
+}
+
+static void vblank_vs_dpms(void)
+{
+	struct output o;
+	unsigned target, sequence;
+
+	setup_output(&o);
+
+	igt_assert(wait_vblank(&o, DRM_VBLANK_EVENT, 60, &target) == 0);
+
+	/* the pending wait completes as soon as the pipe goes down */
+	last_event.count = 0;
+	igt_assert(set_dpms(&o, DRM_MODE_DPMS_OFF) == 0);
+	wait_for_events(1);
+	igt_assert(last_event.sequence != target);
+
+	igt_assert(wait_vblank(&o, 0, 1, &sequence) == -EINVAL);
+
+	igt_assert(set_dpms(&o, DRM_MODE_DPMS_ON) == 0);
+	igt_assert(wait_vblank(&o, 0, 1, &sequence) == 0);
+
+	cleanup_output(&o);
+}
+
+int main(int argc, char **argv)
+{
+	igt_subtest_init(argc, argv);
+
+	igt_fixture
+		fd = drm_open_any();
+
+	igt_subtest("relocations")
+		relocations(0);
+
+	igt_subtest("relocations-lut")
+		relocations(LOCAL_I915_EXEC_HANDLE_LUT);
+
+	igt_subtest("bad-handles")
+		bad_handles();
+
+	igt_subtest("blt-copy")
+		blt_copy();
+
+	igt_subtest("mmap-coherency")
+		mmap_coherency();
+
+	igt_subtest("flip-timestamps")
+		flip_timestamps();
+
+	igt_subtest("vblank-vs-dpms")
+		vblank_vs_dpms();
+
+	igt_fixture
+		close(fd);
+
+	igt_exit();
+}
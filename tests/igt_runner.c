@@ -0,0 +1,1017 @@
+/*
+ * Copyright © 2013 Intel Corporation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ *
+ */
+
+/*
+ * Parallel runner for igt tests.
+ *
+ * Tests with subtests are enumerated with --list-subtests and every subtest
+ * becomes a job of its own, run as "test --run-subtest name". Tests without
+ * subtests ignore --list-subtests and would run in full instead, so only
+ * tests known to have subtests are enumerated: the ones in a --multi-list
+ * and, for tests named on the command line, the multi_kernel_tests this
+ * runner was built with. Everything else is run as a single job. Each job
+ * runs in its own process group with its output captured, and gets killed
+ * when it exceeds the timeout.
+ *
+ * Jobs are scheduled by resource class:
+ *
+ *   exclusive - runs with nothing else at all, e.g. suspend or hang tests
+ *   gpu       - at most one gpu job at a time, alongside cpu jobs
+ *   cpu       - doesn't touch the gpu (or uses the fake device), any number
+ *
+ * The class of a job is looked up in the rules given with --class and
+ * --class-file, the first "pattern class" rule whose fnmatch pattern matches
+ * "test" or "test:subtest" wins. Without a match jobs are in the gpu class,
+ * or the cpu class when running against the fake device, where every process
+ * gets a device of its own.
+ *
+ * Results are streamed as one json object per line as the jobs complete, to
+ * stdout or the file given with --results. A summary goes to stderr at the
+ * end, and the exit status is non-zero if anything failed.
+ *
+ * The test lists printed by "make list-single-tests" and "make
+ * list-multi-tests" can be fed in directly:
+ *
+ *   make -s list-multi-tests > multi
+ *   make -s list-single-tests > single
+ *   ./igt_runner -j8 --multi-list=multi --single-list=single
+ */
+
+#define _GNU_SOURCE
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdbool.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <fnmatch.h>
+#include <getopt.h>
+#include <poll.h>
+#include <signal.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+
+#define DEFAULT_TIMEOUT		600
+#define KILL_GRACE		5
+
+enum class { CLASS_CPU, CLASS_GPU, CLASS_EXCLUSIVE, NUM_CLASSES };
+
+static const char *class_str[NUM_CLASSES] = {
+	[CLASS_CPU] = "cpu",
+	[CLASS_GPU] = "gpu",
+	[CLASS_EXCLUSIVE] = "exclusive",
+};
+
+enum result {
+	RESULT_PASS,
+	RESULT_SKIP,
+	RESULT_FAIL,
+	RESULT_CRASH,
+	RESULT_TIMEOUT,
+	NUM_RESULTS
+};
+
+static const char *result_str[NUM_RESULTS] = {
+	[RESULT_PASS] = "pass",
+	[RESULT_SKIP] = "skip",
+	[RESULT_FAIL] = "fail",
+	[RESULT_CRASH] = "crash",
+	[RESULT_TIMEOUT] = "timeout",
+};
+
+struct rule {
+	char *pattern;
+	enum class class;
+};
+
+struct job {
+	char *path;		/* binary to execute */
+	char *test;		/* basename of the binary */
+	char *subtest;		/* NULL for tests without subtests */
+	enum class class;
+
+	pid_t pid;
+	int fd;			/* combined stdout/stderr of the job */
+	char *output;
+	size_t output_len, output_size;
+	double start, deadline;
+	bool terminated, killed;
+	int status;
+};
+
+static struct {
+	const char *test_dir;
+	unsigned jobs;
+	double timeout;
+	bool dry_run;
+	bool verbose;
+	FILE *results;
+
+	struct rule *rules;
+	unsigned num_rules;
+	enum class default_class;
+
+	struct job *queue;
+	unsigned num_queued;
+	unsigned next;
+
+	struct job **running;
+	unsigned num_running;
+	unsigned class_running[NUM_CLASSES];
+
+	unsigned count[NUM_RESULTS];
+} runner;
+
+static int sigchld_pipe[2];
+
+static double now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static void *xrealloc(void *ptr, size_t size)
+{
+	ptr = realloc(ptr, size);
+	if (ptr == NULL) {
+		perror("realloc");
+		exit(1);
+	}
+
+	return ptr;
+}
+
+static char *xstrdup(const char *s)
+{
+	char *copy = strdup(s);
+
+	if (copy == NULL) {
+		perror("strdup");
+		exit(1);
+	}
+
+	return copy;
+}
+
+static bool parse_class(const char *name, enum class *class)
+{
+	int i;
+
+	for (i = 0; i < NUM_CLASSES; i++) {
+		if (strcmp(name, class_str[i]) == 0) {
+			*class = i;
+			return true;
+		}
+	}
+
+	return false;
+}
+
+static void add_rule(const char *pattern, const char *class_name)
+{
+	enum class class;
+
+	if (!parse_class(class_name, &class)) {
+		fprintf(stderr, "unknown resource class '%s'\n", class_name);
+		exit(1);
+	}
+
+	runner.rules = xrealloc(runner.rules,
+				(runner.num_rules + 1) * sizeof(*runner.rules));
+	runner.rules[runner.num_rules].pattern = xstrdup(pattern);
+	runner.rules[runner.num_rules].class = class;
+	runner.num_rules++;
+}
+
+/* "pattern=class" from the command line */
+static void parse_rule(char *arg)
+{
+	char *sep = strrchr(arg, '=');
+
+	if (sep == NULL) {
+		fprintf(stderr, "expected PATTERN=CLASS, got '%s'\n", arg);
+		exit(1);
+	}
+
+	*sep = '\0';
+	add_rule(arg, sep + 1);
+}
+
+static void read_class_file(const char *filename)
+{
+	char line[1024], pattern[512], class[64];
+	FILE *f;
+
+	f = fopen(filename, "r");
+	if (f == NULL) {
+		perror(filename);
+		exit(1);
+	}
+
+	while (fgets(line, sizeof(line), f)) {
+		char *hash = strchr(line, '#');
+
+		if (hash)
+			*hash = '\0';
+
+		if (sscanf(line, "%511s %63s", pattern, class) == 2)
+			add_rule(pattern, class);
+	}
+
+	fclose(f);
+}
+
+static enum class classify(const char *test, const char *subtest)
+{
+	char name[1024];
+	unsigned i;
+
+	snprintf(name, sizeof(name), "%s:%s", test, subtest ?: "");
+
+	for (i = 0; i < runner.num_rules; i++) {
+		if (fnmatch(runner.rules[i].pattern, test, 0) == 0 ||
+		    (subtest && fnmatch(runner.rules[i].pattern, name, 0) == 0))
+			return runner.rules[i].class;
+	}
+
+	return runner.default_class;
+}
+
+static char *test_path(const char *test)
+{
+	char *path;
+
+	if (strchr(test, '/'))
+		return xstrdup(test);
+
+	if (asprintf(&path, "%s/%s", runner.test_dir, test) < 0) {
+		perror("asprintf");
+		exit(1);
+	}
+
+	return path;
+}
+
+static void queue_job(const char *test, const char *subtest)
+{
+	struct job *job;
+	const char *name;
+
+	runner.queue = xrealloc(runner.queue, (runner.num_queued + 1) *
+				sizeof(*runner.queue));
+	job = &runner.queue[runner.num_queued++];
+	memset(job, 0, sizeof(*job));
+
+	name = strrchr(test, '/');
+	job->path = test_path(test);
+	job->test = xstrdup(name ? name + 1 : test);
+	job->subtest = subtest ? xstrdup(subtest) : NULL;
+	job->class = classify(job->test, job->subtest);
+	job->fd = -1;
+}
+
+#ifndef IGT_MULTI_TESTS
+#define IGT_MULTI_TESTS ""
+#endif
+
+/* Whether test is one of the multi_kernel_tests of the build */
+static bool is_multi_test(const char *test)
+{
+	static const char list[] = IGT_MULTI_TESTS;
+	const char *name = strrchr(test, '/');
+	const char *s = list;
+	size_t len;
+
+	name = name ? name + 1 : test;
+	len = strlen(name);
+
+	while ((s = strstr(s, name))) {
+		if ((s == list || s[-1] == ' ') &&
+		    (s[len] == '\0' || s[len] == ' '))
+			return true;
+		s += len;
+	}
+
+	return false;
+}
+
+/* Subtest names are made of alphanumerics, '-' and '_' */
+static bool valid_subtest_name(const char *name)
+{
+	if (name[0] == '\0')
+		return false;
+
+	return name[strspn(name,
+			   "abcdefghijklmnopqrstuvwxyz"
+			   "ABCDEFGHIJKLMNOPQRSTUVWXYZ"
+			   "0123456789-_")] == '\0';
+}
+
+static void queue_subtests(const char *test)
+{
+	char *path = test_path(test);
+	char line[1024];
+	int pipefd[2], status;
+	unsigned first = runner.num_queued, count = 0;
+	bool invalid = false;
+	pid_t pid;
+	FILE *f;
+
+	if (pipe(pipefd)) {
+		perror("pipe");
+		exit(1);
+	}
+
+	pid = fork();
+	if (pid == 0) {
+		int null = open("/dev/null", O_RDWR);
+
+		dup2(null, STDIN_FILENO);
+		dup2(pipefd[1], STDOUT_FILENO);
+		dup2(null, STDERR_FILENO);
+		close(pipefd[0]);
+
+		execl(path, path, "--list-subtests", (char *)NULL);
+		_exit(127);
+	}
+	close(pipefd[1]);
+
+	f = fdopen(pipefd[0], "r");
+	while (fgets(line, sizeof(line), f)) {
+		line[strcspn(line, "\n")] = '\0';
+		if (line[0] == '\0' || invalid)
+			continue;
+
+		if (!valid_subtest_name(line)) {
+			invalid = true;
+			continue;
+		}
+
+		queue_job(test, line);
+		count++;
+	}
+	fclose(f);
+
+	waitpid(pid, &status, 0);
+	if (invalid) {
+		/* not a subtest list, so the test doesn't have subtests */
+		fprintf(stderr,
+			"%s: bogus subtest list, running it as a whole\n",
+			test);
+		while (runner.num_queued > first) {
+			struct job *job = &runner.queue[--runner.num_queued];
+
+			free(job->path);
+			free(job->test);
+			free(job->subtest);
+		}
+		queue_job(test, NULL);
+	} else if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+		/* let the job report the failure to execute */
+		if (count == 0)
+			queue_job(test, NULL);
+	} else if (count == 0) {
+		fprintf(stderr, "%s: no subtests, running it as a whole\n",
+			test);
+		queue_job(test, NULL);
+	}
+
+	free(path);
+}
+
+/* The format of "make list-{single,multi}-tests" */
+static void read_test_list(const char *filename, bool subtests)
+{
+	char word[512];
+	FILE *f;
+
+	f = fopen(filename, "r");
+	if (f == NULL) {
+		perror(filename);
+		exit(1);
+	}
+
+	while (fscanf(f, "%511s", word) == 1) {
+		if (strcmp(word, "TESTLIST") == 0 ||
+		    strcmp(word, "END") == 0)
+			continue;
+
+		if (subtests)
+			queue_subtests(word);
+		else
+			queue_job(word, NULL);
+	}
+
+	fclose(f);
+}
+
+static void sigchld_handler(int sig)
+{
+	int saved_errno = errno;
+	ssize_t ret;
+
+	/* if the pipe is full the main loop is going to wake up anyway */
+	ret = write(sigchld_pipe[1], "", 1);
+	(void)ret;
+
+	errno = saved_errno;
+}
+
+static bool can_start(const struct job *job)
+{
+	if (runner.num_running >= runner.jobs)
+		return false;
+
+	if (runner.class_running[CLASS_EXCLUSIVE])
+		return false;
+
+	switch (job->class) {
+	case CLASS_EXCLUSIVE:
+		return runner.num_running == 0;
+	case CLASS_GPU:
+		return runner.class_running[CLASS_GPU] == 0;
+	default:
+		return true;
+	}
+}
+
+static void start_job(struct job *job)
+{
+	int pipefd[2];
+
+	if (pipe(pipefd)) {
+		perror("pipe");
+		exit(1);
+	}
+
+	fflush(NULL);
+	job->pid = fork();
+	if (job->pid < 0) {
+		perror("fork");
+		exit(1);
+	}
+
+	if (job->pid == 0) {
+		int null = open("/dev/null", O_RDONLY);
+
+		/* own process group, so that a timeout takes out all helpers */
+		setpgid(0, 0);
+
+		dup2(null, STDIN_FILENO);
+		dup2(pipefd[1], STDOUT_FILENO);
+		dup2(pipefd[1], STDERR_FILENO);
+		close(pipefd[0]);
+		close(pipefd[1]);
+		close(sigchld_pipe[0]);
+		close(sigchld_pipe[1]);
+		signal(SIGCHLD, SIG_DFL);
+
+		if (job->subtest)
+			execl(job->path, job->path,
+			      "--run-subtest", job->subtest, (char *)NULL);
+		else
+			execl(job->path, job->path, (char *)NULL);
+
+		fprintf(stderr, "exec %s: %s\n", job->path, strerror(errno));
+		_exit(127);
+	}
+
+	/* avoid racing against the child's own setpgid */
+	setpgid(job->pid, job->pid);
+
+	close(pipefd[1]);
+	job->fd = pipefd[0];
+	fcntl(job->fd, F_SETFL, O_NONBLOCK);
+	fcntl(job->fd, F_SETFD, FD_CLOEXEC);
+
+	job->start = now();
+	job->deadline = runner.timeout > 0 ? job->start + runner.timeout : 0;
+
+	runner.running[runner.num_running++] = job;
+	runner.class_running[job->class]++;
+
+	if (runner.verbose)
+		fprintf(stderr, "[%s] %s%s%s\n", class_str[job->class],
+			job->test, job->subtest ? ":" : "",
+			job->subtest ?: "");
+}
+
+static void read_output(struct job *job)
+{
+	for (;;) {
+		ssize_t len;
+
+		if (job->output_size - job->output_len < 4096) {
+			job->output_size = job->output_size * 2 + 4096;
+			job->output = xrealloc(job->output, job->output_size);
+		}
+
+		len = read(job->fd, job->output + job->output_len,
+			   job->output_size - job->output_len - 1);
+		if (len > 0) {
+			job->output_len += len;
+			continue;
+		}
+
+		if (len == 0 || (errno != EINTR && errno != EAGAIN)) {
+			close(job->fd);
+			job->fd = -1;
+		}
+		break;
+	}
+
+	job->output[job->output_len] = '\0';
+}
+
+static enum result job_result(const struct job *job)
+{
+	char pattern[1024];
+	const char *line;
+
+	if (job->terminated)
+		return RESULT_TIMEOUT;
+
+	if (WIFSIGNALED(job->status))
+		return RESULT_CRASH;
+
+	/* subtests report their own result, which beats the exit status */
+	if (job->subtest && job->output) {
+		snprintf(pattern, sizeof(pattern), "Subtest %s: ",
+			 job->subtest);
+		line = strstr(job->output, pattern);
+		if (line) {
+			line += strlen(pattern);
+			if (strncmp(line, "SUCCESS", 7) == 0)
+				return RESULT_PASS;
+			if (strncmp(line, "SKIP", 4) == 0)
+				return RESULT_SKIP;
+			return RESULT_FAIL;
+		}
+	}
+
+	switch (WEXITSTATUS(job->status)) {
+	case 0:
+		return RESULT_PASS;
+	case 77:
+		return RESULT_SKIP;
+	default:
+		return RESULT_FAIL;
+	}
+}
+
+static void json_string(FILE *f, const char *s)
+{
+	fputc('"', f);
+	for (; *s; s++) {
+		unsigned char c = *s;
+
+		switch (c) {
+		case '"':
+		case '\\':
+			fprintf(f, "\\%c", c);
+			break;
+		case '\n':
+			fprintf(f, "\\n");
+			break;
+		case '\t':
+			fprintf(f, "\\t");
+			break;
+		default:
+			if (c < 0x20)
+				fprintf(f, "\\u%04x", c);
+			else
+				fputc(c, f);
+		}
+	}
+	fputc('"', f);
+}
+
+static void report(struct job *job, double end)
+{
+	enum result result = job_result(job);
+	FILE *f = runner.results;
+
+	runner.count[result]++;
+
+	fprintf(f, "{\"test\": ");
+	json_string(f, job->test);
+	if (job->subtest) {
+		fprintf(f, ", \"subtest\": ");
+		json_string(f, job->subtest);
+	}
+	fprintf(f, ", \"class\": \"%s\", \"result\": \"%s\"",
+		class_str[job->class], result_str[result]);
+	if (WIFEXITED(job->status))
+		fprintf(f, ", \"exit\": %d", WEXITSTATUS(job->status));
+	else if (WIFSIGNALED(job->status))
+		fprintf(f, ", \"signal\": %d", WTERMSIG(job->status));
+	fprintf(f, ", \"duration\": %.3f, \"output\": ", end - job->start);
+	json_string(f, job->output ?: "");
+	fprintf(f, "}\n");
+	fflush(f);
+
+	if (runner.verbose || result >= RESULT_FAIL)
+		fprintf(stderr, "%s%s%s: %s (%.1fs)\n",
+			job->test, job->subtest ? ":" : "",
+			job->subtest ?: "", result_str[result],
+			end - job->start);
+}
+
+static void finish_job(unsigned idx, int status)
+{
+	struct job *job = runner.running[idx];
+
+	job->status = status;
+
+	/* drain whatever the job left behind */
+	if (job->fd >= 0)
+		read_output(job);
+	if (job->fd >= 0) {
+		close(job->fd);
+		job->fd = -1;
+	}
+
+	/* helpers left behind in the process group go down with the job */
+	kill(-job->pid, SIGKILL);
+
+	report(job, now());
+
+	runner.class_running[job->class]--;
+	runner.running[idx] = runner.running[--runner.num_running];
+}
+
+static void reap(void)
+{
+	int status;
+	pid_t pid;
+
+	while ((pid = waitpid(-1, &status, WNOHANG)) > 0) {
+		unsigned i;
+
+		for (i = 0; i < runner.num_running; i++) {
+			if (runner.running[i]->pid == pid) {
+				finish_job(i, status);
+				break;
+			}
+		}
+	}
+}
+
+static void check_timeouts(double t)
+{
+	unsigned i;
+
+	for (i = 0; i < runner.num_running; i++) {
+		struct job *job = runner.running[i];
+
+		if (job->deadline == 0 || t < job->deadline)
+			continue;
+
+		if (!job->terminated) {
+			/* give the exit handlers a chance to clean up the
+			 * gpu */
+			kill(-job->pid, SIGTERM);
+			job->terminated = true;
+			job->deadline = t + KILL_GRACE;
+		} else if (!job->killed) {
+			kill(-job->pid, SIGKILL);
+			job->killed = true;
+			job->deadline = 0;
+		}
+	}
+}
+
+static int poll_timeout(double t)
+{
+	double next = 0;
+	unsigned i;
+
+	for (i = 0; i < runner.num_running; i++) {
+		double deadline = runner.running[i]->deadline;
+
+		if (deadline && (next == 0 || deadline < next))
+			next = deadline;
+	}
+
+	if (next == 0)
+		return -1;
+
+	return next > t ? (next - t) * 1000 + 1 : 0;
+}
+
+static void wait_for_events(void)
+{
+	struct pollfd *pfd;
+	unsigned i, n = 0;
+	char buf[64];
+
+	pfd = xrealloc(NULL, (runner.num_running + 1) * sizeof(*pfd));
+	pfd[n].fd = sigchld_pipe[0];
+	pfd[n].events = POLLIN;
+	n++;
+
+	for (i = 0; i < runner.num_running; i++) {
+		if (runner.running[i]->fd < 0)
+			continue;
+
+		pfd[n].fd = runner.running[i]->fd;
+		pfd[n].events = POLLIN;
+		n++;
+	}
+
+	if (poll(pfd, n, poll_timeout(now())) > 0) {
+		if (pfd[0].revents)
+			while (read(sigchld_pipe[0], buf, sizeof(buf)) > 0)
+				;
+
+		for (i = 0; i < runner.num_running; i++) {
+			struct job *job = runner.running[i];
+			unsigned j;
+
+			for (j = 1; j < n; j++)
+				if (pfd[j].fd == job->fd && pfd[j].revents)
+					read_output(job);
+		}
+	}
+
+	free(pfd);
+}
+
+static void run_all(void)
+{
+	struct sigaction sa;
+
+	if (pipe(sigchld_pipe)) {
+		perror("pipe");
+		exit(1);
+	}
+	fcntl(sigchld_pipe[0], F_SETFL, O_NONBLOCK);
+	fcntl(sigchld_pipe[1], F_SETFL, O_NONBLOCK);
+
+	memset(&sa, 0, sizeof(sa));
+	sa.sa_handler = sigchld_handler;
+	sa.sa_flags = SA_RESTART | SA_NOCLDSTOP;
+	sigaction(SIGCHLD, &sa, NULL);
+
+	runner.running = xrealloc(NULL, runner.jobs * sizeof(*runner.running));
+
+	while (runner.next < runner.num_queued || runner.num_running) {
+		unsigned i;
+
+		/*
+		 * Start everything the classes allow. A blocked job holds up
+		 * only the jobs of its own class, so a queue of gpu tests
+		 * doesn't keep the cpu tests from filling the other workers.
+		 * Exclusive jobs are run in order, once everything before them
+		 * has completed.
+		 */
+		for (i = runner.next; i < runner.num_queued; i++) {
+			struct job *job = &runner.queue[i];
+
+			if (job->pid)
+				continue;
+
+			if (job->class == CLASS_EXCLUSIVE) {
+				if (can_start(job))
+					start_job(job);
+				break;
+			}
+
+			if (can_start(job))
+				start_job(job);
+			else if (runner.num_running >= runner.jobs)
+				break;
+		}
+
+		while (runner.next < runner.num_queued &&
+		       runner.queue[runner.next].pid)
+			runner.next++;
+
+		if (runner.num_running == 0)
+			continue;
+
+		wait_for_events();
+		reap();
+		check_timeouts(now());
+	}
+}
+
+static void usage(const char *name)
+{
+	fprintf(stderr,
+		"Usage: %s [options] [test...]\n"
+		"Tests given by name are enumerated by subtest if they are in\n"
+		"\"make list-multi-tests\", else run as a whole.\n"
+		"  -j, --jobs=N             number of worker processes\n"
+		"                           (default: online cpus)\n"
+		"  -t, --timeout=SECS       per job timeout, 0 for none\n"
+		"                           (default: %d)\n"
+		"  -d, --test-dir=DIR       where to find tests given by name\n"
+		"                           (default: .)\n"
+		"  -s, --single=TEST        run TEST as a whole instead of by\n"
+		"                           subtest\n"
+		"      --multi-list=FILE    enumerate the subtests of every\n"
+		"                           test in FILE\n"
+		"      --single-list=FILE   run every test in FILE as a whole\n"
+		"  -c, --class=PATTERN=CLASS\n"
+		"                           put jobs matching PATTERN into\n"
+		"                           CLASS\n"
+		"      --class-file=FILE    read \"PATTERN CLASS\" rules from\n"
+		"                           FILE\n"
+		"      --default-class=CLASS\n"
+		"                           class of jobs matching no rule\n"
+		"  -o, --results=FILE       write json results to FILE\n"
+		"                           (default: stdout)\n"
+		"  -n, --dry-run            only list the jobs with their\n"
+		"                           classes\n"
+		"  -v, --verbose            log every job\n"
+		"Classes are exclusive, gpu and cpu. Patterns are matched\n"
+		"against \"test\" and \"test:subtest\".\n",
+		name, DEFAULT_TIMEOUT);
+}
+
+int main(int argc, char **argv)
+{
+	static const struct option long_options[] = {
+		{ "jobs", required_argument, NULL, 'j' },
+		{ "timeout", required_argument, NULL, 't' },
+		{ "test-dir", required_argument, NULL, 'd' },
+		{ "single", required_argument, NULL, 's' },
+		{ "multi-list", required_argument, NULL, 'M' },
+		{ "single-list", required_argument, NULL, 'S' },
+		{ "class", required_argument, NULL, 'c' },
+		{ "class-file", required_argument, NULL, 'C' },
+		{ "default-class", required_argument, NULL, 'D' },
+		{ "results", required_argument, NULL, 'o' },
+		{ "dry-run", no_argument, NULL, 'n' },
+		{ "verbose", no_argument, NULL, 'v' },
+		{ "help", no_argument, NULL, 'h' },
+		{ NULL, 0, NULL, 0 }
+	};
+	const char *preload = getenv("LD_PRELOAD");
+	const char *default_class = NULL;
+	char **singles = NULL, **multi_lists = NULL, **single_lists = NULL;
+	unsigned num_singles = 0, num_multi_lists = 0, num_single_lists = 0;
+	unsigned i;
+	long cpus;
+	int c;
+
+	runner.test_dir = ".";
+	runner.timeout = DEFAULT_TIMEOUT;
+	runner.results = stdout;
+
+	cpus = sysconf(_SC_NPROCESSORS_ONLN);
+	runner.jobs = cpus > 0 ? cpus : 1;
+
+	/* every process gets its own fake device, nothing to contend on */
+	if (preload && strstr(preload, "intel_fake_drm"))
+		runner.default_class = CLASS_CPU;
+	else
+		runner.default_class = CLASS_GPU;
+
+	/*
+	 * Tests are queued only after all options are parsed, since the
+	 * class rules and test dir apply regardless of their position.
+	 */
+	while ((c = getopt_long(argc, argv, "j:t:d:s:c:o:nvh",
+				long_options, NULL)) != -1) {
+		switch (c) {
+		case 'j':
+			runner.jobs = strtoul(optarg, NULL, 0);
+			if (runner.jobs == 0)
+				runner.jobs = 1;
+			break;
+		case 't':
+			runner.timeout = atof(optarg);
+			break;
+		case 'd':
+			runner.test_dir = optarg;
+			break;
+		case 's':
+			singles = xrealloc(singles, (num_singles + 1) *
+					   sizeof(*singles));
+			singles[num_singles++] = optarg;
+			break;
+		case 'M':
+			multi_lists = xrealloc(multi_lists,
+					       (num_multi_lists + 1) *
+					       sizeof(*multi_lists));
+			multi_lists[num_multi_lists++] = optarg;
+			break;
+		case 'S':
+			single_lists = xrealloc(single_lists,
+						(num_single_lists + 1) *
+						sizeof(*single_lists));
+			single_lists[num_single_lists++] = optarg;
+			break;
+		case 'c':
+			parse_rule(optarg);
+			break;
+		case 'C':
+			read_class_file(optarg);
+			break;
+		case 'D':
+			default_class = optarg;
+			break;
+		case 'o':
+			runner.results = fopen(optarg, "w");
+			if (runner.results == NULL) {
+				perror(optarg);
+				return 1;
+			}
+			break;
+		case 'n':
+			runner.dry_run = true;
+			break;
+		case 'v':
+			runner.verbose = true;
+			break;
+		case 'h':
+			usage(argv[0]);
+			return 0;
+		default:
+			usage(argv[0]);
+			return 1;
+		}
+	}
+
+	if (default_class &&
+	    !parse_class(default_class, &runner.default_class)) {
+		fprintf(stderr, "unknown resource class '%s'\n", default_class);
+		return 1;
+	}
+
+	for (i = 0; i < num_multi_lists; i++)
+		read_test_list(multi_lists[i], true);
+	for (i = 0; i < num_single_lists; i++)
+		read_test_list(single_lists[i], false);
+	for (i = 0; i < num_singles; i++)
+		queue_job(singles[i], NULL);
+	for (i = optind; i < argc; i++) {
+		if (is_multi_test(argv[i]))
+			queue_subtests(argv[i]);
+		else
+			queue_job(argv[i], NULL);
+	}
+
+	if (runner.num_queued == 0) {
+		usage(argv[0]);
+		return 1;
+	}
+
+	if (runner.dry_run) {
+		for (i = 0; i < runner.num_queued; i++) {
+			struct job *job = &runner.queue[i];
+
+			printf("%s%s%s %s\n", job->test,
+			       job->subtest ? ":" : "", job->subtest ?: "",
+			       class_str[job->class]);
+		}
+		return 0;
+	}
+
+	run_all();
+
+	fprintf(stderr,
+		"%u jobs: %u pass, %u skip, %u fail, %u crash, %u timeout\n",
+		runner.num_queued,
+		runner.count[RESULT_PASS], runner.count[RESULT_SKIP],
+		runner.count[RESULT_FAIL], runner.count[RESULT_CRASH],
+		runner.count[RESULT_TIMEOUT]);
+
+	if (runner.results != stdout)
+		fclose(runner.results);
+
+	return runner.count[RESULT_FAIL] + runner.count[RESULT_CRASH] +
+		runner.count[RESULT_TIMEOUT] ? 1 : 0;
+}
@@ -27,6 +27,7 @@
 
 #define _GNU_SOURCE
 #include <stdint.h>
+#include <stdbool.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -34,16 +35,175 @@
 #include <unistd.h>
 #include <fcntl.h>
 #include <getopt.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 
 #include <intel_bufmgr.h>
+#include "intel_gpu_tools.h"
 
 struct drm_intel_decode *ctx;
+static uint32_t devid = 0xa011;
+
+/* the window of a binary dump to decode, in bytes */
+static uint64_t window_offset;
+static uint64_t window_length = UINT64_MAX;
+
+/* dwords read from a pipe at a time */
+#define CHUNK_DWORDS	16384
+
+/* libdrm takes the count as an int */
+#define MAX_DECODE_DWORDS	(1 << 30)
+
+/*
+ * How many of the count dwords at data make up whole packets, or all of
+ * them if the first packet's length is unknown or larger.
+ */
+static uint32_t
+whole_packets(const uint32_t *data, uint32_t count)
+{
+	uint32_t end = 0, len;
+
+	while (end < count) {
+		len = intel_command_dwords(devid, data[end]);
+		if (len == 0 || len > count - end)
+			break;
+		end += len;
+	}
+
+	return end ? end : count;
+}
+
+static void
+decode(uint32_t *data, uint64_t offset, uint32_t count)
+{
+	drm_intel_decode_set_batch_pointer(ctx, data, offset, count);
+	drm_intel_decode(ctx);
+}
+
+/*
+ * Regular files are mapped and the whole window decoded at once, so that
+ * no packet is cut in two. Only windows too large for libdrm are split.
+ */
+static int
+decode_mapped(int fd, uint64_t size)
+{
+	uint64_t start, end, map_start, count;
+	long page = sysconf(_SC_PAGESIZE);
+	uint32_t *data;
+	void *map;
+
+	start = window_offset & ~3ull;
+	if (start >= size)
+		return 0;
+	end = size - start > window_length ? start + window_length : size;
+	end = start + ((end - start) & ~3ull);
+	if (end == start)
+		return 0;
+
+	map_start = start & ~((uint64_t)page - 1);
+	map = mmap(NULL, end - map_start, PROT_READ, MAP_PRIVATE, fd,
+		   map_start);
+	if (map == MAP_FAILED)
+		return -1;
+
+	data = (uint32_t *)((char *)map + (start - map_start));
+	count = (end - start) / 4;
+	while (count) {
+		uint32_t n = count > MAX_DECODE_DWORDS ?
+			whole_packets(data, MAX_DECODE_DWORDS) : count;
+
+		decode(data, start, n);
+		data += n;
+		start += 4 * (uint64_t)n;
+		count -= n;
+	}
+
+	munmap(map, end - map_start);
+	return 0;
+}
+
+static uint64_t
+read_full(int fd, void *buf, uint64_t len)
+{
+	uint64_t done = 0;
+	ssize_t ret;
+
+	while (done < len) {
+		ret = read(fd, (char *)buf + done, len - done);
+		if (ret < 0 && errno == EINTR)
+			continue;
+		if (ret <= 0)
+			break;
+		done += ret;
+	}
+
+	return done;
+}
+
+/*
+ * Pipes are decoded a chunk at a time. A chunk is only decoded up to the
+ * last packet that it holds completely, the rest is carried over to the
+ * front of the next chunk. Should a packet of unknown length get in the
+ * way of a full buffer, it is decoded as is.
+ */
+static void
+decode_stream(int fd)
+{
+	uint32_t *buf;
+	uint64_t offset = 0, remaining = window_length;
+	size_t have = 0;	/* bytes at the start of buf */
+
+	buf = malloc(CHUNK_DWORDS * 4);
+	if (buf == NULL) {
+		fprintf(stderr, "Out of memory.\n");
+		exit(1);
+	}
+
+	while (offset < (window_offset & ~3ull)) {
+		uint64_t skip = (window_offset & ~3ull) - offset;
+
+		if (skip > CHUNK_DWORDS * 4)
+			skip = CHUNK_DWORDS * 4;
+		skip = read_full(fd, buf, skip);
+		if (skip == 0)
+			goto out;
+		offset += skip;
+	}
+
+	for (;;) {
+		uint64_t want = CHUNK_DWORDS * 4 - have, got;
+		uint32_t count, safe;
+		bool eof;
+
+		if (want > remaining)
+			want = remaining;
+		got = read_full(fd, (char *)buf + have, want);
+		remaining -= got;
+		have += got;
+		eof = got < want || remaining == 0;
+
+		count = have / 4;
+		safe = eof ? count : whole_packets(buf, count);
+
+		if (safe)
+			decode(buf, offset, safe);
+		offset += safe * 4;
+		have -= safe * 4;
+		memmove(buf, buf + safe, have);
+
+		if (eof)
+			break;
+	}
+
+out:
+	free(buf);
+}
 
 static void
 read_bin_file(const char * filename)
 {
-	uint32_t buf[16384];
-	int fd, offset, ret;
+	struct stat st;
+	int fd;
 
 	if (!strcmp(filename, "-"))
 		fd = fileno(stdin);
@@ -57,12 +217,10 @@ read_bin_file(const char * filename)
 
 	drm_intel_decode_set_dump_past_end(ctx, 1);
 
-	offset = 0;
-	while ((ret = read (fd, buf, sizeof(buf))) > 0) {
-		drm_intel_decode_set_batch_pointer(ctx, buf, offset, ret/4);
-		drm_intel_decode(ctx);
-		offset += ret;
-	}
+	if (fstat(fd, &st) || !S_ISREG(st.st_mode) ||
+	    decode_mapped(fd, st.st_size))
+		decode_stream(fd);
+
 	close (fd);
 }
 
@@ -157,7 +315,6 @@ read_autodetect_file(const char * filename)
 int
 main (int argc, char *argv[])
 {
-	uint32_t devid = 0xa011;
 	int i, c;
 	int option_index = 0;
 	int binary = -1;
@@ -165,10 +322,13 @@ main (int argc, char *argv[])
 	static struct option long_options[] = {
 		{"devid", 1, 0, 'd'},
 		{"ascii", 0, 0, 'a'},
-		{"binary", 0, 0, 'b'}
+		{"binary", 0, 0, 'b'},
+		{"offset", 1, 0, 'o'},
+		{"length", 1, 0, 'l'},
+		{0, 0, 0, 0}
 	};
 
-	while((c = getopt_long(argc, argv, "ab",
+	while((c = getopt_long(argc, argv, "abd:",
 			       long_options, &option_index)) != -1) {
 		switch(c) {
 		case 'd':
@@ -180,6 +340,12 @@ main (int argc, char *argv[])
 		case 'a':
 			binary = 0;
 			break;
+		case 'o':
+			window_offset = strtoull(optarg, NULL, 0);
+			break;
+		case 'l':
+			window_length = strtoull(optarg, NULL, 0);
+			break;
 		default:
 			printf("unkown command options\n");
 			break;
@@ -194,8 +360,8 @@ main (int argc, char *argv[])
 	}
 
 	for (i = optind; i < argc; i++) {
-		/* For stdin input, let's read as data file */
-		if (!strcmp(argv[i], "-")) {
+		/* For stdin input, let's read as data file unless told not to */
+		if (!strcmp(argv[i], "-") && binary != 1) {
 			read_data_file(argv[i]);
 			continue;
 		}
@@ -0,0 +1,747 @@
+/*
+ * Copyright © 2013 Intel Corporation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ *
+ */
+
+/*
+ * Sort a corpus of error states into clusters of hangs that look alike,
+ * so that a few root causes can be told apart from thousands of reports.
+ *
+ * A hang is reduced to a signature made of what doesn't change from one
+ * occurrence to the next: the generation, the hung ring, the opcode of the
+ * command that the ring was stuck at (IPEHR), the units that INSTDONE and
+ * INSTDONE1 report as busy, PGTBL_ER and the opcodes of the commands
+ * around ACTHD. Addresses, lengths and other operands are left out.
+ *
+ * The files are parsed by a pool of threads. The signatures are kept in a
+ * cache along with the size and mtime of their file, so that only new or
+ * changed files have to be parsed on the next run.
+ */
+
+#define _GNU_SOURCE
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <ftw.h>
+#include <time.h>
+#include <pthread.h>
+#include <sys/stat.h>
+#include <err.h>
+#include "intel_gpu_tools.h"
+#include "instdone.h"
+#include "intel_error_state.h"
+
+#define MAX_RINGS	8
+#define MAX_WINDOW	16
+
+/* what is kept of a ring to compute the signature */
+struct ring {
+	char name[16];
+	uint32_t head, tail, acthd, ipehr;
+	bool has_acthd, hung;
+
+	/* the opcodes around ACTHD, window[at] is the one at ACTHD */
+	uint32_t window[2 * MAX_WINDOW + 1];
+	int window_len, at;
+};
+
+struct hang {
+	struct ring rings[MAX_RINGS];
+	int num_rings;
+	uint32_t devid, instdone, instdone1, pgtbl_er;
+	long time;
+
+	const char *line;	/* the one the fields are from */
+};
+
+struct report {
+	char *path;
+	off_t size;
+	time_t mtime;
+
+	long time;
+	uint64_t signature;	/* 0 if the file isn't an error state */
+	char *description;
+
+	struct hang *hang;	/* only while it is being parsed */
+	bool failed;		/* couldn't be read, try again next time */
+};
+
+static struct {
+	struct report *reports;
+	int num, size;
+} corpus;
+
+static int window = 4;
+
+/*
+ * The opcode of a command header, without its length or any flags, so
+ * that the same command always looks the same.
+ */
+static uint32_t command_opcode(uint32_t devid, uint32_t header)
+{
+	switch (header >> 29) {
+	case 0:	/* MI */
+		return header & 0xff800000;
+	case 2:	/* 2D */
+		return header & 0xffc00000;
+	case 3:
+		if (IS_965(devid))
+			return header & 0xffff0000;
+		/* the 3DSTATE_*_1 commands have a sub-opcode */
+		if (((header >> 24) & 0x1f) >= 0x1c)
+			return header & 0xffff0000;
+		return header & 0xff000000;
+	default:
+		return header & 0xe0000000;
+	}
+}
+
+/* ACTHD may point at a command of unknown length, step over it anyway */
+static int command_len(uint32_t devid, uint32_t header)
+{
+	int len = intel_command_dwords(devid, header);
+
+	return len ? len : 1;
+}
+
+/* Walks the buffer from its start to find the commands around ACTHD. */
+static void find_window(struct hang *hang, struct ring *ring,
+			uint32_t gtt_offset, const uint32_t *dwords, int count)
+{
+	int before[MAX_WINDOW];
+	int i, k, n, len, target;
+
+	target = (ring->acthd - gtt_offset) / 4;
+
+	for (i = n = 0; i < count; i += len) {
+		len = command_len(hang->devid, dwords[i]);
+		if (i + len > target)
+			break;
+		before[n++ % MAX_WINDOW] = i;
+	}
+	if (i >= count)
+		return;
+
+	ring->window_len = 0;
+	for (k = n > window ? n - window : 0; k < n; k++)
+		ring->window[ring->window_len++] =
+			command_opcode(hang->devid,
+				       dwords[before[k % MAX_WINDOW]]);
+	ring->at = ring->window_len;
+
+	for (k = 0; k <= window && i < count; k++, i += len) {
+		ring->window[ring->window_len++] =
+			command_opcode(hang->devid, dwords[i]);
+		len = command_len(hang->devid, dwords[i]);
+	}
+}
+
+static void parse_line(void *data, const char *line)
+{
+	struct hang *hang = data;
+
+	hang->line = line;
+}
+
+static void parse_field(void *data, enum error_state_field field, int ring,
+			uint64_t value)
+{
+	struct hang *hang = data;
+	struct ring *r = NULL;
+
+	if (ring >= 0 && ring < MAX_RINGS)
+		r = &hang->rings[ring];
+
+	switch (field) {
+	case ERROR_STATE_TIME:
+		if (hang->time == 0)
+			hang->time = value;
+		break;
+	case ERROR_STATE_PCI_ID:
+		hang->devid = value;
+		break;
+	case ERROR_STATE_RING:
+		if (r == NULL)
+			break;
+		hang->num_rings = ring + 1;
+		sscanf(hang->line, "%15s", r->name);
+		break;
+	case ERROR_STATE_HEAD:
+		if (r)
+			r->head = value & (0x7ffff << 2);
+		break;
+	case ERROR_STATE_TAIL:
+		if (r)
+			r->tail = value & (0x7ffff << 2);
+		break;
+	case ERROR_STATE_ACTHD:
+		if (r) {
+			r->acthd = value;
+			r->has_acthd = true;
+		}
+		break;
+	case ERROR_STATE_IPEHR:
+		if (r)
+			r->ipehr = value;
+		break;
+	case ERROR_STATE_HUNG:
+		if (r)
+			r->hung = true;
+		break;
+	case ERROR_STATE_INSTDONE:
+		/* the render ring's, whether it hung or not */
+		if (ring <= 0)
+			hang->instdone = value;
+		break;
+	case ERROR_STATE_INSTDONE1:
+		hang->instdone1 = value;
+		break;
+	case ERROR_STATE_PGTBL_ER:
+		hang->pgtbl_er = value;
+		break;
+	default:
+		break;
+	}
+}
+
+static void parse_buffer(void *data, const char *ring_name, bool is_batch,
+			 uint32_t gtt_offset, const uint32_t *dwords, int count)
+{
+	struct hang *hang = data;
+	int i;
+
+	for (i = 0; i < hang->num_rings; i++) {
+		struct ring *r = &hang->rings[i];
+
+		if (!r->has_acthd || r->window_len)
+			continue;
+		if (r->acthd < gtt_offset ||
+		    r->acthd - gtt_offset >= (uint32_t)count * 4)
+			continue;
+
+		find_window(hang, r, gtt_offset, dwords, count);
+	}
+}
+
+static struct hang *parse_file(struct report *r)
+{
+	static const struct error_state_ops ops = {
+		.line = parse_line,
+		.field = parse_field,
+		.buffer = parse_buffer,
+	};
+	struct hang *hang;
+	FILE *file;
+	int ret;
+
+	hang = calloc(1, sizeof(*hang));
+	if (hang == NULL)
+		err(1, "calloc");
+	hang->instdone = hang->instdone1 = 0xffffffff;
+
+	file = fopen(r->path, "r");
+	if (file == NULL) {
+		warn("%s", r->path);
+		r->failed = true;
+		free(hang);
+		return NULL;
+	}
+	ret = intel_error_state_parse(file, &ops, hang);
+	if (ret) {
+		warn("%s", r->path);
+		r->failed = true;
+	}
+	fclose(file);
+
+	if (ret || hang->devid == 0) {
+		free(hang);
+		return NULL;
+	}
+	return hang;
+}
+
+/*
+ * The ring hangcheck gave up on, or else the first one that still had
+ * commands to run.
+ */
+static struct ring *hung_ring(struct hang *hang)
+{
+	int i;
+
+	for (i = 0; i < hang->num_rings; i++)
+		if (hang->rings[i].hung)
+			return &hang->rings[i];
+	for (i = 0; i < hang->num_rings; i++)
+		if (hang->rings[i].head != hang->rings[i].tail)
+			return &hang->rings[i];
+	return hang->num_rings ? &hang->rings[0] : NULL;
+}
+
+#define APPEND(str, size, len, fmt, ...) \
+	(len) += snprintf((str) + (len), (len) < (size) ? (size) - (len) : 0, \
+			  fmt, ##__VA_ARGS__)
+
+/*
+ * The description holds everything that makes up the signature and
+ * nothing else, so the signature is simply its hash.
+ */
+static char *describe(struct hang *hang)
+{
+	static uint32_t devid;
+	struct ring *ring = hung_ring(hang);
+	uint64_t done = (uint64_t)hang->instdone1 << 32 | hang->instdone;
+	char str[1024];
+	int i, len = 0;
+
+	if (devid != hang->devid) {
+		devid = hang->devid;
+		num_instdone_bits = 0;
+		init_instdone_definitions(devid);
+	}
+
+	APPEND(str, sizeof(str), len, "gen%d %s: IPEHR 0x%08x, busy",
+	       intel_gen(hang->devid), ring ? ring->name : "?",
+	       ring ? command_opcode(hang->devid, ring->ipehr) : 0);
+
+	for (i = 0; i < num_instdone_bits; i++)
+		if ((done >> instdone_bit_index(&instdone_bits[i]) & 1) == 0)
+			APPEND(str, sizeof(str), len, " %s",
+			       instdone_bits[i].name);
+
+	APPEND(str, sizeof(str), len, ", PGTBL_ER 0x%08x, at",
+	       hang->pgtbl_er);
+
+	if (ring == NULL || ring->window_len == 0)
+		APPEND(str, sizeof(str), len, " ?");
+	else for (i = 0; i < ring->window_len; i++)
+		APPEND(str, sizeof(str), len, i == ring->at ?
+		       " [0x%08x]" : " 0x%08x", ring->window[i]);
+
+	return strdup(str);
+}
+
+/* FNV-1a, never 0 since that stands for no signature */
+static uint64_t hash(const char *str)
+{
+	uint64_t h = 0xcbf29ce484222325ull;
+
+	while (*str) {
+		h ^= (unsigned char)*str++;
+		h *= 0x100000001b3ull;
+	}
+	return h ? h : 1;
+}
+
+static struct report *add_report(const char *path, const struct stat *st)
+{
+	struct report *r;
+
+	if (corpus.num == corpus.size) {
+		corpus.size = corpus.size ? corpus.size * 2 : 1024;
+		corpus.reports = realloc(corpus.reports,
+					 corpus.size * sizeof(*r));
+		if (corpus.reports == NULL)
+			err(1, "realloc");
+	}
+
+	r = &corpus.reports[corpus.num++];
+	memset(r, 0, sizeof(*r));
+	r->path = strdup(path);
+	r->size = st->st_size;
+	r->mtime = st->st_mtime;
+	if (r->path == NULL)
+		err(1, "strdup");
+	return r;
+}
+
+static int add_file(const char *path, const struct stat *st, int type,
+		    struct FTW *ftw)
+{
+	if (type == FTW_F && S_ISREG(st->st_mode))
+		add_report(path, st);
+	return 0;
+}
+
+static int cmp_path(const void *a, const void *b)
+{
+	const struct report *ra = a, *rb = b;
+
+	return strcmp(ra->path, rb->path);
+}
+
+/*
+ * The cache is a text file with a line per file that was looked at:
+ *
+ *	size mtime time signature description path
+ *
+ * separated by tabs. Files that turned out not to be error states have a
+ * signature of 0. It is only good for the window it was made with.
+ */
+#define CACHE_HEADER	"# intel_error_cluster cache 1, window %d\n"
+
+static struct report *read_cache(const char *path, int *num)
+{
+	struct report *cache = NULL;
+	int size = 0, n = 0, w;
+	size_t line_size = 0;
+	char *line = NULL;
+	FILE *file;
+
+	*num = 0;
+	file = fopen(path, "r");
+	if (file == NULL) {
+		if (errno != ENOENT)
+			warn("%s", path);
+		return NULL;
+	}
+
+	if (getline(&line, &line_size, file) < 0 ||
+	    sscanf(line, CACHE_HEADER, &w) != 1 || w != window)
+		goto out;
+
+	while (getline(&line, &line_size, file) > 0) {
+		long long size_, mtime;
+		unsigned long long sig;
+		long time;
+		int desc, end;
+
+		line[strcspn(line, "\n")] = '\0';
+		if (sscanf(line, "%lld\t%lld\t%ld\t%llx\t%n%*[^\t]%n",
+			   &size_, &mtime, &time, &sig, &desc, &end) != 4 ||
+		    line[end] != '\t')
+			continue;
+		line[end] = '\0';
+
+		if (n == size) {
+			size = size ? size * 2 : 1024;
+			cache = realloc(cache, size * sizeof(*cache));
+			if (cache == NULL)
+				err(1, "realloc");
+		}
+
+		cache[n].path = strdup(line + end + 1);
+		cache[n].size = size_;
+		cache[n].mtime = mtime;
+		cache[n].time = time;
+		cache[n].signature = sig;
+		cache[n].description = strdup(line + desc);
+		cache[n].hang = NULL;
+		n++;
+	}
+
+	qsort(cache, n, sizeof(*cache), cmp_path);
+	*num = n;
+out:
+	free(line);
+	fclose(file);
+	return cache;
+}
+
+static void write_cache(const char *path)
+{
+	char *tmp;
+	FILE *file;
+	int i;
+
+	if (asprintf(&tmp, "%s.tmp", path) < 0)
+		err(1, "asprintf");
+
+	file = fopen(tmp, "w");
+	if (file == NULL) {
+		warn("%s", tmp);
+		free(tmp);
+		return;
+	}
+
+	fprintf(file, CACHE_HEADER, window);
+	for (i = 0; i < corpus.num; i++) {
+		struct report *r = &corpus.reports[i];
+
+		if (r->failed)
+			continue;
+
+		fprintf(file, "%lld\t%lld\t%ld\t%016llx\t%s\t%s\n",
+			(long long)r->size, (long long)r->mtime, r->time,
+			(unsigned long long)r->signature,
+			r->description ? r->description : "-", r->path);
+	}
+
+	/* replace the old cache only once the new one is complete */
+	if (fclose(file) || rename(tmp, path))
+		warn("%s", path);
+	free(tmp);
+}
+
+static struct {
+	struct report **todo;
+	int num;
+	int next;
+} work;
+
+static void *worker(void *arg)
+{
+	int i;
+
+	while ((i = __sync_fetch_and_add(&work.next, 1)) < work.num)
+		work.todo[i]->hang = parse_file(work.todo[i]);
+
+	return NULL;
+}
+
+static void parse_all(int jobs)
+{
+	pthread_t *threads;
+	int i, started;
+
+	if (jobs > work.num)
+		jobs = work.num;
+	if (jobs <= 1) {
+		worker(NULL);
+		return;
+	}
+
+	threads = calloc(jobs, sizeof(*threads));
+	if (threads == NULL)
+		err(1, "calloc");
+
+	/* the main thread is a worker too, if threads couldn't be started */
+	for (started = 0; started < jobs; started++)
+		if (pthread_create(&threads[started], NULL, worker, NULL))
+			break;
+	worker(NULL);
+	for (i = 0; i < started; i++)
+		pthread_join(threads[i], NULL);
+
+	free(threads);
+}
+
+struct cluster {
+	uint64_t signature;
+	const char *description;
+	int count;
+	long first, last;
+	const char *exemplar;	/* the earliest hang */
+};
+
+static int cmp_signature(const void *a, const void *b)
+{
+	const struct report *ra = a, *rb = b;
+
+	if (ra->signature != rb->signature)
+		return ra->signature < rb->signature ? -1 : 1;
+	return ra->time < rb->time ? -1 : ra->time > rb->time;
+}
+
+static int cmp_count(const void *a, const void *b)
+{
+	const struct cluster *ca = a, *cb = b;
+
+	if (ca->count != cb->count)
+		return cb->count - ca->count;
+	return cb->last < ca->last ? -1 : cb->last > ca->last;
+}
+
+static const char *format_time(long t, char *str, size_t size)
+{
+	time_t tt = t;
+	struct tm tm;
+
+	strftime(str, size, "%Y-%m-%d %H:%M:%S", localtime_r(&tt, &tm));
+	return str;
+}
+
+static int print_clusters(void)
+{
+	struct cluster *clusters, *c = NULL;
+	char first[32], last[32];
+	int i, n = 0;
+
+	qsort(corpus.reports, corpus.num, sizeof(*corpus.reports),
+	      cmp_signature);
+
+	clusters = calloc(corpus.num, sizeof(*clusters));
+	if (clusters == NULL && corpus.num)
+		err(1, "calloc");
+
+	for (i = 0; i < corpus.num; i++) {
+		struct report *r = &corpus.reports[i];
+
+		if (r->signature == 0)
+			continue;
+
+		/* the reports are in time order within a cluster */
+		if (n == 0 || c->signature != r->signature) {
+			c = &clusters[n++];
+			c->signature = r->signature;
+			c->description = r->description;
+			c->first = r->time;
+			c->exemplar = r->path;
+		}
+		c->count++;
+		c->last = r->time;
+	}
+
+	qsort(clusters, n, sizeof(*clusters), cmp_count);
+
+	printf("%6s  %-19s  %-19s  %-16s  %s\n",
+	       "count", "first seen", "last seen", "signature", "exemplar");
+	for (i = 0; i < n; i++) {
+		c = &clusters[i];
+		printf("%6d  %s  %s  %016llx  %s\n", c->count,
+		       format_time(c->first, first, sizeof(first)),
+		       format_time(c->last, last, sizeof(last)),
+		       (unsigned long long)c->signature, c->exemplar);
+		printf("%6s  %s\n", "", c->description);
+	}
+
+	free(clusters);
+	return n;
+}
+
+static void usage(const char *name)
+{
+	printf("Usage: %s [options] path...\n"
+	       "Options:\n"
+	       "  -c file    keep the signatures in 'file' and only parse the\n"
+	       "             error states that aren't in it yet\n"
+	       "  -j jobs    parse with 'jobs' threads (default one per cpu)\n"
+	       "  -w num     include 'num' commands on each side of ACTHD in the\n"
+	       "             signature (default %d)\n"
+	       "  -h         prints this help\n"
+	       "Paths are error states or directories of them.\n",
+	       name, window);
+}
+
+int main(int argc, char **argv)
+{
+	struct report *cache;
+	const char *cache_path = NULL;
+	int jobs, num_cached, skipped = 0, clusters;
+	int opt, i;
+
+	jobs = sysconf(_SC_NPROCESSORS_ONLN);
+
+	while ((opt = getopt(argc, argv, "c:j:w:h")) != -1) {
+		switch (opt) {
+		case 'c':
+			cache_path = optarg;
+			break;
+		case 'j':
+			jobs = atoi(optarg);
+			break;
+		case 'w':
+			window = atoi(optarg);
+			if (window < 0 || window > MAX_WINDOW)
+				errx(1, "the window is at most %d commands",
+				     MAX_WINDOW);
+			break;
+		case 'h':
+			usage(argv[0]);
+			return 0;
+		default:
+			usage(argv[0]);
+			return 1;
+		}
+	}
+
+	if (optind == argc) {
+		usage(argv[0]);
+		return 1;
+	}
+
+	for (i = optind; i < argc; i++)
+		if (nftw(argv[i], add_file, 16, FTW_PHYS))
+			err(1, "%s", argv[i]);
+
+	cache = cache_path ? read_cache(cache_path, &num_cached) : NULL;
+	if (cache == NULL)
+		num_cached = 0;
+
+	work.todo = calloc(corpus.num, sizeof(*work.todo));
+	if (work.todo == NULL && corpus.num)
+		err(1, "calloc");
+
+	for (i = 0; i < corpus.num; i++) {
+		struct report *r = &corpus.reports[i], *c;
+
+		c = bsearch(r, cache, num_cached, sizeof(*cache), cmp_path);
+		if (c && c->size == r->size && c->mtime == r->mtime) {
+			r->time = c->time;
+			r->signature = c->signature;
+			r->description = c->description;
+			c->description = NULL;
+			continue;
+		}
+
+		work.todo[work.num++] = r;
+	}
+
+	parse_all(jobs);
+
+	for (i = 0; i < work.num; i++) {
+		struct report *r = work.todo[i];
+
+		if (r->hang == NULL)
+			continue;
+
+		r->description = describe(r->hang);
+		if (r->description == NULL)
+			err(1, "strdup");
+		r->signature = hash(r->description);
+		r->time = r->hang->time ? r->hang->time : r->mtime;
+
+		free(r->hang);
+		r->hang = NULL;
+	}
+
+	for (i = 0; i < corpus.num; i++)
+		if (corpus.reports[i].signature == 0 &&
+		    !corpus.reports[i].failed)
+			skipped++;
+
+	if (cache_path)
+		write_cache(cache_path);
+
+	clusters = print_clusters();
+
+	fprintf(stderr, "%d files, %d parsed, %d not error states, %d clusters\n",
+		corpus.num, work.num, skipped, clusters);
+
+	for (i = 0; i < num_cached; i++) {
+		free(cache[i].path);
+		free(cache[i].description);
+	}
+	free(cache);
+	for (i = 0; i < corpus.num; i++) {
+		free(corpus.reports[i].path);
+		free(corpus.reports[i].description);
+	}
+	free(corpus.reports);
+	free(work.todo);
+
+	return 0;
+}
@@ -54,6 +54,7 @@
 #include "intel_chipset.h"
 #include "intel_gpu_tools.h"
 #include "instdone.h"
+#include "intel_error_state.h"
 
 static uint32_t
 print_head(unsigned int reg)
@@ -312,6 +313,8 @@ int num_rings = -1;
 static void print_batch(int is_batch, const char *ring_name, uint32_t gtt_offset)
 {
 	const char *buffer_type[2] = {  "ringbuffer", "batchbuffer" };
+	if (num_rings == -1)
+		num_rings = head_ndx;
 	if (is_batch) {
 		printf("%s (%s) at 0x%08x\n", buffer_type[is_batch], ring_name, gtt_offset);
 	} else {
@@ -319,162 +322,90 @@ static void print_batch(int is_batch, const char *ring_name, uint32_t gtt_offset
 	}
 }
 
+struct decode_state {
+	struct drm_intel_decode *decode_ctx;
+	uint32_t devid;
+	uint32_t ring_length;
+};
+
 static void
-read_data_file(FILE *file)
+decode_line(void *data, const char *line)
 {
-	struct drm_intel_decode *decode_ctx = NULL;
-	uint32_t devid = PCI_CHIP_I855_GM;
-	uint32_t *data = NULL;
-	long long unsigned fence;
-	int data_size = 0, count = 0, line_number = 0, matched;
-	char *line = NULL;
-	size_t line_size;
-	uint32_t offset, value, ring_length = 0;
-	uint32_t gtt_offset = 0, new_gtt_offset;
-	char *ring_name = NULL;
-	int is_batch = 1;
-
-	while (getline(&line, &line_size, file) > 0) {
-		char *dashes;
-		line_number++;
-
-		dashes = strstr(line, "---");
-		if (dashes) {
-			char *new_ring_name = malloc(dashes - line);
-			strncpy(new_ring_name, line, dashes - line);
-			new_ring_name[dashes - line - 1] = '\0';
-
-			if (num_rings == -1)
-				num_rings = head_ndx;
-
-			matched = sscanf(dashes, "--- gtt_offset = 0x%08x\n",
-					&new_gtt_offset);
-			if (matched == 1) {
-				if (count) {
-					print_batch(is_batch, ring_name, gtt_offset);
-					drm_intel_decode_set_batch_pointer(decode_ctx,
-							data, gtt_offset,
-							count);
-					drm_intel_decode(decode_ctx);
-					count = 0;
-				}
-				gtt_offset = new_gtt_offset;
-				is_batch = 1;
-				free(ring_name);
-				ring_name = new_ring_name;
-				continue;
-			}
-
-			matched = sscanf(dashes, "--- ringbuffer = 0x%08x\n",
-					&new_gtt_offset);
-			if (matched == 1) {
-				if (count) {
-					print_batch(is_batch, ring_name, gtt_offset);
-					drm_intel_decode_set_batch_pointer(decode_ctx,
-							data, gtt_offset,
-							count);
-					drm_intel_decode(decode_ctx);
-					count = 0;
-				}
-				gtt_offset = new_gtt_offset;
-				is_batch = 0;
-				free(ring_name);
-				ring_name = new_ring_name;
-				continue;
-			}
-		}
-
-		matched = sscanf(line, "%08x : %08x", &offset, &value);
-		if (matched != 2) {
-			unsigned int reg;
-
-			/* display reg section is after the ringbuffers, don't mix them */
-			if (count) {
-				print_batch(is_batch, ring_name, gtt_offset);
-				drm_intel_decode_set_batch_pointer(decode_ctx,
-						data, gtt_offset,
-						count);
-				drm_intel_decode(decode_ctx);
-				count = 0;
-			}
-
-			printf("%s", line);
-
-			matched = sscanf(line, "PCI ID: 0x%04x\n", &reg);
-			if (matched == 0)
-				matched = sscanf(line, " PCI ID: 0x%04x\n", &reg);
-			if (matched == 0) {
-				const char *pci_id_start = strstr(line, "PCI ID");
-				if (pci_id_start)
-					matched = sscanf(pci_id_start, "PCI ID: 0x%04x\n", &reg);
-			}
-			if (matched == 1) {
-				devid = reg;
-				printf("Detected GEN%i chipset\n",
-						intel_gen(devid));
-
-				decode_ctx = drm_intel_decode_context_alloc(devid);
-			}
-
-			matched = sscanf(line, "  CTL: 0x%08x\n", &reg);
-			if (matched == 1)
-				ring_length = print_ctl(reg);
-
-			matched = sscanf(line, "  HEAD: 0x%08x\n", &reg);
-			if (matched == 1) {
-				head[head_ndx++] = print_head(reg);
-			}
-
-			matched = sscanf(line, "  ACTHD: 0x%08x\n", &reg);
-			if (matched == 1) {
-				print_acthd(reg, ring_length);
-				drm_intel_decode_set_head_tail(decode_ctx, reg, 0xffffffff);
-			}
-
-			matched = sscanf(line, "  PGTBL_ER: 0x%08x\n", &reg);
-			if (matched == 1 && reg)
-				print_pgtbl_err(reg, devid);
-
-			matched = sscanf(line, "  INSTDONE: 0x%08x\n", &reg);
-			if (matched == 1)
-				print_instdone(devid, reg, -1);
-
-			matched = sscanf(line, "  INSTDONE1: 0x%08x\n", &reg);
-			if (matched == 1)
-				print_instdone(devid, -1, reg);
-
-			matched = sscanf(line, "  fence[%i] = %Lx\n", &reg, &fence);
-			if (matched == 2)
-				print_fence(devid, fence);
-
-			continue;
-		}
+	printf("%s", line);
+}
 
-		count++;
+static void
+decode_field(void *data, enum error_state_field field, int ring,
+	     uint64_t value)
+{
+	struct decode_state *state = data;
+	uint32_t reg = value;
+
+	switch (field) {
+	case ERROR_STATE_PCI_ID:
+		state->devid = reg;
+		printf("Detected GEN%i chipset\n", intel_gen(state->devid));
+
+		state->decode_ctx = drm_intel_decode_context_alloc(state->devid);
+		break;
+	case ERROR_STATE_CTL:
+		state->ring_length = print_ctl(reg);
+		break;
+	case ERROR_STATE_HEAD:
+		head[head_ndx++] = print_head(reg);
+		break;
+	case ERROR_STATE_ACTHD:
+		print_acthd(reg, state->ring_length);
+		drm_intel_decode_set_head_tail(state->decode_ctx, reg, 0xffffffff);
+		break;
+	case ERROR_STATE_PGTBL_ER:
+		if (reg)
+			print_pgtbl_err(reg, state->devid);
+		break;
+	case ERROR_STATE_INSTDONE:
+		print_instdone(state->devid, reg, -1);
+		break;
+	case ERROR_STATE_INSTDONE1:
+		print_instdone(state->devid, -1, reg);
+		break;
+	case ERROR_STATE_FENCE:
+		print_fence(state->devid, value);
+		break;
+	default:
+		break;
+	}
+}
 
-		if (count > data_size) {
-			data_size = data_size ? data_size * 2 : 1024;
-			data = realloc(data, data_size * sizeof (uint32_t));
-			if (data == NULL) {
-				fprintf(stderr, "Out of memory.\n");
-				exit(1);
-			}
-		}
+static void
+decode_buffer(void *data, const char *ring_name, bool is_batch,
+	      uint32_t gtt_offset, const uint32_t *dwords, int count)
+{
+	struct decode_state *state = data;
 
-		data[count-1] = value;
-	}
+	print_batch(is_batch, ring_name, gtt_offset);
+	drm_intel_decode_set_batch_pointer(state->decode_ctx,
+			(uint32_t *)dwords, gtt_offset,
+			count);
+	drm_intel_decode(state->decode_ctx);
+}
 
-	if (count) {
-		print_batch(is_batch, ring_name, gtt_offset);
-		drm_intel_decode_set_batch_pointer(decode_ctx,
-				data, gtt_offset,
-				count);
-		drm_intel_decode(decode_ctx);
+static void
+read_data_file(FILE *file)
+{
+	static const struct error_state_ops ops = {
+		.line = decode_line,
+		.field = decode_field,
+		.buffer = decode_buffer,
+	};
+	struct decode_state state = {
+		.devid = PCI_CHIP_I855_GM,
+	};
+
+	if (intel_error_state_parse(file, &ops, &state)) {
+		fprintf(stderr, "Failed to read the error state: %s\n",
+				strerror(errno));
+		exit(1);
 	}
-
-	free(data);
-	free(line);
-	free(ring_name);
 }
 
 int
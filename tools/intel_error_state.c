@@ -0,0 +1,185 @@
+/*
+ * Copyright © 2013 Intel Corporation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ *
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+#include "intel_error_state.h"
+
+struct parser {
+	const struct error_state_ops *ops;
+	void *data;
+
+	uint32_t *dwords;
+	int size, count;
+	char *ring_name;
+	bool is_batch;
+	uint32_t gtt_offset;
+	int ring;
+};
+
+static void flush(struct parser *p)
+{
+	if (p->count == 0)
+		return;
+
+	if (p->ops->buffer)
+		p->ops->buffer(p->data, p->ring_name, p->is_batch,
+			       p->gtt_offset, p->dwords, p->count);
+	p->count = 0;
+}
+
+static void field(struct parser *p, enum error_state_field field,
+		  uint64_t value)
+{
+	if (p->ops->field)
+		p->ops->field(p->data, field, p->ring, value);
+}
+
+static bool parse_buffer_header(struct parser *p, const char *line,
+				const char *dashes)
+{
+	uint32_t gtt_offset;
+	bool is_batch;
+	char *name;
+
+	if (sscanf(dashes, "--- gtt_offset = 0x%08x\n", &gtt_offset) == 1)
+		is_batch = true;
+	else if (sscanf(dashes, "--- ringbuffer = 0x%08x\n", &gtt_offset) == 1)
+		is_batch = false;
+	else
+		return false;
+
+	name = strndup(line, dashes > line ? dashes - line - 1 : 0);
+	if (name == NULL)
+		return false;
+
+	flush(p);
+	free(p->ring_name);
+	p->ring_name = name;
+	p->is_batch = is_batch;
+	p->gtt_offset = gtt_offset;
+	return true;
+}
+
+static void parse_fields(struct parser *p, const char *line)
+{
+	long long unsigned fence;
+	const char *s;
+	unsigned int reg, n;
+	char state[16];
+	long secs;
+
+	if (sscanf(line, "Time: %ld s", &secs) == 1)
+		field(p, ERROR_STATE_TIME, secs);
+
+	s = strstr(line, "PCI ID");
+	if (s && sscanf(s, "PCI ID: 0x%04x\n", &reg) == 1)
+		field(p, ERROR_STATE_PCI_ID, reg);
+
+	s = strstr(line, " command stream:");
+	if (s && s > line && strchr(line, ' ') == s) {
+		field(p, ERROR_STATE_RING, ++p->ring);
+		return;
+	}
+
+	if (sscanf(line, "  CTL: 0x%08x\n", &reg) == 1)
+		field(p, ERROR_STATE_CTL, reg);
+	if (sscanf(line, "  HEAD: 0x%08x\n", &reg) == 1)
+		field(p, ERROR_STATE_HEAD, reg);
+	if (sscanf(line, "  TAIL: 0x%08x\n", &reg) == 1)
+		field(p, ERROR_STATE_TAIL, reg);
+	if (sscanf(line, "  ACTHD: 0x%08x\n", &reg) == 1)
+		field(p, ERROR_STATE_ACTHD, reg);
+	if (sscanf(line, "  IPEHR: 0x%08x\n", &reg) == 1)
+		field(p, ERROR_STATE_IPEHR, reg);
+	if (sscanf(line, "  PGTBL_ER: 0x%08x\n", &reg) == 1)
+		field(p, ERROR_STATE_PGTBL_ER, reg);
+	if (sscanf(line, "  INSTDONE: 0x%08x\n", &reg) == 1)
+		field(p, ERROR_STATE_INSTDONE, reg);
+	if (sscanf(line, "  INSTDONE1: 0x%08x\n", &reg) == 1)
+		field(p, ERROR_STATE_INSTDONE1, reg);
+	if (sscanf(line, "  fence[%i] = %Lx\n", &n, &fence) == 2)
+		field(p, ERROR_STATE_FENCE, fence);
+	if (sscanf(line, "  hangcheck: %15s", state) == 1 &&
+	    strcmp(state, "hung") == 0)
+		field(p, ERROR_STATE_HUNG, 1);
+}
+
+int intel_error_state_parse(FILE *file, const struct error_state_ops *ops,
+			    void *data)
+{
+	struct parser p = { .ops = ops, .data = data, .is_batch = true,
+			    .ring = -1 };
+	uint32_t offset, value;
+	size_t line_size = 0;
+	char *line = NULL;
+	int ret = 0;
+
+	while (getline(&line, &line_size, file) > 0) {
+		char *dashes;
+
+		dashes = strstr(line, "---");
+		if (dashes && parse_buffer_header(&p, line, dashes))
+			continue;
+
+		if (sscanf(line, "%08x : %08x", &offset, &value) != 2) {
+			/* display reg section is after the ringbuffers, don't mix them */
+			flush(&p);
+
+			if (ops->line)
+				ops->line(data, line);
+			parse_fields(&p, line);
+			continue;
+		}
+
+		if (p.count == p.size) {
+			uint32_t *dwords;
+			int size = p.size ? p.size * 2 : 1024;
+
+			dwords = realloc(p.dwords, size * sizeof(uint32_t));
+			if (dwords == NULL) {
+				ret = -1;
+				break;
+			}
+			p.dwords = dwords;
+			p.size = size;
+		}
+
+		p.dwords[p.count++] = value;
+	}
+
+	if (ferror(file))
+		ret = -1;
+	if (ret == 0)
+		flush(&p);
+
+	free(p.dwords);
+	free(p.ring_name);
+	free(line);
+	return ret;
+}
@@ -0,0 +1,73 @@
+/*
+ * Copyright © 2013 Intel Corporation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ *
+ */
+
+#ifndef INTEL_ERROR_STATE_H
+#define INTEL_ERROR_STATE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+
+/*
+ * A parser for the i915_error_state format, shared by intel_error_decode
+ * and intel_error_cluster. It only splits the file up, what to do with the
+ * pieces is left to the callbacks, each of which may be NULL.
+ *
+ * Every line that isn't part of a buffer dump is passed to line(), followed
+ * by a call to field() for each register or value recognized on it. The
+ * dumps are passed to buffer() as a whole, before the line that ends them.
+ *
+ * The parser keeps no state of its own, so several files can be parsed at
+ * once from different threads.
+ */
+enum error_state_field {
+	ERROR_STATE_TIME,	/* seconds */
+	ERROR_STATE_PCI_ID,
+	ERROR_STATE_RING,	/* a ring section starts, value is its index */
+	ERROR_STATE_CTL,
+	ERROR_STATE_HEAD,
+	ERROR_STATE_TAIL,
+	ERROR_STATE_ACTHD,
+	ERROR_STATE_IPEHR,
+	ERROR_STATE_PGTBL_ER,
+	ERROR_STATE_INSTDONE,
+	ERROR_STATE_INSTDONE1,
+	ERROR_STATE_FENCE,
+	ERROR_STATE_HUNG,	/* hangcheck declared the ring hung */
+};
+
+struct error_state_ops {
+	void (*line)(void *data, const char *line);
+	/* ring is the index of the last ring section seen, or -1 */
+	void (*field)(void *data, enum error_state_field field, int ring,
+		      uint64_t value);
+	void (*buffer)(void *data, const char *ring_name, bool is_batch,
+		       uint32_t gtt_offset, const uint32_t *dwords, int count);
+};
+
+/* Returns 0, or -1 with errno set if reading failed or ran out of memory */
+int intel_error_state_parse(FILE *file, const struct error_state_ops *ops,
+			    void *data);
+
+#endif /* INTEL_ERROR_STATE_H */
@@ -0,0 +1,1261 @@
+/*
+ * Copyright © 2013 Intel Corporation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ *
+ */
+
+/*
+ * Request statistics from the i915 tracepoints, as recorded by trace-cmd
+ * or perf: how long requests take to complete, how long the rings sit
+ * idle in between, how long clients wait for them and how often they get
+ * throttled.
+ *
+ * The file is mapped as a whole. The per-cpu buffers of trace-cmd, or the
+ * runs of records in time order of perf, are merged by timestamp with a
+ * heap, so only the requests in flight and the completions since the last
+ * throttle are kept in memory.
+ */
+
+#define _GNU_SOURCE
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <getopt.h>
+#include <byteswap.h>
+#include <endian.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <linux/perf_event.h>
+
+#define TRACECMD_MAGIC	"\027\010\104tracing"
+#define PERF_MAGIC	"PERFILE2"
+
+/* the sample layout the overlay asks perf for */
+#define OVERLAY_SAMPLE_TYPE \
+	(PERF_SAMPLE_TIME | PERF_SAMPLE_STREAM_ID | PERF_SAMPLE_TID | \
+	 PERF_SAMPLE_RAW)
+
+#define MAX_RINGS 8
+
+enum kind {
+	REQUEST_ADD,
+	REQUEST_COMPLETE,
+	WAIT_BEGIN,
+	WAIT_END,
+	THROTTLE_BEGIN,
+	THROTTLE_END,
+	NUM_KINDS,
+	NO_KIND = 0xff
+};
+
+static struct {
+	const char *name;
+	bool known;
+	int ring_offset, ring_size;
+	int seqno_offset, seqno_size;
+} kinds[NUM_KINDS] = {
+	[REQUEST_ADD] = { "i915_gem_request_add" },
+	[REQUEST_COMPLETE] = { "i915_gem_request_complete" },
+	[WAIT_BEGIN] = { "i915_gem_request_wait_begin" },
+	[WAIT_END] = { "i915_gem_request_wait_end" },
+	[THROTTLE_BEGIN] = { "i915_gem_request_throttle_begin" },
+	[THROTTLE_END] = { "i915_gem_request_throttle_end" },
+};
+
+/* by tracepoint id */
+static uint8_t kind_of[65536];
+
+struct event {
+	uint64_t ts;
+	enum kind kind;
+	uint32_t ring, seqno;
+	int32_t pid;
+};
+
+struct source {
+	struct event event;	/* the next one */
+	const uint8_t *pos, *end;
+	bool (*next)(struct source *s);
+
+	/* trace-cmd only */
+	const uint8_t *page_end, *next_page;
+	uint64_t ts;
+};
+
+static bool swap_bytes, big_endian;
+static unsigned page_size, commit_size;
+static uint64_t sample_type;
+static bool verbose;
+
+static uint16_t get16(const void *p)
+{
+	uint16_t v;
+
+	memcpy(&v, p, sizeof(v));
+	return swap_bytes ? bswap_16(v) : v;
+}
+
+static uint32_t get32(const void *p)
+{
+	uint32_t v;
+
+	memcpy(&v, p, sizeof(v));
+	return swap_bytes ? bswap_32(v) : v;
+}
+
+static uint64_t get64(const void *p)
+{
+	uint64_t v;
+
+	memcpy(&v, p, sizeof(v));
+	return swap_bytes ? bswap_64(v) : v;
+}
+
+static uint64_t get_field(const uint8_t *raw, unsigned size,
+			  int offset, int field_size)
+{
+	if (offset < 0 || (unsigned)(offset + field_size) > size)
+		return 0;
+
+	switch (field_size) {
+	case 1: return raw[offset];
+	case 2: return get16(raw + offset);
+	case 4: return get32(raw + offset);
+	case 8: return get64(raw + offset);
+	}
+	return 0;
+}
+
+/*
+ * Picks the id and where ring and seqno are out of the format of a
+ * tracepoint, as found in the events directory of debugfs:
+ *
+ *	name: i915_gem_request_add
+ *	ID: 1031
+ *	format:
+ *		field:unsigned short common_type;	offset:0;	size:2;	...
+ */
+static void parse_format(const char *text, size_t len)
+{
+	char *buf, *line, *save, name[64] = "";
+	int id = -1, ring_offset = -1, ring_size = 0;
+	int seqno_offset = -1, seqno_size = 0;
+	unsigned k;
+
+	buf = strndup(text, len);
+	if (buf == NULL)
+		return;
+
+	for (line = strtok_r(buf, "\n", &save); line;
+	     line = strtok_r(NULL, "\n", &save)) {
+		char *field, *end, *field_name;
+		int offset, size;
+
+		if (sscanf(line, "name: %63s", name) == 1 ||
+		    sscanf(line, "ID: %d", &id) == 1)
+			continue;
+
+		field = strstr(line, "field:");
+		if (field == NULL || (end = strchr(field, ';')) == NULL)
+			continue;
+		if (sscanf(end + 1, " offset:%d; size:%d;", &offset, &size) != 2)
+			continue;
+
+		/* the name is the last word of the declaration */
+		*end = '\0';
+		field_name = strrchr(field, ' ');
+		field_name = field_name ? field_name + 1 : field + 6;
+
+		if (strcmp(field_name, "ring") == 0) {
+			ring_offset = offset;
+			ring_size = size;
+		} else if (strcmp(field_name, "seqno") == 0) {
+			seqno_offset = offset;
+			seqno_size = size;
+		}
+	}
+	free(buf);
+
+	if (id < 0 || id >= 65536 || seqno_offset < 0)
+		return;
+
+	for (k = 0; k < NUM_KINDS; k++) {
+		if (strcmp(name, kinds[k].name))
+			continue;
+
+		kinds[k].known = true;
+		kinds[k].ring_offset = ring_offset;
+		kinds[k].ring_size = ring_size;
+		kinds[k].seqno_offset = seqno_offset;
+		kinds[k].seqno_size = seqno_size;
+		kind_of[id] = k;
+	}
+}
+
+static bool load_formats(const char *dir)
+{
+	bool found = false;
+	unsigned k;
+
+	for (k = 0; k < NUM_KINDS; k++) {
+		char path[1024], text[8192];
+		size_t len;
+		FILE *file;
+
+		snprintf(path, sizeof(path), "%s/i915/%s/format",
+			 dir, kinds[k].name);
+		file = fopen(path, "r");
+		if (file == NULL)
+			continue;
+
+		len = fread(text, 1, sizeof(text), file);
+		fclose(file);
+		parse_format(text, len);
+		found = true;
+	}
+
+	return found;
+}
+
+/* the tracepoint data starts with the common fields, type and pid */
+static bool decode_event(const uint8_t *raw, unsigned size, uint64_t ts,
+			 struct event *e)
+{
+	unsigned k;
+
+	if (size < 8)
+		return false;
+
+	k = kind_of[get16(raw)];
+	if (k == NO_KIND)
+		return false;
+
+	e->ts = ts;
+	e->kind = k;
+	e->pid = get32(raw + 4);
+	e->ring = get_field(raw, size,
+			    kinds[k].ring_offset, kinds[k].ring_size);
+	e->seqno = get_field(raw, size,
+			     kinds[k].seqno_offset, kinds[k].seqno_size);
+	return true;
+}
+
+/*
+ * trace-cmd stores the kernel ring buffer pages as they are: a timestamp,
+ * the number of bytes committed and then records with a 32 bit header of
+ * a 5 bit type/length and a 27 bit time delta.
+ */
+#define RB_TYPE_PADDING		29
+#define RB_TYPE_TIME_EXTEND	30
+#define RB_TYPE_TIME_STAMP	31
+#define RB_LEN_TIME_STAMP	16
+#define RB_COMMIT_MASK		((1u << 27) - 1)
+
+static bool tracecmd_next(struct source *s)
+{
+	for (;;) {
+		const uint8_t *data;
+		uint32_t header, type_len, delta, length;
+
+		if (s->page_end - s->pos < 4) {
+			const uint8_t *page = s->next_page;
+			uint64_t commit;
+
+			if (s->end - page < 8 + commit_size)
+				return false;
+
+			s->ts = get64(page);
+			commit = commit_size == 8 ? get64(page + 8) :
+				get32(page + 8);
+			s->pos = page + 8 + commit_size;
+			s->page_end = page + page_size;
+			if (s->page_end > s->end)
+				s->page_end = s->end;
+			if ((commit & RB_COMMIT_MASK) < s->page_end - s->pos)
+				s->page_end = s->pos + (commit & RB_COMMIT_MASK);
+			s->next_page = page + page_size;
+			if (s->next_page > s->end)
+				s->next_page = s->end;
+			continue;
+		}
+
+		header = get32(s->pos);
+		if (big_endian) {
+			type_len = header >> 27;
+			delta = header & ((1u << 27) - 1);
+		} else {
+			type_len = header & 31;
+			delta = header >> 5;
+		}
+		data = s->pos + 4;
+
+		if (type_len >= RB_TYPE_PADDING || type_len == 0) {
+			if (s->page_end - data < 4 ||
+			    (type_len == RB_TYPE_PADDING && delta == 0)) {
+				/* the rest of the page is unused */
+				s->pos = s->page_end;
+				continue;
+			}
+		}
+
+		switch (type_len) {
+		case RB_TYPE_PADDING:
+			length = get32(data);
+			s->ts += delta;
+			s->pos = length < s->page_end - data ?
+				data + length : s->page_end;
+			continue;
+		case RB_TYPE_TIME_EXTEND:
+			s->ts += ((uint64_t)get32(data) << 27) + delta;
+			s->pos = data + 4;
+			continue;
+		case RB_TYPE_TIME_STAMP:
+			/* reserved, the kernel doesn't fill them in */
+			s->pos = s->page_end - s->pos < RB_LEN_TIME_STAMP ?
+				s->page_end : s->pos + RB_LEN_TIME_STAMP;
+			continue;
+		case 0:
+			length = get32(data) - 4;
+			data += 4;
+			break;
+		default:
+			length = type_len * 4;
+			break;
+		}
+
+		if (length > s->page_end - data) {
+			s->pos = s->page_end;
+			continue;
+		}
+		s->pos = data + ((length + 3) & ~3);
+		s->ts += delta;
+
+		if (decode_event(data, length, s->ts, &s->event))
+			return true;
+	}
+}
+
+/* bounds checked walk over the trace-cmd headers */
+struct reader {
+	const uint8_t *pos, *end;
+	bool error;
+};
+
+static const uint8_t *take(struct reader *r, uint64_t length)
+{
+	const uint8_t *p = r->pos;
+
+	if (r->error || length > (uint64_t)(r->end - r->pos)) {
+		r->error = true;
+		return NULL;
+	}
+	r->pos += length;
+	return p;
+}
+
+static uint32_t take32(struct reader *r)
+{
+	const uint8_t *p = take(r, 4);
+
+	return p ? get32(p) : 0;
+}
+
+static uint64_t take64(struct reader *r)
+{
+	const uint8_t *p = take(r, 8);
+
+	return p ? get64(p) : 0;
+}
+
+static const char *take_string(struct reader *r)
+{
+	const uint8_t *end;
+
+	if (r->error)
+		return "";
+	end = memchr(r->pos, '\0', r->end - r->pos);
+	if (end == NULL) {
+		r->error = true;
+		return "";
+	}
+	return (const char *)take(r, end - r->pos + 1);
+}
+
+/* the size of the commit field, which is a long of the traced kernel */
+static void parse_header_page(const char *text, size_t len)
+{
+	char *buf = strndup(text, len), *field;
+	int size;
+
+	if (buf == NULL)
+		return;
+	field = strstr(buf, "commit;");
+	if (field && sscanf(field, "commit; offset:%*d; size:%d;", &size) == 1 &&
+	    (size == 4 || size == 8))
+		commit_size = size;
+	free(buf);
+}
+
+static int open_tracecmd(const uint8_t *map, size_t size,
+			 struct source **sources)
+{
+	struct reader r = { map + 10, map + size, false };
+	const char *version, *label;
+	uint32_t count, n, m;
+	uint64_t length;
+	unsigned cpus, cpu;
+
+	version = take_string(&r);
+	if (r.error || atoi(version) != 6) {
+		fprintf(stderr, "trace-cmd file version %s not supported\n",
+			version);
+		return -1;
+	}
+
+	big_endian = *take(&r, 1);
+	swap_bytes = big_endian != (__BYTE_ORDER == __BIG_ENDIAN);
+	commit_size = *take(&r, 1);
+	page_size = take32(&r);
+
+	if (strcmp(take_string(&r), "header_page"))
+		goto corrupt;
+	length = take64(&r);
+	parse_header_page((const char *)take(&r, length), length);
+	if (strcmp(take_string(&r), "header_event"))
+		goto corrupt;
+	take(&r, take64(&r));
+
+	/* ftrace's own events */
+	count = take32(&r);
+	for (n = 0; n < count && !r.error; n++)
+		take(&r, take64(&r));
+
+	count = take32(&r);
+	for (n = 0; n < count && !r.error; n++) {
+		bool i915 = strcmp(take_string(&r), "i915") == 0;
+		uint32_t events = take32(&r);
+
+		for (m = 0; m < events && !r.error; m++) {
+			const char *text;
+
+			length = take64(&r);
+			text = (const char *)take(&r, length);
+			if (text && i915)
+				parse_format(text, length);
+		}
+	}
+
+	take(&r, take32(&r));	/* kallsyms */
+	take(&r, take32(&r));	/* trace_printk formats */
+	take(&r, take64(&r));	/* command lines */
+	cpus = take32(&r);
+
+	label = (const char *)take(&r, 10);
+	if (label && memcmp(label, "options  ", 10) == 0) {
+		const uint8_t *option;
+
+		while ((option = take(&r, 2)) && get16(option))
+			take(&r, take32(&r));
+		label = (const char *)take(&r, 10);
+	}
+	if (r.error || label == NULL)
+		goto corrupt;
+	if (memcmp(label, "flyrecord", 10)) {
+		fprintf(stderr, "only flyrecord traces are supported\n");
+		return -1;
+	}
+	if (page_size < 16 || cpus == 0 || cpus > 4096)
+		goto corrupt;
+
+	*sources = calloc(cpus, sizeof(**sources));
+	if (*sources == NULL)
+		return -1;
+
+	for (cpu = 0; cpu < cpus; cpu++) {
+		struct source *s = &(*sources)[cpu];
+		uint64_t offset = take64(&r);
+
+		length = take64(&r);
+		if (r.error)
+			goto corrupt;
+		if (offset > size)
+			offset = length = 0;
+		if (length > size - offset)
+			length = size - offset;
+
+		s->pos = s->page_end = s->next_page = map + offset;
+		s->end = map + offset + length;
+		s->next = tracecmd_next;
+	}
+
+	return cpus;
+
+corrupt:
+	fprintf(stderr, "corrupt trace-cmd file\n");
+	return -1;
+}
+
+/*
+ * perf samples carry the fields asked for by sample_type in a fixed
+ * order; all we want is the time and the raw tracepoint data.
+ */
+static bool perf_sample(const uint8_t *p, unsigned size,
+			uint64_t *ts, const uint8_t **raw, unsigned *raw_size)
+{
+	const uint8_t *end = p + size;
+	uint64_t nr;
+
+	p += sizeof(struct perf_event_header);
+#define SKIP(bit, n) \
+	if (sample_type & (bit)) { \
+		if (end - p < (n)) \
+			return false; \
+		p += (n); \
+	}
+	SKIP(PERF_SAMPLE_IDENTIFIER, 8);
+	SKIP(PERF_SAMPLE_IP, 8);
+	SKIP(PERF_SAMPLE_TID, 8);
+	if (end - p < 8)
+		return false;
+	*ts = get64(p);
+	p += 8;
+	SKIP(PERF_SAMPLE_ADDR, 8);
+	SKIP(PERF_SAMPLE_ID, 8);
+	SKIP(PERF_SAMPLE_STREAM_ID, 8);
+	SKIP(PERF_SAMPLE_CPU, 8);
+	SKIP(PERF_SAMPLE_PERIOD, 8);
+#undef SKIP
+	if (sample_type & PERF_SAMPLE_CALLCHAIN) {
+		if (end - p < 8)
+			return false;
+		nr = get64(p);
+		p += 8;
+		if (nr > (uint64_t)(end - p) / 8)
+			return false;
+		p += 8 * nr;
+	}
+
+	if (end - p < 4)
+		return false;
+	*raw_size = get32(p);
+	p += 4;
+	if (*raw_size > end - p)
+		return false;
+	*raw = p;
+	return true;
+}
+
+/* the next record, or NULL at the end or if it is garbled */
+static const uint8_t *perf_record(const uint8_t **pos, const uint8_t *end,
+				  struct perf_event_header *header)
+{
+	const uint8_t *p = *pos;
+
+	if (end - p < sizeof(*header))
+		return NULL;
+	memcpy(header, p, sizeof(*header));
+	if (header->size < sizeof(*header) || header->size > end - p)
+		return NULL;
+
+	*pos = p + header->size;
+	return p;
+}
+
+static bool perf_next(struct source *s)
+{
+	struct perf_event_header header;
+	const uint8_t *p, *raw;
+	unsigned raw_size;
+	uint64_t ts;
+
+	while ((p = perf_record(&s->pos, s->end, &header))) {
+		if (header.type == PERF_RECORD_SAMPLE &&
+		    perf_sample(p, header.size, &ts, &raw, &raw_size) &&
+		    decode_event(raw, raw_size, ts, &s->event))
+			return true;
+	}
+	return false;
+}
+
+/*
+ * perf writes the per-cpu buffers out in turns, so the records come in
+ * runs which are in time order; every run becomes a source of its own.
+ */
+static int open_perf_data(const uint8_t *data, const uint8_t *end,
+			  struct source **sources)
+{
+	struct perf_event_header header;
+	const uint8_t *pos = data, *p, *raw;
+	uint64_t ts, last = 0;
+	unsigned raw_size, count = 0, size = 0;
+
+	*sources = NULL;
+	for (;;) {
+		const uint8_t *start = pos;
+
+		p = perf_record(&pos, end, &header);
+		if (p == NULL)
+			break;
+		if (header.type != PERF_RECORD_SAMPLE ||
+		    !perf_sample(p, header.size, &ts, &raw, &raw_size))
+			continue;
+		if (count && ts >= last) {
+			last = ts;
+			continue;
+		}
+		last = ts;
+
+		if (count)
+			(*sources)[count - 1].end = start;
+		if (count == size) {
+			struct source *s;
+
+			size = size * 2 + 16;
+			s = realloc(*sources, size * sizeof(*s));
+			if (s == NULL)
+				return -1;
+			*sources = s;
+		}
+		memset(&(*sources)[count], 0, sizeof(**sources));
+		(*sources)[count].pos = start;
+		(*sources)[count].next = perf_next;
+		count++;
+	}
+	if (count)
+		(*sources)[count - 1].end = pos;
+
+	return count;
+}
+
+static int open_perf_file(const uint8_t *map, size_t size,
+			  struct source **sources)
+{
+	struct perf_file_section {
+		uint64_t offset, size;
+	} attrs, data;
+	uint64_t attr_size, n;
+
+	if (size < 8 + 2 * 8 + 3 * 16)
+		goto corrupt;
+
+	attr_size = get64(map + 16);
+	attrs.offset = get64(map + 24);
+	attrs.size = get64(map + 32);
+	data.offset = get64(map + 40);
+	data.size = get64(map + 48);
+	if (attrs.offset > size || attrs.size > size - attrs.offset ||
+	    data.offset > size || data.size > size - data.offset ||
+	    attr_size < 32 + 16 || attrs.size < attr_size)
+		goto corrupt;
+
+	/* one layout for all, as the records don't say whose they are */
+	for (n = 0; n + attr_size <= attrs.size; n += attr_size) {
+		uint64_t type = get64(map + attrs.offset + n + 24);
+
+		if (n && type != sample_type) {
+			fprintf(stderr, "events with different sample types\n");
+			return -1;
+		}
+		sample_type = type;
+	}
+
+	if ((sample_type & (PERF_SAMPLE_TIME | PERF_SAMPLE_RAW)) !=
+	    (PERF_SAMPLE_TIME | PERF_SAMPLE_RAW) ||
+	    sample_type & PERF_SAMPLE_READ) {
+		fprintf(stderr, "samples need time and raw data, record with "
+			"perf record -R\n");
+		return -1;
+	}
+
+	return open_perf_data(map + data.offset,
+			      map + data.offset + data.size, sources);
+
+corrupt:
+	fprintf(stderr, "corrupt perf file\n");
+	return -1;
+}
+
+/* a histogram with 8 buckets per power of two, so within 12.5% */
+#define HIST_SUB	8
+#define HIST_BUCKETS	(64 * HIST_SUB)
+
+struct histogram {
+	uint64_t count, sum, min, max;
+	uint64_t bucket[HIST_BUCKETS];
+};
+
+static unsigned hist_bucket(uint64_t v)
+{
+	unsigned log;
+
+	if (v < 2 * HIST_SUB)
+		return v;
+	log = 63 - __builtin_clzll(v);
+	return (log - 2) * HIST_SUB + ((v >> (log - 3)) & (HIST_SUB - 1));
+}
+
+/* the smallest value going into the bucket */
+static uint64_t hist_value(unsigned b)
+{
+	if (b < 2 * HIST_SUB)
+		return b;
+	return (uint64_t)(HIST_SUB + b % HIST_SUB) << (b / HIST_SUB - 1);
+}
+
+static void hist_add(struct histogram *h, uint64_t v)
+{
+	if (h->count == 0 || v < h->min)
+		h->min = v;
+	if (v > h->max)
+		h->max = v;
+	h->count++;
+	h->sum += v;
+	h->bucket[hist_bucket(v)]++;
+}
+
+/* the upper end of the bucket the percentile falls into */
+static uint64_t hist_percentile(const struct histogram *h, unsigned pct)
+{
+	uint64_t want = (h->count * pct + 99) / 100, seen = 0;
+	unsigned b;
+
+	for (b = 0; b < HIST_BUCKETS - 1; b++) {
+		seen += h->bucket[b];
+		if (seen >= want)
+			break;
+	}
+	if (hist_value(b + 1) - 1 < h->max)
+		return hist_value(b + 1) - 1;
+	return h->max;
+}
+
+/*
+ * Open addressing with linear probing, keyed by seqno and whatever else
+ * tells them apart. Deletion moves the entries behind back instead of
+ * leaving tombstones.
+ */
+#define SLOT_USED (1ull << 63)
+
+struct slot {
+	uint64_t key, value;
+};
+
+struct seqno_table {
+	struct slot *slots;
+	unsigned bits, count;
+};
+
+static unsigned slot_hash(const struct seqno_table *t, uint64_t key)
+{
+	return ((key & ~SLOT_USED) * 0x9e3779b97f4a7c15ull) >> (64 - t->bits);
+}
+
+static struct slot *table_lookup(const struct seqno_table *t, uint64_t key)
+{
+	unsigned mask = (1u << t->bits) - 1, i = slot_hash(t, key);
+
+	key |= SLOT_USED;
+	while (t->slots[i].key && t->slots[i].key != key)
+		i = (i + 1) & mask;
+	return &t->slots[i];
+}
+
+static void table_grow(struct seqno_table *t)
+{
+	struct seqno_table old = *t;
+	unsigned i;
+
+	t->bits = t->bits ? t->bits + 1 : 10;
+	t->slots = calloc(1u << t->bits, sizeof(*t->slots));
+	if (t->slots == NULL) {
+		fprintf(stderr, "out of memory\n");
+		exit(1);
+	}
+
+	for (i = 0; old.slots && i < 1u << old.bits; i++)
+		if (old.slots[i].key)
+			*table_lookup(t, old.slots[i].key) = old.slots[i];
+	free(old.slots);
+}
+
+static void table_set(struct seqno_table *t, uint64_t key, uint64_t value)
+{
+	struct slot *s;
+
+	if (2 * (t->count + 1) > 1u << t->bits)
+		table_grow(t);
+
+	s = table_lookup(t, key);
+	if (!s->key) {
+		s->key = key | SLOT_USED;
+		t->count++;
+	}
+	s->value = value;
+}
+
+static bool table_get(const struct seqno_table *t, uint64_t key,
+		      uint64_t *value)
+{
+	const struct slot *s;
+
+	if (t->count == 0)
+		return false;
+	s = table_lookup(t, key);
+	if (!s->key)
+		return false;
+	*value = s->value;
+	return true;
+}
+
+static void table_clear(struct seqno_table *t)
+{
+	if (t->count)
+		memset(t->slots, 0, (1u << t->bits) * sizeof(*t->slots));
+	t->count = 0;
+}
+
+static bool table_take(struct seqno_table *t, uint64_t key, uint64_t *value)
+{
+	unsigned mask = (1u << t->bits) - 1, i, j, home;
+	struct slot *s;
+
+	if (t->count == 0)
+		return false;
+	s = table_lookup(t, key);
+	if (!s->key)
+		return false;
+	*value = s->value;
+
+	i = j = s - t->slots;
+	for (;;) {
+		j = (j + 1) & mask;
+		if (!t->slots[j].key)
+			break;
+
+		/* move it up unless its home is between the hole and it */
+		home = slot_hash(t, t->slots[j].key);
+		if (i <= j ? (home <= i || home > j) : (home <= i && home > j)) {
+			t->slots[i] = t->slots[j];
+			i = j;
+		}
+	}
+	t->slots[i].key = 0;
+	t->count--;
+	return true;
+}
+
+/* the requests of a ring are queued in seqno order */
+struct pending {
+	uint32_t seqno;
+	uint64_t ts;
+};
+
+static struct ring {
+	struct pending *queue;
+	unsigned head, count, size;
+	uint64_t idle_since;		/* 0 if busy or not known */
+	struct histogram latency, gap;
+} rings[MAX_RINGS];
+
+static struct seqno_table waits, throttles, completions;
+static struct histogram wait_hist, throttle_interval, throttle_duration;
+/* the most seqnos between two throttles that are walked */
+#define THROTTLE_WINDOW (1u << 24)
+
+static uint32_t prev_throttle;
+static bool have_prev_throttle;
+static uint64_t num_events, first_ts, last_ts, bad_ring;
+static unsigned num_throttles;
+
+static bool seqno_passed(uint32_t a, uint32_t b)
+{
+	return (int32_t)(a - b) >= 0;
+}
+
+static void request_add(struct ring *ring, const struct event *e)
+{
+	if (ring->count == ring->size) {
+		struct pending *queue;
+		unsigned n;
+
+		queue = malloc((ring->size * 2 + 64) * sizeof(*queue));
+		if (queue == NULL) {
+			fprintf(stderr, "out of memory\n");
+			exit(1);
+		}
+		for (n = 0; n < ring->count; n++)
+			queue[n] = ring->queue[(ring->head + n) % ring->size];
+		free(ring->queue);
+		ring->queue = queue;
+		ring->head = 0;
+		ring->size = ring->size * 2 + 64;
+	}
+
+	if (ring->count == 0 && ring->idle_since)
+		hist_add(&ring->gap, e->ts - ring->idle_since);
+	ring->idle_since = 0;
+
+	ring->queue[(ring->head + ring->count++) % ring->size] =
+		(struct pending){ e->seqno, e->ts };
+}
+
+/* everything up to the seqno is done */
+static void request_complete(struct ring *ring, const struct event *e)
+{
+	bool retired = false;
+
+	while (ring->count &&
+	       seqno_passed(e->seqno, ring->queue[ring->head].seqno)) {
+		hist_add(&ring->latency,
+			 e->ts - ring->queue[ring->head].ts);
+		ring->head = (ring->head + 1) % ring->size;
+		ring->count--;
+		retired = true;
+	}
+	if (retired && ring->count == 0)
+		ring->idle_since = e->ts;
+
+	/* throttle_end only walks the completions since the last throttle */
+	if (have_prev_throttle && seqno_passed(e->seqno, prev_throttle) &&
+	    e->seqno - prev_throttle <= THROTTLE_WINDOW)
+		table_set(&completions, e->seqno, e->ts);
+}
+
+static uint64_t wait_key(const struct event *e)
+{
+	return (uint64_t)(e->pid & 0xfffffff) << 35 |
+		(uint64_t)e->ring << 32 | e->seqno;
+}
+
+/*
+ * As scripts/throttle.py did: how long the throttle took, how long since
+ * the previous one ended and how the completions in between were spread.
+ */
+static void throttle_end(const struct event *e)
+{
+	uint64_t begin, prev, ts = 0, value, sum = 0, max = 0;
+	unsigned num = 0;
+	uint32_t s;
+
+	num_throttles++;
+
+	s = have_prev_throttle ? prev_throttle : e->seqno;
+	if (!seqno_passed(e->seqno, s) || e->seqno - s > THROTTLE_WINDOW) {
+		/* whatever was recorded is relative to a stale seqno */
+		table_clear(&completions);
+		s = e->seqno;
+	}
+	for (; seqno_passed(e->seqno, s); s++) {
+		if (!(s == e->seqno ? table_get(&completions, s, &value) :
+		      table_take(&completions, s, &value)))
+			continue;
+		if (ts) {
+			sum += value - ts;
+			if (value - ts > max)
+				max = value - ts;
+			num++;
+		}
+		ts = value;
+	}
+
+	if (table_get(&throttles, e->seqno, &begin)) {
+		hist_add(&throttle_duration, e->ts - begin);
+		if (have_prev_throttle &&
+		    table_get(&throttles, prev_throttle, &prev) &&
+		    begin >= prev) {
+			hist_add(&throttle_interval, begin - prev);
+			if (verbose && num)
+				printf("throttle +%dms: %dms -- %d dispatch, "
+				       "avg %.3fms, max %dus\n",
+				       (int)((begin - prev) / 1000000),
+				       (int)((e->ts - begin) / 1000000),
+				       num, sum / (1000000. * num),
+				       (int)(max / 1000));
+		}
+		table_set(&throttles, e->seqno, e->ts);
+	}
+
+	if (have_prev_throttle && prev_throttle != e->seqno)
+		table_take(&throttles, prev_throttle, &value);
+	prev_throttle = e->seqno;
+	have_prev_throttle = true;
+}
+
+static void process(const struct event *e)
+{
+	struct ring *ring = &rings[e->ring % MAX_RINGS];
+	uint64_t begin;
+
+	if (num_events++ == 0)
+		first_ts = e->ts;
+	last_ts = e->ts;
+
+	if (e->ring >= MAX_RINGS) {
+		bad_ring++;
+		return;
+	}
+
+	switch (e->kind) {
+	case REQUEST_ADD:
+		request_add(ring, e);
+		break;
+	case REQUEST_COMPLETE:
+		request_complete(ring, e);
+		break;
+	case WAIT_BEGIN:
+		table_set(&waits, wait_key(e), e->ts);
+		break;
+	case WAIT_END:
+		if (table_take(&waits, wait_key(e), &begin))
+			hist_add(&wait_hist, e->ts - begin);
+		break;
+	case THROTTLE_BEGIN:
+		table_set(&throttles, e->seqno, e->ts);
+		break;
+	case THROTTLE_END:
+		throttle_end(e);
+		break;
+	default:
+		break;
+	}
+}
+
+static void heap_down(struct source **heap, unsigned count, unsigned i)
+{
+	struct source *s = heap[i];
+
+	for (;;) {
+		unsigned child = 2 * i + 1;
+
+		if (child >= count)
+			break;
+		if (child + 1 < count &&
+		    heap[child + 1]->event.ts < heap[child]->event.ts)
+			child++;
+		if (s->event.ts <= heap[child]->event.ts)
+			break;
+		heap[i] = heap[child];
+		i = child;
+	}
+	heap[i] = s;
+}
+
+/* hands the events of all sources to process() in time order */
+static void merge(struct source *sources, unsigned num_sources)
+{
+	struct source **heap;
+	unsigned count = 0, n;
+
+	heap = calloc(num_sources + 1, sizeof(*heap));
+	if (heap == NULL) {
+		fprintf(stderr, "out of memory\n");
+		exit(1);
+	}
+
+	for (n = 0; n < num_sources; n++)
+		if (sources[n].next(&sources[n]))
+			heap[count++] = &sources[n];
+	for (n = count / 2; n-- > 0; )
+		heap_down(heap, count, n);
+
+	while (count) {
+		process(&heap[0]->event);
+		if (!heap[0]->next(heap[0]))
+			heap[0] = heap[--count];
+		if (count)
+			heap_down(heap, count, 0);
+	}
+
+	free(heap);
+}
+
+static const char *ring_name(unsigned ring)
+{
+	static const char *names[] = { "rcs", "vcs", "bcs", "vecs", "vcs2" };
+	static char buf[16];
+
+	if (ring < sizeof(names) / sizeof(names[0]))
+		return names[ring];
+	snprintf(buf, sizeof(buf), "ring%u", ring);
+	return buf;
+}
+
+static void print_hist(const char *name, const char *ring,
+		       const struct histogram *h)
+{
+	if (h->count == 0)
+		return;
+
+	printf("%-18s %-5s %9llu %9.1f %9.1f %9.1f %9.1f %9.1f %9.1f\n",
+	       name, ring, (unsigned long long)h->count,
+	       h->min / 1e3, hist_percentile(h, 50) / 1e3,
+	       hist_percentile(h, 90) / 1e3, hist_percentile(h, 99) / 1e3,
+	       h->max / 1e3, (double)h->sum / h->count / 1e3);
+}
+
+static void report(const char *filename, unsigned num_sources)
+{
+	double seconds = (last_ts - first_ts) / 1e9;
+	unsigned r, outstanding = 0;
+
+	printf("%s: %llu events over %.3fs from %u buffers\n", filename,
+	       (unsigned long long)num_events, seconds, num_sources);
+	if (num_events == 0)
+		return;
+
+	printf("\n%-18s %-5s %9s %9s %9s %9s %9s %9s %9s\n",
+	       "(us)", "ring", "count", "min", "median", "p90", "p99",
+	       "max", "mean");
+	for (r = 0; r < MAX_RINGS; r++)
+		print_hist("request latency", ring_name(r), &rings[r].latency);
+	for (r = 0; r < MAX_RINGS; r++)
+		print_hist("dispatch gap", ring_name(r), &rings[r].gap);
+	print_hist("wait", "", &wait_hist);
+	print_hist("throttle", "", &throttle_duration);
+	print_hist("throttle interval", "", &throttle_interval);
+
+	if (num_throttles)
+		printf("\n%u throttles, %.2f per second\n", num_throttles,
+		       seconds ? num_throttles / seconds : 0);
+
+	for (r = 0; r < MAX_RINGS; r++)
+		outstanding += rings[r].count;
+	if (outstanding)
+		printf("%u requests still outstanding at the end\n",
+		       outstanding);
+	if (waits.count)
+		printf("%u waits still going on at the end\n", waits.count);
+	if (bad_ring)
+		printf("%llu events on unknown rings ignored\n",
+		       (unsigned long long)bad_ring);
+}
+
+static void usage(const char *name)
+{
+	fprintf(stderr,
+		"usage: %s [options] [trace.dat]\n"
+		"\n"
+		"Reads i915 request tracepoints recorded with trace-cmd, with\n"
+		"perf record -R or as raw perf samples laid out the way the\n"
+		"overlay asks for them.\n"
+		"\n"
+		"  -e, --events DIR   tracepoint formats for perf input\n"
+		"                     (/sys/kernel/debug/tracing/events)\n"
+		"  -v, --verbose      print every throttle\n",
+		name);
+}
+
+int main(int argc, char **argv)
+{
+	static const struct option longopts[] = {
+		{ "events", required_argument, 0, 'e' },
+		{ "verbose", no_argument, 0, 'v' },
+		{ "help", no_argument, 0, 'h' },
+		{ NULL, 0, NULL, 0 }
+	};
+	const char *filename = "trace.dat", *events = NULL;
+	struct source *sources = NULL;
+	const uint8_t *map;
+	struct stat st;
+	int fd, c, num_sources;
+
+	while ((c = getopt_long(argc, argv, "e:vh", longopts, NULL)) != -1) {
+		switch (c) {
+		case 'e':
+			events = optarg;
+			break;
+		case 'v':
+			verbose = true;
+			break;
+		default:
+			usage(argv[0]);
+			return c == 'h' ? 0 : 1;
+		}
+	}
+	if (optind + 1 < argc) {
+		usage(argv[0]);
+		return 1;
+	}
+	if (optind < argc)
+		filename = argv[optind];
+
+	fd = open(filename, O_RDONLY);
+	if (fd < 0 || fstat(fd, &st)) {
+		fprintf(stderr, "unable to open %s: %s\n",
+			filename, strerror(errno));
+		return 1;
+	}
+	if (st.st_size == 0) {
+		fprintf(stderr, "%s is empty\n", filename);
+		return 1;
+	}
+	map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	if (map == MAP_FAILED) {
+		fprintf(stderr, "unable to map %s: %s\n",
+			filename, strerror(errno));
+		return 1;
+	}
+	close(fd);
+	madvise((void *)map, st.st_size, MADV_SEQUENTIAL);
+
+	memset(kind_of, NO_KIND, sizeof(kind_of));
+	if (st.st_size >= 10 && memcmp(map, TRACECMD_MAGIC, 10) == 0) {
+		num_sources = open_tracecmd(map, st.st_size, &sources);
+	} else {
+		/* perf doesn't keep the formats we need */
+		if (events ? !load_formats(events) :
+		    !load_formats("/sys/kernel/debug/tracing/events") &&
+		    !load_formats("/sys/kernel/tracing/events")) {
+			fprintf(stderr, "no i915 tracepoint formats found, "
+				"point --events at a copy\n");
+			return 1;
+		}
+
+		if (st.st_size >= 8 && memcmp(map, PERF_MAGIC, 8) == 0) {
+			num_sources = open_perf_file(map, st.st_size, &sources);
+		} else {
+			sample_type = OVERLAY_SAMPLE_TYPE;
+			num_sources = open_perf_data(map, map + st.st_size,
+						     &sources);
+		}
+	}
+	if (num_sources < 0)
+		return 1;
+
+	if (!kinds[REQUEST_ADD].known && !kinds[REQUEST_COMPLETE].known &&
+	    !kinds[WAIT_BEGIN].known && !kinds[THROTTLE_END].known) {
+		fprintf(stderr, "%s has no i915 request tracepoints\n",
+			filename);
+		return 1;
+	}
+
+	merge(sources, num_sources);
+	report(filename, num_sources);
+
+	free(sources);
+	munmap((void *)map, st.st_size);
+	return 0;
+}
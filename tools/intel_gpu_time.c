@@ -26,20 +26,156 @@
  *
  */
 
+/*
+ * Runs a command and reports how busy the gpu was meanwhile, along with
+ * the cpu time the command took.
+ *
+ * Every ring of the device is sampled through mmio: idle when head and
+ * tail match, and waiting on an event or a semaphore as RING_CTL says.
+ * That covers everything running on the gpu, not just the command.
+ *
+ * When the i915 tracepoints can be opened, the requests submitted by the
+ * command and its children are followed as well. A request counts from
+ * the later of its submission and the completion of the one before it on
+ * the same ring, until its own completion. The process tree is followed
+ * with sched_process_fork.
+ */
+
+#define _GNU_SOURCE
 #include <unistd.h>
 #include <signal.h>
+#include <stdbool.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <time.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
 #include <sys/time.h>
 #include <sys/resource.h>
 #include <sys/wait.h>
+#include <linux/perf_event.h>
 
 #include "intel_gpu_tools.h"
 
 #define SAMPLES_PER_SEC             10000
 
+/* the tracepoints are read back every this many samples */
+#define SAMPLES_PER_DRAIN	100
+
+#define RING_CTL		0x0c
+#define   RING_WAIT		(1 << 11)
+#define   RING_WAIT_SEMAPHORE	(1 << 10)
+
+#define N_PAGES			64
+
+#if defined(__i386__)
+#define rmb()           asm volatile("lock; addl $0,0(%%esp)" ::: "memory")
+#define wmb()           asm volatile("lock; addl $0,0(%%esp)" ::: "memory")
+#elif defined(__x86_64__)
+#define rmb()           asm volatile("lfence" ::: "memory")
+#define wmb()           asm volatile("sfence" ::: "memory")
+#else
+#define rmb()           __sync_synchronize()
+#define wmb()           __sync_synchronize()
+#endif
+
+struct request {
+	struct request *next;
+	uint32_t seqno;
+	uint64_t time;
+	bool ours;
+};
+
+struct wait {
+	struct wait *next;
+	pid_t pid;
+	uint32_t seqno;
+	uint64_t time;
+};
+
+/* in the order of the ring ids of the tracepoints */
+static struct ring {
+	const char *name;
+	uint32_t mmio;
+	bool present;
+	unsigned long idle, wait, sema;
+
+	/* of the command, from the tracepoints */
+	uint64_t busy_ns, wait_ns;
+	unsigned long requests, syncs;
+
+	struct request *first, *last;
+	uint64_t last_complete;
+	struct wait *waits;
+} rings[] = {
+	{ .name = "render", .mmio = 0x2030 },
+	{ .name = "bsd", .mmio = 0x4030 },
+	{ .name = "blt", .mmio = 0x22030 },
+	{ .name = "vebox", .mmio = 0x1a030 },
+};
+#define NUM_RINGS (sizeof(rings) / sizeof(rings[0]))
+
+enum kind {
+	REQUEST_ADD,
+	REQUEST_COMPLETE,
+	WAIT_BEGIN,
+	WAIT_END,
+	RING_SYNC,
+	PROCESS_FORK,
+	NUM_KINDS
+};
+
+static struct tracepoint {
+	const char *sys, *name;
+	const char *fields[2];	/* read as ring/seqno or the like */
+	int offset[2];
+	uint64_t *ids;		/* of the event on every cpu */
+} tracepoints[NUM_KINDS] = {
+	[REQUEST_ADD] = { "i915", "i915_gem_request_add", { "ring", "seqno" } },
+	[REQUEST_COMPLETE] = { "i915", "i915_gem_request_complete", { "ring", "seqno" } },
+	[WAIT_BEGIN] = { "i915", "i915_gem_request_wait_begin", { "ring", "seqno" } },
+	[WAIT_END] = { "i915", "i915_gem_request_wait_end", { "ring", "seqno" } },
+	[RING_SYNC] = { "i915", "i915_gem_ring_sync_to", { "sync_to", "seqno" } },
+	[PROCESS_FORK] = { "sched", "sched_process_fork", { "child_pid", "parent_pid" } },
+};
+
+struct event {
+	uint64_t time;
+	enum kind kind;
+	pid_t pid;
+	uint32_t field[2];
+};
+
+static struct {
+	bool enabled;
+	bool monotonic;		/* the events are timed with CLOCK_MONOTONIC */
+	int nr_cpus, page_size;
+	int *fd;
+	void **map;
+
+	struct event *events;
+	int num_events, max_events;
+	unsigned long lost;
+
+	pid_t *tree;
+	int tree_size, max_tree;
+} trace;
+
 static volatile int goddo;
 
+static uint64_t now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
 static pid_t spawn(char **argv)
 {
 	pid_t pid;
@@ -57,54 +193,669 @@ static void sighandler(int sig)
 	goddo = sig;
 }
 
+static void rings_init(uint32_t devid)
+{
+	unsigned n;
+
+	rings[0].present = true;
+	if (IS_GEN4(devid) || HAS_BSD_RING(devid)) {
+		rings[1].present = true;
+		if (intel_gen(devid) >= 6)
+			rings[1].mmio = 0x12030;
+	}
+	rings[2].present = HAS_BLT_RING(devid);
+	rings[3].present = HAS_VEBOX_RING(devid);
+
+	/* and not disabled by the kernel */
+	for (n = 0; n < NUM_RINGS; n++)
+		if (rings[n].present &&
+		    (INREG(rings[n].mmio + RING_CTL) & RING_VALID) == 0)
+			rings[n].present = false;
+}
+
+static void rings_sample(void)
+{
+	unsigned n;
+
+	for (n = 0; n < NUM_RINGS; n++) {
+		struct ring *ring = &rings[n];
+		uint32_t head, tail, ctl;
+
+		if (!ring->present)
+			continue;
+
+		head = INREG(ring->mmio + RING_HEAD) & HEAD_ADDR;
+		tail = INREG(ring->mmio + RING_TAIL) & TAIL_ADDR;
+		ring->idle += head == tail;
+
+		ctl = INREG(ring->mmio + RING_CTL);
+		ring->wait += !!(ctl & RING_WAIT);
+		ring->sema += !!(ctl & RING_WAIT_SEMAPHORE);
+	}
+}
+
+/*
+ * Finds the id of a tracepoint and where its fields are from its format
+ * in the tracing events directory:
+ *
+ *	ID: 1031
+ *	format:
+ *		field:u32 ring;	offset:12;	size:4;	signed:0;
+ */
+static uint64_t tracepoint_format(struct tracepoint *tp)
+{
+	static const char *dirs[] = {
+		"/sys/kernel/debug/tracing/events",
+		"/sys/kernel/tracing/events",
+	};
+	char path[1024], line[1024];
+	uint64_t id = 0;
+	unsigned n;
+	FILE *file = NULL;
+
+	for (n = 0; file == NULL && n < sizeof(dirs) / sizeof(dirs[0]); n++) {
+		snprintf(path, sizeof(path), "%s/%s/%s/format",
+			 dirs[n], tp->sys, tp->name);
+		file = fopen(path, "r");
+	}
+	if (file == NULL)
+		return 0;
+
+	tp->offset[0] = tp->offset[1] = -1;
+	while (fgets(line, sizeof(line), file)) {
+		char *field, *end, *name;
+		int offset, size;
+
+		if (sscanf(line, "ID: %" SCNu64, &id) == 1)
+			continue;
+
+		field = strstr(line, "field:");
+		if (field == NULL || (end = strchr(field, ';')) == NULL)
+			continue;
+		if (sscanf(end + 1, " offset:%d; size:%d;", &offset, &size) != 2 ||
+		    size != 4)
+			continue;
+
+		*end = '\0';
+		name = strrchr(field, ' ');
+		name = name ? name + 1 : field + 6;
+
+		for (n = 0; n < 2; n++)
+			if (strcmp(name, tp->fields[n]) == 0)
+				tp->offset[n] = offset;
+	}
+	fclose(file);
+
+	return tp->offset[0] >= 0 && tp->offset[1] >= 0 ? id : 0;
+}
+
+static int perf_event_open(struct perf_event_attr *attr, pid_t pid, int cpu,
+			   int group_fd, unsigned long flags)
+{
+	attr->size = sizeof(*attr);
+	return syscall(__NR_perf_event_open, attr, pid, cpu, group_fd, flags);
+}
+
+/* Opens a tracepoint on every cpu. */
+static int tracepoint_open(struct tracepoint *tp)
+{
+	struct perf_event_attr attr;
+	int n, *fd;
+
+	memset(&attr, 0, sizeof(attr));
+	attr.type = PERF_TYPE_TRACEPOINT;
+	attr.config = tracepoint_format(tp);
+	if (attr.config == 0)
+		return ENOENT;
+
+	attr.sample_period = 1;
+	attr.sample_type = (PERF_SAMPLE_TID | PERF_SAMPLE_TIME |
+			    PERF_SAMPLE_STREAM_ID | PERF_SAMPLE_RAW);
+	attr.read_format = PERF_FORMAT_ID;
+	attr.exclude_guest = 1;
+	attr.use_clockid = trace.monotonic;
+	attr.clockid = CLOCK_MONOTONIC;
+
+	tp->ids = calloc(trace.nr_cpus, sizeof(*tp->ids));
+	fd = realloc(trace.fd, trace.nr_cpus * sizeof(int) *
+		     (tp - tracepoints + 1));
+	if (tp->ids == NULL || fd == NULL)
+		return ENOMEM;
+	trace.fd = fd;
+	fd += (tp - tracepoints) * trace.nr_cpus;
+
+	for (n = 0; n < trace.nr_cpus; n++) {
+		uint64_t track[2];
+
+		fd[n] = perf_event_open(&attr, -1, n, -1, 0);
+		if (fd[n] < 0 && n == 0 && tp == tracepoints &&
+		    trace.monotonic) {
+			/* older kernels only have their own clock */
+			trace.monotonic = false;
+			attr.use_clockid = 0;
+			fd[n] = perf_event_open(&attr, -1, n, -1, 0);
+		}
+		if (fd[n] < 0)
+			return errno;
+
+		/* read back the event to establish id->tracepoint */
+		if (read(fd[n], track, sizeof(track)) < 0)
+			return errno;
+		tp->ids[n] = track[1];
+	}
+
+	return 0;
+}
+
+/*
+ * Opens all tracepoints and maps the buffers of the first one, the
+ * others write into those of their cpu.
+ */
+static void trace_init(void)
+{
+	int size, n;
+
+	trace.nr_cpus = sysconf(_SC_NPROCESSORS_ONLN);
+	trace.page_size = getpagesize();
+	trace.monotonic = true;
+
+	for (n = 0; n < NUM_KINDS; n++)
+		if (tracepoint_open(&tracepoints[n]))
+			return;
+
+	trace.map = calloc(trace.nr_cpus, sizeof(void *));
+	if (trace.map == NULL)
+		return;
+
+	size = (1 + N_PAGES) * trace.page_size;
+	for (n = 0; n < trace.nr_cpus; n++) {
+		trace.map[n] = mmap(NULL, size, PROT_READ | PROT_WRITE,
+				    MAP_SHARED, trace.fd[n], 0);
+		if (trace.map[n] == MAP_FAILED)
+			return;
+	}
+
+	for (n = trace.nr_cpus; n < NUM_KINDS * trace.nr_cpus; n++)
+		if (ioctl(trace.fd[n], PERF_EVENT_IOC_SET_OUTPUT,
+			  trace.fd[n % trace.nr_cpus]))
+			return;
+
+	trace.enabled = true;
+}
+
+static bool in_tree(pid_t pid)
+{
+	int n;
+
+	for (n = 0; n < trace.tree_size; n++)
+		if (trace.tree[n] == pid)
+			return true;
+	return false;
+}
+
+static void add_to_tree(pid_t pid)
+{
+	if (in_tree(pid))
+		return;
+
+	if (trace.tree_size == trace.max_tree) {
+		int max = trace.max_tree ? 2 * trace.max_tree : 64;
+		pid_t *tree = realloc(trace.tree, max * sizeof(*tree));
+
+		if (tree == NULL)
+			return;
+		trace.tree = tree;
+		trace.max_tree = max;
+	}
+	trace.tree[trace.tree_size++] = pid;
+}
+
+/*
+ * The sample layout asked for above:
+ *
+ *	struct perf_event_header header;
+ *	u32 pid, tid;
+ *	u64 time;
+ *	u64 stream_id;
+ *	u32 raw_size;
+ *	u8 raw[raw_size];
+ */
+static void decode_sample(int cpu, const uint8_t *data)
+{
+	const struct perf_event_header *header = (const void *)data;
+	struct event *e;
+	uint64_t id, time;
+	uint32_t pid, raw_size;
+	const uint8_t *raw;
+	int k, n;
+
+	if (header->size < sizeof(*header) + 28)
+		return;
+
+	memcpy(&pid, data + 8, 4);
+	memcpy(&time, data + 16, 8);
+	memcpy(&id, data + 24, 8);
+	memcpy(&raw_size, data + 32, 4);
+	raw = data + 36;
+	if (36 + raw_size > header->size)
+		return;
+
+	for (k = 0; k < NUM_KINDS; k++)
+		if (tracepoints[k].ids[cpu] == id)
+			break;
+	if (k == NUM_KINDS)
+		return;
+
+	if (trace.num_events == trace.max_events) {
+		int max = trace.max_events ? 2 * trace.max_events : 1024;
+		struct event *events;
+
+		events = realloc(trace.events, max * sizeof(*events));
+		if (events == NULL) {
+			trace.lost++;
+			return;
+		}
+		trace.events = events;
+		trace.max_events = max;
+	}
+
+	e = &trace.events[trace.num_events++];
+	e->time = time;
+	e->kind = k;
+	e->pid = pid;
+	for (n = 0; n < 2; n++) {
+		int offset = tracepoints[k].offset[n];
+
+		if (offset + 4 <= (int)raw_size)
+			memcpy(&e->field[n], raw + offset, 4);
+		else
+			e->field[n] = 0;
+	}
+}
+
+static void read_samples(int cpu)
+{
+	const int size = N_PAGES * trace.page_size;
+	const int mask = size - 1;
+	struct perf_event_mmap_page *mmap = trace.map[cpu];
+	const uint8_t *data;
+	uint8_t buffer[4096];
+	uint64_t head, tail;
+
+	tail = mmap->data_tail;
+	head = mmap->data_head;
+	rmb();
+
+	data = (uint8_t *)mmap + trace.page_size;
+	while (head - tail >= sizeof(struct perf_event_header)) {
+		const struct perf_event_header *header;
+
+		header = (const void *)(data + (tail & mask));
+		if (header->size == 0 || header->size > head - tail)
+			break;
+
+		if ((tail & mask) + header->size > (uint64_t)size) {
+			int before = size - (tail & mask);
+
+			if (header->size > sizeof(buffer)) {
+				tail += header->size;
+				continue;
+			}
+			memcpy(buffer, header, before);
+			memcpy(buffer + before, data, header->size - before);
+			header = (const void *)buffer;
+		}
+
+		if (header->type == PERF_RECORD_SAMPLE)
+			decode_sample(cpu, (const uint8_t *)header);
+		else if (header->type == PERF_RECORD_LOST)
+			trace.lost++;
+		tail += header->size;
+	}
+
+	mmap->data_tail = tail;
+	wmb();
+}
+
+static struct ring *event_ring(const struct event *e)
+{
+	if (e->field[0] >= NUM_RINGS)
+		return NULL;
+	return &rings[e->field[0]];
+}
+
+static void request_complete(struct ring *ring, uint32_t seqno, uint64_t time)
+{
+	struct request *rq;
+
+	while ((rq = ring->first) && (int32_t)(rq->seqno - seqno) <= 0) {
+		uint64_t start = rq->time;
+
+		if (start < ring->last_complete)
+			start = ring->last_complete;
+		if (rq->ours && time > start)
+			ring->busy_ns += time - start;
+		ring->last_complete = time;
+
+		ring->first = rq->next;
+		if (ring->first == NULL)
+			ring->last = NULL;
+		free(rq);
+	}
+}
+
+static void process_event(const struct event *e)
+{
+	struct ring *ring = event_ring(e);
+	struct request *rq;
+	struct wait *w, **prev;
+
+	switch (e->kind) {
+	case REQUEST_ADD:
+		if (ring == NULL || (rq = malloc(sizeof(*rq))) == NULL)
+			break;
+		rq->next = NULL;
+		rq->seqno = e->field[1];
+		rq->time = e->time;
+		rq->ours = in_tree(e->pid);
+		if (ring->last)
+			ring->last->next = rq;
+		else
+			ring->first = rq;
+		ring->last = rq;
+		ring->requests += rq->ours;
+		break;
+
+	case REQUEST_COMPLETE:
+		if (ring)
+			request_complete(ring, e->field[1], e->time);
+		break;
+
+	case WAIT_BEGIN:
+		if (ring == NULL || !in_tree(e->pid) ||
+		    (w = malloc(sizeof(*w))) == NULL)
+			break;
+		w->pid = e->pid;
+		w->seqno = e->field[1];
+		w->time = e->time;
+		w->next = ring->waits;
+		ring->waits = w;
+		break;
+
+	case WAIT_END:
+		if (ring == NULL)
+			break;
+		for (prev = &ring->waits; (w = *prev); prev = &w->next) {
+			if (w->pid != e->pid || w->seqno != e->field[1])
+				continue;
+			ring->wait_ns += e->time - w->time;
+			*prev = w->next;
+			free(w);
+			break;
+		}
+		break;
+
+	case RING_SYNC:
+		if (ring && in_tree(e->pid))
+			ring->syncs++;
+		break;
+
+	case PROCESS_FORK:
+		/* the event comes from the parent, its tid may be a thread's */
+		if (in_tree(e->pid))
+			add_to_tree(e->field[0]);
+		break;
+
+	default:
+		break;
+	}
+}
+
+static int event_cmp(const void *a, const void *b)
+{
+	const struct event *ea = a, *eb = b;
+
+	if (ea->time < eb->time)
+		return -1;
+	return ea->time > eb->time;
+}
+
+/*
+ * Reads all cpus and processes the events in time order. Events later
+ * than the start of the read may still be missing from a cpu read before
+ * them, so those wait for the next round, unless it's the last one.
+ */
+static void trace_drain(bool last)
+{
+	uint64_t cutoff = last || !trace.monotonic ? -1ull : now_ns();
+	int n, done;
+
+	if (!trace.enabled)
+		return;
+
+	for (n = 0; n < trace.nr_cpus; n++)
+		read_samples(n);
+
+	qsort(trace.events, trace.num_events, sizeof(*trace.events),
+	      event_cmp);
+	for (done = 0; done < trace.num_events; done++) {
+		if (trace.events[done].time > cutoff)
+			break;
+		process_event(&trace.events[done]);
+	}
+
+	trace.num_events -= done;
+	memmove(trace.events, trace.events + done,
+		trace.num_events * sizeof(*trace.events));
+}
+
+static double tv_secs(const struct timeval *tv)
+{
+	return tv->tv_sec + 1e-6 * tv->tv_usec;
+}
+
+static void json_string(FILE *out, const char *s)
+{
+	fputc('"', out);
+	for (; *s; s++) {
+		if (*s == '"' || *s == '\\')
+			fprintf(out, "\\%c", *s);
+		else if ((unsigned char)*s < 0x20)
+			fprintf(out, "\\u%04x", *s);
+		else
+			fputc(*s, out);
+	}
+	fputc('"', out);
+}
+
+static void write_json(FILE *out, char **argv, int status,
+		       const struct timeval *elapsed,
+		       const struct rusage *rusage, unsigned long samples)
+{
+	unsigned n;
+	bool first = true;
+
+	fprintf(out, "{\n\t\"command\": [");
+	for (n = 0; argv[n]; n++) {
+		if (n)
+			fprintf(out, ", ");
+		json_string(out, argv[n]);
+	}
+	fprintf(out, "],\n");
+	fprintf(out, "\t\"status\": %d,\n", status);
+	fprintf(out, "\t\"elapsed\": %.6f,\n", tv_secs(elapsed));
+	fprintf(out, "\t\"rusage\": {\n");
+	fprintf(out, "\t\t\"user\": %.6f,\n", tv_secs(&rusage->ru_utime));
+	fprintf(out, "\t\t\"sys\": %.6f,\n", tv_secs(&rusage->ru_stime));
+	fprintf(out, "\t\t\"maxrss_kb\": %ld,\n", rusage->ru_maxrss);
+	fprintf(out, "\t\t\"minflt\": %ld,\n", rusage->ru_minflt);
+	fprintf(out, "\t\t\"majflt\": %ld,\n", rusage->ru_majflt);
+	fprintf(out, "\t\t\"nvcsw\": %ld,\n", rusage->ru_nvcsw);
+	fprintf(out, "\t\t\"nivcsw\": %ld\n", rusage->ru_nivcsw);
+	fprintf(out, "\t},\n");
+	fprintf(out, "\t\"samples\": %lu,\n", samples);
+	fprintf(out, "\t\"attributed\": %s,\n",
+		trace.enabled ? "true" : "false");
+	fprintf(out, "\t\"rings\": {");
+	for (n = 0; n < NUM_RINGS; n++) {
+		const struct ring *ring = &rings[n];
+
+		if (!ring->present)
+			continue;
+
+		fprintf(out, "%s\n\t\t\"%s\": {\n", first ? "" : ",",
+			ring->name);
+		fprintf(out, "\t\t\t\"busy\": %.4f,\n",
+			samples ? 1 - (double)ring->idle / samples : 0);
+		fprintf(out, "\t\t\t\"wait\": %.4f,\n",
+			samples ? (double)ring->wait / samples : 0);
+		fprintf(out, "\t\t\t\"sema\": %.4f",
+			samples ? (double)ring->sema / samples : 0);
+		if (trace.enabled) {
+			fprintf(out, ",\n\t\t\t\"process_busy\": %.6f,\n",
+				ring->busy_ns / 1e9);
+			fprintf(out, "\t\t\t\"process_wait\": %.6f,\n",
+				ring->wait_ns / 1e9);
+			fprintf(out, "\t\t\t\"process_requests\": %lu,\n",
+				ring->requests);
+			fprintf(out, "\t\t\t\"process_syncs\": %lu",
+				ring->syncs);
+		}
+		fprintf(out, "\n\t\t}");
+		first = false;
+	}
+	fprintf(out, "\n\t}\n}\n");
+}
+
+static void usage(const char *name)
+{
+	fprintf(stderr,
+		"usage: %s [-s samples] [-j file] cmd [args...]\n"
+		"  -s samples  ring samples per second (default %d)\n"
+		"  -j file     also write the results as json, '-' for stdout\n"
+		"              (the summary then goes to stderr)\n",
+		name, SAMPLES_PER_SEC);
+}
+
 int main(int argc, char **argv)
 {
+	struct pci_device *pci_dev;
 	pid_t child;
-	uint64_t ring_idle = 0, ring_time = 0;
+	unsigned long samples = 0;
+	uint64_t period, next;
 	struct timeval start, end;
 	static struct rusage rusage;
-	int status;
+	const char *json = NULL;
+	int samples_per_sec = SAMPLES_PER_SEC;
+	int status, opt;
+	FILE *text;
+	unsigned n;
 
-	intel_get_mmio(intel_get_pci_device());
+	while ((opt = getopt(argc, argv, "+s:j:h")) != -1) {
+		switch (opt) {
+		case 's':
+			samples_per_sec = atoi(optarg);
+			break;
+		case 'j':
+			json = optarg;
+			break;
+		case 'h':
+			usage(argv[0]);
+			return 0;
+		default:
+			usage(argv[0]);
+			return 1;
+		}
+	}
 
-	if (argc == 1) {
-		fprintf(stderr, "usage: %s cmd [args...]\n", argv[0]);
+	if (optind == argc || samples_per_sec <= 0) {
+		usage(argv[0]);
 		return 1;
 	}
 
+	pci_dev = intel_get_pci_device();
+	intel_get_mmio(pci_dev);
+	rings_init(pci_dev->device_id);
+	trace_init();
+
 	signal(SIGCHLD, sighandler);
 	signal(SIGINT, SIG_IGN);
 	signal(SIGQUIT, SIG_IGN);
 
 	gettimeofday(&start, NULL);
-	child = spawn(argv+1);
+	child = spawn(argv + optind);
 	if (child < 0)
 		return 127;
+	add_to_tree(child);
 
+	period = 1000000000 / samples_per_sec;
+	next = now_ns();
 	while (!goddo) {
-		uint32_t ring_head, ring_tail;
+		struct timespec ts;
 
-		ring_head = INREG(LP_RING + RING_HEAD) & HEAD_ADDR;
-		ring_tail = INREG(LP_RING + RING_TAIL) & TAIL_ADDR;
+		rings_sample();
+		if (++samples % SAMPLES_PER_DRAIN == 0)
+			trace_drain(false);
 
-		if (ring_tail == ring_head)
-			ring_idle++;
-		ring_time++;
-
-		usleep(1000000 / SAMPLES_PER_SEC);
+		next += period;
+		ts.tv_sec = next / 1000000000;
+		ts.tv_nsec = next % 1000000000;
+		clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL);
 	}
 	gettimeofday(&end, NULL);
 	timersub(&end, &start, &end);
 
 	waitpid(child, &status, 0);
+	trace_drain(true);
+
+	/* like the shell does for a command killed by a signal */
+	status = WIFEXITED(status) ? WEXITSTATUS(status) :
+		WIFSIGNALED(status) ? 128 + WTERMSIG(status) : 1;
+
+	/* keep stdout valid json for -j - */
+	text = json && strcmp(json, "-") == 0 ? stderr : stdout;
 
 	getrusage(RUSAGE_CHILDREN, &rusage);
-	printf("user: %ld.%06lds, sys: %ld.%06lds, elapsed: %ld.%06lds, CPU: %.1f%%, GPU: %.1f%%\n",
-	       rusage.ru_utime.tv_sec, rusage.ru_utime.tv_usec,
-	       rusage.ru_stime.tv_sec, rusage.ru_stime.tv_usec,
-	       end.tv_sec, end.tv_usec,
-	       100*(rusage.ru_utime.tv_sec + 1e-6*rusage.ru_utime.tv_usec + rusage.ru_stime.tv_sec + 1e-6*rusage.ru_stime.tv_usec) / (end.tv_sec + 1e-6*end.tv_usec),
-	       100 - ring_idle * 100. / ring_time);
-
-	return WEXITSTATUS(status);
+	fprintf(text, "user: %ld.%06lds, sys: %ld.%06lds, elapsed: %ld.%06lds, CPU: %.1f%%, GPU: %.1f%%\n",
+		rusage.ru_utime.tv_sec, rusage.ru_utime.tv_usec,
+		rusage.ru_stime.tv_sec, rusage.ru_stime.tv_usec,
+		end.tv_sec, end.tv_usec,
+		100*(tv_secs(&rusage.ru_utime) + tv_secs(&rusage.ru_stime)) / tv_secs(&end),
+		100 - rings[0].idle * 100. / samples);
+
+	for (n = 0; n < NUM_RINGS; n++) {
+		const struct ring *ring = &rings[n];
+
+		if (!ring->present)
+			continue;
+
+		fprintf(text, "%s: busy %.1f%%, wait %.1f%%, sema %.1f%%",
+			ring->name,
+			100 - ring->idle * 100. / samples,
+			ring->wait * 100. / samples,
+			ring->sema * 100. / samples);
+		if (trace.enabled)
+			fprintf(text, "; command: %.6fs in %lu requests, waited %.6fs, %lu syncs",
+				ring->busy_ns / 1e9, ring->requests,
+				ring->wait_ns / 1e9, ring->syncs);
+		fprintf(text, "\n");
+	}
+	if (trace.lost)
+		fprintf(text, "lost %lu tracepoint events, the command's times are low\n",
+			trace.lost);
+
+	if (json) {
+		FILE *out = strcmp(json, "-") ? fopen(json, "w") : stdout;
+
+		if (out == NULL) {
+			perror(json);
+			return 1;
+		}
+		write_json(out, argv + optind, status, &end,
+			   &rusage, samples);
+		if (out != stdout)
+			fclose(out);
+	}
+
+	return status;
 }
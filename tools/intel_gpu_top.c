@@ -57,11 +57,13 @@
 
 struct top_bit {
 	struct instdone_bit *bit;
+	int index;		/* in the sample word */
 	int count;
 } top_bits[MAX_NUM_TOP_BITS];
 struct top_bit *top_bits_sorted[MAX_NUM_TOP_BITS];
 
-static uint32_t instdone, instdone1;
+/* of the idle bits, i.e. those clear in INSTDONE */
+static struct instdone_counter idle_counter;
 
 static const char *bars[] = {
 	" ",
@@ -139,20 +141,6 @@ top_bits_sort(const void *a, const void *b)
 		return -1;
 }
 
-static void
-update_idle_bit(struct top_bit *top_bit)
-{
-	uint32_t reg_val;
-
-	if (top_bit->bit->reg == INST_DONE_1)
-		reg_val = instdone1;
-	else
-		reg_val = instdone;
-
-	if ((reg_val & top_bit->bit->bit) == 0)
-		top_bit->count++;
-}
-
 static void
 print_clock(const char *name, int clock) {
 	if (clock == -1)
@@ -504,6 +492,7 @@ int main(int argc, char **argv)
 
 	for (i = 0; i < num_instdone_bits; i++) {
 		top_bits[i].bit = &instdone_bits[i];
+		top_bits[i].index = instdone_bit_index(&instdone_bits[i]);
 		top_bits[i].count = 0;
 		top_bits_sorted[i] = &top_bits[i];
 	}
@@ -535,8 +524,9 @@ int main(int argc, char **argv)
 		}
 	}
 
+	instdone_counter_reset(&idle_counter);
+
 	for (;;) {
-		int j;
 		unsigned long long t1, ti, tf, t2;
 		unsigned long long def_sleep = 1000000 / samples_per_sec;
 		unsigned long long last_samples_per_sec = samples_per_sec;
@@ -556,6 +546,7 @@ int main(int argc, char **argv)
 		ring_reset(&blt_ring);
 
 		for (i = 0; i < samples_per_sec; i++) {
+			uint32_t instdone, instdone1 = 0;
 			long long interval;
 			ti = gettime();
 			if (IS_965(devid)) {
@@ -564,8 +555,8 @@ int main(int argc, char **argv)
 			} else
 				instdone = INREG(INST_DONE);
 
-			for (j = 0; j < num_instdone_bits; j++)
-				update_idle_bit(&top_bits[j]);
+			instdone_counter_add(&idle_counter,
+					     ~((uint64_t)instdone1 << 32 | instdone));
 
 			ring_sample(&render_ring);
 			ring_sample(&bsd_ring);
@@ -598,6 +589,10 @@ int main(int argc, char **argv)
 			}
 		}
 
+		instdone_counter_flush(&idle_counter);
+		for (i = 0; i < num_instdone_bits; i++)
+			top_bits[i].count = idle_counter.counts[top_bits[i].index];
+
 		qsort(top_bits_sorted, num_instdone_bits,
 		      sizeof(struct top_bit *), top_bits_sort);
 
@@ -688,6 +683,7 @@ int main(int argc, char **argv)
 			fflush(output);
 		}
 
+		instdone_counter_reset(&idle_counter);
 		for (i = 0; i < num_instdone_bits; i++) {
 			top_bits_sorted[i]->count = 0;
 
@@ -25,6 +25,12 @@
  *
  */
 
+/*
+ * The GTT is copied out of the device once and everything else works on
+ * that copy, which can also be saved to a snapshot file and looked at
+ * later, or compared with another snapshot.
+ */
+
 #define __STDC_FORMAT_MACROS
 #include <inttypes.h>
 #include <stdio.h>
@@ -33,101 +39,111 @@
 #include <stdarg.h>
 #include <pciaccess.h>
 #include <unistd.h>
+#include <err.h>
 
 #include "intel_gpu_tools.h"
 
 #define KB(x) ((x) * 1024)
 #define MB(x) ((x) * 1024 * 1024)
-unsigned char *gtt;
-uint32_t devid;
 
-#define INGTT(offset) (*(volatile uint32_t *)(gtt + (offset) / (KB(4) / 4)))
-static uint64_t get_phys(uint32_t pt_offset)
-{
-	uint64_t pae = 0;
-	uint64_t phys = INGTT(pt_offset);
+/*
+ * A snapshot is this header followed by the PTEs as they were read, in
+ * the byte order of the machine that saved it. The PTE bits holding the
+ * upper physical address bits are saved along, so that snapshots of
+ * platforms this tool no longer knows about can still be decoded.
+ */
+#define GTT_SNAPSHOT_MAGIC	"IGTT"
+#define GTT_SNAPSHOT_VERSION	2
 
+struct gtt_snapshot_header {
+	char magic[4];
+	uint32_t version;
+	uint32_t devid;
+	uint32_t num_ptes;
+	uint32_t pae_mask;
+};
+
+/* how a PTE relates to the next one */
+enum step {
+	STEP_OTHER,
+	STEP_LINEAR,
+	STEP_CONSTANT,
+};
+
+struct run {
+	uint32_t start;		/* PTE index */
+	uint32_t length;	/* in pages */
+	enum step kind;
+	uint64_t phys;
+};
+
+struct gtt {
+	uint32_t devid;
+	uint32_t pae;		/* PTE bits holding physical bits 32 and up */
+	uint32_t num_ptes;
+	uint32_t *ptes;
+	uint64_t *phys;
+	uint8_t *steps;
+	struct run *runs;
+	uint32_t num_runs;
+	uint64_t scratch;	/* what the unused PTEs point at */
+};
+
+static uint32_t pae_mask(uint32_t devid)
+{
 	if (intel_gen(devid) < 4 && !IS_G33(devid))
-		return phys & ~0xfff;
+		return 0;
 
 	switch (intel_gen(devid)) {
 		case 3:
 		case 4:
 		case 5:
-			pae = (phys & 0xf0) << 28;
-			break;
+			return 0xf0;
 		case 6:
 		case 7:
 			if (IS_HASWELL(devid))
-				pae = (phys & 0x7f0) << 28;
+				return 0x7f0;
 			else
-				pae = (phys & 0xff0) << 28;
-			break;
+				return 0xff0;
 		default:
 			fprintf(stderr, "Unsupported platform\n");
 			exit(-1);
 	}
-
-	return (phys | pae) & ~0xfff;
-}
-
-static void pte_dump(int size, uint32_t offset) {
-	int start;
-	/* Want to print 4 ptes at a time (4b PTE assumed). */
-	if (size % 16)
-		size = (size + 16) & ~0xffff;
-
-
-	printf("GTT offset |                 PTEs\n");
-	printf("--------------------------------------------------------\n");
-	for (start = 0; start < size; start += KB(16)) {
-		printf("  0x%06x | 0x%08x 0x%08x 0x%08x 0x%08x\n",
-				start,
-				INGTT(start + 0x0),
-				INGTT(start + 0x1000),
-				INGTT(start + 0x2000),
-				INGTT(start + 0x3000));
-	}
 }
 
-int main(int argc, char **argv)
+static void read_gtt(struct gtt *gtt, struct pci_device *pci_dev)
 {
-	struct pci_device *pci_dev;
-	int start, aper_size;
+	volatile uint32_t *ptes = NULL;
+	pciaddr_t size;
+	uint32_t i;
 	int flag[] = {
 		PCI_DEV_MAP_FLAG_WRITE_COMBINE,
 		PCI_DEV_MAP_FLAG_WRITABLE,
 		0
 	}, f;
 
-	pci_dev = intel_get_pci_device();
-	devid = pci_dev->device_id;
-
-	if (IS_GEN2(devid)) {
-		printf("Unsupported chipset for gtt dumper\n");
-		exit(1);
-	}
-
 	for (f = 0; flag[f] != 0; f++) {
-		if (IS_GEN3(devid)) {
+		if (IS_GEN3(gtt->devid)) {
 			/* 915/945 chips has GTT range in bar 3 */
+			size = pci_dev->regions[3].size;
 			if (pci_device_map_range(pci_dev,
 						 pci_dev->regions[3].base_addr,
-						 pci_dev->regions[3].size,
+						 size,
 						 flag[f],
-						 (void **)&gtt) == 0)
+						 (void **)&ptes) == 0)
 				break;
 		} else {
 			int offset;
-			if (IS_GEN4(devid))
+			if (IS_GEN4(gtt->devid))
 				offset = KB(512);
 			else
 				offset = MB(2);
+			size = offset;
 			if (pci_device_map_range(pci_dev,
 						 pci_dev->regions[0].base_addr + offset,
 						 offset,
 						 flag[f],
-						 (void **)&gtt) == 0)
+						 (void **)&ptes) == 0)
 				break;
 		}
 	}
@@ -136,51 +152,516 @@ int main(int argc, char **argv)
 		exit(1);
 	}
 
-	aper_size = pci_dev->regions[2].size;
-	if (argc > 1 && !strncmp("-d", argv[1], 2)) {
-		pte_dump(aper_size, 0);
-		return 0;
+	gtt->num_ptes = pci_dev->regions[2].size / KB(4);
+	if (gtt->num_ptes > size / 4)
+		gtt->num_ptes = size / 4;
+
+	gtt->ptes = malloc(gtt->num_ptes * sizeof(uint32_t));
+	if (gtt->ptes == NULL)
+		err(1, "malloc");
+	for (i = 0; i < gtt->num_ptes; i++)
+		gtt->ptes[i] = ptes[i];
+
+	pci_device_unmap_range(pci_dev, (void *)ptes, size);
+}
+
+static void read_snapshot(struct gtt *gtt, const char *path)
+{
+	struct gtt_snapshot_header header;
+	FILE *file;
+
+	file = fopen(path, "r");
+	if (file == NULL)
+		err(1, "%s", path);
+
+	if (fread(&header, sizeof(header), 1, file) != 1 ||
+	    memcmp(header.magic, GTT_SNAPSHOT_MAGIC, 4))
+		errx(1, "%s: not a GTT snapshot", path);
+	if (header.version != GTT_SNAPSHOT_VERSION)
+		errx(1, "%s: unknown snapshot version %u", path,
+		     header.version);
+
+	gtt->devid = header.devid;
+	gtt->pae = header.pae_mask;
+	gtt->num_ptes = header.num_ptes;
+	gtt->ptes = malloc(gtt->num_ptes * sizeof(uint32_t));
+	if (gtt->ptes == NULL)
+		err(1, "malloc");
+	if (fread(gtt->ptes, sizeof(uint32_t), gtt->num_ptes, file) !=
+	    gtt->num_ptes)
+		errx(1, "%s: truncated snapshot", path);
+
+	fclose(file);
+}
+
+static void write_snapshot(const struct gtt *gtt, const char *path)
+{
+	struct gtt_snapshot_header header;
+	FILE *file;
+
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, GTT_SNAPSHOT_MAGIC, 4);
+	header.version = GTT_SNAPSHOT_VERSION;
+	header.devid = gtt->devid;
+	header.num_ptes = gtt->num_ptes;
+	header.pae_mask = gtt->pae;
+
+	file = fopen(path, "w");
+	if (file == NULL)
+		err(1, "%s", path);
+	fwrite(&header, sizeof(header), 1, file);
+	fwrite(gtt->ptes, sizeof(uint32_t), gtt->num_ptes, file);
+	if (fclose(file))
+		err(1, "%s", path);
+}
+
+/*
+ * The number of steps from i on that are of the given kind. The steps are
+ * compared 8 at a time, which goes quickly over the long runs that make
+ * up most of the GTT.
+ */
+static uint32_t step_run(const struct gtt *gtt, uint32_t i, enum step step)
+{
+	const uint64_t pattern = 0x0101010101010101ull * step;
+	uint32_t start = i;
+	uint64_t word;
+
+	while (i + 8 <= gtt->num_ptes) {
+		memcpy(&word, gtt->steps + i, 8);
+		if (word != pattern)
+			break;
+		i += 8;
 	}
+	while (i < gtt->num_ptes && gtt->steps[i] == step)
+		i++;
 
-	for (start = 0; start < aper_size; start += KB(4)) {
-		uint64_t start_phys = get_phys(start);
-		uint32_t end;
-		int constant_length = 0;
-		int linear_length = 0;
+	return i - start;
+}
 
-		/* Check if it's a linear sequence */
-		for (end = start + KB(4); end < aper_size; end += KB(4)) {
-			uint64_t end_phys = get_phys(end);
-			if (end_phys == start_phys + (end - start))
-				linear_length++;
-			else
-				break;
+/*
+ * Splits the GTT into runs of pages that are linear in physical memory,
+ * that all point at the same page, or single pages in between. The PTEs
+ * are decoded and compared with the next one in loops without branches,
+ * which the compiler can vectorize.
+ */
+static void analyze(struct gtt *gtt)
+{
+	uint64_t pae = gtt->pae;
+	uint32_t i, n = gtt->num_ptes, length, longest = 0;
+
+	gtt->phys = malloc(n * sizeof(uint64_t));
+	gtt->steps = malloc(n);
+	gtt->runs = malloc(n * sizeof(struct run));
+	if (gtt->phys == NULL || gtt->steps == NULL || gtt->runs == NULL)
+		err(1, "malloc");
+
+	for (i = 0; i < n; i++) {
+		uint64_t pte = gtt->ptes[i];
+
+		gtt->phys[i] = (pte | (pte & pae) << 28) & ~0xfffull;
+	}
+
+	for (i = 0; i + 1 < n; i++) {
+		uint64_t delta = gtt->phys[i + 1] - gtt->phys[i];
+
+		gtt->steps[i] = (delta == KB(4)) * STEP_LINEAR +
+				(delta == 0) * STEP_CONSTANT;
+	}
+	if (n)
+		gtt->steps[n - 1] = STEP_OTHER;
+
+	gtt->num_runs = 0;
+	for (i = 0; i < n; i += length) {
+		struct run *run = &gtt->runs[gtt->num_runs++];
+
+		run->start = i;
+		run->phys = gtt->phys[i];
+
+		if ((length = step_run(gtt, i, STEP_LINEAR))) {
+			run->kind = STEP_LINEAR;
+			length++;
+		} else if ((length = step_run(gtt, i, STEP_CONSTANT))) {
+			run->kind = STEP_CONSTANT;
+			length++;
+		} else {
+			run->kind = STEP_OTHER;
+			length = 1;
+		}
+		run->length = length;
+
+		/* unused PTEs all point at the scratch page */
+		if (run->kind == STEP_CONSTANT && length > longest) {
+			longest = length;
+			gtt->scratch = run->phys;
 		}
-		if (linear_length > 0) {
+	}
+	if (longest == 0)
+		gtt->scratch = ~0ull;
+}
+
+static void print_runs(const struct gtt *gtt)
+{
+	uint32_t i;
+
+	for (i = 0; i < gtt->num_runs; i++) {
+		const struct run *run = &gtt->runs[i];
+		uint32_t start = run->start * KB(4);
+		uint32_t end = (run->start + run->length - 1) * KB(4);
+
+		switch (run->kind) {
+		case STEP_LINEAR:
 			printf("0x%08x - 0x%08x: linear from "
 			       "0x%" PRIx64 " to 0x%" PRIx64 "\n",
-			       start, end - KB(4),
-			       start_phys, start_phys + (end - start) - KB(4));
-			start = end - KB(4);
+			       start, end,
+			       run->phys, run->phys + end - start);
+			break;
+		case STEP_CONSTANT:
+			printf("0x%08x - 0x%08x: constant 0x%" PRIx64 "%s\n",
+			       start, end, run->phys,
+			       run->phys == gtt->scratch ? " (scratch)" : "");
+			break;
+		default:
+			printf("0x%08x: 0x%" PRIx64 "\n", start, run->phys);
+			break;
+		}
+	}
+}
+
+static void pte_dump(const struct gtt *gtt) {
+	int size = gtt->num_ptes * KB(4);
+	int start;
+	/* Want to print 4 ptes at a time (4b PTE assumed). */
+	if (size % 16)
+		size = (size + 16) & ~0xffff;
+
+#define PTE(offset) ((offset) / KB(4) < gtt->num_ptes ? gtt->ptes[(offset) / KB(4)] : 0)
+
+	printf("GTT offset |                 PTEs\n");
+	printf("--------------------------------------------------------\n");
+	for (start = 0; start < size; start += KB(16)) {
+		printf("  0x%06x | 0x%08x 0x%08x 0x%08x 0x%08x\n",
+				start,
+				PTE(start + 0x0),
+				PTE(start + 0x1000),
+				PTE(start + 0x2000),
+				PTE(start + 0x3000));
+	}
+}
+
+#define MAX_ORDER	20
+
+struct stats {
+	uint32_t pages, scratch, mapped;
+	uint32_t extents, distinct;
+	uint32_t largest_run, largest_run_start;
+	uint32_t largest_free, largest_free_start;
+	uint32_t orders[MAX_ORDER + 1];	/* extents by log2 of their size */
+};
+
+struct extent {
+	uint64_t phys;
+	uint32_t length;
+};
+
+static int cmp_extent(const void *a, const void *b)
+{
+	const struct extent *ea = a, *eb = b;
+
+	if (ea->phys != eb->phys)
+		return ea->phys < eb->phys ? -1 : 1;
+	return ea->length < eb->length ? -1 : ea->length > eb->length;
+}
+
+/*
+ * An extent is a run of pages that is contiguous in physical memory and
+ * not the scratch page. The same extent may be mapped more than once.
+ */
+static void compute_stats(const struct gtt *gtt, struct stats *stats)
+{
+	struct extent *extents;
+	uint32_t i, n = 0, free_run = 0;
+	uint64_t end = 0;
+
+	memset(stats, 0, sizeof(*stats));
+	stats->pages = gtt->num_ptes;
+
+	extents = malloc((gtt->num_runs + 1) * sizeof(*extents));
+	if (extents == NULL)
+		err(1, "malloc");
+
+	for (i = 0; i < gtt->num_runs; i++) {
+		const struct run *run = &gtt->runs[i];
+		uint32_t length = run->kind == STEP_LINEAR ? run->length : 1;
+		int order = 0;
+
+		if (run->phys == gtt->scratch) {
+			stats->scratch += run->length;
+			free_run += run->length;
+			if (free_run > stats->largest_free) {
+				stats->largest_free = free_run;
+				stats->largest_free_start =
+					run->start + run->length - free_run;
+			}
 			continue;
 		}
+		free_run = 0;
 
-		/* Check if it's a constant sequence */
-		for (end = start + KB(4); end < aper_size; end += KB(4)) {
-			uint64_t end_phys = get_phys(end);
-			if (end_phys == start_phys)
-				constant_length++;
-			else
+		stats->mapped += run->length;
+		if (length > stats->largest_run) {
+			stats->largest_run = length;
+			stats->largest_run_start = run->start;
+		}
+
+		/* a constant run maps the same page over and over */
+		while (order < MAX_ORDER && (2u << order) <= length)
+			order++;
+		stats->orders[order] += run->kind == STEP_CONSTANT ?
+			run->length : 1;
+		stats->extents += run->kind == STEP_CONSTANT ? run->length : 1;
+		extents[n].phys = run->phys;
+		extents[n].length = length;
+		n++;
+	}
+
+	/* extents which overlap or touch count as one physical range */
+	qsort(extents, n, sizeof(*extents), cmp_extent);
+	for (i = 0; i < n; i++) {
+		uint64_t extent_end = extents[i].phys +
+			(uint64_t)extents[i].length * KB(4);
+
+		if (i == 0 || extents[i].phys > end)
+			stats->distinct++;
+		if (i == 0 || extent_end > end)
+			end = extent_end;
+	}
+
+	free(extents);
+}
+
+static void print_row(const char *label, char str[][64], int n)
+{
+	printf("%-24s %24s", label, str[0]);
+	if (n > 1)
+		printf(" %24s", str[1]);
+	printf("\n");
+}
+
+/* formats a row for each of the n columns, with i as the column */
+#define ROW(str, i, n, label, fmt, ...) do { \
+	for (i = 0; i < n; i++) \
+		snprintf(str[i], sizeof(str[i]), fmt, __VA_ARGS__); \
+	print_row(label, str, n); \
+} while (0)
+
+/* Prints the statistics of one GTT, or of two side by side. */
+static void print_stats(const struct gtt **gtts, int n)
+{
+	struct stats stats[2];
+	char str[2][64], label[48];
+	int i, order;
+
+	for (i = 0; i < n; i++)
+		compute_stats(gtts[i], &stats[i]);
+
+	if (n > 1)
+		ROW(str, i, n, "", "%s", i ? "new" : "old");
+	ROW(str, i, n, "pages", "%u", stats[i].pages);
+	ROW(str, i, n, "mapped pages", "%u", stats[i].mapped);
+	ROW(str, i, n, "scratch pages", "%u", stats[i].scratch);
+	ROW(str, i, n, "extents", "%u", stats[i].extents);
+	ROW(str, i, n, "distinct extents", "%u", stats[i].distinct);
+	ROW(str, i, n, "largest extent", "%u at 0x%08x",
+	    stats[i].largest_run, stats[i].largest_run_start * KB(4));
+	ROW(str, i, n, "largest free run", "%u at 0x%08x",
+	    stats[i].largest_free, stats[i].largest_free_start * KB(4));
+	/* 0 when all the free space is in one piece, towards 1 the more
+	 * pieces it is split into */
+	ROW(str, i, n, "free fragmentation", "%.3f", stats[i].scratch ?
+	    1 - (double)stats[i].largest_free / stats[i].scratch : 0.);
+
+	for (order = 0; order <= MAX_ORDER; order++) {
+		for (i = 0; i < n; i++)
+			if (stats[i].orders[order])
 				break;
+		if (i == n)
+			continue;
+
+		if (order == 0)
+			snprintf(label, sizeof(label), "extents of 1 page");
+		else if (order == MAX_ORDER)
+			snprintf(label, sizeof(label), "extents of %u+ pages",
+				 1u << order);
+		else
+			snprintf(label, sizeof(label), "extents of %u-%u pages",
+				 1u << order, (2u << order) - 1);
+		ROW(str, i, n, label, "%u", stats[i].orders[order]);
+	}
+}
+
+enum change {
+	CHANGE_NONE,
+	CHANGE_MAPPED,
+	CHANGE_UNMAPPED,
+	CHANGE_REMAPPED,
+};
+
+static enum change page_change(const struct gtt *old, const struct gtt *new,
+			       uint32_t i)
+{
+	if (old->phys[i] == new->phys[i])
+		return CHANGE_NONE;
+	if (old->phys[i] == old->scratch)
+		return CHANGE_MAPPED;
+	if (new->phys[i] == new->scratch)
+		return CHANGE_UNMAPPED;
+	return CHANGE_REMAPPED;
+}
+
+/* Prints the ranges of pages that are mapped differently in new. */
+static void print_diff(const struct gtt *old, const struct gtt *new)
+{
+	uint32_t counts[CHANGE_REMAPPED + 1] = { 0 };
+	uint32_t i, end, n = old->num_ptes;
+	enum change change;
+
+	if (old->devid != new->devid)
+		fprintf(stderr, "warning: comparing device 0x%04x with 0x%04x\n",
+			old->devid, new->devid);
+	if (old->num_ptes != new->num_ptes) {
+		fprintf(stderr, "warning: comparing %u with %u PTEs\n",
+			old->num_ptes, new->num_ptes);
+		if (new->num_ptes < n)
+			n = new->num_ptes;
+	}
+
+	for (i = 0; i < n; i = end) {
+		/* most of the GTT stays the same, skip over it in blocks */
+		if (i + 8 <= n &&
+		    memcmp(&old->phys[i], &new->phys[i], 8 * sizeof(uint64_t)) == 0) {
+			end = i + 8;
+			continue;
 		}
-		if (constant_length > 0) {
-			printf("0x%08x - 0x%08x: constant 0x%" PRIx64 "\n",
-			       start, end - KB(4), start_phys);
-			start = end - KB(4);
+
+		change = page_change(old, new, i);
+		for (end = i + 1; end < n; end++)
+			if (page_change(old, new, end) != change)
+				break;
+		if (change == CHANGE_NONE)
 			continue;
+
+		printf("0x%08x - 0x%08x: ", i * KB(4), (end - 1) * KB(4));
+		switch (change) {
+		case CHANGE_MAPPED:
+			printf("mapped at 0x%" PRIx64 "\n", new->phys[i]);
+			break;
+		case CHANGE_UNMAPPED:
+			printf("unmapped from 0x%" PRIx64 "\n", old->phys[i]);
+			break;
+		default:
+			printf("remapped from 0x%" PRIx64 " to 0x%" PRIx64 "\n",
+			       old->phys[i], new->phys[i]);
+			break;
 		}
+		counts[change] += end - i;
+	}
+
+	printf("%u pages mapped, %u unmapped, %u remapped\n",
+	       counts[CHANGE_MAPPED], counts[CHANGE_UNMAPPED],
+	       counts[CHANGE_REMAPPED]);
+}
+
+static void usage(const char *name)
+{
+	printf("Usage: %s [options]\n"
+	       "Options:\n"
+	       "  -d         dump the PTEs\n"
+	       "  -S         print fragmentation statistics instead of the runs\n"
+	       "  -s file    save the GTT to a snapshot file\n"
+	       "  -f file    look at a snapshot instead of the device\n"
+	       "  -c file    compare with an older snapshot\n"
+	       "  -h         prints this help\n",
+	       name);
+}
+
+int main(int argc, char **argv)
+{
+	struct gtt gtt, old;
+	const char *snapshot = NULL, *save = NULL, *compare = NULL;
+	int dump = 0, stats = 0, opt;
+
+	while ((opt = getopt(argc, argv, "dSs:f:c:h")) != -1) {
+		switch (opt) {
+		case 'd':
+			dump = 1;
+			break;
+		case 'S':
+			stats = 1;
+			break;
+		case 's':
+			save = optarg;
+			break;
+		case 'f':
+			snapshot = optarg;
+			break;
+		case 'c':
+			compare = optarg;
+			break;
+		case 'h':
+			usage(argv[0]);
+			return 0;
+		default:
+			usage(argv[0]);
+			return 1;
+		}
+	}
+
+	memset(&gtt, 0, sizeof(gtt));
+	if (snapshot) {
+		read_snapshot(&gtt, snapshot);
+	} else {
+		struct pci_device *pci_dev;
+
+		pci_dev = intel_get_pci_device();
+		gtt.devid = pci_dev->device_id;
+
+		if (IS_GEN2(gtt.devid)) {
+			printf("Unsupported chipset for gtt dumper\n");
+			exit(1);
+		}
+
+		gtt.pae = pae_mask(gtt.devid);
+		read_gtt(&gtt, pci_dev);
+	}
+
+	if (save) {
+		write_snapshot(&gtt, save);
+		if (!dump && !stats && !compare)
+			return 0;
+	}
+
+	if (dump) {
+		pte_dump(&gtt);
+		return 0;
+	}
+
+	analyze(&gtt);
+
+	if (compare) {
+		const struct gtt *both[] = { &old, &gtt };
+
+		memset(&old, 0, sizeof(old));
+		read_snapshot(&old, compare);
+		analyze(&old);
+
+		print_diff(&old, &gtt);
+		printf("\n");
+		print_stats(both, 2);
+	} else if (stats) {
+		const struct gtt *one[] = { &gtt };
 
-		printf("0x%08x: 0x%" PRIx64 "\n", start, start_phys);
+		print_stats(one, 1);
+	} else {
+		print_runs(&gtt);
 	}
 
 	return 0;
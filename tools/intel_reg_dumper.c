@@ -34,6 +34,7 @@
 #include <err.h>
 #include <unistd.h>
 #include "intel_gpu_tools.h"
+#include "intel_reg_watch.h"
 
 static uint32_t devid = 0;
 
@@ -2633,6 +2634,176 @@ decode_register(char *name, uint32_t val)
 		decode_register_name(name, val);
 }
 
+/*
+ * The decoder of a register for the current device, picked from the same
+ * lists as a full dump would use, or from any list if none of those
+ * knows the register.
+ */
+static struct reg_debug *
+find_register(uint32_t address)
+{
+	struct reg_debug *lists[3];
+	int counts[3], n = 0, i, j;
+
+	if (IS_HASWELL(devid)) {
+		lists[n] = haswell_debug_regs;
+		counts[n++] = ARRAY_SIZE(haswell_debug_regs);
+	} else if (IS_GEN5(devid) || IS_GEN6(devid) || IS_IVYBRIDGE(devid)) {
+		lists[n] = ironlake_debug_regs;
+		counts[n++] = ARRAY_SIZE(ironlake_debug_regs);
+	} else {
+		if (IS_945GM(devid)) {
+			lists[n] = i945gm_mi_regs;
+			counts[n++] = ARRAY_SIZE(i945gm_mi_regs);
+		}
+		lists[n] = intel_debug_regs;
+		counts[n++] = ARRAY_SIZE(intel_debug_regs);
+	}
+	if (IS_GEN6(devid) || IS_GEN7(devid)) {
+		lists[n] = gen6_rp_debug_regs;
+		counts[n++] = ARRAY_SIZE(gen6_rp_debug_regs);
+	}
+
+	for (i = 0; i < n; i++)
+		for (j = 0; j < counts[i]; j++)
+			if (lists[i][j].reg == address)
+				return &lists[i][j];
+
+	for (i = 0; i < ARRAY_SIZE(known_registers); i++)
+		for (j = 0; j < known_registers[i].count; j++)
+			if (known_registers[i].regs[j].reg == address)
+				return &known_registers[i].regs[j];
+
+	return NULL;
+}
+
+static void
+guess_pch(void)
+{
+	if (IS_GEN5(devid))
+		pch = PCH_IBX;
+	else if (IS_GEN6(devid) || IS_IVYBRIDGE(devid))
+		pch = PCH_CPT;
+	else if (IS_HASWELL(devid))
+		pch = PCH_LPT;
+	else
+		pch = PCH_NONE;
+}
+
+/*
+ * Prints the changes recorded by intel_reg_watch, one line each with the
+ * time since the watch started, the old and the new value, and the new
+ * one decoded.
+ */
+static int
+decode_watch_log(const char *path)
+{
+	struct reg_watch_header header;
+	struct reg_watch_record rec;
+	struct reg_debug **decoders;
+	uint32_t *offsets, *values;
+	uint8_t *seen;
+	uint64_t t = 0;
+	unsigned long late = 0;
+	uint32_t mmio_size = 2 * 1024 * 1024;
+	FILE *f;
+	int i;
+
+	f = fopen(path, "r");
+	if (f == NULL)
+		err(1, "%s", path);
+
+	if (fread(&header, sizeof(header), 1, f) != 1 ||
+	    memcmp(header.magic, REG_WATCH_MAGIC, 4) ||
+	    header.version != REG_WATCH_VERSION)
+		errx(1, "%s: not a register watch log", path);
+
+	if (!devid)
+		devid = header.devid;
+	guess_pch();
+
+	offsets = calloc(header.num_regs, sizeof(*offsets));
+	values = calloc(header.num_regs, sizeof(*values));
+	seen = calloc(header.num_regs, sizeof(*seen));
+	decoders = calloc(header.num_regs, sizeof(*decoders));
+	if (!offsets || !values || !seen || !decoders)
+		err(1, "calloc");
+
+	if (fread(offsets, sizeof(*offsets), header.num_regs, f) !=
+	    header.num_regs)
+		errx(1, "%s: truncated", path);
+	for (i = 0; i < header.num_regs; i++) {
+		decoders[i] = find_register(offsets[i]);
+		if (offsets[i] + 4 > mmio_size)
+			mmio_size = offsets[i] + 4;
+	}
+
+	/* some decoders look at other registers, let them see the log */
+	mmio = calloc(1, mmio_size);
+	if (mmio == NULL)
+		err(1, "calloc");
+
+	printf("device 0x%04x, %u registers sampled every %.1fus\n",
+	       devid, header.num_regs, header.period_ns / 1000.);
+
+	while (fread(&rec, sizeof(rec), 1, f) == 1) {
+		struct reg_debug *reg;
+		char debug[1024], old[16];
+		const char *late_mark = "";
+
+		t += rec.delta;
+		if (rec.index == REG_WATCH_TIME) {
+			t += (uint64_t)rec.value << 32;
+			continue;
+		}
+		if (rec.index >= header.num_regs)
+			errx(1, "%s: bad register index %d", path, rec.index);
+
+		if (rec.flags & REG_WATCH_LATE) {
+			late_mark = "*";
+			late++;
+		}
+
+		if (seen[rec.index])
+			snprintf(old, sizeof(old), "0x%08x", values[rec.index]);
+		else
+			strcpy(old, "");
+		seen[rec.index] = 1;
+		values[rec.index] = rec.value;
+		OUTREG(offsets[rec.index], rec.value);
+
+		reg = decoders[rec.index];
+		printf("%4u.%06u%1s ", (unsigned)(t / 1000000000),
+		       (unsigned)(t % 1000000000 / 1000), late_mark);
+		if (reg == NULL) {
+			printf("%30s: %10s -> 0x%08x\n",
+			       "", old, rec.value);
+			continue;
+		}
+
+		if (reg->debug_output != NULL) {
+			reg->debug_output(debug, sizeof(debug), reg->reg,
+					  rec.value);
+			printf("%30.30s: %10s -> 0x%08x (%s)\n",
+			       reg->name, old, rec.value, debug);
+		} else {
+			printf("%30.30s: %10s -> 0x%08x\n",
+			       reg->name, old, rec.value);
+		}
+	}
+
+	if (late)
+		printf("* sampled late, changes in between may be missing\n");
+
+	free(mmio);
+	free(decoders);
+	free(seen);
+	free(values);
+	free(offsets);
+	fclose(f);
+	return 0;
+}
+
 static void
 intel_dump_other_regs(void)
 {
@@ -2879,9 +3050,11 @@ static void print_usage(void)
 {
 	printf("Usage: intel_reg_dumper [options] [file]\n"
 	       "       intel_reg_dumper [options] register value\n"
+	       "       intel_reg_dumper [options] -w log\n"
 	       "Options:\n"
 	       "  -d id   when a dump file is used, use 'id' as device id (in "
 	       "hex)\n"
+	       "  -w log  decode the changes recorded by intel_reg_watch\n"
 	       "  -h      prints this help\n");
 }
 
@@ -2889,14 +3062,17 @@ int main(int argc, char** argv)
 {
 	struct pci_device *pci_dev;
 	int opt, n_args;
-	char *file = NULL, *reg_name = NULL;
+	char *file = NULL, *reg_name = NULL, *watch_log = NULL;
 	uint32_t reg_val, power_well;
 
-	while ((opt = getopt(argc, argv, "d:h")) != -1) {
+	while ((opt = getopt(argc, argv, "d:w:h")) != -1) {
 		switch (opt) {
 		case 'd':
 			devid = strtol(optarg, NULL, 16);
 			break;
+		case 'w':
+			watch_log = optarg;
+			break;
 		case 'h':
 			print_usage();
 			return 0;
@@ -2906,6 +3082,14 @@ int main(int argc, char** argv)
 		}
 	}
 
+	if (watch_log) {
+		if (optind != argc) {
+			print_usage();
+			return 1;
+		}
+		return decode_watch_log(watch_log);
+	}
+
 	n_args = argc - optind;
 	if (n_args == 1) {
 		file = argv[optind];
@@ -2927,14 +3111,7 @@ int main(int argc, char** argv)
 	if (file) {
 		intel_map_file(file);
 		if (devid) {
-			if (IS_GEN5(devid))
-				pch = PCH_IBX;
-			else if (IS_GEN6(devid) || IS_IVYBRIDGE(devid))
-				pch = PCH_CPT;
-			else if (IS_HASWELL(devid))
-				pch = PCH_LPT;
-			else
-				pch = PCH_NONE;
+			guess_pch();
 		} else {
 			printf("Dumping from file without -d argument. "
 			       "Assuming Ironlake machine.\n");
@@ -0,0 +1,384 @@
+/*
+ * Copyright © 2013 Intel Corporation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ *
+ */
+
+/*
+ * Watch a set of registers at a fixed rate and log only their changes,
+ * so that short lived states show up without having to store every
+ * sample. The sampling runs on a thread of its own pinned to one cpu,
+ * the main thread just waits for the time to run out or a signal.
+ *
+ * The log is decoded with intel_reg_dumper -w.
+ */
+
+#define _GNU_SOURCE
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <signal.h>
+#include <sched.h>
+#include <pthread.h>
+#include <time.h>
+#include <err.h>
+#include "intel_gpu_tools.h"
+#include "intel_reg_watch.h"
+
+#define MAX_REGS	1024
+
+/* below this the period is waited for spinning, not sleeping */
+#define SPIN_NS		50000
+
+static uint32_t regs[MAX_REGS];
+static int num_regs;
+
+static struct {
+	FILE *file;
+	uint64_t period;
+	uint64_t last;		/* time of the last record */
+	int cpu;
+	volatile bool stop;
+
+	unsigned long samples, records, late;
+	uint64_t max_late;
+} watch;
+
+static uint64_t now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static void wait_until(uint64_t t)
+{
+	struct timespec ts;
+
+	if (t - now_ns() < SPIN_NS) {
+		while ((int64_t)(now_ns() - t) < 0)
+			;
+		return;
+	}
+
+	ts.tv_sec = t / 1000000000;
+	ts.tv_nsec = t % 1000000000;
+	while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL) == EINTR)
+		;
+}
+
+static void emit(uint64_t t, int index, uint32_t value, int flags)
+{
+	struct reg_watch_record rec;
+	uint64_t delta = t - watch.last;
+
+	if (delta >> 32) {
+		rec.delta = delta & 0xffffffff;
+		rec.index = REG_WATCH_TIME;
+		rec.flags = 0;
+		rec.value = delta >> 32;
+		fwrite(&rec, sizeof(rec), 1, watch.file);
+		delta = 0;
+	}
+
+	rec.delta = delta;
+	rec.index = index;
+	rec.flags = flags;
+	rec.value = value;
+	fwrite(&rec, sizeof(rec), 1, watch.file);
+
+	watch.last = t;
+	watch.records++;
+}
+
+/*
+ * Registers are read straight from the mapping, they have all been
+ * checked against the register map up front and reading them through
+ * intel_register_read() would check them again on every sample.
+ */
+static void *sampler(void *arg)
+{
+	uint32_t *prev = arg;
+	uint64_t next, t;
+	int i;
+
+	t = next = watch.last;
+	for (i = 0; i < num_regs; i++) {
+		prev[i] = INREG(regs[i]);
+		emit(t, i, prev[i], 0);
+	}
+	watch.samples++;
+
+	while (!watch.stop) {
+		int flags = 0;
+
+		next += watch.period;
+		wait_until(next);
+
+		t = now_ns();
+		if (t - next > watch.period) {
+			flags = REG_WATCH_LATE;
+			watch.late++;
+			if (t - next > watch.max_late)
+				watch.max_late = t - next;
+			/* don't try to catch up with a burst of samples */
+			next = t;
+		}
+
+		for (i = 0; i < num_regs; i++) {
+			uint32_t val = INREG(regs[i]);
+
+			if (val != prev[i]) {
+				emit(t, i, val, flags);
+				prev[i] = val;
+			}
+		}
+		watch.samples++;
+	}
+
+	return NULL;
+}
+
+static void add_register(const char *str, const char *where)
+{
+	char *end;
+	unsigned long reg;
+
+	reg = strtoul(str, &end, 16);
+	if (end == str || *end || reg & 3)
+		errx(1, "%s: bad register offset '%s'", where, str);
+	if (num_regs == MAX_REGS)
+		errx(1, "too many registers, at most %d", MAX_REGS);
+
+	regs[num_regs++] = reg;
+}
+
+static void read_register_list(const char *path)
+{
+	char line[256], *s;
+	int n = 0;
+	FILE *f;
+
+	f = fopen(path, "r");
+	if (f == NULL)
+		err(1, "%s", path);
+
+	while (fgets(line, sizeof(line), f)) {
+		char where[280];
+
+		n++;
+		s = strchr(line, '#');
+		if (s)
+			*s = '\0';
+		s = strtok(line, " \t\n");
+		if (s == NULL)
+			continue;
+
+		snprintf(where, sizeof(where), "%s:%d", path, n);
+		add_register(s, where);
+	}
+
+	fclose(f);
+}
+
+static void check_registers(uint32_t devid, bool snapshot, long size)
+{
+	struct intel_register_map map;
+	int i;
+
+	if (snapshot) {
+		for (i = 0; i < num_regs; i++)
+			if (regs[i] + 4 > size)
+				errx(1, "register 0x%x is beyond the snapshot",
+				     regs[i]);
+		return;
+	}
+
+	map = intel_get_register_map(devid);
+	for (i = 0; i < num_regs; i++)
+		if (!intel_get_register_range(map, regs[i], INTEL_RANGE_READ))
+			errx(1, "register 0x%x can't be read safely", regs[i]);
+}
+
+static void usage(const char *name)
+{
+	printf("Usage: %s [options] -o log register...\n"
+	       "Options:\n"
+	       "  -o log     write the changes to 'log'\n"
+	       "  -l file    watch the registers listed in 'file', one per line\n"
+	       "  -r rate    samples per second (default 10000)\n"
+	       "  -t secs    stop after 'secs' seconds instead of on ctrl-c\n"
+	       "  -c cpu     pin the sampling to 'cpu' (default the last one)\n"
+	       "  -f file    watch the registers of a snapshot file\n"
+	       "  -d id      when a snapshot is used, use 'id' as device id (in hex)\n"
+	       "  -h         prints this help\n"
+	       "Registers are mmio offsets in hex.\n",
+	       name);
+}
+
+int main(int argc, char **argv)
+{
+	struct reg_watch_header header;
+	struct pci_device *pci_dev;
+	char *output = NULL, *snapshot = NULL;
+	double rate = 10000, duration = 0;
+	uint32_t devid = 0, *prev;
+	pthread_attr_t attr;
+	pthread_t thread;
+	cpu_set_t cpus;
+	sigset_t signals;
+	long size = 0;
+	int opt, i;
+
+	watch.cpu = sysconf(_SC_NPROCESSORS_ONLN) - 1;
+
+	while ((opt = getopt(argc, argv, "o:l:r:t:c:f:d:h")) != -1) {
+		switch (opt) {
+		case 'o':
+			output = optarg;
+			break;
+		case 'l':
+			read_register_list(optarg);
+			break;
+		case 'r':
+			rate = atof(optarg);
+			break;
+		case 't':
+			duration = atof(optarg);
+			break;
+		case 'c':
+			watch.cpu = atoi(optarg);
+			break;
+		case 'f':
+			snapshot = optarg;
+			break;
+		case 'd':
+			devid = strtol(optarg, NULL, 16);
+			break;
+		case 'h':
+			usage(argv[0]);
+			return 0;
+		default:
+			usage(argv[0]);
+			return 1;
+		}
+	}
+
+	for (i = optind; i < argc; i++)
+		add_register(argv[i], "command line");
+
+	if (output == NULL || num_regs == 0 || rate <= 0 || rate > 1e8) {
+		usage(argv[0]);
+		return 1;
+	}
+	watch.period = 1e9 / rate;
+
+	if (snapshot) {
+		FILE *f = fopen(snapshot, "r");
+
+		if (f == NULL)
+			err(1, "%s", snapshot);
+		fseek(f, 0, SEEK_END);
+		size = ftell(f);
+		fclose(f);
+
+		intel_map_file(snapshot);
+	} else {
+		pci_dev = intel_get_pci_device();
+		devid = pci_dev->device_id;
+		if (intel_register_access_init(pci_dev, 1))
+			errx(1, "couldn't initialize register access");
+	}
+	check_registers(devid, snapshot != NULL, size);
+
+	watch.file = fopen(output, "w");
+	if (watch.file == NULL)
+		err(1, "%s", output);
+	/* keep the writes out of the way of the sampling */
+	setvbuf(watch.file, NULL, _IOFBF, 1 << 20);
+
+	prev = calloc(num_regs, sizeof(*prev));
+	if (prev == NULL)
+		err(1, "calloc");
+
+	/* the signals go to us and not the sampler, which inherits this */
+	sigemptyset(&signals);
+	sigaddset(&signals, SIGINT);
+	sigaddset(&signals, SIGTERM);
+	pthread_sigmask(SIG_BLOCK, &signals, NULL);
+
+	watch.last = now_ns();
+
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, REG_WATCH_MAGIC, 4);
+	header.version = REG_WATCH_VERSION;
+	header.devid = devid;
+	header.num_regs = num_regs;
+	header.period_ns = watch.period;
+	header.start_ns = watch.last;
+	fwrite(&header, sizeof(header), 1, watch.file);
+	fwrite(regs, sizeof(regs[0]), num_regs, watch.file);
+
+	pthread_attr_init(&attr);
+	CPU_ZERO(&cpus);
+	CPU_SET(watch.cpu, &cpus);
+	if (pthread_attr_setaffinity_np(&attr, sizeof(cpus), &cpus))
+		errx(1, "can't pin to cpu %d", watch.cpu);
+	if (pthread_create(&thread, &attr, sampler, prev))
+		errx(1, "can't start the sampling thread");
+	pthread_attr_destroy(&attr);
+
+	if (duration > 0) {
+		struct timespec timeout;
+
+		timeout.tv_sec = duration;
+		timeout.tv_nsec = (duration - timeout.tv_sec) * 1e9;
+		while (sigtimedwait(&signals, NULL, &timeout) < 0 &&
+		       errno == EINTR)
+			;
+	} else {
+		while (sigwaitinfo(&signals, NULL) < 0 && errno == EINTR)
+			;
+	}
+
+	watch.stop = true;
+	pthread_join(thread, NULL);
+
+	if (fclose(watch.file))
+		err(1, "%s", output);
+
+	fprintf(stderr, "%lu samples, %lu changes", watch.samples,
+		watch.records - num_regs);
+	if (watch.late)
+		fprintf(stderr, ", %lu late by up to %.1fus", watch.late,
+			watch.max_late / 1000.);
+	fprintf(stderr, "\n");
+
+	free(prev);
+	if (!snapshot)
+		intel_register_access_fini();
+	return 0;
+}
@@ -0,0 +1,72 @@
+/*
+ * Copyright © 2013 Intel Corporation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ *
+ */
+
+#ifndef INTEL_REG_WATCH_H
+#define INTEL_REG_WATCH_H
+
+#include <stdint.h>
+
+/*
+ * The log written by intel_reg_watch and read by intel_reg_dumper -w:
+ *
+ *	header
+ *	offsets		the mmio offset of every watched register
+ *	records		one per transition, in time order
+ *
+ * The first sample is recorded as a transition of every register, after
+ * that only the registers that changed since the previous sample are.
+ * Everything is in the byte order of the machine that recorded it, as
+ * with intel_reg_snapshot.
+ */
+#define REG_WATCH_MAGIC		"IRWL"
+#define REG_WATCH_VERSION	1
+
+struct reg_watch_header {
+	char magic[4];
+	uint32_t version;
+	uint32_t devid;
+	uint32_t num_regs;
+	uint32_t period_ns;	/* the requested sampling period */
+	uint32_t reserved;
+	uint64_t start_ns;	/* CLOCK_MONOTONIC of the first sample */
+};
+
+/*
+ * index is that of the register in the offsets. REG_WATCH_TIME records
+ * carry no register, they advance the time by value << 32 on top of
+ * delta for gaps that don't fit into 32 bits.
+ */
+#define REG_WATCH_TIME		0xffff
+
+/* the sample came late by more than a period, changes may be missing */
+#define REG_WATCH_LATE		(1 << 0)
+
+struct reg_watch_record {
+	uint32_t delta;		/* ns since the previous record */
+	uint16_t index;
+	uint16_t flags;
+	uint32_t value;
+};
+
+#endif /* INTEL_REG_WATCH_H */
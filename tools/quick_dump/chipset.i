@@ -1,9 +1,11 @@
 %module chipset
 %include "stdint.i"
+%include "carrays.i"
 %{
 #include <pciaccess.h>
 #include <stdint.h>
 #include "intel_chipset.h"
+#include "reg_table.h"
 extern int is_sandybridge(unsigned short pciid);
 extern int is_ivybridge(unsigned short pciid);
 extern int is_valleyview(unsigned short pciid);
@@ -18,6 +20,8 @@ extern unsigned short pcidev_to_devid(struct pci_device *pci_dev);
 extern uint32_t intel_dpio_reg_read(uint32_t reg);
 %}
 
+%array_class(uint32_t, uint32_array);
+
 extern int is_sandybridge(unsigned short pciid);
 extern int is_ivybridge(unsigned short pciid);
 extern int is_valleyview(unsigned short pciid);
@@ -30,3 +34,9 @@ extern void intel_register_access_fini();
 extern int intel_register_access_needs_fakewake();
 extern unsigned short pcidev_to_devid(struct pci_device *pci_dev);
 extern uint32_t intel_dpio_reg_read(uint32_t reg);
+
+extern struct reg_table *reg_table_open(const char *path);
+extern void reg_table_close(struct reg_table *table);
+extern int reg_table_find_set(const struct reg_table *table, const char *name);
+extern int reg_table_set_size(const struct reg_table *table, int set);
+extern int reg_table_read_set(struct reg_table *table, int set, uint32_t *values);
@@ -6,32 +6,99 @@
 # register types:
 #  '' - normal register
 #  'DPIO' - DPIO register
+#
+# reg_compile.py compiles all lists and profiles into registers.bin. When
+# that is found next to this script, or where make install put it, the
+# lists are taken from it and read through the library a whole list at a
+# time.
 
 import argparse
 import os
 import sys
 import ast
-import subprocess
+import struct
+import time
 import chipset
 import reg_access as reg
 
-def parse_file(file):
-	print('{0:^10s} | {1:^28s} | {2:^10s}'. format('offset', file.name, 'value'))
+TABLE = 'registers.bin'
+# set to $(pkgdatadir) by make install
+DATADIR = None
+
+def print_header(name):
+	print('{0:^10s} | {1:^28s} | {2:^10s}'. format('offset', name, 'value'))
 	print('-' * 54)
+
+def print_register(name, offset, val):
+	print('{0:#010x} | {1:<28} | {2:#010x}'.format(offset, name, val))
+
+def parse_file(file):
+	print_header(file.name)
 	for line in file:
 		register = ast.literal_eval(line)
+		offset = register[1]
+		if not isinstance(offset, int):
+			offset = int(offset, 16)
 		if register[2] == 'DPIO':
-			val = reg.dpio_read(register[1])
+			val = chipset.intel_dpio_reg_read(offset)
 		else:
-			val = reg.read(register[1])
-		intreg = int(register[1], 16)
-		print('{0:#010x} | {1:<28} | {2:#010x}'.format(intreg, register[0], val))
+			val = chipset.intel_register_read(offset)
+		print_register(register[0], offset, val)
 	print('')
 
+class RegisterTable:
+	def __init__(self, path):
+		data = open(path, 'rb').read()
+		header = struct.unpack_from('<4s7I', data)
+		if header[0] != b'QDRT' or header[1] != 1:
+			raise IOError('{0}: not a register table'.format(path))
+		num_sets, num_profiles, num_refs, num_regs = header[2:6]
+
+		def name(offset):
+			end = data.index(b'\0', strtab + offset)
+			return data[strtab + offset:end].decode()
+
+		pos = 32
+		sets = [struct.unpack_from('<4I', data, pos + 16 * n) for n in range(num_sets)]
+		pos += 16 * num_sets
+		profiles = [struct.unpack_from('<4I', data, pos + 16 * n) for n in range(num_profiles)]
+		pos += 16 * num_profiles
+		refs = struct.unpack_from('<{0}I'.format(num_refs), data, pos)
+		pos += 4 * num_refs
+		regs = [struct.unpack_from('<3I', data, pos + 12 * n) for n in range(num_regs)]
+		strtab = pos + 12 * num_regs
+
+		self.sets = []
+		self.index = {}
+		for s in sets:
+			self.index[name(s[0])] = len(self.sets)
+			self.sets.append((name(s[0]), [(name(r[0]), r[1]) for r in regs[s[1]:s[1] + s[2]]], s[3] & 1))
+		self.profiles = {}
+		for p in profiles:
+			self.profiles[name(p[0])] = list(refs[p[1]:p[1] + p[2]])
+
+		self.handle = chipset.reg_table_open(path)
+		if self.handle is None:
+			raise IOError('{0}: unable to load'.format(path))
+		self.values = chipset.uint32_array(max([len(s[1]) for s in self.sets] + [1]))
+
+	def base_sets(self):
+		return [n for n, s in enumerate(self.sets) if s[2]]
+
+	def dump_set(self, n):
+		name, registers, base = self.sets[n]
+		chipset.reg_table_read_set(self.handle, n, self.values.cast())
+		print_header(name)
+		for i, (reg_name, offset) in enumerate(registers):
+			print_register(reg_name, offset, self.values[i])
+		print('')
 
 parser = argparse.ArgumentParser(description='Dumb register dumper.')
 parser.add_argument('-b', '--baseless', action='store_true', default=False, help='baseless mode, ignore files starting with base_')
 parser.add_argument('-a', '--autodetect', action='store_true', default=False, help='autodetect chipset')
+parser.add_argument('-t', '--text', action='store_true', default=False, help='parse the register lists even if they are compiled')
+parser.add_argument('-c', '--count', type=int, default=1, help='number of dumps to take')
+parser.add_argument('-i', '--interval', type=float, default=1.0, help='seconds between dumps')
 parser.add_argument('profile', nargs='?', type=argparse.FileType('r'), default=None)
 args = parser.parse_args()
 
@@ -40,33 +107,61 @@ if reg.init() == False:
 	sys.exit()
 
 # Put us where the script is
-os.chdir(os.path.dirname(sys.argv[0]))
+os.chdir(os.path.dirname(sys.argv[0]) or '.')
 
-#parse anything named base_ these are assumed to apply for all gens.
-if args.baseless == False:
-	for root, dirs, files in os.walk('.'):
-		for name in files:
-			if name.startswith(("base_")):
-				file = open(name.rstrip(), 'r')
-				parse_file(file)
+table = None
+if not args.text:
+	paths = [TABLE]
+	if DATADIR:
+		paths.append(os.path.join(DATADIR, TABLE))
+	for path in paths:
+		if os.path.exists(path):
+			table = RegisterTable(path)
+			break
+
+def autodetect_profile(name):
+	if table and name in table.profiles:
+		return [table.sets[n][0] for n in table.profiles[name]]
+	return open(name, 'r')
 
 if args.autodetect:
 	pci_dev = chipset.intel_get_pci_device()
 	devid = chipset.pcidev_to_devid(pci_dev)
 	if chipset.is_sandybridge(devid):
-		args.profile = open('sandybridge', 'r')
+		args.profile = autodetect_profile('sandybridge')
 	elif chipset.is_ivybridge(devid):
-		args.profile = open('ivybridge', 'r')
+		args.profile = autodetect_profile('ivybridge')
 	elif chipset.is_valleyview(devid):
-		args.profile = open('valleyview', 'r')
+		args.profile = autodetect_profile('valleyview')
 	elif chipset.is_haswell(devid):
-		args.profile = open('haswell', 'r')
+		args.profile = autodetect_profile('haswell')
 	else:
 		print("Autodetect of devid " + hex(devid) + " failed")
 
-if args.profile == None:
-	sys.exit()
+extras = []
+if args.profile != None:
+	extras = [extra.rstrip() for extra in args.profile if extra.strip()]
+
+def dump():
+	#parse anything named base_ these are assumed to apply for all gens.
+	if args.baseless == False:
+		if table:
+			for n in table.base_sets():
+				table.dump_set(n)
+		else:
+			for name in sorted(os.listdir('.')):
+				if name.startswith("base_") and name.endswith(".txt"):
+					parse_file(open(name, 'r'))
+
+	for extra in extras:
+		if table and extra in table.index:
+			table.dump_set(table.index[extra])
+		else:
+			parse_file(open(extra, 'r'))
 
-for extra in args.profile:
-	extra_file = open(extra.rstrip(), 'r')
-	parse_file(extra_file)
+for n in range(args.count):
+	if n:
+		time.sleep(args.interval)
+	if args.count > 1:
+		print('# dump {0} at {1:.6f}'.format(n, time.time()))
+	dump()
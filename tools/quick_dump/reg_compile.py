@@ -0,0 +1,100 @@
+#!/usr/bin/env python3
+
+# Compiles the register lists and platform profiles into one binary
+# table, laid out as described in reg_table.h, so that quick_dump.py
+# doesn't have to parse them on every run.
+#
+# Files ending in .txt are register lists, anything else is a profile
+# naming the lists of a platform, one per line.
+
+import argparse
+import ast
+import os
+import struct
+import sys
+
+MAGIC = b'QDRT'
+VERSION = 1
+
+TYPES = {'': 0, 'DPIO': 1}
+SET_BASE = 1
+
+class Strings:
+	def __init__(self):
+		self.data = bytearray()
+		self.offsets = {}
+
+	def add(self, s):
+		if s not in self.offsets:
+			self.offsets[s] = len(self.data)
+			self.data += s.encode() + b'\0'
+		return self.offsets[s]
+
+def parse_set(path):
+	registers = []
+	for n, line in enumerate(open(path), 1):
+		if not line.strip():
+			continue
+		try:
+			name, offset, kind = ast.literal_eval(line)
+			if not isinstance(offset, int):
+				offset = int(offset, 16)
+			registers.append((name, offset, TYPES[kind]))
+		except (ValueError, SyntaxError, KeyError, TypeError):
+			sys.exit('{0}:{1}: bad register definition'.format(path, n))
+	return registers
+
+def compile_table(paths):
+	strings = Strings()
+	sets = []		# (name, registers, flags)
+	profiles = []		# (name, set names)
+
+	for path in paths:
+		name = os.path.basename(path)
+		if name.endswith('.txt'):
+			flags = SET_BASE if name.startswith('base_') else 0
+			sets.append((name, parse_set(path), flags))
+		else:
+			lists = [l.strip() for l in open(path) if l.strip()]
+			profiles.append((name, lists))
+
+	index = dict((s[0], n) for n, s in enumerate(sets))
+	set_refs = []
+	profile_data = b''
+	for name, lists in profiles:
+		for l in lists:
+			if l not in index:
+				sys.exit('{0}: unknown register list {1}'.format(name, l))
+		profile_data += struct.pack('<4I', strings.add(name),
+					    len(set_refs), len(lists), 0)
+		set_refs += [index[l] for l in lists]
+
+	set_data = b''
+	register_data = b''
+	first = 0
+	for name, registers, flags in sets:
+		set_data += struct.pack('<4I', strings.add(name), first,
+					len(registers), flags)
+		for reg in registers:
+			register_data += struct.pack('<3I', strings.add(reg[0]),
+						     reg[1], reg[2])
+		first += len(registers)
+
+	while len(strings.data) % 4:
+		strings.data += b'\0'
+
+	header = MAGIC + struct.pack('<7I', VERSION, len(sets), len(profiles),
+				     len(set_refs), first, len(strings.data), 0)
+	return (header + set_data + profile_data +
+		struct.pack('<{0}I'.format(len(set_refs)), *set_refs) +
+		register_data + bytes(strings.data))
+
+if __name__ == "__main__":
+	parser = argparse.ArgumentParser(description='Compile quick_dump register lists.')
+	parser.add_argument('-o', '--output', required=True, help='table to write')
+	parser.add_argument('files', nargs='+', help='register lists and profiles')
+	args = parser.parse_args()
+
+	data = compile_table(args.files)
+	with open(args.output, 'wb') as f:
+		f.write(data)
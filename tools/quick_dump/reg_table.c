@@ -0,0 +1,187 @@
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "intel_gpu_tools.h"
+#include "reg_table.h"
+
+struct reg_table {
+	const void *map;
+	size_t size;
+
+	const struct reg_table_header *header;
+	const struct reg_table_set *sets;
+	const struct reg_table_register *registers;
+	const char *strtab;
+
+	/* the mmio offsets of the largest set, for reading it in one go */
+	uint32_t *offsets;
+	uint32_t *values;
+};
+
+static int check_table(struct reg_table *table)
+{
+	const struct reg_table_header *h = table->map;
+	const struct reg_table_profile *profiles;
+	const uint32_t *set_refs;
+	uint64_t size;
+	uint32_t n;
+
+	if (table->size < sizeof(*h) ||
+	    memcmp(h->magic, REG_TABLE_MAGIC, 4) ||
+	    h->version != REG_TABLE_VERSION)
+		return -1;
+
+	size = sizeof(*h) +
+		(uint64_t)h->num_sets * sizeof(struct reg_table_set) +
+		(uint64_t)h->num_profiles * sizeof(struct reg_table_profile) +
+		(uint64_t)h->num_set_refs * sizeof(uint32_t) +
+		(uint64_t)h->num_registers * sizeof(struct reg_table_register) +
+		h->strtab_size;
+	if (size != table->size || h->strtab_size == 0)
+		return -1;
+
+	table->header = h;
+	table->sets = (const void *)(h + 1);
+	profiles = (const void *)(table->sets + h->num_sets);
+	set_refs = (const void *)(profiles + h->num_profiles);
+	table->registers = (const void *)(set_refs + h->num_set_refs);
+	table->strtab = (const void *)(table->registers + h->num_registers);
+
+	if (table->strtab[h->strtab_size - 1])
+		return -1;
+
+	for (n = 0; n < h->num_sets; n++) {
+		const struct reg_table_set *set = &table->sets[n];
+
+		if (set->name >= h->strtab_size ||
+		    set->first > h->num_registers ||
+		    set->count > h->num_registers - set->first)
+			return -1;
+	}
+	for (n = 0; n < h->num_profiles; n++)
+		if (profiles[n].name >= h->strtab_size ||
+		    profiles[n].first > h->num_set_refs ||
+		    profiles[n].count > h->num_set_refs - profiles[n].first)
+			return -1;
+	for (n = 0; n < h->num_set_refs; n++)
+		if (set_refs[n] >= h->num_sets)
+			return -1;
+	for (n = 0; n < h->num_registers; n++)
+		if (table->registers[n].name >= h->strtab_size)
+			return -1;
+
+	return 0;
+}
+
+/*
+ * Maps a table written by reg_compile.py. Returns NULL if it can't be
+ * read or is not a table of this version.
+ */
+struct reg_table *reg_table_open(const char *path)
+{
+	struct reg_table *table;
+	struct stat st;
+	uint32_t n, max = 0;
+	int fd;
+
+	table = calloc(1, sizeof(*table));
+	if (table == NULL)
+		return NULL;
+
+	fd = open(path, O_RDONLY);
+	if (fd < 0)
+		goto err;
+	if (fstat(fd, &st) || st.st_size == 0) {
+		close(fd);
+		goto err;
+	}
+	table->size = st.st_size;
+	table->map = mmap(NULL, table->size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (table->map == MAP_FAILED) {
+		table->map = NULL;
+		goto err;
+	}
+
+	if (check_table(table))
+		goto err;
+
+	for (n = 0; n < table->header->num_sets; n++)
+		if (table->sets[n].count > max)
+			max = table->sets[n].count;
+	table->offsets = calloc(max + 1, sizeof(uint32_t));
+	table->values = calloc(max + 1, sizeof(uint32_t));
+	if (table->offsets == NULL || table->values == NULL)
+		goto err;
+
+	return table;
+
+err:
+	reg_table_close(table);
+	return NULL;
+}
+
+void reg_table_close(struct reg_table *table)
+{
+	if (table == NULL)
+		return;
+
+	if (table->map)
+		munmap((void *)table->map, table->size);
+	free(table->offsets);
+	free(table->values);
+	free(table);
+}
+
+int reg_table_find_set(const struct reg_table *table, const char *name)
+{
+	uint32_t n;
+
+	for (n = 0; n < table->header->num_sets; n++)
+		if (strcmp(table->strtab + table->sets[n].name, name) == 0)
+			return n;
+	return -1;
+}
+
+int reg_table_set_size(const struct reg_table *table, int set)
+{
+	if (set < 0 || (uint32_t)set >= table->header->num_sets)
+		return -1;
+	return table->sets[set].count;
+}
+
+/*
+ * Reads all registers of a set into values, in the order of the set.
+ * The mmio ones are read with a single intel_register_read_array(), the
+ * DPIO ones have to go through the sideband one at a time.
+ *
+ * Returns the number of registers, or -1 for a bad set index.
+ */
+int reg_table_read_set(struct reg_table *table, int set, uint32_t *values)
+{
+	const struct reg_table_register *regs;
+	int count, n, mmio = 0;
+
+	count = reg_table_set_size(table, set);
+	if (count < 0)
+		return -1;
+	regs = &table->registers[table->sets[set].first];
+
+	for (n = 0; n < count; n++)
+		if (regs[n].type == REG_TYPE_MMIO)
+			table->offsets[mmio++] = regs[n].offset;
+	intel_register_read_array(table->offsets, table->values, mmio);
+
+	for (n = mmio = 0; n < count; n++) {
+		if (regs[n].type == REG_TYPE_MMIO)
+			values[n] = table->values[mmio++];
+		else
+			values[n] = intel_dpio_reg_read(regs[n].offset);
+	}
+
+	return count;
+}
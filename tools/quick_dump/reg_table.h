@@ -0,0 +1,66 @@
+#ifndef REG_TABLE_H
+#define REG_TABLE_H
+
+#include <stdint.h>
+
+/*
+ * The register lists of quick_dump as compiled by reg_compile.py, so that
+ * a dump doesn't have to parse them again every time:
+ *
+ *	header
+ *	sets		one per base_*.txt, gen*_other.txt, ...
+ *	profiles	one per platform list like "ivybridge"
+ *	set refs	the sets of every profile, as indices
+ *	registers	those of all sets back to back
+ *	string table	names, referred to by their offset
+ *
+ * Everything is little endian and 4 byte aligned.
+ */
+#define REG_TABLE_MAGIC		"QDRT"
+#define REG_TABLE_VERSION	1
+
+#define REG_TYPE_MMIO	0
+#define REG_TYPE_DPIO	1
+
+#define REG_SET_BASE	(1 << 0)	/* dumped for every platform */
+
+struct reg_table_header {
+	char magic[4];
+	uint32_t version;
+	uint32_t num_sets;
+	uint32_t num_profiles;
+	uint32_t num_set_refs;
+	uint32_t num_registers;
+	uint32_t strtab_size;
+	uint32_t reserved;
+};
+
+struct reg_table_set {
+	uint32_t name;
+	uint32_t first;		/* index of its first register */
+	uint32_t count;
+	uint32_t flags;
+};
+
+struct reg_table_profile {
+	uint32_t name;
+	uint32_t first;		/* index of its first set ref */
+	uint32_t count;
+	uint32_t reserved;
+};
+
+struct reg_table_register {
+	uint32_t name;
+	uint32_t offset;
+	uint32_t type;
+};
+
+struct reg_table;
+
+struct reg_table *reg_table_open(const char *path);
+void reg_table_close(struct reg_table *table);
+int reg_table_find_set(const struct reg_table *table, const char *name);
+int reg_table_set_size(const struct reg_table *table, int set);
+int reg_table_read_set(struct reg_table *table, int set, uint32_t *values);
+
+#endif /* REG_TABLE_H */